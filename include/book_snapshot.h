@@ -0,0 +1,355 @@
+/**
+ * @file book_snapshot.h
+ * @brief Memory-mapped book snapshots plus a replay log for fast restart
+ *
+ * A feed handler keeps its book as an array of fixed-size records. This
+ * file gives it two things in one memory-mapped file:
+ *  - two snapshot images of that array, written alternately;
+ *  - a ring log of every feed message applied since.
+ * After a restart the newest complete image is loaded and the log is
+ * replayed from the image's log position. The book is then current within
+ * milliseconds instead of waiting for every symbol to tick again.
+ *
+ * Snapshots are double-buffered. A new snapshot is copied into the image
+ * that is not current, and a single store then makes it current. A process
+ * killed half-way through a copy leaves the previous image intact. Each
+ * image keeps a dirty bitmap, so a snapshot copies only the records that
+ * changed since that image was last written. The copy is a few memcpy()s
+ * into the page cache with no system calls, so it can run on the feed
+ * thread between messages. The kernel writes the pages back on its own
+ * schedule.
+ *
+ * As with order_journal.h, the MAP_SHARED file survives the process being
+ * killed but not a machine crash.
+ */
+
+#ifndef BOOK_SNAPSHOT_H
+#define BOOK_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BOOK_SNAPSHOT_MAGIC 0x42534e50u     /**< "BSNP" */
+#define BOOK_SNAPSHOT_VERSION 1
+#define BOOK_SNAPSHOT_ALIGN 64
+
+/**
+ * @brief File header
+ */
+typedef struct {
+    uint32_t magic;                 /**< BOOK_SNAPSHOT_MAGIC once initialized */
+    uint32_t version;               /**< BOOK_SNAPSHOT_VERSION */
+    uint32_t record_size;           /**< Bytes per book record */
+    uint32_t max_records;           /**< Records per image */
+    uint32_t log_slots;             /**< Log capacity, power of 2 */
+    uint32_t log_stride;            /**< Bytes per log slot */
+    _Alignas(BOOK_SNAPSHOT_ALIGN) atomic_uint current;  /**< Image holding the newest snapshot */
+    _Alignas(BOOK_SNAPSHOT_ALIGN) atomic_ullong log_seq; /**< Last message logged */
+} book_snapshot_header_t;
+
+/**
+ * @brief Per-image header; the records follow
+ */
+typedef struct {
+    uint64_t generation;            /**< Snapshot number, 0 if never written */
+    uint64_t log_seq;               /**< Last logged message reflected in the image */
+    uint64_t taken_ns;              /**< When the snapshot was taken */
+    uint32_t count;                 /**< Records in use */
+    uint8_t reserved[BOOK_SNAPSHOT_ALIGN - 28];
+} book_snapshot_image_t;
+
+/**
+ * @brief Log slot header; the message follows
+ */
+typedef struct {
+    atomic_ullong seq;              /**< Message number, stored once the payload is complete */
+    uint32_t length;                /**< Payload bytes */
+    uint32_t reserved;
+} book_log_slot_t;
+
+/**
+ * @brief Process-local handle
+ */
+typedef struct {
+    book_snapshot_header_t *hdr;    /**< Mapped header */
+    book_snapshot_image_t *image[2];/**< The two images */
+    uint8_t *log;                   /**< First log slot */
+    size_t map_size;                /**< Bytes mapped */
+    int fd;                         /**< Backing file */
+    int recovered;                  /**< Set if an existing file was reopened */
+    uint64_t *dirty[2];             /**< Records changed since each image was written */
+    uint64_t snapshots;             /**< Snapshots taken by this process */
+    uint64_t records_copied;        /**< Records copied by those snapshots */
+    uint64_t replay_lost;           /**< Messages overwritten before they could be replayed */
+} book_snapshot_t;
+
+// Words in a dirty bitmap
+static inline size_t book_snapshot_words(const book_snapshot_t *s) {
+    return (s->hdr->max_records + 63) / 64;
+}
+
+/**
+ * @brief Open or create a snapshot file
+ *
+ * A file with matching geometry is reopened as-is so that its contents can
+ * be recovered. Anything else is reinitialized empty.
+ *
+ * @param s Handle to initialize
+ * @param path Snapshot file
+ * @param record_size Bytes per book record
+ * @param max_records Records per image
+ * @param log_slots Messages the log retains (rounded up to a power of 2)
+ * @param max_message Largest message that can be logged
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int book_snapshot_open(book_snapshot_t *s, const char *path, uint32_t record_size,
+                                     uint32_t max_records, uint32_t log_slots, uint32_t max_message) {
+    memset(s, 0, sizeof(*s));
+
+    uint32_t slots = 1;
+    while (slots < log_slots) {
+        slots <<= 1;
+    }
+    size_t image_stride = (sizeof(book_snapshot_image_t) + (size_t)record_size * max_records +
+                           BOOK_SNAPSHOT_ALIGN - 1) & ~(size_t)(BOOK_SNAPSHOT_ALIGN - 1);
+    uint32_t stride = (uint32_t)((sizeof(book_log_slot_t) + max_message + BOOK_SNAPSHOT_ALIGN - 1) &
+                                 ~(size_t)(BOOK_SNAPSHOT_ALIGN - 1));
+    size_t size = sizeof(book_snapshot_header_t) + 2 * image_stride + (size_t)slots * stride;
+
+    s->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (s->fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(s->fd, &st) < 0) {
+        goto fail;
+    }
+    s->recovered = (size_t)st.st_size == size;
+    if (!s->recovered && (ftruncate(s->fd, 0) < 0 || ftruncate(s->fd, (off_t)size) < 0)) {
+        goto fail;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (base == MAP_FAILED) {
+        goto fail;
+    }
+    s->hdr = base;
+    s->map_size = size;
+    s->image[0] = (book_snapshot_image_t *)((uint8_t *)base + sizeof(book_snapshot_header_t));
+    s->image[1] = (book_snapshot_image_t *)((uint8_t *)s->image[0] + image_stride);
+    s->log = (uint8_t *)s->image[1] + image_stride;
+
+    book_snapshot_header_t *hdr = s->hdr;
+    if (s->recovered && (hdr->magic != BOOK_SNAPSHOT_MAGIC || hdr->version != BOOK_SNAPSHOT_VERSION ||
+                         hdr->record_size != record_size || hdr->max_records != max_records ||
+                         hdr->log_slots != slots || hdr->log_stride != stride)) {
+        // Same size, different layout: start over
+        memset(base, 0, size);
+        s->recovered = 0;
+    }
+    if (!s->recovered) {
+        hdr->version = BOOK_SNAPSHOT_VERSION;
+        hdr->record_size = record_size;
+        hdr->max_records = max_records;
+        hdr->log_slots = slots;
+        hdr->log_stride = stride;
+        atomic_thread_fence(memory_order_release);
+        hdr->magic = BOOK_SNAPSHOT_MAGIC;
+    }
+
+    // Neither image is known to match the live book yet: both start all dirty
+    size_t words = book_snapshot_words(s);
+    for (int i = 0; i < 2; i++) {
+        s->dirty[i] = malloc(words * sizeof(uint64_t));
+        if (!s->dirty[i]) {
+            munmap(base, size);
+            s->hdr = NULL;
+            errno = ENOMEM;
+            goto fail;
+        }
+        memset(s->dirty[i], 0xff, words * sizeof(uint64_t));
+    }
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        free(s->dirty[0]);
+        s->dirty[0] = NULL;
+        close(s->fd);
+        s->fd = -1;
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Record idx of an image
+ */
+static inline void *book_snapshot_record(const book_snapshot_t *s, const book_snapshot_image_t *image,
+                                         uint32_t idx) {
+    return (uint8_t *)(image + 1) + (size_t)idx * s->hdr->record_size;
+}
+
+/**
+ * @brief Newest complete snapshot, or NULL if none was ever taken
+ */
+static inline const book_snapshot_image_t *book_snapshot_latest(const book_snapshot_t *s) {
+    unsigned cur = atomic_load_explicit(&s->hdr->current, memory_order_acquire) & 1;
+    return s->image[cur]->generation ? s->image[cur] : NULL;
+}
+
+/**
+ * @brief Note that book record idx changed
+ */
+static inline void book_snapshot_mark(book_snapshot_t *s, uint32_t idx) {
+    if (idx < s->hdr->max_records) {
+        s->dirty[0][idx >> 6] |= 1ULL << (idx & 63);
+        s->dirty[1][idx >> 6] |= 1ULL << (idx & 63);
+    }
+}
+
+// Log slot for message number n
+static inline book_log_slot_t *book_log_slot(const book_snapshot_t *s, uint64_t n) {
+    return (book_log_slot_t *)(s->log + (size_t)(n & (s->hdr->log_slots - 1)) * s->hdr->log_stride);
+}
+
+/**
+ * @brief Append a feed message that is about to be applied to the book
+ *
+ * @return 0 on success, -1 if the message is too long to log; the caller
+ *         should then take a snapshot once it has applied the message
+ */
+static inline int book_snapshot_log(book_snapshot_t *s, const void *data, uint32_t length) {
+    book_snapshot_header_t *hdr = s->hdr;
+    if (length > hdr->log_stride - sizeof(book_log_slot_t)) {
+        return -1;
+    }
+    uint64_t n = atomic_load_explicit(&hdr->log_seq, memory_order_relaxed) + 1;
+    book_log_slot_t *slot = book_log_slot(s, n);
+    slot->length = length;
+    memcpy(slot + 1, data, length);
+    atomic_store_explicit(&slot->seq, n, memory_order_release);
+    atomic_store_explicit(&hdr->log_seq, n, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Messages logged since the newest snapshot
+ */
+static inline uint64_t book_snapshot_backlog(const book_snapshot_t *s) {
+    const book_snapshot_image_t *image = book_snapshot_latest(s);
+    uint64_t head = atomic_load_explicit(&s->hdr->log_seq, memory_order_relaxed);
+    return head - (image ? image->log_seq : 0);
+}
+
+/**
+ * @brief Snapshot the live book into the image that is not current
+ *
+ * Only records changed since that image was last written are copied. Call
+ * between messages, so the book reflects exactly the messages logged.
+ *
+ * @param s Snapshot handle
+ * @param records Live book, count records of record_size bytes
+ * @param count Records in use
+ * @param now_ns Snapshot time
+ * @return Records copied
+ */
+static inline uint32_t book_snapshot_take(book_snapshot_t *s, const void *records, uint32_t count,
+                                          uint64_t now_ns) {
+    book_snapshot_header_t *hdr = s->hdr;
+    unsigned cur = atomic_load_explicit(&hdr->current, memory_order_relaxed) & 1;
+    unsigned next = cur ^ 1;
+    book_snapshot_image_t *image = s->image[next];
+    uint64_t *dirty = s->dirty[next];
+
+    if (count > hdr->max_records) {
+        count = hdr->max_records;
+    }
+    uint32_t copied = 0;
+    for (uint32_t w = 0; w < (count + 63) / 64; w++) {
+        uint64_t bits = dirty[w];
+        if (w == count / 64) {
+            bits &= (1ULL << (count & 63)) - 1;
+        }
+        dirty[w] &= ~bits;
+        while (bits) {
+            uint32_t idx = w * 64 + (uint32_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            memcpy(book_snapshot_record(s, image, idx),
+                   (const uint8_t *)records + (size_t)idx * hdr->record_size, hdr->record_size);
+            copied++;
+        }
+    }
+
+    image->generation = s->image[cur]->generation + 1;
+    image->log_seq = atomic_load_explicit(&hdr->log_seq, memory_order_relaxed);
+    image->taken_ns = now_ns;
+    image->count = count;
+    atomic_store_explicit(&hdr->current, next, memory_order_release);
+
+    s->snapshots++;
+    s->records_copied += copied;
+    return copied;
+}
+
+/**
+ * @brief Callback for each replayed message
+ */
+typedef void (*book_replay_fn)(void *ctx, const void *data, uint32_t length);
+
+/**
+ * @brief Replay messages logged after the newest snapshot
+ *
+ * Messages already overwritten in the log are counted in s->replay_lost;
+ * replay continues from the oldest one that is still there.
+ *
+ * @return Messages replayed
+ */
+static inline uint64_t book_snapshot_replay(book_snapshot_t *s, book_replay_fn fn, void *ctx) {
+    const book_snapshot_image_t *image = book_snapshot_latest(s);
+    uint64_t head = atomic_load_explicit(&s->hdr->log_seq, memory_order_acquire);
+    uint64_t from = (image ? image->log_seq : 0) + 1;
+    if (head >= s->hdr->log_slots && from <= head - s->hdr->log_slots) {
+        s->replay_lost += head - s->hdr->log_slots + 1 - from;
+        from = head - s->hdr->log_slots + 1;
+    }
+
+    uint64_t replayed = 0;
+    for (uint64_t n = from; n <= head; n++) {
+        const book_log_slot_t *slot = book_log_slot(s, n);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != n) {
+            s->replay_lost++;
+            continue;
+        }
+        fn(ctx, slot + 1, slot->length);
+        replayed++;
+    }
+    return replayed;
+}
+
+/**
+ * @brief Unmap and close the snapshot file
+ */
+static inline void book_snapshot_close(book_snapshot_t *s) {
+    if (s->hdr) {
+        munmap(s->hdr, s->map_size);
+        s->hdr = NULL;
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    free(s->dirty[0]);
+    free(s->dirty[1]);
+    s->dirty[0] = s->dirty[1] = NULL;
+}
+
+#endif /* BOOK_SNAPSHOT_H */
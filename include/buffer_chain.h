@@ -0,0 +1,566 @@
+/**
+ * @file buffer_chain.h
+ * @brief Refcounted buffer chains (mbuf-style) for zero-copy pipelines
+ *
+ * Received data lives in fixed-size segments taken from a preallocated
+ * pool. A buffer (bc_buf_t) is a slice of a segment; several buffers can
+ * reference the same segment, which is returned to the pool when the last
+ * reference is dropped. Buffers are linked into chains that support O(1)
+ * append, prepend and concatenation, splitting at any byte offset without
+ * copying, and conversion to iovec arrays for readv/writev/sendmsg.
+ *
+ * The pool is thread-safe, so a chain (or a clone of it) can be handed to
+ * another thread, e.g. a logger, and released there. Segment payload comes
+ * from a hugepage arena bound to the NUMA node of the thread that creates
+ * the pool, so create each pool on the thread that does the I/O.
+ */
+
+#ifndef BUFFER_CHAIN_H
+#define BUFFER_CHAIN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "mem_pool.h"
+
+#define BC_DEFAULT_SEGMENT_SIZE 2048   /**< Default segment payload size */
+#define BC_BUFS_PER_SEGMENT 4          /**< Buffer descriptors per segment */
+#define BC_MAX_IOV 64                  /**< Max iovecs used per read/write call */
+
+/**
+ * @brief Fixed-size, refcounted data segment
+ */
+typedef struct bc_segment {
+    atomic_int refs;                  /**< Buffers referencing this segment */
+    uint32_t size;                    /**< Payload capacity */
+    struct bc_segment *next_free;     /**< Pool free list link */
+    char *data;                       /**< Payload */
+} bc_segment_t;
+
+/**
+ * @brief Slice of a segment; the unit linked into chains
+ */
+typedef struct bc_buf {
+    struct bc_buf *next;    /**< Next buffer in chain or free list */
+    bc_segment_t *seg;      /**< Backing segment */
+    uint32_t off;           /**< Slice start within segment */
+    uint32_t len;           /**< Slice length */
+} bc_buf_t;
+
+/**
+ * @brief Pool of segments and buffer descriptors
+ */
+typedef struct {
+    pthread_mutex_t lock;       /**< Protects the free lists */
+    uint32_t seg_size;          /**< Payload size of each segment */
+    size_t num_segs;            /**< Total segments */
+    size_t free_segs_count;     /**< Segments currently free */
+    bc_segment_t *segs;         /**< Segment headers */
+    char *payload;              /**< Segment payload */
+    mem_arena_t payload_arena;  /**< Hugepage/NUMA backing for payload */
+    bc_buf_t *bufs;             /**< Descriptor arena */
+    bc_segment_t *free_segs;    /**< Free segment list */
+    bc_buf_t *free_bufs;        /**< Free descriptor list */
+} bc_pool_t;
+
+/**
+ * @brief Chain of buffers
+ */
+typedef struct {
+    bc_buf_t *head;     /**< First buffer */
+    bc_buf_t *tail;     /**< Last buffer */
+    size_t len;         /**< Total bytes in chain */
+    size_t count;       /**< Number of buffers */
+} bc_chain_t;
+
+/**
+ * @brief Initialize a buffer pool
+ *
+ * @param pool Pool to initialize
+ * @param seg_size Payload bytes per segment (0 for the default)
+ * @param num_segs Number of segments to preallocate
+ * @return 0 on success, -1 on failure
+ */
+static inline int bc_pool_init(bc_pool_t *pool, uint32_t seg_size, size_t num_segs) {
+    memset(pool, 0, sizeof(*pool));
+    pool->seg_size = seg_size ? seg_size : BC_DEFAULT_SEGMENT_SIZE;
+    pool->num_segs = num_segs;
+
+    size_t num_bufs = num_segs * BC_BUFS_PER_SEGMENT;
+    pool->segs = calloc(num_segs, sizeof(bc_segment_t));
+    pool->bufs = calloc(num_bufs, sizeof(bc_buf_t));
+    if (!pool->segs || !pool->bufs ||
+        mem_arena_init(&pool->payload_arena, num_segs * pool->seg_size, MEM_NODE_LOCAL) < 0) {
+        perror("buffer pool allocation failed");
+        free(pool->segs);
+        free(pool->bufs);
+        return -1;
+    }
+    pool->payload = pool->payload_arena.base;
+
+    for (size_t i = 0; i < num_segs; i++) {
+        bc_segment_t *seg = &pool->segs[i];
+        seg->size = pool->seg_size;
+        seg->data = pool->payload + i * pool->seg_size;
+        atomic_init(&seg->refs, 0);
+        seg->next_free = pool->free_segs;
+        pool->free_segs = seg;
+    }
+    pool->free_segs_count = num_segs;
+
+    for (size_t i = 0; i < num_bufs; i++) {
+        pool->bufs[i].next = pool->free_bufs;
+        pool->free_bufs = &pool->bufs[i];
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    return 0;
+}
+
+/**
+ * @brief Release pool memory (all chains must have been freed)
+ */
+static inline void bc_pool_destroy(bc_pool_t *pool) {
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->segs);
+    mem_arena_destroy(&pool->payload_arena);
+    free(pool->bufs);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Take a descriptor from the pool
+ */
+static inline bc_buf_t *bc_desc_get(bc_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    bc_buf_t *buf = pool->free_bufs;
+    if (buf) {
+        pool->free_bufs = buf->next;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (buf) {
+        buf->next = NULL;
+    }
+    return buf;
+}
+
+/**
+ * @brief Allocate a buffer backed by a fresh, empty segment
+ *
+ * @return Buffer with len 0 and the whole segment as tailroom, or NULL
+ *         if the pool is exhausted
+ */
+static inline bc_buf_t *bc_buf_alloc(bc_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    bc_segment_t *seg = pool->free_segs;
+    bc_buf_t *buf = pool->free_bufs;
+    if (!seg || !buf) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    pool->free_segs = seg->next_free;
+    pool->free_segs_count--;
+    pool->free_bufs = buf->next;
+    pthread_mutex_unlock(&pool->lock);
+
+    atomic_store_explicit(&seg->refs, 1, memory_order_relaxed);
+    buf->next = NULL;
+    buf->seg = seg;
+    buf->off = 0;
+    buf->len = 0;
+    return buf;
+}
+
+/**
+ * @brief Create another reference to part of an existing buffer
+ *
+ * @param pool Buffer pool
+ * @param src Buffer to share
+ * @param off Offset within src
+ * @param len Length of the new slice
+ * @return New buffer sharing src's segment, or NULL on exhaustion
+ */
+static inline bc_buf_t *bc_buf_ref(bc_pool_t *pool, const bc_buf_t *src,
+                                   uint32_t off, uint32_t len) {
+    bc_buf_t *buf = bc_desc_get(pool);
+    if (!buf) {
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&src->seg->refs, 1, memory_order_relaxed);
+    buf->seg = src->seg;
+    buf->off = src->off + off;
+    buf->len = len;
+    return buf;
+}
+
+/**
+ * @brief Drop a buffer, returning its segment when unreferenced
+ */
+static inline void bc_buf_free(bc_pool_t *pool, bc_buf_t *buf) {
+    bc_segment_t *seg = buf->seg;
+    int last = atomic_fetch_sub_explicit(&seg->refs, 1, memory_order_acq_rel) == 1;
+
+    pthread_mutex_lock(&pool->lock);
+    if (last) {
+        seg->next_free = pool->free_segs;
+        pool->free_segs = seg;
+        pool->free_segs_count++;
+    }
+    buf->seg = NULL;
+    buf->next = pool->free_bufs;
+    pool->free_bufs = buf;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Pointer to the first byte of a buffer
+ */
+static inline char *bc_buf_data(const bc_buf_t *buf) {
+    return buf->seg->data + buf->off;
+}
+
+/**
+ * @brief Writable bytes after the end of a buffer
+ *
+ * Shared segments are treated as read-only.
+ */
+static inline uint32_t bc_buf_tailroom(const bc_buf_t *buf) {
+    if (atomic_load_explicit(&buf->seg->refs, memory_order_acquire) != 1) {
+        return 0;
+    }
+    return buf->seg->size - (buf->off + buf->len);
+}
+
+/**
+ * @brief Initialize an empty chain
+ */
+static inline void bc_chain_init(bc_chain_t *chain) {
+    chain->head = NULL;
+    chain->tail = NULL;
+    chain->len = 0;
+    chain->count = 0;
+}
+
+/**
+ * @brief Append a buffer to the end of a chain (O(1))
+ */
+static inline void bc_chain_append(bc_chain_t *chain, bc_buf_t *buf) {
+    buf->next = NULL;
+    if (chain->tail) {
+        chain->tail->next = buf;
+    } else {
+        chain->head = buf;
+    }
+    chain->tail = buf;
+    chain->len += buf->len;
+    chain->count++;
+}
+
+/**
+ * @brief Prepend a buffer to the front of a chain (O(1))
+ */
+static inline void bc_chain_prepend(bc_chain_t *chain, bc_buf_t *buf) {
+    buf->next = chain->head;
+    chain->head = buf;
+    if (!chain->tail) {
+        chain->tail = buf;
+    }
+    chain->len += buf->len;
+    chain->count++;
+}
+
+/**
+ * @brief Move all buffers of src to the end of dst (O(1))
+ */
+static inline void bc_chain_concat(bc_chain_t *dst, bc_chain_t *src) {
+    if (!src->head) {
+        return;
+    }
+    if (dst->tail) {
+        dst->tail->next = src->head;
+    } else {
+        dst->head = src->head;
+    }
+    dst->tail = src->tail;
+    dst->len += src->len;
+    dst->count += src->count;
+    bc_chain_init(src);
+}
+
+/**
+ * @brief Release every buffer in a chain
+ */
+static inline void bc_chain_free(bc_pool_t *pool, bc_chain_t *chain) {
+    bc_buf_t *buf = chain->head;
+    while (buf) {
+        bc_buf_t *next = buf->next;
+        bc_buf_free(pool, buf);
+        buf = next;
+    }
+    bc_chain_init(chain);
+}
+
+/**
+ * @brief Split a chain at a byte offset without copying payload
+ *
+ * Bytes [0, at) stay in chain; bytes [at, len) move to tail. A buffer
+ * straddling the split point is shared between both chains. Cost is
+ * proportional to the number of buffers before the split point.
+ *
+ * @return 0 on success, -1 if at is out of range or descriptors ran out
+ */
+static inline int bc_chain_split(bc_pool_t *pool, bc_chain_t *chain, size_t at,
+                                 bc_chain_t *tail) {
+    bc_chain_init(tail);
+
+    if (at > chain->len) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (at == chain->len) {
+        return 0;
+    }
+
+    bc_buf_t *prev = NULL;
+    bc_buf_t *buf = chain->head;
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos + buf->len <= at) {
+        pos += buf->len;
+        prev = buf;
+        buf = buf->next;
+        count++;
+    }
+
+    if (pos < at) {
+        // Split point falls inside buf: share its segment
+        uint32_t keep = (uint32_t)(at - pos);
+        bc_buf_t *rest = bc_buf_ref(pool, buf, keep, buf->len - keep);
+        if (!rest) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        rest->next = buf->next;
+        buf->len = keep;
+        buf->next = NULL;
+
+        tail->head = rest;
+        tail->tail = (chain->tail == buf) ? rest : chain->tail;
+        chain->tail = buf;
+        count++;
+    } else {
+        // Split point is on a buffer boundary
+        tail->head = buf;
+        tail->tail = chain->tail;
+        chain->tail = prev;
+        if (prev) {
+            prev->next = NULL;
+        } else {
+            chain->head = NULL;
+        }
+    }
+
+    tail->len = chain->len - at;
+    tail->count = chain->count - count + (pos < at ? 1 : 0);
+    chain->len = at;
+    chain->count = count;
+    return 0;
+}
+
+/**
+ * @brief Append references to every buffer of src onto dst
+ *
+ * Both chains then share the same segments; no payload is copied.
+ *
+ * @return 0 on success, -1 if descriptors ran out (dst is left partial)
+ */
+static inline int bc_chain_clone(bc_pool_t *pool, const bc_chain_t *src, bc_chain_t *dst) {
+    for (bc_buf_t *buf = src->head; buf; buf = buf->next) {
+        bc_buf_t *ref = bc_buf_ref(pool, buf, 0, buf->len);
+        if (!ref) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        bc_chain_append(dst, ref);
+    }
+    return 0;
+}
+
+/**
+ * @brief Drop n bytes from the front of a chain
+ */
+static inline void bc_chain_consume(bc_pool_t *pool, bc_chain_t *chain, size_t n) {
+    if (n > chain->len) {
+        n = chain->len;
+    }
+    chain->len -= n;
+
+    while (n > 0) {
+        bc_buf_t *buf = chain->head;
+        if (n < buf->len) {
+            buf->off += (uint32_t)n;
+            buf->len -= (uint32_t)n;
+            return;
+        }
+        n -= buf->len;
+        chain->head = buf->next;
+        if (!chain->head) {
+            chain->tail = NULL;
+        }
+        chain->count--;
+        bc_buf_free(pool, buf);
+    }
+
+    // Also drop empty buffers left at the front
+    while (chain->head && chain->head->len == 0 && chain->head != chain->tail) {
+        bc_buf_t *buf = chain->head;
+        chain->head = buf->next;
+        chain->count--;
+        bc_buf_free(pool, buf);
+    }
+}
+
+/**
+ * @brief Fill an iovec array describing the chain's data
+ *
+ * @param chain Chain to describe
+ * @param iov Output array
+ * @param max_iov Capacity of iov
+ * @return Number of iovec entries filled
+ */
+static inline int bc_chain_to_iovec(const bc_chain_t *chain, struct iovec *iov, int max_iov) {
+    int n = 0;
+    for (bc_buf_t *buf = chain->head; buf && n < max_iov; buf = buf->next) {
+        if (buf->len == 0) {
+            continue;
+        }
+        iov[n].iov_base = bc_buf_data(buf);
+        iov[n].iov_len = buf->len;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Copy bytes out of a chain into contiguous memory
+ *
+ * @return Number of bytes copied
+ */
+static inline size_t bc_chain_copyout(const bc_chain_t *chain, size_t off, void *dst, size_t len) {
+    char *out = (char *)dst;
+    size_t copied = 0;
+
+    for (bc_buf_t *buf = chain->head; buf && copied < len; buf = buf->next) {
+        if (off >= buf->len) {
+            off -= buf->len;
+            continue;
+        }
+        size_t n = buf->len - off;
+        if (n > len - copied) {
+            n = len - copied;
+        }
+        memcpy(out + copied, bc_buf_data(buf) + off, n);
+        copied += n;
+        off = 0;
+    }
+
+    return copied;
+}
+
+/**
+ * @brief Read from fd straight into pool segments appended to a chain
+ *
+ * Uses the tailroom of the last buffer first, then up to max_segs fresh
+ * segments, in a single readv() call. Unused fresh segments are returned.
+ *
+ * @return Bytes read, 0 on EOF, -1 on error (errno set; ENOBUFS if the
+ *         pool is exhausted)
+ */
+static inline ssize_t bc_chain_read(bc_pool_t *pool, bc_chain_t *chain, int fd, int max_segs) {
+    struct iovec iov[BC_MAX_IOV];
+    bc_buf_t *fresh[BC_MAX_IOV];
+    int niov = 0;
+    int nfresh = 0;
+
+    bc_buf_t *tail = chain->tail;
+    uint32_t room = tail ? bc_buf_tailroom(tail) : 0;
+    if (room > 0) {
+        iov[niov].iov_base = bc_buf_data(tail) + tail->len;
+        iov[niov].iov_len = room;
+        niov++;
+    }
+
+    if (max_segs > BC_MAX_IOV - 1) {
+        max_segs = BC_MAX_IOV - 1;
+    }
+    while (nfresh < max_segs) {
+        bc_buf_t *buf = bc_buf_alloc(pool);
+        if (!buf) {
+            break;
+        }
+        fresh[nfresh++] = buf;
+        iov[niov].iov_base = bc_buf_data(buf);
+        iov[niov].iov_len = buf->seg->size;
+        niov++;
+    }
+
+    if (niov == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t n = readv(fd, iov, niov);
+    size_t remaining = n > 0 ? (size_t)n : 0;
+
+    if (room > 0) {
+        uint32_t used = remaining < room ? (uint32_t)remaining : room;
+        tail->len += used;
+        chain->len += used;
+        remaining -= used;
+    }
+
+    for (int i = 0; i < nfresh; i++) {
+        if (remaining > 0) {
+            uint32_t used = remaining < fresh[i]->seg->size ? (uint32_t)remaining
+                                                            : fresh[i]->seg->size;
+            fresh[i]->len = used;
+            remaining -= used;
+            bc_chain_append(chain, fresh[i]);
+        } else {
+            bc_buf_free(pool, fresh[i]);
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief Write as much of a chain as possible with writev()
+ *
+ * Written bytes are consumed from the chain.
+ *
+ * @return Bytes written, or -1 on error (errno set)
+ */
+static inline ssize_t bc_chain_write(bc_pool_t *pool, bc_chain_t *chain, int fd) {
+    struct iovec iov[BC_MAX_IOV];
+    int niov = bc_chain_to_iovec(chain, iov, BC_MAX_IOV);
+    if (niov == 0) {
+        return 0;
+    }
+
+    ssize_t n = writev(fd, iov, niov);
+    if (n > 0) {
+        bc_chain_consume(pool, chain, (size_t)n);
+    }
+    return n;
+}
+
+#endif /* BUFFER_CHAIN_H */
@@ -0,0 +1,455 @@
+/**
+ * @file can_bridge.h
+ * @brief CAN-to-UDP bridge: many timestamped frames per datagram, both ways
+ *
+ * Frames read from a CAN socket are packed into UDP datagrams for a remote
+ * collector instead of being sent one datagram per frame. A datagram goes
+ * out when either threshold is reached:
+ *  - size: max_records frames, at most CBR_MAX_RECORDS so a datagram fits
+ *    a 1500-byte Ethernet MTU without fragmentation;
+ *  - time: flush_ms after its first frame arrived, which bounds the delay
+ *    the bridge adds.
+ * At full load on a 1 Mbit/s bus (about 8000 frames/s) the size threshold
+ * wins and each datagram carries 72 frames. Datagrams received from the
+ * collector are unpacked and written to the CAN socket with one sendmmsg().
+ *
+ * Datagram format, little-endian:
+ *
+ *     header (16 bytes): magic "CANB", sequence u32, base timestamp u64 (ns, CLOCK_REALTIME)
+ *     record (20 bytes): offset from base u32 (ns), can_id u32, dlc u8, 3 reserved, data[8]
+ *
+ * Timestamps are the kernel receive times (SO_TIMESTAMPNS) when the CAN
+ * socket provides them, otherwise the time the bridge read the frame.
+ * Sequence numbers let the receiver count lost datagrams. Like the
+ * gateway, the bridge never retries: a datagram the network refuses, or a
+ * frame the CAN interface has no room for, is dropped and counted.
+ */
+
+#ifndef CAN_BRIDGE_H
+#define CAN_BRIDGE_H
+
+// recvmmsg() and sendmmsg() are GNU extensions: define _GNU_SOURCE before any include
+#ifndef _GNU_SOURCE
+#error "can_bridge.h requires _GNU_SOURCE"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/can.h>
+#include "can_gateway.h"
+#include "latency_histogram.h"
+#include "wire_codec.h"
+
+#define CBR_MAGIC 0x424e4143u       /**< "CANB" in little-endian order */
+#define CBR_HEADER_SIZE 16
+#define CBR_RECORD_SIZE 20
+#define CBR_MAX_DATAGRAM 1472       /**< UDP payload of a 1500-byte Ethernet frame */
+#define CBR_MAX_RECORDS ((CBR_MAX_DATAGRAM - CBR_HEADER_SIZE) / CBR_RECORD_SIZE)
+#define CBR_BATCH 64                /**< CAN frames per recvmmsg() */
+#define CBR_RX_DATAGRAMS 8          /**< Datagrams per recvmmsg() */
+
+/**
+ * @brief Bridge between one CAN socket and one connected UDP socket
+ */
+typedef struct {
+    int can_fd;
+    int udp_fd;
+    int epfd;
+    size_t max_records;             /**< Size threshold */
+    uint64_t flush_ns;              /**< Time threshold */
+
+    // Datagram being filled
+    uint8_t out[CBR_MAX_DATAGRAM];
+    size_t out_records;
+    uint64_t out_base_ns;           /**< Timestamp of its first frame */
+    uint64_t out_deadline_ns;       /**< CLOCK_MONOTONIC time it must be sent by */
+    uint32_t tx_seq;
+
+    // CAN receive batch
+    struct can_frame rx[CBR_BATCH];
+    struct mmsghdr rx_msgs[CBR_BATCH];
+    struct iovec rx_iov[CBR_BATCH];
+    char rx_ctrl[CBR_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+
+    // Datagrams from the collector and the frames unpacked from one
+    uint8_t in[CBR_RX_DATAGRAMS][CBR_MAX_DATAGRAM];
+    struct mmsghdr in_msgs[CBR_RX_DATAGRAMS];
+    struct iovec in_iov[CBR_RX_DATAGRAMS];
+    struct can_frame tx[CBR_MAX_RECORDS];
+    struct mmsghdr tx_msgs[CBR_MAX_RECORDS];
+    struct iovec tx_iov[CBR_MAX_RECORDS];
+    uint32_t rx_seq;                /**< Next expected sequence number */
+    int rx_seq_valid;
+
+    uint64_t can_rx;                /**< Frames read from CAN */
+    uint64_t can_tx;                /**< Frames written to CAN */
+    uint64_t can_dropped;           /**< Frames CAN had no room for */
+    uint64_t datagrams_tx;
+    uint64_t datagrams_rx;
+    uint64_t bytes_tx;
+    uint64_t udp_errors;            /**< Datagrams the network refused */
+    uint64_t bad_datagrams;         /**< Received datagrams that were not bridge datagrams */
+    uint64_t lost_datagrams;        /**< Gaps in the received sequence */
+    latency_histogram_t latency;    /**< Frame timestamp to its datagram being sent */
+} can_bridge_t;
+
+static inline uint64_t cbr_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Open a non-blocking UDP socket connected to the collector
+ *
+ * @param host Collector IPv4 address
+ * @param port Collector port
+ * @param local_port Port to receive the collector's datagrams on, 0 for any
+ * @return Socket, or -1 on failure (errno set)
+ */
+static inline int cbr_open_udp(const char *host, uint16_t port, uint16_t local_port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(local_port);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Initialize a bridge; it owns both sockets from now on
+ *
+ * @param b Bridge
+ * @param can_fd Socket carrying one struct can_frame per datagram
+ * @param udp_fd Connected UDP socket (cbr_open_udp())
+ * @param max_records Frames per datagram, 1 to CBR_MAX_RECORDS
+ * @param flush_ms Longest time a frame waits for its datagram to fill
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int cbr_init(can_bridge_t *b, int can_fd, int udp_fd, size_t max_records, unsigned flush_ms) {
+    memset(b, 0, sizeof(*b));
+    b->can_fd = can_fd;
+    b->udp_fd = udp_fd;
+    b->max_records = max_records < 1 ? 1 : max_records > CBR_MAX_RECORDS ? CBR_MAX_RECORDS : max_records;
+    b->flush_ns = (uint64_t)flush_ms * 1000000;
+    for (int i = 0; i < CBR_BATCH; i++) {
+        b->rx_iov[i].iov_base = &b->rx[i];
+        b->rx_iov[i].iov_len = sizeof(struct can_frame);
+        b->rx_msgs[i].msg_hdr.msg_iov = &b->rx_iov[i];
+        b->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        b->rx_msgs[i].msg_hdr.msg_control = b->rx_ctrl[i];
+    }
+    for (int i = 0; i < CBR_RX_DATAGRAMS; i++) {
+        b->in_iov[i].iov_base = b->in[i];
+        b->in_iov[i].iov_len = CBR_MAX_DATAGRAM;
+        b->in_msgs[i].msg_hdr.msg_iov = &b->in_iov[i];
+        b->in_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (size_t i = 0; i < CBR_MAX_RECORDS; i++) {
+        b->tx_iov[i].iov_base = &b->tx[i];
+        b->tx_iov[i].iov_len = sizeof(struct can_frame);
+        b->tx_msgs[i].msg_hdr.msg_iov = &b->tx_iov[i];
+        b->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    latency_histogram_init(&b->latency);
+
+    int one = 1;
+    setsockopt(can_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+    b->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (b->epfd < 0) {
+        return -1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = can_fd;
+    if (epoll_ctl(b->epfd, EPOLL_CTL_ADD, can_fd, &ev) < 0) {
+        return -1;
+    }
+    ev.data.fd = udp_fd;
+    return epoll_ctl(b->epfd, EPOLL_CTL_ADD, udp_fd, &ev);
+}
+
+/**
+ * @brief Encode one record
+ */
+static inline void cbr_put_record(uint8_t *p, const struct can_frame *f, uint32_t offset_ns) {
+    wire_put32(p, offset_ns, WIRE_SWAP_LE);
+    wire_put32(p + 4, f->can_id, WIRE_SWAP_LE);
+    p[8] = f->can_dlc;
+    memset(p + 9, 0, 3);
+    memcpy(p + 12, f->data, CAN_MAX_DLEN);
+}
+
+/**
+ * @brief Decode one record; -1 if its DLC is out of range
+ */
+static inline int cbr_get_record(const uint8_t *p, struct can_frame *f, uint32_t *offset_ns) {
+    if (p[8] > CAN_MAX_DLEN) {
+        return -1;
+    }
+    memset(f, 0, sizeof(*f));
+    *offset_ns = wire_get32(p, WIRE_SWAP_LE);
+    f->can_id = wire_get32(p + 4, WIRE_SWAP_LE);
+    f->can_dlc = p[8];
+    memcpy(f->data, p + 12, CAN_MAX_DLEN);
+    return 0;
+}
+
+/**
+ * @brief Send the datagram being filled, if it holds any frames
+ */
+static inline void cbr_flush(can_bridge_t *b) {
+    if (b->out_records == 0) {
+        return;
+    }
+    wire_put32(b->out, CBR_MAGIC, WIRE_SWAP_LE);
+    wire_put32(b->out + 4, b->tx_seq++, WIRE_SWAP_LE);
+    wire_put64(b->out + 8, b->out_base_ns, WIRE_SWAP_LE);
+    size_t len = CBR_HEADER_SIZE + b->out_records * CBR_RECORD_SIZE;
+    ssize_t sent;
+    do {
+        sent = send(b->udp_fd, b->out, len, MSG_DONTWAIT);
+    } while (sent < 0 && errno == EINTR);
+    if (sent == (ssize_t)len) {
+        b->datagrams_tx++;
+        b->bytes_tx += len;
+        uint64_t now = cgw_realtime_ns();
+        for (size_t i = 0; i < b->out_records; i++) {
+            uint64_t stamp = b->out_base_ns + wire_get32(b->out + CBR_HEADER_SIZE + i * CBR_RECORD_SIZE, WIRE_SWAP_LE);
+            if (now > stamp) {
+                latency_histogram_record(&b->latency, now - stamp);
+            }
+        }
+    } else {
+        b->udp_errors++;
+    }
+    b->out_records = 0;
+}
+
+/**
+ * @brief Add a frame to the datagram being filled, sending it when full
+ *
+ * @param b Bridge
+ * @param f Frame
+ * @param stamp_ns Receive time, CLOCK_REALTIME
+ * @param now_ns Current CLOCK_MONOTONIC time, for the flush deadline
+ */
+static inline void cbr_append(can_bridge_t *b, const struct can_frame *f, uint64_t stamp_ns, uint64_t now_ns) {
+    // Offsets are 32-bit: a frame more than 4 s after the base starts a new datagram
+    if (b->out_records && (stamp_ns < b->out_base_ns || stamp_ns - b->out_base_ns > UINT32_MAX)) {
+        cbr_flush(b);
+    }
+    if (b->out_records == 0) {
+        b->out_base_ns = stamp_ns;
+        b->out_deadline_ns = now_ns + b->flush_ns;
+    }
+    cbr_put_record(b->out + CBR_HEADER_SIZE + b->out_records * CBR_RECORD_SIZE, f,
+                   (uint32_t)(stamp_ns - b->out_base_ns));
+    if (++b->out_records == b->max_records) {
+        cbr_flush(b);
+    }
+}
+
+/**
+ * @brief Unpack a datagram from the collector and write its frames to CAN
+ *
+ * @return Frames written, or -1 if the datagram is malformed
+ */
+static inline int cbr_decapsulate(can_bridge_t *b, const uint8_t *data, size_t len) {
+    if (len < CBR_HEADER_SIZE || (len - CBR_HEADER_SIZE) % CBR_RECORD_SIZE != 0 || len > CBR_MAX_DATAGRAM ||
+        wire_get32(data, WIRE_SWAP_LE) != CBR_MAGIC) {
+        b->bad_datagrams++;
+        return -1;
+    }
+    size_t count = (len - CBR_HEADER_SIZE) / CBR_RECORD_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t offset;
+        if (cbr_get_record(data + CBR_HEADER_SIZE + i * CBR_RECORD_SIZE, &b->tx[i], &offset) < 0) {
+            b->bad_datagrams++;
+            return -1;
+        }
+    }
+    uint32_t seq = wire_get32(data + 4, WIRE_SWAP_LE);
+    if (b->rx_seq_valid && seq != b->rx_seq) {
+        // Only forward gaps count; a restarted sender resets the sequence
+        uint32_t gap = seq - b->rx_seq;
+        if (gap < 0x80000000u) {
+            b->lost_datagrams += gap;
+        }
+    }
+    b->rx_seq = seq + 1;
+    b->rx_seq_valid = 1;
+    b->datagrams_rx++;
+
+    int sent = 0;
+    while (sent < (int)count) {
+        int n = sendmmsg(b->can_fd, b->tx_msgs + sent, (unsigned)((int)count - sent), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        sent += n;
+    }
+    b->can_tx += (uint64_t)sent;
+    b->can_dropped += count - (size_t)sent;
+    return sent;
+}
+
+// Drain the CAN socket into datagrams; 0, or -1 if the socket failed
+static inline int cbr_receive_can(can_bridge_t *b) {
+    for (;;) {
+        for (int i = 0; i < CBR_BATCH; i++) {
+            b->rx_msgs[i].msg_hdr.msg_controllen = sizeof(b->rx_ctrl[i]);
+        }
+        int n = recvmmsg(b->can_fd, b->rx_msgs, CBR_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        uint64_t now = cbr_monotonic_ns();
+        uint64_t wall = 0;
+        for (int i = 0; i < n; i++) {
+            if (b->rx_msgs[i].msg_len != sizeof(struct can_frame)) {
+                continue;
+            }
+            uint64_t stamp = cgw_rx_stamp(&b->rx_msgs[i].msg_hdr);
+            if (stamp == 0) {
+                stamp = wall ? wall : (wall = cgw_realtime_ns());
+            }
+            b->can_rx++;
+            cbr_append(b, &b->rx[i], stamp, now);
+        }
+        if (n < CBR_BATCH) {
+            return 0;
+        }
+    }
+}
+
+// Drain datagrams from the collector; 0, or -1 if the socket failed
+static inline int cbr_receive_udp(can_bridge_t *b) {
+    for (;;) {
+        int n = recvmmsg(b->udp_fd, b->in_msgs, CBR_RX_DATAGRAMS, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // A refused earlier send shows up here on a connected socket
+            if (errno == ECONNREFUSED) {
+                b->udp_errors++;
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        for (int i = 0; i < n; i++) {
+            size_t len = b->in_msgs[i].msg_len;
+            if (b->in_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                len = CBR_MAX_DATAGRAM + 1;     // Larger than any bridge datagram
+            }
+            cbr_decapsulate(b, b->in[i], len);
+        }
+        if (n < CBR_RX_DATAGRAMS) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Wait for traffic in either direction and bridge it
+ *
+ * The wait ends early when the datagram being filled reaches its flush
+ * deadline, so no frame waits more than about flush_ms.
+ *
+ * @param b Bridge
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return Number of readable sockets, or -1 if epoll or a socket failed
+ */
+static inline int cbr_poll(can_bridge_t *b, int timeout_ms) {
+    if (b->out_records) {
+        uint64_t now = cbr_monotonic_ns();
+        int until = now >= b->out_deadline_ns ? 0 : (int)((b->out_deadline_ns - now + 999999) / 1000000);
+        if (timeout_ms < 0 || until < timeout_ms) {
+            timeout_ms = until;
+        }
+    }
+    struct epoll_event events[2];
+    int n = epoll_wait(b->epfd, events, 2, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    int result = n;
+    for (int i = 0; i < n; i++) {
+        int r = events[i].data.fd == b->can_fd ? cbr_receive_can(b) : cbr_receive_udp(b);
+        if (r < 0) {
+            result = -1;
+        }
+    }
+    if (b->out_records && cbr_monotonic_ns() >= b->out_deadline_ns) {
+        cbr_flush(b);
+    }
+    return result;
+}
+
+/**
+ * @brief Print counters and the bridging latency
+ */
+static inline void cbr_print_stats(const can_bridge_t *b) {
+    printf("CAN -> UDP: %lu frames in %lu datagrams (%.1f per datagram, %lu bytes), %lu refused\n",
+           (unsigned long)b->can_rx, (unsigned long)b->datagrams_tx,
+           b->datagrams_tx ? (double)b->can_rx / (double)b->datagrams_tx : 0.0, (unsigned long)b->bytes_tx,
+           (unsigned long)b->udp_errors);
+    printf("UDP -> CAN: %lu datagrams, %lu frames sent, %lu dropped, %lu malformed, %lu lost\n",
+           (unsigned long)b->datagrams_rx, (unsigned long)b->can_tx, (unsigned long)b->can_dropped,
+           (unsigned long)b->bad_datagrams, (unsigned long)b->lost_datagrams);
+    if (b->latency.count) {
+        latency_histogram_print(&b->latency, "bridge latency");
+    }
+}
+
+/**
+ * @brief Send any pending frames and close both sockets
+ */
+static inline void cbr_close(can_bridge_t *b) {
+    cbr_flush(b);
+    close(b->can_fd);
+    close(b->udp_fd);
+    if (b->epfd >= 0) {
+        close(b->epfd);
+        b->epfd = -1;
+    }
+}
+
+#endif /* CAN_BRIDGE_H */
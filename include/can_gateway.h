@@ -0,0 +1,548 @@
+/**
+ * @file can_gateway.h
+ * @brief Multi-bus CAN gateway: one epoll loop, ID-indexed routes, batched TX
+ *
+ * Each bus is a socket that carries one struct can_frame per datagram: a
+ * raw CAN socket bound to an interface (cgw_open_can()), or any
+ * SOCK_SEQPACKET/SOCK_DGRAM stand-in, as the tests use. One thread waits on
+ * every bus in a single epoll set. For each readable bus it:
+ *  - drains the bus with recvmmsg(), up to CGW_BATCH frames per call;
+ *  - routes each frame;
+ *  - queues the routed copies on their destination buses.
+ * When every readable bus has been drained, each destination queue is
+ * flushed with one sendmmsg(). Frames that the destination cannot take
+ * (ENOBUFS on a busy CAN interface) are dropped and counted, never retried:
+ * a late frame is worth less than the next one.
+ *
+ * Routes are indexed by source bus and CAN ID:
+ *  - each bus has a 2048-entry table for standard IDs;
+ *  - extended IDs go to an open-addressed hash table;
+ *  - a per-bus default route catches IDs without a rule of their own.
+ * Lookup is therefore one array or hash access per frame. Rules for the same
+ * source and ID are chained, so one frame can fan out to several buses, each
+ * with its own rewrite. A rewrite can replace the ID and apply AND/OR masks
+ * to the 8 data bytes (like can-gw modifications). Error frames are never
+ * routed.
+ *
+ * Each bus has SO_TIMESTAMPNS enabled when it supports it. The time from
+ * the kernel receive timestamp to the completed sendmmsg() is then recorded
+ * as forwarding latency.
+ *
+ * Rule syntax for cgw_parse_rule():
+ *
+ *     src:id>dst[:new_id][,and=HEX][,or=HEX]
+ *
+ * id is a hex or decimal CAN ID; values above 0x7FF are extended IDs. An id
+ * of * is the bus's default route. The masks are 16 hex digits, data[0]
+ * first. Examples: "0:0x100>1", "1:*>0", "0:0x200>2:0x210,and=ff00000000000000".
+ */
+
+#ifndef CAN_GATEWAY_H
+#define CAN_GATEWAY_H
+
+// recvmmsg() and sendmmsg() are GNU extensions: define _GNU_SOURCE before any include
+#ifndef _GNU_SOURCE
+#error "can_gateway.h requires _GNU_SOURCE"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "latency_histogram.h"
+
+#define CGW_MAX_BUSES 8
+#define CGW_BATCH 64                /**< Frames per recvmmsg()/sendmmsg() */
+#define CGW_MAX_RULES 1024
+#define CGW_EFF_BITS 11
+#define CGW_EFF_SLOTS (1 << CGW_EFF_BITS)   /**< Extended-ID route slots */
+#define CGW_NO_RULE (-1)
+#define CGW_ANY_ID 0xffffffffu      /**< Rule ID for the default route */
+
+/**
+ * @brief One route: frames from src with id go to dst, optionally rewritten
+ */
+typedef struct {
+    uint32_t id;                    /**< Source ID (CAN_EFF_FLAG for extended), or CGW_ANY_ID */
+    uint8_t src;                    /**< Source bus */
+    uint8_t dst;                    /**< Destination bus */
+    uint8_t set_id;                 /**< Replace the ID with new_id */
+    uint32_t new_id;                /**< Replacement ID (CAN_EFF_FLAG for extended) */
+    uint64_t and_mask;              /**< Data bytes are ANDed with this... */
+    uint64_t or_mask;               /**< ...then ORed with this */
+    int16_t next;                   /**< Next rule for the same source and ID */
+} cgw_rule_t;
+
+/**
+ * @brief One bus and its transmit queue
+ */
+typedef struct {
+    int fd;
+    char name[IFNAMSIZ];
+    int16_t sff[CAN_SFF_MASK + 1];  /**< First rule per standard ID */
+    int16_t default_rule;           /**< First rule for unlisted IDs */
+    struct can_frame tx[CGW_BATCH];
+    uint64_t tx_stamp[CGW_BATCH];   /**< Receive time of each queued frame, 0 if unknown */
+    struct mmsghdr tx_msgs[CGW_BATCH];
+    struct iovec tx_iov[CGW_BATCH];
+    int tx_count;
+    uint64_t rx_frames;             /**< Frames received */
+    uint64_t tx_frames;             /**< Frames sent */
+    uint64_t tx_batches;            /**< sendmmsg() calls */
+    uint64_t dropped;               /**< Frames the bus could not take */
+    uint64_t unrouted;              /**< Received frames with no route */
+} cgw_bus_t;
+
+/**
+ * @brief Gateway
+ */
+typedef struct {
+    int epfd;
+    int bus_count;
+    cgw_bus_t buses[CGW_MAX_BUSES];
+    cgw_rule_t rules[CGW_MAX_RULES];
+    int rule_count;
+    struct {
+        uint32_t id;                /**< Extended ID without flags */
+        uint8_t src;
+        int16_t rule;               /**< First rule, CGW_NO_RULE if the slot is free */
+    } eff[CGW_EFF_SLOTS];
+    struct can_frame rx[CGW_BATCH];
+    struct mmsghdr rx_msgs[CGW_BATCH];
+    struct iovec rx_iov[CGW_BATCH];
+    char rx_ctrl[CGW_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    latency_histogram_t latency;    /**< Receive timestamp to sendmmsg() completion */
+} can_gateway_t;
+
+static inline uint64_t cgw_realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Open a non-blocking raw CAN socket bound to an interface
+ *
+ * @return Socket, or -1 on failure (errno set)
+ */
+static inline int cgw_open_can(const char *interface) {
+    int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        goto fail;
+    }
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        goto fail;
+    }
+    return fd;
+
+fail:
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Initialize an empty gateway
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int cgw_init(can_gateway_t *g) {
+    memset(g, 0, sizeof(*g));
+    g->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (g->epfd < 0) {
+        return -1;
+    }
+    for (int i = 0; i < CGW_EFF_SLOTS; i++) {
+        g->eff[i].rule = CGW_NO_RULE;
+    }
+    for (int i = 0; i < CGW_BATCH; i++) {
+        g->rx_iov[i].iov_base = &g->rx[i];
+        g->rx_iov[i].iov_len = sizeof(struct can_frame);
+        g->rx_msgs[i].msg_hdr.msg_iov = &g->rx_iov[i];
+        g->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        g->rx_msgs[i].msg_hdr.msg_control = g->rx_ctrl[i];
+    }
+    latency_histogram_init(&g->latency);
+    return 0;
+}
+
+/**
+ * @brief Add a bus; the gateway owns fd from now on
+ *
+ * @param g Gateway
+ * @param fd Socket carrying one struct can_frame per datagram
+ * @param name Name for statistics
+ * @return Bus index, or -1 on failure
+ */
+static inline int cgw_add_bus(can_gateway_t *g, int fd, const char *name) {
+    if (g->bus_count == CGW_MAX_BUSES) {
+        errno = ENOSPC;
+        return -1;
+    }
+    int index = g->bus_count;
+    cgw_bus_t *bus = &g->buses[index];
+    memset(bus, 0, sizeof(*bus));
+    bus->fd = fd;
+    strncpy(bus->name, name, IFNAMSIZ - 1);
+    for (unsigned i = 0; i <= CAN_SFF_MASK; i++) {
+        bus->sff[i] = CGW_NO_RULE;
+    }
+    bus->default_rule = CGW_NO_RULE;
+    for (int i = 0; i < CGW_BATCH; i++) {
+        bus->tx_iov[i].iov_base = &bus->tx[i];
+        bus->tx_iov[i].iov_len = sizeof(struct can_frame);
+        bus->tx_msgs[i].msg_hdr.msg_iov = &bus->tx_iov[i];
+        bus->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Kernel receive timestamps, where the socket type has them
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t)index;
+    if (epoll_ctl(g->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return -1;
+    }
+    g->bus_count++;
+    return index;
+}
+
+// Slot holding (or to hold) the chain for an extended ID
+static inline int cgw_eff_slot(const can_gateway_t *g, uint8_t src, uint32_t id) {
+    uint32_t h = ((id ^ ((uint32_t)src << 24)) * 2654435761u) >> (32 - CGW_EFF_BITS);
+    for (int probe = 0; probe < CGW_EFF_SLOTS; probe++) {
+        int slot = (int)((h + (uint32_t)probe) & (CGW_EFF_SLOTS - 1));
+        if (g->eff[slot].rule == CGW_NO_RULE || (g->eff[slot].id == id && g->eff[slot].src == src)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Head of the rule chain for (src, id); NULL if the table is full
+static inline int16_t *cgw_chain(can_gateway_t *g, uint8_t src, uint32_t id) {
+    cgw_bus_t *bus = &g->buses[src];
+    if (id == CGW_ANY_ID) {
+        return &bus->default_rule;
+    }
+    if (!(id & CAN_EFF_FLAG)) {
+        return &bus->sff[id & CAN_SFF_MASK];
+    }
+    int slot = cgw_eff_slot(g, src, id & CAN_EFF_MASK);
+    if (slot < 0) {
+        return NULL;
+    }
+    g->eff[slot].id = id & CAN_EFF_MASK;
+    g->eff[slot].src = src;
+    return &g->eff[slot].rule;
+}
+
+/**
+ * @brief Add a route; rules for the same source and ID apply in the order added
+ *
+ * Both buses must have been added already.
+ *
+ * @return Rule index, or -1 if a bus index is invalid or the tables are full
+ */
+static inline int cgw_add_rule(can_gateway_t *g, const cgw_rule_t *rule) {
+    if (rule->src >= g->bus_count || rule->dst >= g->bus_count || rule->src == rule->dst ||
+        g->rule_count == CGW_MAX_RULES) {
+        errno = EINVAL;
+        return -1;
+    }
+    int16_t *link = cgw_chain(g, rule->src, rule->id);
+    if (!link) {
+        errno = ENOSPC;
+        return -1;
+    }
+    while (*link != CGW_NO_RULE) {
+        link = &g->rules[*link].next;
+    }
+    int index = g->rule_count++;
+    g->rules[index] = *rule;
+    g->rules[index].next = CGW_NO_RULE;
+    *link = (int16_t)index;
+    return index;
+}
+
+/**
+ * @brief First rule for a frame from src, or CGW_NO_RULE
+ */
+static inline int cgw_lookup(const can_gateway_t *g, uint8_t src, canid_t can_id) {
+    const cgw_bus_t *bus = &g->buses[src];
+    if (can_id & CAN_ERR_FLAG) {
+        return CGW_NO_RULE;
+    }
+    int rule;
+    if (can_id & CAN_EFF_FLAG) {
+        int slot = cgw_eff_slot(g, src, can_id & CAN_EFF_MASK);
+        rule = slot < 0 ? CGW_NO_RULE : g->eff[slot].rule;
+    } else {
+        rule = bus->sff[can_id & CAN_SFF_MASK];
+    }
+    return rule != CGW_NO_RULE ? rule : bus->default_rule;
+}
+
+/**
+ * @brief Copy a frame with a rule's rewrite applied
+ */
+static inline void cgw_apply(const cgw_rule_t *rule, const struct can_frame *in, struct can_frame *out) {
+    *out = *in;
+    if (rule->set_id) {
+        out->can_id = (in->can_id & CAN_RTR_FLAG) | rule->new_id;
+    }
+    uint64_t data;
+    memcpy(&data, in->data, sizeof(data));
+    data = (data & rule->and_mask) | rule->or_mask;
+    memcpy(out->data, &data, sizeof(data));
+}
+
+// Parse 16 hex digits into 8 data bytes, data[0] first
+static inline int cgw_parse_mask(const char *s, uint64_t *mask) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        unsigned v;
+        if (sscanf(s + 2 * i, "%2x", &v) != 1 || !s[2 * i + 1]) {
+            return -1;
+        }
+        bytes[i] = (uint8_t)v;
+    }
+    if (s[16] != '\0' && s[16] != ',') {
+        return -1;
+    }
+    memcpy(mask, bytes, sizeof(bytes));
+    return 0;
+}
+
+static inline int cgw_parse_id(const char *s, char **end, uint32_t *id) {
+    errno = 0;
+    unsigned long v = strtoul(s, end, 0);
+    if (errno || *end == s || v > CAN_EFF_MASK) {
+        return -1;
+    }
+    *id = v > CAN_SFF_MASK ? (uint32_t)v | CAN_EFF_FLAG : (uint32_t)v;
+    return 0;
+}
+
+/**
+ * @brief Parse a rule in the syntax described above and add it
+ *
+ * @return Rule index, or -1 if the rule is malformed or cannot be added
+ */
+static inline int cgw_parse_rule(can_gateway_t *g, const char *spec) {
+    cgw_rule_t rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.and_mask = ~0ULL;
+
+    char *p;
+    unsigned long src = strtoul(spec, &p, 10);
+    if (p == spec || *p++ != ':') {
+        goto invalid;
+    }
+    if (*p == '*') {
+        rule.id = CGW_ANY_ID;
+        p++;
+    } else if (cgw_parse_id(p, &p, &rule.id) < 0) {
+        goto invalid;
+    }
+    if (*p++ != '>') {
+        goto invalid;
+    }
+    const char *start = p;
+    unsigned long dst = strtoul(start, &p, 10);
+    if (p == start || src >= CGW_MAX_BUSES || dst >= CGW_MAX_BUSES) {
+        goto invalid;
+    }
+    rule.src = (uint8_t)src;
+    rule.dst = (uint8_t)dst;
+    if (*p == ':') {
+        if (cgw_parse_id(p + 1, &p, &rule.new_id) < 0) {
+            goto invalid;
+        }
+        rule.set_id = 1;
+    }
+    while (*p == ',') {
+        p++;
+        if (strncmp(p, "and=", 4) == 0 && cgw_parse_mask(p + 4, &rule.and_mask) == 0) {
+            p += 20;
+        } else if (strncmp(p, "or=", 3) == 0 && cgw_parse_mask(p + 3, &rule.or_mask) == 0) {
+            p += 19;
+        } else {
+            goto invalid;
+        }
+    }
+    if (*p != '\0') {
+        goto invalid;
+    }
+    return cgw_add_rule(g, &rule);
+
+invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+// Send a bus's queued frames in one sendmmsg(); the rest are dropped
+static inline void cgw_flush(can_gateway_t *g, cgw_bus_t *bus) {
+    int sent = 0;
+    while (sent < bus->tx_count) {
+        int n = sendmmsg(bus->fd, bus->tx_msgs + sent, (unsigned)(bus->tx_count - sent), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        bus->tx_batches++;
+        sent += n;
+    }
+    uint64_t now = cgw_realtime_ns();
+    for (int i = 0; i < sent; i++) {
+        if (bus->tx_stamp[i] && now > bus->tx_stamp[i]) {
+            latency_histogram_record(&g->latency, now - bus->tx_stamp[i]);
+        }
+    }
+    bus->tx_frames += (uint64_t)sent;
+    bus->dropped += (uint64_t)(bus->tx_count - sent);
+    bus->tx_count = 0;
+}
+
+// Receive timestamp from a message's control data, 0 if there is none
+static inline uint64_t cgw_rx_stamp(const struct msghdr *msg) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+// Route every frame of one received batch onto the destination queues
+static inline void cgw_route(can_gateway_t *g, uint8_t src, int count) {
+    cgw_bus_t *from = &g->buses[src];
+    for (int i = 0; i < count; i++) {
+        if (g->rx_msgs[i].msg_len != sizeof(struct can_frame)) {
+            continue;
+        }
+        from->rx_frames++;
+        int r = cgw_lookup(g, src, g->rx[i].can_id);
+        if (r == CGW_NO_RULE) {
+            from->unrouted++;
+            continue;
+        }
+        uint64_t stamp = cgw_rx_stamp(&g->rx_msgs[i].msg_hdr);
+        for (; r != CGW_NO_RULE; r = g->rules[r].next) {
+            cgw_bus_t *to = &g->buses[g->rules[r].dst];
+            if (to->tx_count == CGW_BATCH) {
+                cgw_flush(g, to);
+            }
+            cgw_apply(&g->rules[r], &g->rx[i], &to->tx[to->tx_count]);
+            to->tx_stamp[to->tx_count++] = stamp;
+        }
+    }
+}
+
+// Drain one bus; 0, or -1 if the socket failed
+static inline int cgw_receive(can_gateway_t *g, uint8_t src) {
+    for (;;) {
+        for (int i = 0; i < CGW_BATCH; i++) {
+            g->rx_msgs[i].msg_hdr.msg_controllen = sizeof(g->rx_ctrl[i]);
+        }
+        int n = recvmmsg(g->buses[src].fd, g->rx_msgs, CGW_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        cgw_route(g, src, n);
+        if (n < CGW_BATCH) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Wait for frames and forward them
+ *
+ * @param g Gateway
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return Number of buses that were readable, or -1 if epoll or a bus failed
+ */
+static inline int cgw_poll(can_gateway_t *g, int timeout_ms) {
+    struct epoll_event events[CGW_MAX_BUSES];
+    int n = epoll_wait(g->epfd, events, CGW_MAX_BUSES, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    int result = n;
+    for (int i = 0; i < n; i++) {
+        if (cgw_receive(g, (uint8_t)events[i].data.u32) < 0) {
+            result = -1;
+        }
+    }
+    for (int b = 0; b < g->bus_count; b++) {
+        if (g->buses[b].tx_count) {
+            cgw_flush(g, &g->buses[b]);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Print per-bus counters and the forwarding latency
+ */
+static inline void cgw_print_stats(const can_gateway_t *g) {
+    printf("%-10s %12s %12s %10s %10s %10s\n", "bus", "rx", "tx", "tx calls", "dropped", "unrouted");
+    for (int b = 0; b < g->bus_count; b++) {
+        const cgw_bus_t *bus = &g->buses[b];
+        printf("%-10s %12lu %12lu %10lu %10lu %10lu\n", bus->name, (unsigned long)bus->rx_frames,
+               (unsigned long)bus->tx_frames, (unsigned long)bus->tx_batches, (unsigned long)bus->dropped,
+               (unsigned long)bus->unrouted);
+    }
+    if (g->latency.count) {
+        latency_histogram_print(&g->latency, "forwarding latency");
+    }
+}
+
+/**
+ * @brief Close every bus and the epoll set
+ */
+static inline void cgw_close(can_gateway_t *g) {
+    for (int b = 0; b < g->bus_count; b++) {
+        close(g->buses[b].fd);
+    }
+    g->bus_count = 0;
+    if (g->epfd >= 0) {
+        close(g->epfd);
+        g->epfd = -1;
+    }
+}
+
+#endif /* CAN_GATEWAY_H */
@@ -0,0 +1,661 @@
+/**
+ * @file can_stats.h
+ * @brief Per-ID CAN bus statistics in shared memory
+ *
+ * One writer (the process reading the bus) keeps a table of 2048 entries,
+ * one per standard CAN ID, directly indexed by the ID. Each frame updates
+ * its entry:
+ *  - frames, payload bytes and bits on the wire;
+ *  - inter-arrival gap: min, mean and max, plus a log2 histogram;
+ *  - jitter: the gap's deviation from the ID's smoothed period (EWMA, 1/8),
+ *    also as a log2 histogram;
+ *  - missed frames, for IDs with a rolling message counter
+ *    (cst_set_counter()), counted from jumps in the counter.
+ * Extended and error frames are counted in the header but have no entry.
+ *
+ * Bus load is kept on the fly. Every frame's exact length on the wire
+ * is added to the current one-second window; the length includes stuff
+ * bits, CRC, ACK, EOF and interframe space. cst_frame_bits() computes it
+ * bit by bit, cst_frame_bits_fast() eight bits at a time from per-handle
+ * tables. When a window closes, its share of the bit rate becomes the
+ * published load.
+ *
+ * The table lives in a POSIX shared memory object (or a memfd), so a
+ * viewer can read it from another process while the writer runs. The
+ * writer never waits for readers. Each entry has a sequence counter that
+ * is odd while the entry is being updated; a reader copies the entry and
+ * retries if the counter moved (cst_read()). An update is a few stores to
+ * one entry, with no system calls and no locks.
+ *
+ * Timestamps are CLOCK_REALTIME nanoseconds, the clock of SO_TIMESTAMPNS.
+ */
+
+#ifndef CAN_STATS_H
+#define CAN_STATS_H
+
+// recvmmsg() is a GNU extension: define _GNU_SOURCE before any include
+#ifndef _GNU_SOURCE
+#error "can_stats.h requires _GNU_SOURCE"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/can.h>
+#include <linux/memfd.h>
+#include "can_gateway.h"
+
+#define CST_MAGIC 0x43535441u           /**< "CSTA" */
+#define CST_VERSION 1
+#define CST_IDS (CAN_SFF_MASK + 1)      /**< One entry per standard ID */
+#define CST_HIST_BUCKETS 24             /**< log2 microsecond buckets, the last is 8 s and up */
+#define CST_NO_COUNTER 0xFF
+#define CST_WINDOW_NS 1000000000ULL     /**< Bus load window */
+#define CST_BATCH 64                    /**< Frames per recvmmsg() in cst_drain() */
+#define CST_CACHE_LINE 64
+
+/**
+ * @brief Statistics for one standard ID
+ */
+typedef struct {
+    _Alignas(CST_CACHE_LINE) atomic_uint seq;   /**< Odd while being updated */
+    uint8_t counter_byte;           /**< Payload byte holding a message counter, or CST_NO_COUNTER */
+    uint8_t counter_mask;           /**< Counter bits: 0xFF, or 0x0F for a 4-bit counter */
+    uint8_t counter_valid;
+    uint8_t last_counter;
+    uint64_t frames;
+    uint64_t bytes;                 /**< Payload bytes */
+    uint64_t bits;                  /**< Bits on the wire */
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint64_t period_ns;             /**< Smoothed inter-arrival time */
+    uint64_t gaps;                  /**< Inter-arrival samples */
+    uint64_t gap_min_ns;
+    uint64_t gap_max_ns;
+    uint64_t gap_sum_ns;
+    uint64_t counter_missed;        /**< Frames missing from the counter sequence */
+    uint64_t gap_hist[CST_HIST_BUCKETS];
+    uint64_t jitter_hist[CST_HIST_BUCKETS];
+} cst_entry_t;
+
+/**
+ * @brief Header at the start of the shared mapping; the entries follow
+ */
+typedef struct {
+    uint32_t magic;                 /**< CST_MAGIC once initialized */
+    uint32_t version;               /**< CST_VERSION */
+    uint32_t entry_count;           /**< CST_IDS */
+    uint32_t entry_size;            /**< sizeof(cst_entry_t) */
+    uint32_t bitrate;               /**< Bus bit rate, for the load */
+    uint32_t writer_pid;
+    _Alignas(CST_CACHE_LINE) atomic_ullong frames;  /**< Every frame, extended and error frames included */
+    atomic_ullong bits;
+    atomic_ullong extended_frames;
+    atomic_ullong error_frames;
+    atomic_uint load_permille;      /**< Bus load over the last complete window */
+    atomic_uint peak_permille;      /**< Highest window load so far */
+} cst_header_t;
+
+// Bit stream state for cst_frame_bits(): CRC-15 and stuffing run so far
+typedef struct {
+    unsigned crc;
+    unsigned count;                 // Bits before stuffing
+    unsigned stuff;
+    unsigned prev;
+    unsigned run;
+} cst_bitstream_t;
+
+// Append the low width bits of value, most significant first, to the stuffed part
+static inline void cst_push(cst_bitstream_t *bs, unsigned value, int width, int crc) {
+    for (int b = width - 1; b >= 0; b--) {
+        unsigned bit = (value >> b) & 1;
+        if (crc) {
+            unsigned next = bit ^ (bs->crc >> 14);
+            bs->crc = (bs->crc << 1) & 0x7FFF;
+            bs->crc ^= 0x4599 & -next;
+        }
+        // A stuff bit follows five equal bits and starts the next run itself
+        if (bit != bs->prev) {
+            bs->prev = bit;
+            bs->run = 1;
+        } else if (++bs->run == 5) {
+            bs->stuff++;
+            bs->prev ^= 1;
+            bs->run = 1;
+        }
+    }
+    bs->count += (unsigned)width;
+}
+
+/**
+ * @brief Bits a classic CAN frame occupies on the wire
+ *
+ * Counts SOF through the CRC with stuff bits (computing the CRC-15 to know
+ * them), then the CRC delimiter, ACK, EOF and the 3-bit interframe space.
+ * Data frames of 8 bytes take 111 to about 135 bits with a standard ID.
+ * One pass over the bits, without buffering them.
+ */
+static inline unsigned cst_frame_bits(const struct can_frame *f) {
+    canid_t id = f->can_id;
+    unsigned rtr = (id & CAN_RTR_FLAG) != 0;
+    unsigned dlc = f->can_dlc & 0xF;
+    unsigned data_bytes = rtr ? 0 : dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : dlc;
+
+    // SOF is dominant and starts the first run; the CRC of a zero bit from zero is zero
+    cst_bitstream_t bs = { 0, 1, 0, 0, 1 };
+    if (id & CAN_EFF_FLAG) {
+        cst_push(&bs, (id & CAN_EFF_MASK) >> 18, 11, 1);
+        cst_push(&bs, 3, 2, 1);                     // SRR, IDE
+        cst_push(&bs, id & 0x3FFFF, 18, 1);
+        cst_push(&bs, rtr << 2, 3, 1);              // RTR, r1, r0
+    } else {
+        cst_push(&bs, ((id & CAN_SFF_MASK) << 3) | (rtr << 2), 14, 1);   // ID, RTR, IDE, r0
+    }
+    cst_push(&bs, dlc, 4, 1);
+    for (unsigned i = 0; i < data_bytes; i++) {
+        cst_push(&bs, f->data[i], 8, 1);
+    }
+    cst_push(&bs, bs.crc, 15, 0);
+    return bs.count + bs.stuff + 13;                // CRC delimiter, ACK slot and delimiter, EOF, IFS
+}
+
+/**
+ * @brief Byte tables for cst_frame_bits_fast()
+ *
+ * The stuffing state before a bit is the previous bit and its run length
+ * (1 to 4), packed as prev << 2 | (run - 1).
+ */
+typedef struct {
+    uint16_t crc[256];              /**< CRC-15 of each byte from a zero register */
+    uint8_t stuff[8][256];          /**< Per state and byte: stuff bits << 3 | next state */
+} cst_bit_tables_t;
+
+static inline void cst_bit_tables_init(cst_bit_tables_t *t) {
+    for (unsigned byte = 0; byte < 256; byte++) {
+        cst_bitstream_t bs = { 0, 0, 0, 0, 1 };
+        cst_push(&bs, byte, 8, 1);
+        t->crc[byte] = (uint16_t)bs.crc;
+        for (unsigned state = 0; state < 8; state++) {
+            cst_bitstream_t run = { 0, 0, 0, state >> 2, (state & 3) + 1 };
+            cst_push(&run, byte, 8, 0);
+            t->stuff[state][byte] = (uint8_t)(run.stuff << 3 | run.prev << 2 | (run.run - 1));
+        }
+    }
+}
+
+// cst_push() eight bits at a time through the tables, any leftover bits one by one
+static inline void cst_push_bytes(const cst_bit_tables_t *t, cst_bitstream_t *bs, uint32_t value, int width,
+                                  int crc) {
+    unsigned state = bs->prev << 2 | (bs->run - 1);
+    for (; width >= 8; width -= 8) {
+        unsigned byte = (value >> (width - 8)) & 0xFF;
+        if (crc) {
+            bs->crc = ((bs->crc << 8) & 0x7FFF) ^ t->crc[((bs->crc >> 7) ^ byte) & 0xFF];
+        }
+        uint8_t next = t->stuff[state][byte];
+        bs->stuff += next >> 3u;
+        state = next & 7u;
+        bs->count += 8;
+    }
+    bs->prev = state >> 2;
+    bs->run = (state & 3) + 1;
+    cst_push(bs, value, width, crc);
+}
+
+/**
+ * @brief cst_frame_bits() taking eight bits at a time
+ *
+ * The tables apply to any 8 bits of the stream, aligned or not, so only
+ * the odd bits of each field go one at a time.
+ */
+static inline unsigned cst_frame_bits_fast(const cst_bit_tables_t *t, const struct can_frame *f) {
+    canid_t id = f->can_id;
+    uint32_t rtr = (id & CAN_RTR_FLAG) != 0;
+    uint32_t dlc = f->can_dlc & 0xF;
+    unsigned data_bytes = rtr ? 0 : dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : dlc;
+
+    cst_bitstream_t bs = { 0, 1, 0, 0, 1 };
+    if (id & CAN_EFF_FLAG) {
+        // Base ID, SRR, IDE and the top of the extension; then the rest of it, RTR, r1, r0, DLC
+        cst_push_bytes(t, &bs, ((id & CAN_EFF_MASK) >> 18) << 4 | 3u << 2 | ((id >> 16) & 3), 15, 1);
+        cst_push_bytes(t, &bs, (id & 0xFFFF) << 7 | rtr << 6 | dlc, 23, 1);
+    } else {
+        cst_push_bytes(t, &bs, (id & CAN_SFF_MASK) << 7 | rtr << 6 | dlc, 18, 1);   // ID, RTR, IDE, r0, DLC
+    }
+    for (unsigned i = 0; i < data_bytes; i++) {
+        cst_push_bytes(t, &bs, f->data[i], 8, 1);
+    }
+    cst_push_bytes(t, &bs, bs.crc, 15, 0);
+    return bs.count + bs.stuff + 13;
+}
+
+/**
+ * @brief Process-local handle
+ */
+typedef struct {
+    cst_header_t *hdr;
+    cst_entry_t *entries;
+    size_t map_size;
+    int fd;
+    int writer;
+    char name[64];                  /**< shm name, empty for memfd */
+    uint64_t window_end_ns;         /**< Writer: end of the current load window */
+    uint64_t window_bits;           /**< Writer: bits in the current window */
+    struct can_frame rx[CST_BATCH];
+    struct mmsghdr rx_msgs[CST_BATCH];
+    struct iovec rx_iov[CST_BATCH];
+    char rx_ctrl[CST_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    cst_bit_tables_t tables;        /**< Writer: frame length lookup */
+} can_stats_t;
+
+// log2 microsecond bucket of a duration
+static inline unsigned cst_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    if (us < 2) {
+        return 0;
+    }
+    unsigned b = 63u - (unsigned)__builtin_clzll(us);
+    return b < CST_HIST_BUCKETS ? b : CST_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Upper bound of the bucket holding a fraction of a histogram's samples
+ *
+ * @return Nanoseconds, 0 for an empty histogram
+ */
+static inline uint64_t cst_hist_percentile(const uint64_t *hist, double fraction) {
+    uint64_t total = 0;
+    for (unsigned b = 0; b < CST_HIST_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(fraction * (double)total), seen = 0;
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    for (unsigned b = 0; b < CST_HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > rank) {
+            return (2ULL << b) * 1000;
+        }
+    }
+    return (2ULL << (CST_HIST_BUCKETS - 1)) * 1000;
+}
+
+// Map an initialized table from fd
+static inline int cst_map(can_stats_t *s, int fd, int writable) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(cst_header_t) + CST_IDS * sizeof(cst_entry_t)) {
+        errno = errno ? errno : EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    s->hdr = base;
+    s->entries = (cst_entry_t *)((char *)base + sizeof(cst_header_t));
+    s->map_size = (size_t)st.st_size;
+    s->fd = fd;
+    return 0;
+}
+
+/**
+ * @brief Create the table as its writer
+ *
+ * @param s Handle to initialize
+ * @param name POSIX shm name (e.g. "/can_stats"), or NULL for an anonymous memfd
+ * @param bitrate Bus bit rate in bit/s
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int cst_create(can_stats_t *s, const char *name, uint32_t bitrate) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    size_t size = sizeof(cst_header_t) + CST_IDS * sizeof(cst_entry_t);
+    int fd;
+    if (name) {
+        fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        snprintf(s->name, sizeof(s->name), "%s", name);
+    } else {
+        fd = (int)syscall(SYS_memfd_create, "can_stats", MFD_CLOEXEC);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) < 0 || cst_map(s, fd, 1) < 0) {
+        int saved = errno;
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        errno = saved;
+        return -1;
+    }
+
+    // Fresh pages are zero: every entry starts empty
+    for (unsigned i = 0; i < CST_IDS; i++) {
+        s->entries[i].counter_byte = CST_NO_COUNTER;
+    }
+    s->hdr->version = CST_VERSION;
+    s->hdr->entry_count = CST_IDS;
+    s->hdr->entry_size = sizeof(cst_entry_t);
+    s->hdr->bitrate = bitrate;
+    s->hdr->writer_pid = (uint32_t)getpid();
+    atomic_thread_fence(memory_order_release);
+    s->hdr->magic = CST_MAGIC;
+    s->writer = 1;
+
+    cst_bit_tables_init(&s->tables);
+    for (int i = 0; i < CST_BATCH; i++) {
+        s->rx_iov[i].iov_base = &s->rx[i];
+        s->rx_iov[i].iov_len = sizeof(struct can_frame);
+        s->rx_msgs[i].msg_hdr.msg_iov = &s->rx_iov[i];
+        s->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        s->rx_msgs[i].msg_hdr.msg_control = s->rx_ctrl[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Attach to a table read-only
+ *
+ * @param name POSIX shm name, or a file path such as /proc/<pid>/fd/<n>
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int cst_attach(can_stats_t *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    if (!name[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = strchr(name + 1, '/') ? open(name, O_RDONLY | O_CLOEXEC) : shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    errno = 0;
+    if (cst_map(s, fd, 0) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (s->hdr->magic != CST_MAGIC || s->hdr->version != CST_VERSION || s->hdr->entry_count != CST_IDS ||
+        s->hdr->entry_size != sizeof(cst_entry_t)) {
+        munmap(s->hdr, s->map_size);
+        close(fd);
+        s->hdr = NULL;
+        s->fd = -1;
+        errno = EPROTO;
+        return -1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return 0;
+}
+
+/**
+ * @brief Track a rolling message counter for one ID (writer)
+ *
+ * @param s Table
+ * @param id Standard CAN ID
+ * @param byte Payload byte holding the counter
+ * @param mask Counter bits within the byte: 0xFF for 8-bit, 0x0F for 4-bit
+ */
+static inline void cst_set_counter(can_stats_t *s, canid_t id, uint8_t byte, uint8_t mask) {
+    cst_entry_t *e = &s->entries[id & CAN_SFF_MASK];
+    e->counter_byte = byte;
+    e->counter_mask = mask;
+    e->counter_valid = 0;
+}
+
+// Close the load window(s) that ended before now
+static inline void cst_roll(can_stats_t *s, uint64_t now_ns) {
+    if (s->window_end_ns == 0) {
+        s->window_end_ns = now_ns + CST_WINDOW_NS;
+        return;
+    }
+    uint64_t capacity = s->hdr->bitrate ? s->hdr->bitrate : 1;
+    unsigned permille = (unsigned)(s->window_bits * 1000 / capacity);
+    if (now_ns >= s->window_end_ns + CST_WINDOW_NS) {
+        permille = 0;               // A whole window passed with nothing on the bus
+    }
+    atomic_store_explicit(&s->hdr->load_permille, permille, memory_order_relaxed);
+    if (s->window_bits * 1000 / capacity > atomic_load_explicit(&s->hdr->peak_permille, memory_order_relaxed)) {
+        atomic_store_explicit(&s->hdr->peak_permille, (unsigned)(s->window_bits * 1000 / capacity),
+                              memory_order_relaxed);
+    }
+    s->window_bits = 0;
+    s->window_end_ns += (now_ns - s->window_end_ns) / CST_WINDOW_NS * CST_WINDOW_NS + CST_WINDOW_NS;
+}
+
+/**
+ * @brief Account one received frame (writer)
+ *
+ * @param s Table
+ * @param f Frame
+ * @param stamp_ns Receive time, CLOCK_REALTIME
+ */
+static inline void cst_record(can_stats_t *s, const struct can_frame *f, uint64_t stamp_ns) {
+    cst_header_t *h = s->hdr;
+    unsigned bits = cst_frame_bits_fast(&s->tables, f);
+    if (stamp_ns >= s->window_end_ns) {
+        cst_roll(s, stamp_ns);
+    }
+    s->window_bits += bits;
+    // Single writer: plain load and store, no read-modify-write
+    atomic_store_explicit(&h->frames, atomic_load_explicit(&h->frames, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&h->bits, atomic_load_explicit(&h->bits, memory_order_relaxed) + bits,
+                          memory_order_relaxed);
+    if (f->can_id & (CAN_ERR_FLAG | CAN_EFF_FLAG)) {
+        atomic_ullong *counter = f->can_id & CAN_ERR_FLAG ? &h->error_frames : &h->extended_frames;
+        atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+
+    cst_entry_t *e = &s->entries[f->can_id & CAN_SFF_MASK];
+    unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (e->frames == 0) {
+        e->first_ns = stamp_ns;
+    } else if (stamp_ns > e->last_ns) {
+        uint64_t gap = stamp_ns - e->last_ns;
+        if (e->gaps == 0 || gap < e->gap_min_ns) {
+            e->gap_min_ns = gap;
+        }
+        if (gap > e->gap_max_ns) {
+            e->gap_max_ns = gap;
+        }
+        e->gap_sum_ns += gap;
+        e->gap_hist[cst_bucket(gap)]++;
+        if (e->gaps == 0) {
+            e->period_ns = gap;
+        } else {
+            uint64_t deviation = gap > e->period_ns ? gap - e->period_ns : e->period_ns - gap;
+            e->jitter_hist[cst_bucket(deviation)]++;
+            e->period_ns = gap > e->period_ns ? e->period_ns + (gap - e->period_ns) / 8
+                                               : e->period_ns - (e->period_ns - gap) / 8;
+        }
+        e->gaps++;
+    }
+    e->last_ns = stamp_ns;
+    e->frames++;
+    e->bits += bits;
+
+    unsigned dlc = f->can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : f->can_dlc;
+    e->bytes += dlc;
+    if (e->counter_byte < dlc && !(f->can_id & CAN_RTR_FLAG)) {
+        uint8_t counter = f->data[e->counter_byte] & e->counter_mask;
+        if (e->counter_valid && counter != e->last_counter) {
+            // A repeated value is a retransmission, not a gap
+            e->counter_missed += (uint8_t)((counter - e->last_counter - 1) & e->counter_mask);
+        }
+        e->last_counter = counter;
+        e->counter_valid = 1;
+    }
+
+    atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Close load windows while the bus is idle (writer)
+ *
+ * Frames close windows as they arrive; call this periodically as well so
+ * the load drops to zero when the bus goes quiet.
+ */
+static inline void cst_tick(can_stats_t *s, uint64_t now_ns) {
+    if (now_ns >= s->window_end_ns) {
+        cst_roll(s, now_ns);
+    }
+}
+
+/**
+ * @brief Read every pending frame from a CAN socket into the table (writer)
+ *
+ * The socket should be non-blocking, unfiltered and have SO_TIMESTAMPNS
+ * enabled. Frames without a kernel timestamp are stamped with the time
+ * they were read.
+ *
+ * @return Frames read, or -1 if the socket failed
+ */
+static inline int cst_drain(can_stats_t *s, int fd) {
+    int total = 0;
+    for (;;) {
+        for (int i = 0; i < CST_BATCH; i++) {
+            s->rx_msgs[i].msg_hdr.msg_controllen = sizeof(s->rx_ctrl[i]);
+        }
+        int n = recvmmsg(fd, s->rx_msgs, CST_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? total : -1;
+        }
+        uint64_t now = 0;
+        for (int i = 0; i < n; i++) {
+            if (s->rx_msgs[i].msg_len != sizeof(struct can_frame)) {
+                continue;
+            }
+            uint64_t stamp = cgw_rx_stamp(&s->rx_msgs[i].msg_hdr);
+            if (stamp == 0) {
+                stamp = now ? now : (now = cgw_realtime_ns());
+            }
+            cst_record(s, &s->rx[i], stamp);
+        }
+        total += n;
+        if (n < CST_BATCH) {
+            return total;
+        }
+    }
+}
+
+/**
+ * @brief Consistent copy of one ID's entry (reader or writer)
+ *
+ * @return 1 if the ID has been seen, 0 if not
+ */
+static inline int cst_read(const can_stats_t *s, canid_t id, cst_entry_t *out) {
+    cst_entry_t *e = &s->entries[id & CAN_SFF_MASK];
+    for (;;) {
+        unsigned before = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (before & 1) {
+            continue;               // Being updated
+        }
+        memcpy(out, e, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == before) {
+            return out->frames > 0;
+        }
+    }
+}
+
+// An entry copied for printing, with its ID
+typedef struct {
+    cst_entry_t entry;
+    canid_t id;
+} cst_row_t;
+
+// Order rows by bits on the wire, busiest first
+static inline int cst_compare_bits(const void *a, const void *b) {
+    const cst_row_t *x = a, *y = b;
+    return x->entry.bits < y->entry.bits ? 1 : x->entry.bits > y->entry.bits ? -1 : 0;
+}
+
+/**
+ * @brief Print the bus load and the busiest IDs
+ *
+ * @param s Table
+ * @param top Number of IDs to list
+ */
+static inline void cst_print(const can_stats_t *s, int top) {
+    const cst_header_t *h = s->hdr;
+    uint64_t total_bits = atomic_load_explicit(&h->bits, memory_order_relaxed);
+    printf("Bus load %.1f%% (peak %.1f%%) at %u bit/s: %llu frames, %llu extended, %llu error\n",
+           atomic_load_explicit(&h->load_permille, memory_order_relaxed) / 10.0,
+           atomic_load_explicit(&h->peak_permille, memory_order_relaxed) / 10.0, h->bitrate,
+           (unsigned long long)atomic_load_explicit(&h->frames, memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&h->extended_frames, memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&h->error_frames, memory_order_relaxed));
+
+    cst_row_t *rows = malloc(CST_IDS * sizeof(cst_row_t));
+    if (!rows) {
+        return;
+    }
+    int count = 0;
+    for (canid_t id = 0; id < CST_IDS; id++) {
+        if (cst_read(s, id, &rows[count].entry)) {
+            rows[count++].id = id;
+        }
+    }
+    qsort(rows, (size_t)count, sizeof(cst_row_t), cst_compare_bits);
+
+    printf("%5s %10s %7s %10s %10s %10s %10s %8s\n", "ID", "frames", "share", "period", "min gap", "max gap",
+           "jitter p99", "missed");
+    for (int i = 0; i < count && i < top; i++) {
+        const cst_entry_t *e = &rows[i].entry;
+        double mean_ms = e->gaps ? (double)e->gap_sum_ns / (double)e->gaps / 1e6 : 0.0;
+        char missed[24];
+        if (e->counter_byte == CST_NO_COUNTER) {
+            snprintf(missed, sizeof(missed), "-");
+        } else {
+            snprintf(missed, sizeof(missed), "%llu", (unsigned long long)e->counter_missed);
+        }
+        printf("0x%03X %10llu %6.2f%% %8.2fms %8.2fms %8.2fms %8.2fms %8s\n", rows[i].id,
+               (unsigned long long)e->frames, total_bits ? 100.0 * (double)e->bits / (double)total_bits : 0.0,
+               mean_ms, (double)e->gap_min_ns / 1e6, (double)e->gap_max_ns / 1e6,
+               (double)cst_hist_percentile(e->jitter_hist, 0.99) / 1e6, missed);
+    }
+    free(rows);
+}
+
+/**
+ * @brief Unmap the table; the writer also removes a named table
+ */
+static inline void cst_close(can_stats_t *s) {
+    if (s->hdr) {
+        munmap(s->hdr, s->map_size);
+        s->hdr = NULL;
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    if (s->writer && s->name[0]) {
+        shm_unlink(s->name);
+    }
+}
+
+#endif /* CAN_STATS_H */
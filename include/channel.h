@@ -0,0 +1,200 @@
+/**
+ * @file channel.h
+ * @brief MPMC channel with an eventfd for epoll-driven receivers
+ *
+ * A channel is a bounded lock-free MPMC queue plus an eventfd. Senders only
+ * write the eventfd on the empty to non-empty transition (tracked by a
+ * "signalled" flag), so a burst of messages costs one system call. A
+ * reactor registers channel_fd() with epoll and, when it becomes readable,
+ * calls channel_ack() followed by channel_recv() until it returns NULL.
+ * Threads without a reactor can block in channel_recv_wait().
+ *
+ * Closing a channel wakes every receiver; channel_recv_wait() returns NULL
+ * with errno EPIPE once the channel is closed and drained.
+ */
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include "mpmc_queue.h"
+
+/**
+ * @brief Channel of opaque, non-NULL pointers
+ */
+typedef struct {
+    mpmc_queue_t queue;     /**< Message storage */
+    int efd;                /**< Readable while messages may be pending */
+    atomic_int signalled;   /**< Eventfd written and not yet acknowledged */
+    atomic_int closed;      /**< Set by channel_close() */
+} channel_t;
+
+/**
+ * @brief Create a channel
+ *
+ * @param ch Channel to initialize
+ * @param capacity Maximum queued messages (rounded up to a power of 2)
+ * @return 0 on success, -1 on failure
+ */
+static inline int channel_init(channel_t *ch, size_t capacity) {
+    if (mpmc_queue_init(&ch->queue, capacity) < 0) {
+        return -1;
+    }
+    ch->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ch->efd < 0) {
+        mpmc_queue_destroy(&ch->queue);
+        return -1;
+    }
+    atomic_init(&ch->signalled, 0);
+    atomic_init(&ch->closed, 0);
+    return 0;
+}
+
+/**
+ * @brief Release channel resources
+ */
+static inline void channel_destroy(channel_t *ch) {
+    if (ch->efd >= 0) {
+        close(ch->efd);
+        ch->efd = -1;
+    }
+    mpmc_queue_destroy(&ch->queue);
+}
+
+/**
+ * @brief Descriptor to register with epoll/poll for EPOLLIN
+ */
+static inline int channel_fd(const channel_t *ch) {
+    return ch->efd;
+}
+
+/**
+ * @brief Wake receivers unless a wakeup is already pending
+ */
+static inline void channel_signal(channel_t *ch) {
+    if (atomic_exchange(&ch->signalled, 1) == 0) {
+        uint64_t one = 1;
+        ssize_t res = write(ch->efd, &one, sizeof(one));
+        (void)res;
+    }
+}
+
+/**
+ * @brief Send a message
+ *
+ * @param ch Channel
+ * @param item Non-NULL message
+ * @return 0 on success, -1 with errno EAGAIN if full or EPIPE if closed
+ */
+static inline int channel_send(channel_t *ch, void *item) {
+    if (atomic_load_explicit(&ch->closed, memory_order_relaxed)) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (mpmc_queue_push(&ch->queue, item) < 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    channel_signal(ch);
+    return 0;
+}
+
+/**
+ * @brief Take a message without blocking
+ *
+ * @return Message, or NULL if none is queued
+ */
+static inline void *channel_recv(channel_t *ch) {
+    return mpmc_queue_pop(&ch->queue);
+}
+
+/**
+ * @brief Acknowledge a wakeup before draining
+ *
+ * Must be called before the drain loop: clearing the flag first guarantees
+ * that a message sent after the last successful channel_recv() rewrites the
+ * eventfd instead of being missed.
+ */
+static inline void channel_ack(channel_t *ch) {
+    uint64_t value;
+    ssize_t res = read(ch->efd, &value, sizeof(value));
+    (void)res;
+    atomic_store(&ch->signalled, 0);
+    // Keep other receivers awake until the close is observed by all
+    if (atomic_load(&ch->closed)) {
+        channel_signal(ch);
+    }
+}
+
+/**
+ * @brief Receive a message, blocking up to timeout_ms
+ *
+ * @param ch Channel
+ * @param timeout_ms Milliseconds to wait, -1 for no limit
+ * @return Message, or NULL with errno ETIMEDOUT or EPIPE (closed and empty)
+ */
+static inline void *channel_recv_wait(channel_t *ch, int timeout_ms) {
+    int spun = 0;
+    for (;;) {
+        void *item = channel_recv(ch);
+        if (item) {
+            return item;
+        }
+        if (atomic_load(&ch->closed)) {
+            item = channel_recv(ch);
+            if (!item) {
+                errno = EPIPE;
+            }
+            return item;
+        }
+
+        // Give running senders a chance to batch up work before sleeping
+        if (!spun) {
+            spun = 1;
+            sched_yield();
+            continue;
+        }
+
+        struct pollfd pfd = { .fd = ch->efd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            return NULL;
+        }
+        if (ready == 0) {
+            item = channel_recv(ch);
+            if (!item) {
+                errno = ETIMEDOUT;
+            }
+            return item;
+        }
+        if (ready > 0) {
+            channel_ack(ch);
+        }
+    }
+}
+
+/**
+ * @brief Close the channel; queued messages can still be received
+ */
+static inline void channel_close(channel_t *ch) {
+    atomic_store(&ch->closed, 1);
+    channel_signal(ch);
+}
+
+/**
+ * @brief Check whether the channel has been closed
+ */
+static inline int channel_is_closed(channel_t *ch) {
+    return atomic_load(&ch->closed);
+}
+
+#endif /* CHANNEL_H */
@@ -0,0 +1,343 @@
+/**
+ * @file command_protocol.h
+ * @brief Line-based command protocol with perfect-hash dispatch and pipelining
+ *
+ * Each command is one line: a name, then optional arguments after the
+ * first space. The reply is the handler's text followed by "\r\n> ", so a
+ * client that waits for the prompt before each command sees the same bytes
+ * as before.
+ *
+ * Dispatch: cmd_table_build() searches for a hash seed under which every
+ * command name lands in its own slot of a power-of-two table. A lookup is
+ * one hash of the name, one slot, and one memcmp() to reject names that
+ * are not commands; there is no scan.
+ *
+ * Pipelining: a session (cmd_session_t) takes bytes as they are read,
+ * whatever their framing. A read may hold many commands, and a command
+ * may be split across reads. Replies to every complete line go into one
+ * output buffer. The caller feeds everything it has read, then calls
+ * cmd_session_flush() once, which hands the batch to the flush callback.
+ * The buffer is flushed earlier only when it could not hold another reply.
+ * Over TLS this means one SSL_write(), and usually one record, per read
+ * batch rather than per command.
+ *
+ * Handlers write their reply into a cmd_out_t instead of returning a
+ * static buffer, so sessions on different threads do not share state.
+ */
+
+#ifndef COMMAND_PROTOCOL_H
+#define COMMAND_PROTOCOL_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define CMD_MAX_LINE 1024           /**< Longest command line, terminator included */
+#define CMD_MAX_REPLY 1024          /**< Longest reply text from one handler */
+#define CMD_PROMPT "\r\n> "
+#define CMD_OUT_SIZE 65536          /**< Reply batch; flushed early only when nearly full */
+#define CMD_TABLE_SLOTS 64          /**< Largest hash table: up to 32 commands */
+#define CMD_SEED_TRIES 100000
+
+enum { CMD_CONTINUE = 0, CMD_CLOSE = 1 };
+
+/**
+ * @brief Reply text being built
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int overflow;                   /**< Set if an append did not fit; the reply is truncated */
+} cmd_out_t;
+
+/**
+ * @brief Writes the reply for one command; returns CMD_CONTINUE or CMD_CLOSE
+ *
+ * args is NULL when the line holds only the command name.
+ */
+typedef int (*cmd_handler_fn)(void *ctx, const char *args, cmd_out_t *out);
+
+/**
+ * @brief One command
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+    cmd_handler_fn handler;
+} cmd_def_t;
+
+/**
+ * @brief Perfect-hash dispatch table
+ */
+typedef struct {
+    const cmd_def_t *slots[CMD_TABLE_SLOTS];
+    uint8_t name_len[CMD_TABLE_SLOTS];
+    uint32_t seed;
+    uint32_t mask;
+    size_t count;
+} cmd_table_t;
+
+/**
+ * @brief Sends a batch of replies; returns -1 if the connection failed
+ */
+typedef int (*cmd_flush_fn)(void *io, const char *data, size_t len);
+
+/**
+ * @brief Per-connection protocol state
+ */
+typedef struct {
+    const cmd_table_t *table;
+    void *ctx;                      /**< Passed to handlers */
+    cmd_flush_fn flush;
+    void *io;                       /**< Passed to flush */
+    char line[CMD_MAX_LINE];        /**< Partial line carried between reads */
+    size_t line_len;
+    int discarding;                 /**< Skipping the rest of an over-long line */
+    int closed;
+    uint64_t commands;
+    uint64_t flushes;
+    size_t out_len;
+    char out_buf[CMD_OUT_SIZE];     /**< Replies not yet flushed; not cleared by init */
+} cmd_session_t;
+
+/**
+ * @brief Append formatted text to a reply
+ */
+__attribute__((format(printf, 2, 3)))
+static inline void cmd_printf(cmd_out_t *out, const char *fmt, ...) {
+    if (out->overflow) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out->data + out->len, out->cap - out->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= out->cap - out->len) {
+        out->len = out->cap - 1;    // vsnprintf() kept what fit
+        out->overflow = 1;
+        return;
+    }
+    out->len += (size_t)n;
+}
+
+/**
+ * @brief Append bytes to a reply
+ */
+static inline void cmd_write(cmd_out_t *out, const char *data, size_t len) {
+    if (out->overflow) {
+        return;
+    }
+    if (len >= out->cap - out->len) {
+        len = out->cap - out->len - 1;
+        out->overflow = 1;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+// FNV-1a seeded, with a final mix so the low bits depend on every byte
+static inline uint32_t cmd_hash(const char *name, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+ * @brief Build a collision-free table for a set of commands
+ *
+ * The table has the smallest power-of-two size at least twice the number
+ * of commands, so a seed is found within a few tries.
+ *
+ * @return 0 on success, -1 if the names are duplicated, too many or too long
+ */
+static inline int cmd_table_build(cmd_table_t *t, const cmd_def_t *defs, size_t count) {
+    memset(t, 0, sizeof(*t));
+    size_t size = 8;
+    while (size < 2 * count) {
+        size *= 2;
+    }
+    if (size > CMD_TABLE_SLOTS) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(defs[i].name) == 0 || strlen(defs[i].name) > UINT8_MAX) {
+            return -1;
+        }
+    }
+    t->mask = (uint32_t)(size - 1);
+    t->count = count;
+
+    for (uint32_t seed = 1; seed <= CMD_SEED_TRIES; seed++) {
+        memset(t->slots, 0, sizeof(t->slots));
+        size_t i = 0;
+        for (; i < count; i++) {
+            size_t len = strlen(defs[i].name);
+            uint32_t slot = cmd_hash(defs[i].name, len, seed) & t->mask;
+            if (t->slots[slot]) {
+                break;
+            }
+            t->slots[slot] = &defs[i];
+            t->name_len[slot] = (uint8_t)len;
+        }
+        if (i == count) {
+            t->seed = seed;
+            return 0;
+        }
+    }
+    return -1;                      // Only duplicates fail every seed
+}
+
+/**
+ * @brief Command for a name, NULL if there is none
+ */
+static inline const cmd_def_t *cmd_lookup(const cmd_table_t *t, const char *name, size_t len) {
+    uint32_t slot = cmd_hash(name, len, t->seed) & t->mask;
+    const cmd_def_t *def = t->slots[slot];
+    if (!def || t->name_len[slot] != len || memcmp(def->name, name, len) != 0) {
+        return NULL;
+    }
+    return def;
+}
+
+static inline void cmd_session_init(cmd_session_t *s, const cmd_table_t *table, void *ctx,
+                                    cmd_flush_fn flush, void *io) {
+    memset(s, 0, offsetof(cmd_session_t, out_buf));
+    s->table = table;
+    s->ctx = ctx;
+    s->flush = flush;
+    s->io = io;
+}
+
+/**
+ * @brief Send the replies batched so far
+ *
+ * @return 0 on success, -1 if the flush callback failed
+ */
+static inline int cmd_session_flush(cmd_session_t *s) {
+    if (s->out_len == 0) {
+        return 0;
+    }
+    s->flushes++;
+    int rc = s->flush(s->io, s->out_buf, s->out_len);
+    s->out_len = 0;
+    return rc;
+}
+
+// Room for one more reply in the batch, flushing it first if needed; the reply starts at out
+static inline int cmd_session_reserve(cmd_session_t *s, cmd_out_t *out) {
+    if (CMD_OUT_SIZE - s->out_len < CMD_MAX_REPLY + sizeof(CMD_PROMPT) && cmd_session_flush(s) < 0) {
+        return -1;
+    }
+    out->data = s->out_buf + s->out_len;
+    out->len = 0;
+    out->cap = CMD_MAX_REPLY;
+    out->overflow = 0;
+    return 0;
+}
+
+// Close a reply with the prompt and add it to the batch
+static inline void cmd_session_commit(cmd_session_t *s, const cmd_out_t *out) {
+    s->out_len += out->len;
+    memcpy(s->out_buf + s->out_len, CMD_PROMPT, sizeof(CMD_PROMPT) - 1);
+    s->out_len += sizeof(CMD_PROMPT) - 1;
+}
+
+// Run one complete line (terminator stripped, NUL-terminated) and batch its reply
+static inline int cmd_session_line(cmd_session_t *s, char *line) {
+    cmd_out_t out;
+    if (cmd_session_reserve(s, &out) < 0) {
+        return -1;
+    }
+    int rc = CMD_CONTINUE;
+
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    if (*line) {
+        char *args = line;
+        while (*args && !isspace((unsigned char)*args)) {
+            args++;
+        }
+        size_t name_len = (size_t)(args - line);
+        while (isspace((unsigned char)*args)) {
+            args++;
+        }
+        const cmd_def_t *def = cmd_lookup(s->table, line, name_len);
+        s->commands++;
+        if (def) {
+            rc = def->handler(s->ctx, *args ? args : NULL, &out);
+        } else {
+            cmd_printf(&out, "Unknown command: %.*s\nType 'help' for available commands", (int)name_len, line);
+        }
+    }
+    cmd_session_commit(s, &out);
+    return rc;
+}
+
+/**
+ * @brief Process bytes read from the connection
+ *
+ * Runs every complete line in order and batches the replies; call
+ * cmd_session_flush() when no more input is waiting. A trailing partial
+ * line is kept for the next call. A line longer than CMD_MAX_LINE gets an
+ * error reply and is skipped. After a handler returns CMD_CLOSE, the rest
+ * of the input is ignored.
+ *
+ * @return CMD_CONTINUE, CMD_CLOSE, or -1 if an early flush failed
+ */
+static inline int cmd_session_feed(cmd_session_t *s, const char *data, size_t len) {
+    int rc = CMD_CONTINUE;
+    while (len > 0 && !s->closed) {
+        const char *nl = memchr(data, '\n', len);
+        size_t take = nl ? (size_t)(nl - data) : len;
+
+        if (s->discarding) {
+            // Part of an over-long line: drop it, answer once it ends
+        } else if (s->line_len + take >= CMD_MAX_LINE) {
+            s->discarding = 1;
+            s->line_len = 0;
+        } else {
+            memcpy(s->line + s->line_len, data, take);
+            s->line_len += take;
+        }
+        if (nl) {
+            take++;
+            if (s->discarding) {
+                s->discarding = 0;
+                cmd_out_t out;
+                if (cmd_session_reserve(s, &out) < 0) {
+                    return -1;
+                }
+                cmd_printf(&out, "Error: Line too long (limit %d bytes)", CMD_MAX_LINE - 1);
+                cmd_session_commit(s, &out);
+            } else {
+                if (s->line_len > 0 && s->line[s->line_len - 1] == '\r') {
+                    s->line_len--;
+                }
+                s->line[s->line_len] = '\0';
+                s->line_len = 0;
+                rc = cmd_session_line(s, s->line);
+                if (rc < 0) {
+                    return -1;
+                }
+                if (rc == CMD_CLOSE) {
+                    s->closed = 1;
+                }
+            }
+        }
+        data += take;
+        len -= take;
+    }
+    return s->closed ? CMD_CLOSE : CMD_CONTINUE;
+}
+
+#endif // COMMAND_PROTOCOL_H
@@ -0,0 +1,200 @@
+/**
+ * @file conflator.h
+ * @brief Latest-value conflation between a fast producer and a slow consumer
+ *
+ * The producer publishes updates keyed by a small integer (symbol index,
+ * sensor slot). The conflator holds only the latest value per key, plus a
+ * queue of keys that changed since the consumer last read them. A key is in
+ * that queue at most once. An update to a key that is already queued
+ * overwrites the value and is counted as conflated.
+ *
+ * So memory is fixed at one value per key whatever the speed difference.
+ * The producer never blocks and never fails. A consumer that falls behind
+ * sees fewer, newer updates instead of a growing backlog or arbitrary
+ * losses, and always the latest value of every key that changed. Keys are
+ * delivered in the order they first changed, so a busy key cannot starve
+ * the others.
+ *
+ * One producer thread and one consumer thread. Values are published through
+ * a per-key sequence stamp, like shm_ring.h: odd while being written. The
+ * consumer retries a copy that raced with a write.
+ */
+
+#ifndef CONFLATOR_H
+#define CONFLATOR_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define CONFLATOR_CACHE_LINE 64
+
+/**
+ * @brief Per-key slot header; the value follows
+ */
+typedef struct {
+    atomic_uint stamp;                  /**< Odd while the producer writes the value */
+    atomic_uint queued;                 /**< Set while the key is in the dirty queue */
+    unsigned read_stamp;                /**< Consumer: stamp of the value last delivered */
+    unsigned reserved;
+} conflator_slot_t;
+
+/**
+ * @brief Conflation table
+ */
+typedef struct {
+    unsigned char *slots;               /**< Key slots, cache-line strided */
+    size_t stride;                      /**< Bytes per slot */
+    uint32_t capacity;                  /**< Number of keys */
+    uint32_t value_size;                /**< Bytes per value */
+    uint32_t *dirty;                    /**< Queue of changed keys */
+    uint32_t mask;                      /**< Queue size - 1 */
+
+    _Alignas(CONFLATOR_CACHE_LINE) atomic_ullong head;  /**< Producer: keys queued */
+    atomic_ullong published;            /**< Updates published */
+    atomic_ullong conflated;            /**< Updates merged into another delivery */
+
+    _Alignas(CONFLATOR_CACHE_LINE) atomic_ullong tail;  /**< Consumer: keys taken */
+    atomic_ullong delivered;            /**< Values handed to the consumer */
+} conflator_t;
+
+// Slot for key
+static inline conflator_slot_t *conflator_slot(const conflator_t *c, uint32_t key) {
+    return (conflator_slot_t *)(c->slots + (size_t)key * c->stride);
+}
+
+/**
+ * @brief Create a conflator for keys 0..capacity-1
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int conflator_init(conflator_t *c, uint32_t capacity, uint32_t value_size) {
+    memset(c, 0, sizeof(*c));
+    if (capacity == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t queue = 1;
+    while (queue < capacity) {
+        queue <<= 1;
+    }
+    c->stride = (sizeof(conflator_slot_t) + value_size + CONFLATOR_CACHE_LINE - 1) &
+                ~(size_t)(CONFLATOR_CACHE_LINE - 1);
+    c->slots = aligned_alloc(CONFLATOR_CACHE_LINE, c->stride * capacity);
+    c->dirty = malloc(queue * sizeof(uint32_t));
+    if (!c->slots || !c->dirty) {
+        free(c->slots);
+        free(c->dirty);
+        c->slots = NULL;
+        c->dirty = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(c->slots, 0, c->stride * capacity);
+    c->capacity = capacity;
+    c->value_size = value_size;
+    c->mask = queue - 1;
+    return 0;
+}
+
+/**
+ * @brief Publish the latest value for key (producer)
+ *
+ * @return 1 if the key was queued, 0 if the update was conflated into one
+ *         the consumer has not read yet, -1 if the key is out of range
+ */
+static inline int conflator_publish(conflator_t *c, uint32_t key, const void *value) {
+    if (key >= c->capacity) {
+        return -1;
+    }
+    conflator_slot_t *slot = conflator_slot(c, key);
+
+    unsigned stamp = atomic_load_explicit(&slot->stamp, memory_order_relaxed);
+    atomic_store_explicit(&slot->stamp, stamp + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(slot + 1, value, c->value_size);
+    atomic_store_explicit(&slot->stamp, stamp + 2, memory_order_release);
+    atomic_fetch_add_explicit(&c->published, 1, memory_order_relaxed);
+
+    // The consumer clears queued before reading, so a set flag means this
+    // value will still be read
+    if (atomic_exchange_explicit(&slot->queued, 1, memory_order_acq_rel)) {
+        atomic_fetch_add_explicit(&c->conflated, 1, memory_order_relaxed);
+        return 0;
+    }
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    c->dirty[head & c->mask] = key;
+    atomic_store_explicit(&c->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Take the next changed key and its latest value (consumer)
+ *
+ * @param c Conflator
+ * @param key Set to the key
+ * @param value Receives value_size bytes
+ * @return 1 if a value was delivered, 0 if nothing changed
+ */
+static inline int conflator_poll(conflator_t *c, uint32_t *key, void *value) {
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&c->head, memory_order_acquire)) {
+            return 0;
+        }
+        uint32_t k = c->dirty[tail & c->mask];
+        atomic_store_explicit(&c->tail, tail + 1, memory_order_release);
+
+        // Later updates re-queue the key from here on. The exchange pairs with
+        // the producer's, so every update it saw as conflated is visible below.
+        conflator_slot_t *slot = conflator_slot(c, k);
+        atomic_exchange_explicit(&slot->queued, 0, memory_order_acq_rel);
+
+        unsigned before;
+        for (;;) {
+            before = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            memcpy(value, slot + 1, c->value_size);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->stamp, memory_order_relaxed) == before) {
+                break;
+            }
+        }
+
+        // A value read by the previous delivery of this key, just before its
+        // producer re-queued it, is not delivered twice
+        if (before == slot->read_stamp) {
+            atomic_fetch_add_explicit(&c->conflated, 1, memory_order_relaxed);
+            continue;
+        }
+        slot->read_stamp = before;
+        atomic_fetch_add_explicit(&c->delivered, 1, memory_order_relaxed);
+        *key = k;
+        return 1;
+    }
+}
+
+/**
+ * @brief Keys waiting for the consumer
+ */
+static inline uint64_t conflator_pending(const conflator_t *c) {
+    return atomic_load_explicit(&c->head, memory_order_acquire) -
+           atomic_load_explicit(&c->tail, memory_order_acquire);
+}
+
+/**
+ * @brief Free the table
+ */
+static inline void conflator_destroy(conflator_t *c) {
+    free(c->slots);
+    free(c->dirty);
+    c->slots = NULL;
+    c->dirty = NULL;
+}
+
+#endif /* CONFLATOR_H */
@@ -0,0 +1,428 @@
+/**
+ * @file coroutine.h
+ * @brief Stackless coroutines over an epoll event loop
+ *
+ * This header provides protothread-style coroutines (Duff's device on
+ * __LINE__) scheduled by a small epoll loop. Handlers are written as
+ * straight-line code that calls CO_READ/CO_WRITE/CO_SLEEP; when an operation
+ * would block, the coroutine records its resume point, registers interest
+ * with the loop and returns. Switching costs a function return plus a
+ * switch jump, and a coroutine needs no stack of its own.
+ *
+ * Rules that come with being stackless:
+ * - Local variables do not survive a suspension point. Keep state that must
+ *   persist in the structure passed as the task argument.
+ * - Only one CO_* suspension macro may appear on a single source line.
+ * - Suspension macros may only be used in the coroutine function itself,
+ *   not in functions it calls, and not inside another switch statement.
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include "thread_pool.h"
+
+#define CO_MAX_EVENTS 256    /**< epoll events fetched per loop iteration */
+
+/**
+ * @brief Marks the intentional fall-through into a resume label
+ */
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define CO_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define CO_FALLTHROUGH ((void)0)
+#endif
+
+/**
+ * @brief Coroutine function return codes
+ */
+enum {
+    CO_DONE = 0,     /**< Coroutine finished */
+    CO_WAITING = 1   /**< Coroutine suspended */
+};
+
+struct co_task;
+struct co_loop;
+
+/** Coroutine body */
+typedef int (*co_fn)(struct co_task *co);
+
+/** Called once after a coroutine finishes */
+typedef void (*co_cleanup_fn)(struct co_task *co);
+
+/**
+ * @brief Coroutine control block (caller-owned, usually embedded)
+ */
+typedef struct co_task {
+    int line;                  /**< Resume point (0 = start) */
+    co_fn fn;                  /**< Coroutine body */
+    co_cleanup_fn cleanup;     /**< Completion callback (may be NULL) */
+    void *arg;                 /**< User state */
+    struct co_loop *loop;      /**< Owning loop */
+    int fd;                    /**< fd currently registered with epoll, -1 if none */
+    uint64_t wake_ns;          /**< Deadline while sleeping */
+    struct co_task *next;      /**< Ready queue link */
+} co_task_t;
+
+/**
+ * @brief Event loop scheduling coroutines
+ */
+typedef struct co_loop {
+    int epfd;                  /**< epoll instance */
+    co_task_t *ready_head;     /**< Tasks runnable without waiting */
+    co_task_t *ready_tail;
+    co_task_t **sleepers;      /**< Min-heap ordered by wake_ns */
+    size_t num_sleepers;
+    size_t sleepers_cap;
+    int active;                /**< Coroutines not yet finished */
+    uint64_t resumes;          /**< Total coroutine resumptions */
+} co_loop_t;
+
+/**
+ * @brief Monotonic time in nanoseconds
+ */
+static inline uint64_t co_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Start a coroutine body
+ */
+#define CO_BEGIN(co) switch ((co)->line) { case 0:
+
+/**
+ * @brief End a coroutine body
+ */
+#define CO_END(co) } (co)->line = -1; return CO_DONE
+
+/**
+ * @brief Finish the coroutine immediately
+ */
+#define CO_EXIT(co) do { (co)->line = -1; return CO_DONE; } while (0)
+
+/**
+ * @brief Give other ready coroutines a chance to run
+ */
+#define CO_YIELD(co) do {                                                 \
+        (co)->line = __LINE__; co_ready((co)); return CO_WAITING;         \
+        case __LINE__:;                                                   \
+    } while (0)
+
+/**
+ * @brief Suspend without rescheduling; something else must call co_ready()
+ */
+#define CO_SUSPEND(co) do {                                               \
+        (co)->line = __LINE__; return CO_WAITING;                         \
+        case __LINE__:;                                                   \
+    } while (0)
+
+/**
+ * @brief Suspend until fd reports any of the given epoll events
+ */
+#define CO_WAIT_FD(co, fd, events) do {                                   \
+        (co)->line = __LINE__;                                            \
+        if (co_wait_fd((co), (fd), (events)) == 0) return CO_WAITING;     \
+        CO_FALLTHROUGH; case __LINE__:;                                   \
+    } while (0)
+
+/**
+ * @brief Read from a non-blocking fd, suspending while it would block
+ *
+ * @param res ssize_t lvalue receiving the read() result
+ */
+#define CO_READ(co, fd, buf, len, res) do {                               \
+        (co)->line = __LINE__; CO_FALLTHROUGH; case __LINE__:             \
+        (res) = read((fd), (buf), (len));                                 \
+        if ((res) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {     \
+            if (co_wait_fd((co), (fd), EPOLLIN) == 0) return CO_WAITING;  \
+            (res) = -1;                                                   \
+        }                                                                 \
+    } while (0)
+
+/**
+ * @brief Write to a non-blocking fd, suspending while it would block
+ *
+ * Performs a single write; callers loop for partial writes.
+ *
+ * @param res ssize_t lvalue receiving the write() result
+ */
+#define CO_WRITE(co, fd, buf, len, res) do {                              \
+        (co)->line = __LINE__; CO_FALLTHROUGH; case __LINE__:             \
+        (res) = write((fd), (buf), (len));                                \
+        if ((res) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {     \
+            if (co_wait_fd((co), (fd), EPOLLOUT) == 0) return CO_WAITING; \
+            (res) = -1;                                                   \
+        }                                                                 \
+    } while (0)
+
+/**
+ * @brief Suspend for at least ms milliseconds
+ */
+#define CO_SLEEP(co, ms) do {                                             \
+        (co)->line = __LINE__;                                            \
+        co_sleep_until((co), co_now_ns() + (uint64_t)(ms) * 1000000ULL);  \
+        return CO_WAITING;                                                \
+        case __LINE__:;                                                   \
+    } while (0)
+
+/**
+ * @brief Run a job on a thread pool and resume when it completes
+ *
+ * The job's arg is set to the coroutine; the work function reaches its
+ * state through ((co_task_t *)job->arg)->arg. The pool's completion queue
+ * must be drained on this coroutine's loop.
+ */
+#define CO_OFFLOAD(co, pool, job, work, home) do {                        \
+        (co)->line = __LINE__;                                            \
+        thread_pool_offload((pool), (job), (work), co_job_done, (co),     \
+                            (home));                                      \
+        return CO_WAITING;                                                \
+        case __LINE__:;                                                   \
+    } while (0)
+
+/**
+ * @brief Initialize a coroutine loop
+ *
+ * @param loop Loop to initialize
+ * @return 0 on success, -1 on failure
+ */
+static inline int co_loop_init(co_loop_t *loop) {
+    memset(loop, 0, sizeof(*loop));
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Release loop resources (does not touch unfinished tasks)
+ */
+static inline void co_loop_destroy(co_loop_t *loop) {
+    if (loop->epfd >= 0) {
+        close(loop->epfd);
+        loop->epfd = -1;
+    }
+    free(loop->sleepers);
+    loop->sleepers = NULL;
+    loop->num_sleepers = 0;
+    loop->sleepers_cap = 0;
+}
+
+/**
+ * @brief Queue a coroutine to be resumed on the next loop pass
+ */
+static inline void co_ready(co_task_t *co) {
+    co_loop_t *loop = co->loop;
+    co->next = NULL;
+    if (loop->ready_tail) {
+        loop->ready_tail->next = co;
+    } else {
+        loop->ready_head = co;
+    }
+    loop->ready_tail = co;
+}
+
+/**
+ * @brief Thread pool completion hook used by CO_OFFLOAD
+ */
+static inline void co_job_done(tp_job_t *job) {
+    co_ready((co_task_t *)job->arg);
+}
+
+/**
+ * @brief Arm a one-shot epoll registration for a coroutine
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int co_wait_fd(co_task_t *co, int fd, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = co;
+
+    if (co->fd == fd) {
+        return epoll_ctl(co->loop->epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    if (co->fd >= 0) {
+        epoll_ctl(co->loop->epfd, EPOLL_CTL_DEL, co->fd, NULL);
+        co->fd = -1;
+    }
+
+    if (epoll_ctl(co->loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return -1;
+    }
+    co->fd = fd;
+    return 0;
+}
+
+/**
+ * @brief Add a coroutine to the sleeper heap
+ */
+static inline void co_sleep_until(co_task_t *co, uint64_t wake_ns) {
+    co_loop_t *loop = co->loop;
+
+    if (loop->num_sleepers == loop->sleepers_cap) {
+        size_t cap = loop->sleepers_cap ? loop->sleepers_cap * 2 : 64;
+        co_task_t **heap = realloc(loop->sleepers, cap * sizeof(*heap));
+        if (!heap) {
+            // Out of memory: degrade to an immediate wakeup
+            co_ready(co);
+            return;
+        }
+        loop->sleepers = heap;
+        loop->sleepers_cap = cap;
+    }
+
+    co->wake_ns = wake_ns;
+    size_t i = loop->num_sleepers++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (loop->sleepers[parent]->wake_ns <= wake_ns) {
+            break;
+        }
+        loop->sleepers[i] = loop->sleepers[parent];
+        i = parent;
+    }
+    loop->sleepers[i] = co;
+}
+
+/**
+ * @brief Remove the earliest sleeper from the heap
+ */
+static inline co_task_t *co_pop_sleeper(co_loop_t *loop) {
+    co_task_t *top = loop->sleepers[0];
+    co_task_t *last = loop->sleepers[--loop->num_sleepers];
+    size_t n = loop->num_sleepers;
+    size_t i = 0;
+
+    while (n > 0) {
+        size_t child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && loop->sleepers[child + 1]->wake_ns < loop->sleepers[child]->wake_ns) {
+            child++;
+        }
+        if (last->wake_ns <= loop->sleepers[child]->wake_ns) {
+            break;
+        }
+        loop->sleepers[i] = loop->sleepers[child];
+        i = child;
+    }
+    if (n > 0) {
+        loop->sleepers[i] = last;
+    }
+
+    return top;
+}
+
+/**
+ * @brief Resume a coroutine and finalize it if it finished
+ */
+static inline void co_resume(co_task_t *co) {
+    co_loop_t *loop = co->loop;
+    loop->resumes++;
+
+    if (co->fn(co) == CO_DONE) {
+        if (co->fd >= 0) {
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, co->fd, NULL);
+            co->fd = -1;
+        }
+        loop->active--;
+        if (co->cleanup) {
+            co->cleanup(co);
+        }
+    }
+}
+
+/**
+ * @brief Start a coroutine on the loop
+ *
+ * The coroutine first runs on the next loop pass.
+ *
+ * @param loop Loop to run on
+ * @param co Caller-owned control block
+ * @param fn Coroutine body
+ * @param cleanup Called after the body finishes (may be NULL)
+ * @param arg User state
+ */
+static inline void co_spawn(co_loop_t *loop, co_task_t *co, co_fn fn,
+                            co_cleanup_fn cleanup, void *arg) {
+    co->line = 0;
+    co->fn = fn;
+    co->cleanup = cleanup;
+    co->arg = arg;
+    co->loop = loop;
+    co->fd = -1;
+    co->wake_ns = 0;
+    loop->active++;
+    co_ready(co);
+}
+
+/**
+ * @brief Run one loop iteration: I/O, timers, then ready coroutines
+ *
+ * @param loop Coroutine loop
+ * @param timeout_ms Maximum time to block waiting for events
+ * @return Number of events processed, or -1 on epoll error
+ */
+static inline int co_loop_run_once(co_loop_t *loop, int timeout_ms) {
+    struct epoll_event events[CO_MAX_EVENTS];
+
+    if (loop->ready_head) {
+        timeout_ms = 0;
+    } else if (loop->num_sleepers > 0) {
+        uint64_t now = co_now_ns();
+        uint64_t wake = loop->sleepers[0]->wake_ns;
+        int until = wake > now ? (int)((wake - now + 999999ULL) / 1000000ULL) : 0;
+        if (timeout_ms < 0 || until < timeout_ms) {
+            timeout_ms = until;
+        }
+    }
+
+    int nfds = epoll_wait(loop->epfd, events, CO_MAX_EVENTS, timeout_ms);
+    if (nfds < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        nfds = 0;
+    }
+
+    for (int i = 0; i < nfds; i++) {
+        co_resume((co_task_t *)events[i].data.ptr);
+    }
+
+    if (loop->num_sleepers > 0) {
+        uint64_t now = co_now_ns();
+        while (loop->num_sleepers > 0 && loop->sleepers[0]->wake_ns <= now) {
+            co_resume(co_pop_sleeper(loop));
+        }
+    }
+
+    // Run only the tasks that were ready at this point; tasks that yield
+    // again are picked up on the next pass so I/O is not starved.
+    co_task_t *co = loop->ready_head;
+    loop->ready_head = NULL;
+    loop->ready_tail = NULL;
+    while (co) {
+        co_task_t *next = co->next;
+        co_resume(co);
+        co = next;
+    }
+
+    return nfds;
+}
+
+#endif /* COROUTINE_H */
@@ -0,0 +1,143 @@
+/**
+ * @file feed_arbiter.h
+ * @brief A/B feed line arbitration by sequence number
+ *
+ * Exchanges send every market data message on two redundant lines. The
+ * arbiter sees every copy from both lines and passes each sequence number
+ * through exactly once: the first copy to arrive wins and later copies are
+ * dropped. A message lost on one line is therefore filled by the other
+ * without waiting for recovery, and effective latency is the minimum of
+ * the two lines.
+ *
+ * Sequence numbers within FEED_ARB_WINDOW of the highest one seen are
+ * tracked in a bitmap. A message that arrives behind the high-water mark
+ * is still delivered if it was never seen (it fills a gap). Anything
+ * further back is treated as stale.
+ *
+ * For each line the arbiter records:
+ *  - copies received and copies that won;
+ *  - duplicates dropped and how far behind the winner they arrived;
+ *  - gaps in that line's own sequence.
+ * For the merged stream it records gaps that were filled later and
+ * messages still missing on both lines.
+ */
+
+#ifndef FEED_ARBITER_H
+#define FEED_ARBITER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define FEED_ARB_LINES 2
+#define FEED_ARB_WINDOW 1024        /**< Sequence numbers tracked (power of 2) */
+
+/**
+ * @brief Per-line counters
+ */
+typedef struct {
+    uint64_t received;          /**< Copies seen on this line */
+    uint64_t won;               /**< Copies delivered (arrived first) */
+    uint64_t duplicates;        /**< Copies dropped as already delivered */
+    uint64_t gaps;              /**< Gaps in this line's own sequence */
+    uint64_t gap_messages;      /**< Messages missing on this line */
+    uint64_t lag_total_ns;      /**< Sum over duplicates of the delay behind the winner */
+    uint64_t lag_max_ns;        /**< Largest such delay */
+    uint64_t next_seq;          /**< Next sequence expected on this line */
+} feed_line_stats_t;
+
+/**
+ * @brief Arbiter state
+ */
+typedef struct {
+    uint64_t high_seq;                          /**< Highest sequence delivered */
+    uint64_t delivered;                         /**< Messages passed through */
+    uint64_t stale;                             /**< Copies too old for the window */
+    uint64_t recovered;                         /**< Merged-stream gaps filled late */
+    uint64_t missing;                           /**< Currently missing on both lines */
+    feed_line_stats_t line[FEED_ARB_LINES];
+    uint64_t seen[FEED_ARB_WINDOW / 64];        /**< Delivered bitmap, indexed seq % window */
+    uint64_t first_ns[FEED_ARB_WINDOW];         /**< Arrival time of each winner */
+} feed_arbiter_t;
+
+/**
+ * @brief Reset an arbiter
+ */
+static inline void feed_arb_init(feed_arbiter_t *arb) {
+    memset(arb, 0, sizeof(*arb));
+}
+
+// Bitmap helpers
+static inline int feed_arb_test(const feed_arbiter_t *arb, uint64_t seq) {
+    uint64_t bit = seq & (FEED_ARB_WINDOW - 1);
+    return (int)((arb->seen[bit >> 6] >> (bit & 63)) & 1);
+}
+
+static inline void feed_arb_set(feed_arbiter_t *arb, uint64_t seq, int value) {
+    uint64_t bit = seq & (FEED_ARB_WINDOW - 1);
+    if (value) {
+        arb->seen[bit >> 6] |= 1ULL << (bit & 63);
+    } else {
+        arb->seen[bit >> 6] &= ~(1ULL << (bit & 63));
+    }
+}
+
+/**
+ * @brief Offer one copy of a message
+ *
+ * @param arb Arbiter
+ * @param line Line index (0 = A, 1 = B)
+ * @param seq Message sequence number (starting at 1)
+ * @param now_ns Arrival time
+ * @return 1 if the message should be processed, 0 if it is a duplicate or stale
+ */
+static inline int feed_arb_accept(feed_arbiter_t *arb, int line, uint64_t seq, uint64_t now_ns) {
+    feed_line_stats_t *ls = &arb->line[line];
+    ls->received++;
+
+    // Gaps in this line's own stream
+    if (ls->next_seq && seq > ls->next_seq) {
+        ls->gaps++;
+        ls->gap_messages += seq - ls->next_seq;
+    }
+    if (seq >= ls->next_seq) {
+        ls->next_seq = seq + 1;
+    }
+
+    if (seq > arb->high_seq) {
+        // New high-water mark: slots between the old and new mark become
+        // unseen, and anything skipped is missing until the other line fills it
+        uint64_t skipped = arb->high_seq ? seq - arb->high_seq - 1 : 0;
+        uint64_t clear_from = seq - arb->high_seq > FEED_ARB_WINDOW ? seq - FEED_ARB_WINDOW + 1
+                                                                    : arb->high_seq + 1;
+        for (uint64_t s = clear_from; s < seq; s++) {
+            feed_arb_set(arb, s, 0);
+        }
+        arb->missing += skipped;
+        arb->high_seq = seq;
+    } else if (seq + FEED_ARB_WINDOW <= arb->high_seq) {
+        arb->stale++;
+        return 0;
+    } else if (feed_arb_test(arb, seq)) {
+        uint64_t lag = now_ns - arb->first_ns[seq & (FEED_ARB_WINDOW - 1)];
+        ls->duplicates++;
+        ls->lag_total_ns += lag;
+        if (lag > ls->lag_max_ns) {
+            ls->lag_max_ns = lag;
+        }
+        return 0;
+    } else {
+        // Behind the mark but never delivered: fills a gap
+        arb->recovered++;
+        if (arb->missing) {
+            arb->missing--;
+        }
+    }
+
+    feed_arb_set(arb, seq, 1);
+    arb->first_ns[seq & (FEED_ARB_WINDOW - 1)] = now_ns;
+    arb->delivered++;
+    ls->won++;
+    return 1;
+}
+
+#endif /* FEED_ARBITER_H */
@@ -0,0 +1,741 @@
+/**
+ * @file forwarder.h
+ * @brief Batching, compressing forwarder with acked delivery and a disk spill
+ *
+ * The ingest thread appends fixed-size records (e.g. encoded readings) to
+ * an open batch with fwd_append(), which is a memcpy. A batch is sealed
+ * when it reaches the size limit or when it has been open for the maximum
+ * delay (checked by fwd_append() and fwd_tick()). Sealing compresses the
+ * batch (lz_block.h) straight into a frame in the spill ring and gives it
+ * the next batch sequence number.
+ *
+ * The spill ring is a file mapped MAP_SHARED, like order_journal.h. It
+ * holds every sealed batch until the collector acknowledges it, so an
+ * upstream outage only fills the ring. The producer and the sender share
+ * the ring lock-free:
+ *  - the producer publishes head after a frame is written;
+ *  - the sender publishes tail after frames are acknowledged.
+ * When the ring is full, new batches are dropped and counted; batches
+ * already spilled are never lost. The ring survives the process being
+ * killed, but not a machine crash, since pages are not synced per batch.
+ * A restarted forwarder resends everything after the last acknowledged
+ * batch.
+ *
+ * A sender thread drives the TCP connection with fwd_poll(). It connects
+ * without blocking, retries every retry_ms while the collector is down, and
+ * writes frames directly from the ring. On every new connection it starts
+ * again from the oldest unacknowledged batch. The collector acknowledges
+ * cumulatively by sequence number and discards batches it has already
+ * seen, so delivery resumes exactly where the acks left off.
+ *
+ * Sequence numbers belong to the spill file. A forwarder that starts over
+ * with a new or reinitialized spill counts from 1 again, so every spill
+ * gets a random epoch, sent in each frame. When the epoch changes the
+ * collector starts its duplicate check afresh instead of discarding the
+ * new batches as already seen.
+ *
+ * Wire format, little-endian:
+ *  - batch frame: magic "FWDB", payload length (u32), sequence (u64), raw
+ *    length (u32), record count (u32), spill epoch (u64), payload. The payload is compressed
+ *    when that is smaller, otherwise raw (payload length == raw length).
+ *  - ack: magic "FWDA", reserved (u32), highest sequence received (u64).
+ *
+ * fwd_collector_serve() implements the collector side for one connection.
+ * It is used by the tests and by the stand-in collector in
+ * src/tools/fwd_collector.c.
+ */
+
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "lz_block.h"
+#include "wire_codec.h"
+
+#define FWD_MAGIC 0x42445746u               /**< "FWDB": batch frame */
+#define FWD_ACK_MAGIC 0x41445746u           /**< "FWDA": acknowledgement */
+#define FWD_PAD_MAGIC 0x50445746u           /**< "FWDP": ring space skipped up to the wrap */
+#define FWD_SPILL_MAGIC 0x4c505346u         /**< "FSPL" */
+#define FWD_SPILL_VERSION 2
+#define FWD_HEADER_SIZE 32                  /**< Batch frame header */
+#define FWD_ACK_SIZE 16
+#define FWD_ALIGN 64                        /**< Ring frames start on a cache line */
+#define FWD_RETRY_MS 1000                   /**< Default reconnect interval */
+
+/**
+ * @brief Decoded batch frame header
+ */
+typedef struct {
+    uint32_t length;                /**< Payload bytes */
+    uint64_t seq;                   /**< Batch sequence number, from 1 */
+    uint32_t raw_length;            /**< Record bytes after decompression */
+    uint32_t records;               /**< Records in the batch */
+    uint64_t epoch;                 /**< Spill epoch the sequence number belongs to */
+} fwd_frame_t;
+
+/**
+ * @brief Spill file header, one FWD_ALIGN block
+ */
+typedef struct {
+    uint32_t magic;                 /**< FWD_SPILL_MAGIC once initialized */
+    uint32_t version;               /**< FWD_SPILL_VERSION */
+    uint64_t capacity;              /**< Ring bytes after the header */
+    _Atomic uint64_t head;          /**< Bytes ever written; advanced by the producer */
+    _Atomic uint64_t tail;          /**< Bytes ever acknowledged; advanced by the sender */
+    _Atomic uint64_t last_seq;      /**< Last batch sealed */
+    _Atomic uint64_t acked_seq;     /**< Last batch acknowledged */
+    uint64_t epoch;                 /**< Random, chosen when the spill is initialized */
+    uint64_t reserved;
+} fwd_spill_header_t;
+
+_Static_assert(sizeof(fwd_spill_header_t) == FWD_ALIGN, "spill header must be one block");
+
+/**
+ * @brief Forwarder; producer fields belong to the ingest thread, sender
+ * fields to the thread calling fwd_poll()
+ */
+typedef struct {
+    fwd_spill_header_t *spill;      /**< Mapped header; the ring follows */
+    uint8_t *ring;
+    size_t map_size;
+    int spill_fd;                   /**< Backing file, -1 for anonymous */
+    int recovered;                  /**< Set if unacknowledged batches were reloaded */
+    int efd;                        /**< Signalled when a batch is sealed */
+
+    // Producer
+    uint8_t *batch;                 /**< Open batch */
+    size_t batch_len;
+    size_t batch_max;
+    uint32_t batch_records;
+    uint64_t batch_opened_ms;
+    uint64_t max_delay_ms;
+    uint64_t batches;               /**< Batches sealed */
+    uint64_t records;               /**< Records sealed */
+    uint64_t raw_bytes;             /**< Record bytes sealed */
+    uint64_t wire_bytes;            /**< Frame bytes sealed, after compression */
+    uint64_t dropped;               /**< Records dropped because the ring was full */
+
+    // Sender
+    struct sockaddr_in addr;        /**< Collector */
+    int fd;                         /**< Connection, -1 while down */
+    int connecting;                 /**< Non-blocking connect in progress */
+    uint64_t retry_ms;              /**< Reconnect interval */
+    uint64_t retry_at_ms;
+    uint64_t send_off;              /**< Ring offset of the next frame to send */
+    size_t frame_sent;              /**< Bytes of that frame already written */
+    uint8_t ack[FWD_ACK_SIZE];      /**< Partially read acknowledgement */
+    size_t ack_len;
+    uint64_t connects;              /**< Connections established */
+} fwd_t;
+
+static inline uint64_t fwd_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline uint64_t fwd_align(uint64_t n) {
+    return (n + FWD_ALIGN - 1) & ~(uint64_t)(FWD_ALIGN - 1);
+}
+
+/**
+ * @brief Encode a batch frame header
+ */
+static inline void fwd_put_header(uint8_t *p, const fwd_frame_t *h) {
+    wire_put32(p, FWD_MAGIC, WIRE_SWAP_LE);
+    wire_put32(p + 4, h->length, WIRE_SWAP_LE);
+    wire_put64(p + 8, h->seq, WIRE_SWAP_LE);
+    wire_put32(p + 16, h->raw_length, WIRE_SWAP_LE);
+    wire_put32(p + 20, h->records, WIRE_SWAP_LE);
+    wire_put64(p + 24, h->epoch, WIRE_SWAP_LE);
+}
+
+/**
+ * @brief Decode a batch frame header
+ *
+ * @return 0 if it is a well-formed batch header, -1 otherwise
+ */
+static inline int fwd_get_header(const uint8_t *p, fwd_frame_t *h) {
+    if (wire_get32(p, WIRE_SWAP_LE) != FWD_MAGIC) {
+        return -1;
+    }
+    h->length = wire_get32(p + 4, WIRE_SWAP_LE);
+    h->seq = wire_get64(p + 8, WIRE_SWAP_LE);
+    h->raw_length = wire_get32(p + 16, WIRE_SWAP_LE);
+    h->records = wire_get32(p + 20, WIRE_SWAP_LE);
+    h->epoch = wire_get64(p + 24, WIRE_SWAP_LE);
+    return h->length <= h->raw_length ? 0 : -1;
+}
+
+/**
+ * @brief Recover the records of a batch
+ *
+ * @return Record bytes (h->raw_length), or -1 if the payload is corrupt or
+ *         does not fit in cap
+ */
+static inline ssize_t fwd_unpack(const fwd_frame_t *h, const uint8_t *payload, void *out, size_t cap) {
+    if (h->raw_length > cap) {
+        return -1;
+    }
+    if (h->length == h->raw_length) {
+        memcpy(out, payload, h->length);
+        return h->length;
+    }
+    ssize_t n = lzb_decompress(payload, h->length, out, cap);
+    return n == (ssize_t)h->raw_length ? n : -1;
+}
+
+/**
+ * @brief Encode an acknowledgement of every batch up to seq
+ */
+static inline void fwd_put_ack(uint8_t *p, uint64_t seq) {
+    wire_put32(p, FWD_ACK_MAGIC, WIRE_SWAP_LE);
+    wire_put32(p + 4, 0, WIRE_SWAP_LE);
+    wire_put64(p + 8, seq, WIRE_SWAP_LE);
+}
+
+// Epoch for a new spill: random and never 0, which the collector uses for none yet
+static inline uint64_t fwd_new_epoch(void) {
+    uint64_t epoch = 0;
+    if (getrandom(&epoch, sizeof(epoch), 0) != (ssize_t)sizeof(epoch)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        epoch = ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec) ^ ((uint64_t)getpid() << 40);
+    }
+    return epoch ? epoch : 1;
+}
+
+/**
+ * @brief Release everything; safe on a partially opened forwarder
+ */
+static inline void fwd_close(fwd_t *f) {
+    if (f->fd >= 0) {
+        close(f->fd);
+        f->fd = -1;
+    }
+    if (f->efd >= 0) {
+        close(f->efd);
+        f->efd = -1;
+    }
+    if (f->spill) {
+        munmap(f->spill, f->map_size);
+        f->spill = NULL;
+    }
+    if (f->spill_fd >= 0) {
+        close(f->spill_fd);
+        f->spill_fd = -1;
+    }
+    free(f->batch);
+    f->batch = NULL;
+}
+
+/**
+ * @brief Open a forwarder
+ *
+ * An existing spill file of the same size and version is reopened with its
+ * unacknowledged batches, which are sent first. Anything else is
+ * reinitialized.
+ *
+ * @param f Forwarder to initialize
+ * @param spill_path Spill file, or NULL for an anonymous in-memory ring
+ * @param spill_bytes Ring capacity (rounded up to FWD_ALIGN)
+ * @param batch_bytes Record bytes per batch; at most a quarter of the ring
+ * @param max_delay_ms Longest a record waits in an open batch
+ * @param host Collector IPv4 address
+ * @param port Collector port
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int fwd_open(fwd_t *f, const char *spill_path, size_t spill_bytes, size_t batch_bytes,
+                           uint64_t max_delay_ms, const char *host, int port) {
+    memset(f, 0, sizeof(*f));
+    f->spill_fd = -1;
+    f->efd = -1;
+    f->fd = -1;
+
+    uint64_t capacity = fwd_align(spill_bytes);
+    if (batch_bytes == 0 || fwd_align(FWD_HEADER_SIZE + batch_bytes) * 4 > capacity || batch_bytes > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&f->addr, 0, sizeof(f->addr));
+    f->addr.sin_family = AF_INET;
+    f->addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &f->addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t size = FWD_ALIGN + capacity;
+    void *base;
+    if (spill_path) {
+        f->spill_fd = open(spill_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (f->spill_fd < 0) {
+            goto fail;
+        }
+        struct stat st;
+        if (fstat(f->spill_fd, &st) < 0) {
+            goto fail;
+        }
+        f->recovered = (size_t)st.st_size == size;
+        if (!f->recovered && ftruncate(f->spill_fd, (off_t)size) < 0) {
+            goto fail;
+        }
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, f->spill_fd, 0);
+    } else {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base == MAP_FAILED) {
+        goto fail;
+    }
+    f->spill = base;
+    f->ring = (uint8_t *)base + FWD_ALIGN;
+    f->map_size = size;
+
+    fwd_spill_header_t *hdr = f->spill;
+    if (f->recovered) {
+        uint64_t head = atomic_load(&hdr->head);
+        uint64_t tail = atomic_load(&hdr->tail);
+        f->recovered = hdr->magic == FWD_SPILL_MAGIC && hdr->version == FWD_SPILL_VERSION &&
+                       hdr->capacity == capacity && tail <= head && head - tail <= capacity;
+    }
+    if (!f->recovered) {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->version = FWD_SPILL_VERSION;
+        hdr->capacity = capacity;
+        hdr->epoch = fwd_new_epoch();
+        hdr->magic = FWD_SPILL_MAGIC;
+    } else if (atomic_load(&hdr->head) == atomic_load(&hdr->tail)) {
+        f->recovered = 0;   // Nothing left to resend
+    }
+
+    f->batch = malloc(batch_bytes);
+    f->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!f->batch || f->efd < 0) {
+        goto fail;
+    }
+    f->batch_max = batch_bytes;
+    f->max_delay_ms = max_delay_ms;
+    f->retry_ms = FWD_RETRY_MS;
+    f->send_off = atomic_load(&hdr->tail);
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        fwd_close(f);
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Seal the open batch into the spill ring
+ *
+ * @return 0 if sealed (or empty), -1 if the ring was full and the batch was dropped
+ */
+static inline int fwd_seal(fwd_t *f) {
+    if (f->batch_records == 0) {
+        return 0;
+    }
+    fwd_spill_header_t *hdr = f->spill;
+    uint64_t capacity = hdr->capacity;
+    uint64_t head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+
+    // Reserve room for the uncompressed frame, wrapping if it does not fit before the end
+    uint64_t worst = fwd_align(FWD_HEADER_SIZE + f->batch_len);
+    uint64_t pos = head % capacity;
+    uint64_t pad = capacity - pos < worst ? capacity - pos : 0;
+    int result = 0;
+    if (head + pad + worst - tail > capacity) {
+        f->dropped += f->batch_records;
+        result = -1;
+        goto reset;
+    }
+    if (pad) {
+        wire_put32(f->ring + pos, FWD_PAD_MAGIC, WIRE_SWAP_LE);
+        head += pad;
+        pos = 0;
+    }
+
+    // Compressed only if that is smaller
+    uint8_t *frame = f->ring + pos;
+    size_t length = lzb_compress(f->batch, f->batch_len, frame + FWD_HEADER_SIZE, f->batch_len - 1);
+    if (length == 0) {
+        memcpy(frame + FWD_HEADER_SIZE, f->batch, f->batch_len);
+        length = f->batch_len;
+    }
+    uint64_t seq = atomic_load_explicit(&hdr->last_seq, memory_order_relaxed) + 1;
+    fwd_frame_t h = { (uint32_t)length, seq, (uint32_t)f->batch_len, f->batch_records, hdr->epoch };
+    fwd_put_header(frame, &h);
+    atomic_store_explicit(&hdr->last_seq, seq, memory_order_relaxed);
+    atomic_store_explicit(&hdr->head, head + fwd_align(FWD_HEADER_SIZE + length), memory_order_release);
+
+    f->batches++;
+    f->records += f->batch_records;
+    f->raw_bytes += f->batch_len;
+    f->wire_bytes += FWD_HEADER_SIZE + length;
+    uint64_t one = 1;
+    ssize_t res = write(f->efd, &one, sizeof(one));
+    (void)res;
+
+reset:
+    f->batch_len = 0;
+    f->batch_records = 0;
+    return result;
+}
+
+/**
+ * @brief Append a record to the open batch
+ *
+ * @param f Forwarder
+ * @param record Record bytes; records are concatenated, so use fixed-size
+ *        or self-delimiting records
+ * @param len Record length, at most the batch size
+ * @param now_ms Current time in milliseconds (monotonic)
+ * @return 0 on success, -1 if the record was too large or a batch was dropped
+ */
+static inline int fwd_append(fwd_t *f, const void *record, size_t len, uint64_t now_ms) {
+    int result = 0;
+    if (len == 0 || len > f->batch_max) {
+        return -1;
+    }
+    if (f->batch_len + len > f->batch_max) {
+        result = fwd_seal(f);
+    }
+    if (f->batch_records == 0) {
+        f->batch_opened_ms = now_ms;
+    }
+    memcpy(f->batch + f->batch_len, record, len);
+    f->batch_len += len;
+    f->batch_records++;
+    if (f->batch_len == f->batch_max || now_ms - f->batch_opened_ms >= f->max_delay_ms) {
+        result |= fwd_seal(f);
+    }
+    return result;
+}
+
+/**
+ * @brief Seal the open batch if it has waited max_delay_ms; call periodically
+ */
+static inline int fwd_tick(fwd_t *f, uint64_t now_ms) {
+    if (f->batch_records && now_ms - f->batch_opened_ms >= f->max_delay_ms) {
+        return fwd_seal(f);
+    }
+    return 0;
+}
+
+/**
+ * @brief Batches sealed but not yet acknowledged
+ */
+static inline uint64_t fwd_unacked(const fwd_t *f) {
+    return atomic_load(&f->spill->last_seq) - atomic_load(&f->spill->acked_seq);
+}
+
+static inline void fwd_disconnect(fwd_t *f, uint64_t now_ms) {
+    if (f->fd >= 0) {
+        close(f->fd);
+        f->fd = -1;
+    }
+    f->connecting = 0;
+    f->retry_at_ms = now_ms + f->retry_ms;
+}
+
+// Connection established: resume from the oldest unacknowledged batch
+static inline void fwd_connected(fwd_t *f) {
+    f->connecting = 0;
+    f->connects++;
+    f->send_off = atomic_load_explicit(&f->spill->tail, memory_order_relaxed);
+    f->frame_sent = 0;
+    f->ack_len = 0;
+}
+
+static inline void fwd_connect(fwd_t *f, uint64_t now_ms) {
+    f->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (f->fd < 0) {
+        f->retry_at_ms = now_ms + f->retry_ms;
+        return;
+    }
+    if (connect(f->fd, (struct sockaddr *)&f->addr, sizeof(f->addr)) == 0) {
+        fwd_connected(f);
+    } else if (errno == EINPROGRESS) {
+        f->connecting = 1;
+    } else {
+        fwd_disconnect(f, now_ms);
+    }
+}
+
+// Ring position of the frame at off, skipping a pad; header in *h
+static inline uint8_t *fwd_frame_at(fwd_t *f, uint64_t *off, fwd_frame_t *h) {
+    uint64_t capacity = f->spill->capacity;
+    uint8_t *p = f->ring + *off % capacity;
+    if (wire_get32(p, WIRE_SWAP_LE) == FWD_PAD_MAGIC) {
+        *off += capacity - *off % capacity;
+        p = f->ring;
+    }
+    if (fwd_get_header(p, h) < 0) {
+        memset(h, 0, sizeof(*h));   // Only a damaged spill file gets here
+    }
+    return p;
+}
+
+// Free every sent frame up to and including seq
+static inline void fwd_release(fwd_t *f, uint64_t seq) {
+    fwd_spill_header_t *hdr = f->spill;
+    uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_relaxed);
+    while (tail < f->send_off) {
+        uint64_t off = tail;
+        fwd_frame_t h;
+        fwd_frame_at(f, &off, &h);
+        if (h.seq > seq) {
+            break;
+        }
+        tail = off + fwd_align(FWD_HEADER_SIZE + h.length);
+        atomic_store_explicit(&hdr->acked_seq, h.seq, memory_order_relaxed);
+    }
+    atomic_store_explicit(&hdr->tail, tail, memory_order_release);
+}
+
+// Write sealed frames until the socket is full; -1 on a connection error
+static inline int fwd_send(fwd_t *f) {
+    uint64_t head = atomic_load_explicit(&f->spill->head, memory_order_acquire);
+    while (f->send_off < head) {
+        uint64_t off = f->send_off;
+        fwd_frame_t h;
+        uint8_t *p = fwd_frame_at(f, &off, &h);
+        f->send_off = off;
+        size_t frame_len = FWD_HEADER_SIZE + h.length;
+        ssize_t n = send(f->fd, p + f->frame_sent, frame_len - f->frame_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        f->frame_sent += (size_t)n;
+        if (f->frame_sent == frame_len) {
+            f->send_off += fwd_align(frame_len);
+            f->frame_sent = 0;
+        }
+    }
+    return 0;
+}
+
+// Read acknowledgements until the socket is empty; -1 on EOF, error or garbage
+static inline int fwd_read_acks(fwd_t *f) {
+    for (;;) {
+        ssize_t n = recv(f->fd, f->ack + f->ack_len, FWD_ACK_SIZE - f->ack_len, 0);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        f->ack_len += (size_t)n;
+        if (f->ack_len < FWD_ACK_SIZE) {
+            continue;
+        }
+        f->ack_len = 0;
+        if (wire_get32(f->ack, WIRE_SWAP_LE) != FWD_ACK_MAGIC) {
+            return -1;
+        }
+        fwd_release(f, wire_get64(f->ack + 8, WIRE_SWAP_LE));
+    }
+}
+
+/**
+ * @brief Run the sender: connect, send sealed batches, process acks
+ *
+ * Call in a loop from one thread. Waits up to timeout_ms for the socket,
+ * a newly sealed batch or the next reconnect attempt.
+ *
+ * @return 0, or -1 if poll() failed
+ */
+static inline int fwd_poll(fwd_t *f, int timeout_ms) {
+    uint64_t now = fwd_now_ms();
+    if (f->fd < 0 && now >= f->retry_at_ms) {
+        fwd_connect(f, now);
+    }
+    if (f->fd >= 0 && !f->connecting && fwd_send(f) < 0) {
+        fwd_disconnect(f, now);
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = f->efd;
+    fds[0].events = POLLIN;
+    nfds_t count = 1;
+    if (f->fd >= 0) {
+        int unsent = f->send_off < atomic_load_explicit(&f->spill->head, memory_order_acquire);
+        fds[1].fd = f->fd;
+        fds[1].events = (short)(f->connecting ? POLLOUT : POLLIN | (unsent ? POLLOUT : 0));
+        count = 2;
+    } else if (f->retry_at_ms - now < (uint64_t)timeout_ms) {
+        timeout_ms = (int)(f->retry_at_ms - now);
+    }
+    fds[0].revents = fds[1].revents = 0;
+
+    if (poll(fds, count, timeout_ms) < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    now = fwd_now_ms();
+    if (fds[0].revents & POLLIN) {
+        uint64_t value;
+        ssize_t res = read(f->efd, &value, sizeof(value));
+        (void)res;
+    }
+    if (count < 2 || f->fd < 0) {
+        return 0;
+    }
+
+    if (f->connecting) {
+        if (fds[1].revents) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(f->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+                fwd_disconnect(f, now);
+                return 0;
+            }
+            fwd_connected(f);
+        }
+        return 0;
+    }
+    if ((fds[1].revents & (POLLIN | POLLERR | POLLHUP)) && fwd_read_acks(f) < 0) {
+        fwd_disconnect(f, now);
+        return 0;
+    }
+    if (fwd_send(f) < 0) {
+        fwd_disconnect(f, now);
+    }
+    return 0;
+}
+
+/**
+ * @brief Called by the collector for each new batch
+ */
+typedef void (*fwd_batch_fn)(void *ctx, const fwd_frame_t *frame, const uint8_t *records);
+
+/**
+ * @brief Collector state; survives reconnections so resent batches are skipped
+ */
+typedef struct {
+    uint64_t epoch;                 /**< Spill epoch of last_seq, 0 before the first batch */
+    uint64_t last_seq;              /**< Highest batch delivered */
+    size_t max_batch;               /**< Largest raw batch accepted */
+    uint8_t *payload;
+    uint8_t *records;
+    uint64_t batches;               /**< New batches delivered */
+    uint64_t duplicates;            /**< Resent batches skipped */
+    uint64_t restarts;              /**< Epoch changes: the forwarder started a new spill */
+    uint64_t wire_bytes;            /**< Frame bytes received */
+} fwd_collector_t;
+
+/**
+ * @brief Initialize a collector accepting batches up to max_batch record bytes
+ */
+static inline int fwd_collector_init(fwd_collector_t *c, size_t max_batch) {
+    memset(c, 0, sizeof(*c));
+    c->max_batch = max_batch;
+    c->payload = malloc(max_batch);
+    c->records = malloc(max_batch);
+    if (!c->payload || !c->records) {
+        free(c->payload);
+        free(c->records);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void fwd_collector_destroy(fwd_collector_t *c) {
+    free(c->payload);
+    free(c->records);
+    c->payload = c->records = NULL;
+}
+
+static inline int fwd_read_full(int fd, uint8_t *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n == 0) {
+            return got == 0 ? 0 : -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Serve one blocking forwarder connection until it closes
+ *
+ * Delivers each batch with a sequence number above last_seq to fn, then
+ * acknowledges it. Older batches are acknowledged again and skipped. A
+ * batch from a new spill epoch resets last_seq first.
+ *
+ * @return 0 when the forwarder closed the connection, -1 on error or a malformed frame
+ */
+static inline int fwd_collector_serve(fwd_collector_t *c, int fd, fwd_batch_fn fn, void *ctx) {
+    for (;;) {
+        uint8_t header[FWD_HEADER_SIZE];
+        int r = fwd_read_full(fd, header, sizeof(header));
+        if (r <= 0) {
+            return r;
+        }
+        fwd_frame_t h;
+        if (fwd_get_header(header, &h) < 0 || h.raw_length > c->max_batch) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (h.length > 0 && fwd_read_full(fd, c->payload, h.length) <= 0) {
+            return -1;
+        }
+        c->wire_bytes += FWD_HEADER_SIZE + h.length;
+        if (h.epoch != c->epoch) {
+            c->restarts += c->epoch != 0;
+            c->epoch = h.epoch;
+            c->last_seq = 0;
+        }
+        if (h.seq <= c->last_seq) {
+            c->duplicates++;
+        } else {
+            if (fwd_unpack(&h, c->payload, c->records, c->max_batch) < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            fn(ctx, &h, c->records);
+            c->last_seq = h.seq;
+            c->batches++;
+        }
+
+        uint8_t ack[FWD_ACK_SIZE];
+        fwd_put_ack(ack, c->last_seq);
+        if (send(fd, ack, sizeof(ack), MSG_NOSIGNAL) != (ssize_t)sizeof(ack)) {
+            return -1;
+        }
+    }
+}
+
+#endif /* FORWARDER_H */
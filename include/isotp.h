@@ -0,0 +1,667 @@
+/**
+ * @file isotp.h
+ * @brief ISO-TP (ISO 15765-2) transport over classic CAN
+ *
+ * Messages up to 4 GB are segmented into CAN frames with normal
+ * addressing:
+ *  - single frame (SF) for up to 7 bytes;
+ *  - first frame (FF), with the escape form for messages above 4095 bytes;
+ *  - consecutive frames (CF) of 7 bytes, sequence numbers 0-15;
+ *  - flow control (FC) frames from the receiver: continue, wait or
+ *    overflow, block size (BS) and separation time (STmin).
+ * Frames are padded to 8 bytes with 0xCC.
+ *
+ * isotp_link_t is the protocol state machine for one pair of CAN IDs. It
+ * never blocks and does no I/O of its own:
+ *  - outgoing frames go to a tx callback;
+ *  - received frames are fed in with isotp_on_frame();
+ *  - STmin pacing and the N_Bs/N_Cr timeouts advance in isotp_poll();
+ *  - isotp_next_us() says when the next call is due.
+ * The link can therefore share an event loop with other traffic, as the
+ * diagnostic handler in can_automotive does. A sent message is not
+ * copied, so it must stay valid until the transfer ends.
+ *
+ * isotp_socket_t is a blocking transport on top:
+ *  - with the kernel's CAN_ISOTP protocol (can-isotp, Linux 5.10+) the
+ *    kernel does the segmentation;
+ *  - otherwise it falls back to a raw CAN socket driven by a link.
+ * The block size and STmin offered to the sender are set when the socket
+ * is opened. BS 0 and STmin 0 ask for back-to-back CFs with a single FC,
+ * the fastest a bus allows. ECUs that cannot keep up need a non-zero
+ * STmin or block size.
+ */
+
+#ifndef ISOTP_H
+#define ISOTP_H
+
+// ppoll() for sub-millisecond STmin waits: define _GNU_SOURCE before any include
+#ifndef _GNU_SOURCE
+#error "isotp.h requires _GNU_SOURCE"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/isotp.h>
+
+#define ISOTP_PCI_SF 0x0
+#define ISOTP_PCI_FF 0x1
+#define ISOTP_PCI_CF 0x2
+#define ISOTP_PCI_FC 0x3
+#define ISOTP_FC_CTS 0x0            /**< Continue to send */
+#define ISOTP_FC_WAIT 0x1
+#define ISOTP_FC_OVFLW 0x2          /**< Message too large for the receiver */
+#define ISOTP_PAD 0xCC
+#define ISOTP_TIMEOUT_US 1000000    /**< N_Bs (wait for FC) and N_Cr (wait for CF) */
+#define ISOTP_MAX_WAIT_FRAMES 16    /**< FC WAIT frames accepted in a row */
+
+/**
+ * @brief Send one frame; return 0, or -1 if the bus is busy (retried on the next poll)
+ */
+typedef int (*isotp_tx_fn)(void *ctx, const struct can_frame *frame);
+
+/**
+ * @brief Called with each complete received message
+ */
+typedef void (*isotp_rx_fn)(void *ctx, const uint8_t *data, size_t len);
+
+enum { ISOTP_TX_IDLE, ISOTP_TX_WAIT_FC, ISOTP_TX_SENDING };
+
+/**
+ * @brief ISO-TP state for one pair of CAN IDs
+ */
+typedef struct {
+    canid_t tx_id;                  /**< ID we send on */
+    canid_t rx_id;                  /**< ID we receive on */
+    uint8_t block_size;             /**< BS offered to senders, 0 = no limit */
+    uint8_t stmin;                  /**< STmin offered to senders (encoded) */
+    isotp_tx_fn tx;
+    isotp_rx_fn rx;
+    void *ctx;
+
+    // Transmit
+    const uint8_t *tx_data;
+    size_t tx_len;
+    size_t tx_off;
+    int tx_state;
+    uint8_t tx_sn;
+    uint8_t tx_bs;                  /**< BS from the last FC */
+    unsigned tx_block_left;         /**< CFs left in this block */
+    unsigned tx_waits;              /**< FC WAIT frames in a row */
+    uint64_t tx_gap_us;             /**< STmin from the last FC */
+    uint64_t tx_next_us;            /**< Earliest time for the next CF */
+    uint64_t tx_deadline_us;        /**< N_Bs deadline while waiting for FC */
+    int tx_result;                  /**< Last transfer: 0, -ETIMEDOUT, -EOVERFLOW */
+
+    // Receive
+    uint8_t *rx_buf;
+    size_t rx_cap;
+    size_t rx_len;                  /**< Length announced by the FF */
+    size_t rx_off;
+    int rx_active;
+    uint8_t rx_sn;
+    unsigned rx_block_left;
+    uint64_t rx_deadline_us;        /**< N_Cr deadline */
+
+    uint64_t tx_messages;
+    uint64_t rx_messages;
+    uint64_t errors;                /**< Timeouts, sequence errors, overflows */
+} isotp_link_t;
+
+static inline uint64_t isotp_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Decode an STmin byte to microseconds (reserved values mean 127 ms)
+ */
+static inline uint64_t isotp_stmin_us(uint8_t stmin) {
+    if (stmin <= 0x7F) {
+        return (uint64_t)stmin * 1000;
+    }
+    if (stmin >= 0xF1 && stmin <= 0xF9) {
+        return (uint64_t)(stmin - 0xF0) * 100;
+    }
+    return 127000;
+}
+
+/**
+ * @brief Encode a separation time, rounding up to what STmin can express
+ */
+static inline uint8_t isotp_stmin_encode(uint64_t us) {
+    if (us == 0) {
+        return 0;
+    }
+    if (us <= 900) {
+        return (uint8_t)(0xF0 + (us + 99) / 100);
+    }
+    uint64_t ms = (us + 999) / 1000;
+    return (uint8_t)(ms > 0x7F ? 0x7F : ms);
+}
+
+/**
+ * @brief Initialize a link
+ *
+ * @param link Link to initialize
+ * @param tx_id CAN ID to send on (CAN_EFF_FLAG for extended)
+ * @param rx_id CAN ID to receive on
+ * @param rx_buf Reassembly buffer; longer messages are refused with FC overflow
+ * @param rx_cap Size of rx_buf
+ * @param tx Frame output
+ * @param rx Message input
+ * @param ctx Passed to both callbacks
+ */
+static inline void isotp_init(isotp_link_t *link, canid_t tx_id, canid_t rx_id, uint8_t *rx_buf, size_t rx_cap,
+                              isotp_tx_fn tx, isotp_rx_fn rx, void *ctx) {
+    memset(link, 0, sizeof(*link));
+    link->tx_id = tx_id;
+    link->rx_id = rx_id;
+    link->rx_buf = rx_buf;
+    link->rx_cap = rx_cap;
+    link->tx = tx;
+    link->rx = rx;
+    link->ctx = ctx;
+}
+
+// Empty frame on tx_id, all 8 bytes padding
+static inline void isotp_frame(const isotp_link_t *link, struct can_frame *f) {
+    memset(f, 0, sizeof(*f));
+    f->can_id = link->tx_id;
+    f->can_dlc = CAN_MAX_DLEN;
+    memset(f->data, ISOTP_PAD, CAN_MAX_DLEN);
+}
+
+static inline int isotp_send_fc(isotp_link_t *link, uint8_t status) {
+    struct can_frame f;
+    isotp_frame(link, &f);
+    f.data[0] = (uint8_t)(ISOTP_PCI_FC << 4 | status);
+    f.data[1] = link->block_size;
+    f.data[2] = link->stmin;
+    return link->tx(link->ctx, &f);
+}
+
+static inline void isotp_tx_end(isotp_link_t *link, int result) {
+    link->tx_state = ISOTP_TX_IDLE;
+    link->tx_result = result;
+    if (result == 0) {
+        link->tx_messages++;
+    } else {
+        link->errors++;
+    }
+}
+
+/**
+ * @brief Whether a transmission is in progress
+ */
+static inline int isotp_busy(const isotp_link_t *link) {
+    return link->tx_state != ISOTP_TX_IDLE;
+}
+
+/**
+ * @brief Start sending a message
+ *
+ * A single frame goes out at once. A longer message sends its FF here and
+ * its CFs from isotp_on_frame() and isotp_poll() as flow control allows.
+ *
+ * @return 0 if started, -1 if busy, empty or the FF could not be sent (errno set)
+ */
+static inline int isotp_send(isotp_link_t *link, const uint8_t *data, size_t len, uint64_t now_us) {
+    if (isotp_busy(link) || len == 0 || len > UINT32_MAX) {
+        errno = isotp_busy(link) ? EBUSY : EINVAL;
+        return -1;
+    }
+    struct can_frame f;
+    isotp_frame(link, &f);
+    if (len <= 7) {
+        f.data[0] = (uint8_t)len;
+        memcpy(f.data + 1, data, len);
+        if (link->tx(link->ctx, &f) < 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        isotp_tx_end(link, 0);
+        return 0;
+    }
+
+    size_t first;
+    if (len <= 4095) {
+        f.data[0] = (uint8_t)(ISOTP_PCI_FF << 4 | len >> 8);
+        f.data[1] = (uint8_t)len;
+        first = 6;
+    } else {
+        // Escape sequence: 12-bit length 0, then a 32-bit big-endian length
+        f.data[0] = ISOTP_PCI_FF << 4;
+        f.data[1] = 0;
+        f.data[2] = (uint8_t)(len >> 24);
+        f.data[3] = (uint8_t)(len >> 16);
+        f.data[4] = (uint8_t)(len >> 8);
+        f.data[5] = (uint8_t)len;
+        first = 2;
+    }
+    memcpy(f.data + CAN_MAX_DLEN - first, data, first);
+    if (link->tx(link->ctx, &f) < 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    link->tx_data = data;
+    link->tx_len = len;
+    link->tx_off = first;
+    link->tx_sn = 1;
+    link->tx_waits = 0;
+    link->tx_state = ISOTP_TX_WAIT_FC;
+    link->tx_deadline_us = now_us + ISOTP_TIMEOUT_US;
+    return 0;
+}
+
+/**
+ * @brief Send due consecutive frames and expire timeouts
+ */
+static inline void isotp_poll(isotp_link_t *link, uint64_t now_us) {
+    if (link->rx_active && now_us >= link->rx_deadline_us) {
+        link->rx_active = 0;        // N_Cr: the sender went quiet
+        link->errors++;
+    }
+    if (link->tx_state == ISOTP_TX_WAIT_FC && now_us >= link->tx_deadline_us) {
+        isotp_tx_end(link, -ETIMEDOUT);
+        return;
+    }
+    while (link->tx_state == ISOTP_TX_SENDING && now_us >= link->tx_next_us) {
+        struct can_frame f;
+        isotp_frame(link, &f);
+        size_t n = link->tx_len - link->tx_off < 7 ? link->tx_len - link->tx_off : 7;
+        f.data[0] = (uint8_t)(ISOTP_PCI_CF << 4 | link->tx_sn);
+        memcpy(f.data + 1, link->tx_data + link->tx_off, n);
+        if (link->tx(link->ctx, &f) < 0) {
+            return;
+        }
+        link->tx_off += n;
+        link->tx_sn = (link->tx_sn + 1) & 0xF;
+        if (link->tx_off == link->tx_len) {
+            isotp_tx_end(link, 0);
+            return;
+        }
+        if (link->tx_bs && --link->tx_block_left == 0) {
+            link->tx_state = ISOTP_TX_WAIT_FC;
+            link->tx_deadline_us = now_us + ISOTP_TIMEOUT_US;
+            return;
+        }
+        link->tx_next_us = now_us + link->tx_gap_us;
+    }
+}
+
+/**
+ * @brief Earliest time isotp_poll() has work, UINT64_MAX if none
+ */
+static inline uint64_t isotp_next_us(const isotp_link_t *link) {
+    uint64_t next = UINT64_MAX;
+    if (link->rx_active) {
+        next = link->rx_deadline_us;
+    }
+    if (link->tx_state == ISOTP_TX_WAIT_FC && link->tx_deadline_us < next) {
+        next = link->tx_deadline_us;
+    }
+    if (link->tx_state == ISOTP_TX_SENDING && link->tx_next_us < next) {
+        next = link->tx_next_us;
+    }
+    return next;
+}
+
+static inline void isotp_on_fc(isotp_link_t *link, const struct can_frame *f, uint64_t now_us) {
+    if (link->tx_state != ISOTP_TX_WAIT_FC || f->can_dlc < 3) {
+        return;
+    }
+    switch (f->data[0] & 0xF) {
+    case ISOTP_FC_CTS:
+        link->tx_bs = f->data[1];
+        link->tx_block_left = f->data[1];
+        link->tx_gap_us = isotp_stmin_us(f->data[2]);
+        link->tx_waits = 0;
+        link->tx_state = ISOTP_TX_SENDING;
+        link->tx_next_us = now_us;
+        isotp_poll(link, now_us);
+        break;
+    case ISOTP_FC_WAIT:
+        if (++link->tx_waits > ISOTP_MAX_WAIT_FRAMES) {
+            isotp_tx_end(link, -ETIMEDOUT);
+        } else {
+            link->tx_deadline_us = now_us + ISOTP_TIMEOUT_US;
+        }
+        break;
+    default:
+        isotp_tx_end(link, -EOVERFLOW);
+        break;
+    }
+}
+
+static inline void isotp_rx_done(isotp_link_t *link) {
+    link->rx_active = 0;
+    link->rx_messages++;
+    link->rx(link->ctx, link->rx_buf, link->rx_len);
+}
+
+/**
+ * @brief Process a received frame
+ *
+ * @return 0 if the frame belonged to this link, -1 if it is for another ID
+ *         or not an ISO-TP frame
+ */
+static inline int isotp_on_frame(isotp_link_t *link, const struct can_frame *f, uint64_t now_us) {
+    if (f->can_id != link->rx_id || f->can_dlc < 1) {
+        return -1;
+    }
+    const uint8_t *d = f->data;
+    switch (d[0] >> 4) {
+    case ISOTP_PCI_SF: {
+        size_t len = d[0] & 0xF;
+        if (len == 0 || len > 7 || f->can_dlc < len + 1) {
+            return -1;
+        }
+        link->rx_active = 0;        // A new message ends any reception in progress
+        if (len > link->rx_cap) {
+            link->errors++;
+            return 0;
+        }
+        memcpy(link->rx_buf, d + 1, len);
+        link->rx_len = len;
+        isotp_rx_done(link);
+        return 0;
+    }
+    case ISOTP_PCI_FF: {
+        if (f->can_dlc < CAN_MAX_DLEN) {
+            return -1;
+        }
+        size_t len = (size_t)(d[0] & 0xF) << 8 | d[1];
+        size_t first = 6;
+        if (len == 0) {
+            len = (size_t)d[2] << 24 | (size_t)d[3] << 16 | (size_t)d[4] << 8 | d[5];
+            first = 2;
+        }
+        if (len <= 7) {
+            return -1;
+        }
+        link->rx_active = 0;
+        if (len > link->rx_cap) {
+            link->errors++;
+            isotp_send_fc(link, ISOTP_FC_OVFLW);
+            return 0;
+        }
+        memcpy(link->rx_buf, d + CAN_MAX_DLEN - first, first);
+        link->rx_len = len;
+        link->rx_off = first;
+        link->rx_sn = 1;
+        link->rx_block_left = link->block_size;
+        link->rx_active = 1;
+        link->rx_deadline_us = now_us + ISOTP_TIMEOUT_US;
+        isotp_send_fc(link, ISOTP_FC_CTS);
+        return 0;
+    }
+    case ISOTP_PCI_CF: {
+        if (!link->rx_active) {
+            return 0;               // Stray CF: ignored
+        }
+        if ((d[0] & 0xF) != link->rx_sn) {
+            link->rx_active = 0;    // Lost or reordered frame: abort the message
+            link->errors++;
+            return 0;
+        }
+        size_t n = link->rx_len - link->rx_off < 7 ? link->rx_len - link->rx_off : 7;
+        if (f->can_dlc < n + 1) {
+            link->rx_active = 0;
+            link->errors++;
+            return 0;
+        }
+        memcpy(link->rx_buf + link->rx_off, d + 1, n);
+        link->rx_off += n;
+        link->rx_sn = (link->rx_sn + 1) & 0xF;
+        link->rx_deadline_us = now_us + ISOTP_TIMEOUT_US;
+        if (link->rx_off == link->rx_len) {
+            isotp_rx_done(link);
+        } else if (link->block_size && --link->rx_block_left == 0) {
+            link->rx_block_left = link->block_size;
+            isotp_send_fc(link, ISOTP_FC_CTS);
+        }
+        return 0;
+    }
+    case ISOTP_PCI_FC:
+        isotp_on_fc(link, f, now_us);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Blocking ISO-TP endpoint: kernel CAN_ISOTP or a raw socket with a link
+ */
+typedef struct {
+    int fd;
+    int kernel;                     /**< fd is a CAN_ISOTP socket */
+    isotp_link_t link;              /**< Userspace fallback state */
+    uint8_t *rx_buf;
+    size_t rx_cap;
+    size_t rx_len;                  /**< Length of the message just received */
+    int rx_ready;                   /**< rx_buf holds a message not yet returned */
+} isotp_socket_t;
+
+static inline int isotp_socket_tx(void *ctx, const struct can_frame *frame) {
+    isotp_socket_t *s = ctx;
+    return write(s->fd, frame, sizeof(*frame)) == (ssize_t)sizeof(*frame) ? 0 : -1;
+}
+
+static inline void isotp_socket_rx(void *ctx, const uint8_t *data, size_t len) {
+    isotp_socket_t *s = ctx;
+    (void)data;                     // Already in rx_buf
+    s->rx_len = len;
+    s->rx_ready = 1;
+}
+
+/**
+ * @brief Run the userspace link on an existing raw frame socket
+ *
+ * The socket must carry one struct can_frame per read and write (a raw CAN
+ * socket, or a SOCK_SEQPACKET stand-in). It is made non-blocking and owned
+ * by s from now on.
+ *
+ * @param rx_buf Reassembly buffer of rx_cap bytes, owned by the caller
+ */
+static inline void isotp_socket_attach(isotp_socket_t *s, int fd, canid_t tx_id, canid_t rx_id, uint8_t block_size,
+                                       uint8_t stmin, uint8_t *rx_buf, size_t rx_cap) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->rx_buf = rx_buf;
+    s->rx_cap = rx_cap;
+    int one = 1;
+    ioctl(fd, FIONBIO, &one);
+    isotp_init(&s->link, tx_id, rx_id, rx_buf, rx_cap, isotp_socket_tx, isotp_socket_rx, s);
+    s->link.block_size = block_size;
+    s->link.stmin = stmin;
+}
+
+/**
+ * @brief Open an ISO-TP endpoint on a CAN interface
+ *
+ * Uses a kernel CAN_ISOTP socket when the kernel has one, otherwise a raw
+ * socket filtered to rx_id with the userspace link.
+ *
+ * @param s Endpoint to initialize
+ * @param interface CAN interface, e.g. "vcan0"
+ * @param tx_id CAN ID to send on
+ * @param rx_id CAN ID to receive on
+ * @param block_size BS offered to the sender (0 = no limit)
+ * @param stmin STmin offered to the sender (encoded, see isotp_stmin_encode())
+ * @param rx_buf Reassembly buffer, owned by the caller
+ * @param rx_cap Size of rx_buf
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int isotp_socket_open(isotp_socket_t *s, const char *interface, canid_t tx_id, canid_t rx_id,
+                                    uint8_t block_size, uint8_t stmin, uint8_t *rx_buf, size_t rx_cap) {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+
+    int fd = socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_ISOTP);
+    if (fd >= 0) {
+        struct can_isotp_options opts = { .flags = CAN_ISOTP_TX_PADDING | CAN_ISOTP_WAIT_TX_DONE,
+                                          .txpad_content = ISOTP_PAD };
+        struct can_isotp_fc_options fc = { .bs = block_size, .stmin = stmin, .wftmax = 0 };
+        addr.can_addr.tp.tx_id = tx_id;
+        addr.can_addr.tp.rx_id = rx_id;
+        if (ioctl(fd, SIOCGIFINDEX, &ifr) == 0 &&
+            setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &opts, sizeof(opts)) == 0 &&
+            setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_RECV_FC, &fc, sizeof(fc)) == 0) {
+            addr.can_ifindex = ifr.ifr_ifindex;
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+                memset(s, 0, sizeof(*s));
+                s->fd = fd;
+                s->kernel = 1;
+                s->rx_buf = rx_buf;
+                s->rx_cap = rx_cap;
+                return 0;
+            }
+        }
+        close(fd);
+    }
+
+    // Userspace fallback on a raw socket that only sees rx_id
+    fd = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+    struct can_filter filter = { rx_id, (rx_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK) | CAN_EFF_FLAG };
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0 ||
+        setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) < 0) {
+        goto fail;
+    }
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        goto fail;
+    }
+    isotp_socket_attach(s, fd, tx_id, rx_id, block_size, stmin, rx_buf, rx_cap);
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+    }
+    return -1;
+}
+
+// Wait for the raw socket, at most until deadline or the link's next event
+static inline int isotp_socket_wait(isotp_socket_t *s, uint64_t deadline_us) {
+    uint64_t now = isotp_now_us();
+    uint64_t until = isotp_next_us(&s->link);
+    if (deadline_us < until) {
+        until = deadline_us;
+    }
+    uint64_t wait = until > now ? until - now : 0;
+    struct timespec ts = { (time_t)(wait / 1000000), (long)(wait % 1000000) * 1000 };
+    struct pollfd pfd = { s->fd, POLLIN, 0 };
+    if (s->link.tx_state == ISOTP_TX_SENDING && s->link.tx_next_us <= now) {
+        pfd.events |= POLLOUT;      // A CF is due but was refused: wait for room
+    }
+    if (ppoll(&pfd, 1, until == UINT64_MAX ? NULL : &ts, NULL) < 0 && errno != EINTR) {
+        return -1;
+    }
+
+    struct can_frame f;
+    while (read(s->fd, &f, sizeof(f)) == (ssize_t)sizeof(f)) {
+        isotp_on_frame(&s->link, &f, isotp_now_us());
+    }
+    isotp_poll(&s->link, isotp_now_us());
+    return 0;
+}
+
+/**
+ * @brief Send a message and wait until it has been transmitted
+ *
+ * @return 0, or -1 with errno ETIMEDOUT (no flow control), EOVERFLOW
+ *         (receiver refused the size) or a socket error
+ */
+static inline int isotp_socket_send(isotp_socket_t *s, const uint8_t *data, size_t len) {
+    if (s->kernel) {
+        return write(s->fd, data, len) == (ssize_t)len ? 0 : -1;
+    }
+    uint64_t give_up = isotp_now_us() + ISOTP_TIMEOUT_US;
+    while (isotp_send(&s->link, data, len, isotp_now_us()) < 0) {
+        // Only the first frame can be refused here: wait for room on the bus
+        if (errno != EAGAIN || isotp_now_us() >= give_up) {
+            return -1;
+        }
+        usleep(100);
+    }
+    while (isotp_busy(&s->link)) {
+        if (isotp_socket_wait(s, UINT64_MAX) < 0) {
+            return -1;
+        }
+    }
+    if (s->link.tx_result < 0) {
+        errno = -s->link.tx_result;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receive one message into the endpoint's buffer
+ *
+ * One message is buffered: one that arrives while isotp_socket_send() waits
+ * for flow control is returned by the next call.
+ *
+ * @param s Endpoint
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return Message length (the data is in rx_buf), or -1 with errno
+ *         ETIMEDOUT or a socket error
+ */
+static inline ssize_t isotp_socket_recv(isotp_socket_t *s, int timeout_ms) {
+    uint64_t deadline = timeout_ms < 0 ? UINT64_MAX : isotp_now_us() + (uint64_t)timeout_ms * 1000;
+    if (s->kernel) {
+        struct pollfd pfd = { s->fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r <= 0) {
+            errno = r == 0 ? ETIMEDOUT : errno;
+            return -1;
+        }
+        return read(s->fd, s->rx_buf, s->rx_cap);
+    }
+    // A message may already have arrived while a send was waiting for flow control
+    while (!s->rx_ready) {
+        if (isotp_now_us() >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (isotp_socket_wait(s, deadline) < 0) {
+            return -1;
+        }
+    }
+    s->rx_ready = 0;
+    return (ssize_t)s->rx_len;
+}
+
+/**
+ * @brief Close the endpoint's socket
+ */
+static inline void isotp_socket_close(isotp_socket_t *s) {
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+}
+
+#endif /* ISOTP_H */
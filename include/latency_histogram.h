@@ -0,0 +1,148 @@
+/**
+ * @file latency_histogram.h
+ * @brief Fixed-size log-linear latency histogram
+ *
+ * Records nanosecond latencies into buckets with 16 linear sub-buckets per
+ * power of two (about 6% relative precision) from 1 ns to beyond 10^18 ns,
+ * in a flat array with no allocation. Recording is a couple of shifts and an
+ * increment, cheap enough for hot paths. Not thread-safe; keep one per
+ * thread and merge with latency_histogram_merge().
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LH_SUB_BITS 4                                /**< log2(sub-buckets per octave) */
+#define LH_SUB_BUCKETS (1 << LH_SUB_BITS)
+#define LH_BUCKETS (64 * LH_SUB_BUCKETS)
+
+/**
+ * @brief Latency histogram with summary statistics
+ */
+typedef struct {
+    uint64_t count;                 /**< Samples recorded */
+    uint64_t min_ns;                /**< Smallest sample */
+    uint64_t max_ns;                /**< Largest sample */
+    uint64_t total_ns;              /**< Sum of samples (for the mean) */
+    uint64_t buckets[LH_BUCKETS];   /**< Sample counts */
+} latency_histogram_t;
+
+/**
+ * @brief Reset a histogram
+ */
+static inline void latency_histogram_init(latency_histogram_t *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+// Bucket index: values below LH_SUB_BUCKETS map 1:1, larger values keep
+// their top LH_SUB_BITS + 1 bits
+static inline unsigned lh_bucket(uint64_t v) {
+    if (v < LH_SUB_BUCKETS) {
+        return (unsigned)v;
+    }
+    unsigned msb = 63 - (unsigned)__builtin_clzll(v);
+    unsigned shift = msb - LH_SUB_BITS;
+    return ((shift + 1) << LH_SUB_BITS) + (unsigned)((v >> shift) & (LH_SUB_BUCKETS - 1));
+}
+
+// Largest value that falls into a bucket
+static inline uint64_t lh_bucket_upper(unsigned idx) {
+    if (idx < LH_SUB_BUCKETS) {
+        return idx;
+    }
+    unsigned shift = (idx >> LH_SUB_BITS) - 1;
+    uint64_t base = (uint64_t)(LH_SUB_BUCKETS + (idx & (LH_SUB_BUCKETS - 1))) << shift;
+    return base + ((1ULL << shift) - 1);
+}
+
+/**
+ * @brief Record one latency sample
+ */
+static inline void latency_histogram_record(latency_histogram_t *h, uint64_t ns) {
+    if (h->count == 0 || ns < h->min_ns) {
+        h->min_ns = ns;
+    }
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->total_ns += ns;
+    h->count++;
+    h->buckets[lh_bucket(ns)]++;
+}
+
+/**
+ * @brief Value at or below which the given fraction of samples fall
+ *
+ * @param h Histogram
+ * @param fraction Quantile in [0, 1], e.g. 0.99
+ * @return Upper bound of the quantile's bucket in ns (0 when empty)
+ */
+static inline uint64_t latency_histogram_percentile(const latency_histogram_t *h, double fraction) {
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(fraction * (double)h->count);
+    if (target >= h->count) {
+        target = h->count - 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LH_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > target) {
+            uint64_t upper = lh_bucket_upper(i);
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/**
+ * @brief Mean latency in ns
+ */
+static inline double latency_histogram_mean(const latency_histogram_t *h) {
+    return h->count ? (double)h->total_ns / (double)h->count : 0.0;
+}
+
+/**
+ * @brief Add another histogram's samples into dst
+ */
+static inline void latency_histogram_merge(latency_histogram_t *dst, const latency_histogram_t *src) {
+    if (src->count == 0) {
+        return;
+    }
+    if (dst->count == 0 || src->min_ns < dst->min_ns) {
+        dst->min_ns = src->min_ns;
+    }
+    if (src->max_ns > dst->max_ns) {
+        dst->max_ns = src->max_ns;
+    }
+    dst->count += src->count;
+    dst->total_ns += src->total_ns;
+    for (unsigned i = 0; i < LH_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+/**
+ * @brief Print a one-line summary in microseconds
+ */
+static inline void latency_histogram_print(const latency_histogram_t *h, const char *label) {
+    if (h->count == 0) {
+        printf("%s: no samples\n", label);
+        return;
+    }
+    printf("%s (%lu samples): min %.3f µs, avg %.3f µs, p50 %.3f µs, p99 %.3f µs, "
+           "p99.9 %.3f µs, max %.3f µs\n",
+           label, (unsigned long)h->count, h->min_ns / 1000.0,
+           latency_histogram_mean(h) / 1000.0,
+           latency_histogram_percentile(h, 0.50) / 1000.0,
+           latency_histogram_percentile(h, 0.99) / 1000.0,
+           latency_histogram_percentile(h, 0.999) / 1000.0,
+           h->max_ns / 1000.0);
+}
+
+#endif /* LATENCY_HISTOGRAM_H */
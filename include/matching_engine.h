@@ -0,0 +1,411 @@
+/**
+ * @file matching_engine.h
+ * @brief Price-time priority limit order book with preallocated pools
+ *
+ * Each symbol has a bid and an ask side made of price levels kept in
+ * best-first order; each level holds a FIFO of resting orders. Incoming
+ * orders match against the opposite side from the best level down, oldest
+ * order first, at the resting order's price. Any remainder rests on the
+ * book.
+ *
+ * Orders and levels come from mem_pool_t pools sized at startup, so the
+ * matching path never calls malloc. Exchange order IDs encode the order's
+ * pool slot, which makes cancel lookups O(1) without a hash table.
+ *
+ * The engine is single-threaded by design.
+ */
+
+#ifndef MATCHING_ENGINE_H
+#define MATCHING_ENGINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mem_pool.h"
+#include "trading_protocol.h"
+
+#define ME_MAX_SYMBOLS 64           /**< Books per engine */
+#define ME_SLOT_BITS 24             /**< Low ID bits holding the pool slot */
+
+struct me_level;
+
+/**
+ * @brief Resting or incoming order
+ */
+typedef struct me_order {
+    struct me_order *next;      /**< Next (newer) order at the level; pool link when free */
+    struct me_order *prev;      /**< Previous (older) order at the level */
+    struct me_level *level;     /**< Level the order rests on, NULL while incoming */
+    uint64_t id;                /**< Exchange order ID, 0 when free */
+    uint64_t client_order_id;   /**< Client-assigned ID */
+    void *owner;                /**< Caller context (e.g. session) */
+    int64_t price;              /**< Limit price in ticks */
+    uint32_t remaining;         /**< Open quantity */
+    uint32_t quantity;          /**< Original quantity */
+    uint16_t book;              /**< Book index */
+    uint8_t side;               /**< SIDE_BUY / SIDE_SELL */
+} me_order_t;
+
+/**
+ * @brief All resting orders at one price
+ */
+typedef struct me_level {
+    struct me_level *next;      /**< Next worse level; pool link when free */
+    struct me_level *prev;      /**< Next better level */
+    int64_t price;              /**< Level price in ticks */
+    uint64_t total_qty;         /**< Sum of remaining quantity */
+    uint32_t count;             /**< Orders at the level */
+    me_order_t *head;           /**< Oldest order */
+    me_order_t *tail;           /**< Newest order */
+} me_level_t;
+
+/**
+ * @brief Order book for one symbol
+ */
+typedef struct {
+    char symbol[SYMBOL_LEN + 1];    /**< NUL-terminated symbol */
+    me_level_t *bids;               /**< Best (highest) bid first */
+    me_level_t *asks;               /**< Best (lowest) ask first */
+    int64_t last_price;             /**< Last execution price */
+    uint64_t volume;                /**< Shares traded */
+} me_book_t;
+
+/**
+ * @brief Matching engine: books plus order and level pools
+ */
+typedef struct {
+    me_book_t books[ME_MAX_SYMBOLS];
+    int num_books;
+    mem_pool_t orders;              /**< me_order_t pool */
+    mem_pool_t levels;              /**< me_level_t pool */
+    uint64_t next_seq;              /**< High bits of the next order ID */
+    uint64_t executions;            /**< Matches performed */
+} me_engine_t;
+
+/**
+ * @brief Called for each execution, before the filled order is released
+ *
+ * @param ctx Caller context
+ * @param maker Resting order
+ * @param taker Incoming order
+ * @param price Execution price in ticks
+ * @param qty Shares executed (remaining fields are already reduced)
+ */
+typedef void (*me_exec_fn)(void *ctx, const me_order_t *maker, const me_order_t *taker,
+                           int64_t price, uint32_t qty);
+
+/**
+ * @brief Create an engine with fixed order and level capacity
+ *
+ * @return 0 on success, -1 on failure
+ */
+static inline int me_engine_init(me_engine_t *me, size_t max_orders, size_t max_levels) {
+    memset(me, 0, sizeof(*me));
+    if (max_orders >= (1UL << ME_SLOT_BITS)) {
+        fprintf(stderr, "matching engine: too many orders\n");
+        return -1;
+    }
+    if (mem_pool_init(&me->orders, sizeof(me_order_t), max_orders, MEM_NODE_LOCAL) < 0) {
+        return -1;
+    }
+    if (mem_pool_init(&me->levels, sizeof(me_level_t), max_levels, MEM_NODE_LOCAL) < 0) {
+        mem_pool_destroy(&me->orders);
+        return -1;
+    }
+    me->next_seq = 1;
+    return 0;
+}
+
+/**
+ * @brief Release engine memory
+ */
+static inline void me_engine_destroy(me_engine_t *me) {
+    mem_pool_destroy(&me->orders);
+    mem_pool_destroy(&me->levels);
+}
+
+/**
+ * @brief Find a book by symbol
+ *
+ * @return Book index, or -1 if unknown
+ */
+static inline int me_find_book(const me_engine_t *me, const char *symbol, size_t len) {
+    if (len > SYMBOL_LEN) {
+        return -1;
+    }
+    for (int i = 0; i < me->num_books; i++) {
+        if (strncmp(me->books[i].symbol, symbol, len) == 0 && me->books[i].symbol[len] == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Add a book for a symbol (or return the existing one)
+ *
+ * @return Book index, or -1 if the engine is full
+ */
+static inline int me_add_book(me_engine_t *me, const char *symbol) {
+    size_t len = strnlen(symbol, SYMBOL_LEN + 1);
+    int idx = me_find_book(me, symbol, len);
+    if (idx >= 0) {
+        return idx;
+    }
+    if (me->num_books >= ME_MAX_SYMBOLS || len > SYMBOL_LEN) {
+        return -1;
+    }
+    idx = me->num_books++;
+    memset(&me->books[idx], 0, sizeof(me_book_t));
+    memcpy(me->books[idx].symbol, symbol, len);
+    return idx;
+}
+
+/**
+ * @brief Best bid price in ticks (0 if the side is empty)
+ */
+static inline int64_t me_best_bid(const me_book_t *book) {
+    return book->bids ? book->bids->price : 0;
+}
+
+/**
+ * @brief Best ask price in ticks (0 if the side is empty)
+ */
+static inline int64_t me_best_ask(const me_book_t *book) {
+    return book->asks ? book->asks->price : 0;
+}
+
+// Pool slot of an order, encoded in the low bits of its ID
+static inline uint64_t me_order_slot(const me_engine_t *me, const me_order_t *o) {
+    return (uint64_t)((const char *)o - (const char *)me->orders.arena.base) / me->orders.obj_size;
+}
+
+/**
+ * @brief Allocate an incoming order and assign its exchange ID
+ *
+ * The order is not matched yet, so the caller can acknowledge it first.
+ *
+ * @return Order, or NULL if the order pool is exhausted
+ */
+static inline me_order_t *me_new_order(me_engine_t *me, int book, uint8_t side, int64_t price,
+                                       uint32_t qty, uint64_t client_order_id, void *owner) {
+    me_order_t *o = mem_pool_alloc(&me->orders);
+    if (!o) {
+        return NULL;
+    }
+    o->id = (me->next_seq++ << ME_SLOT_BITS) | me_order_slot(me, o);
+    o->client_order_id = client_order_id;
+    o->owner = owner;
+    o->price = price;
+    o->remaining = qty;
+    o->quantity = qty;
+    o->book = (uint16_t)book;
+    o->side = side;
+    return o;
+}
+
+// Return an order to the pool
+static inline void me_release_order(me_engine_t *me, me_order_t *o) {
+    o->id = 0;
+    mem_pool_free(&me->orders, o);
+}
+
+// Unlink an order from its level, dropping the level when it empties
+static inline void me_unlink_order(me_engine_t *me, me_order_t *o) {
+    me_level_t *lvl = o->level;
+    me_book_t *book = &me->books[o->book];
+
+    if (o->prev) {
+        o->prev->next = o->next;
+    } else {
+        lvl->head = o->next;
+    }
+    if (o->next) {
+        o->next->prev = o->prev;
+    } else {
+        lvl->tail = o->prev;
+    }
+    lvl->total_qty -= o->remaining;
+    lvl->count--;
+    o->level = NULL;
+
+    if (lvl->count == 0) {
+        me_level_t **side = o->side == SIDE_BUY ? &book->bids : &book->asks;
+        if (lvl->prev) {
+            lvl->prev->next = lvl->next;
+        } else {
+            *side = lvl->next;
+        }
+        if (lvl->next) {
+            lvl->next->prev = lvl->prev;
+        }
+        mem_pool_free(&me->levels, lvl);
+    }
+}
+
+// Append an order to its side, creating the level if needed
+static inline int me_rest_order(me_engine_t *me, me_order_t *o) {
+    me_book_t *book = &me->books[o->book];
+    me_level_t **side = o->side == SIDE_BUY ? &book->bids : &book->asks;
+    me_level_t *prev = NULL, *lvl = *side;
+
+    // Levels are best first: descending for bids, ascending for asks
+    while (lvl && (o->side == SIDE_BUY ? lvl->price > o->price : lvl->price < o->price)) {
+        prev = lvl;
+        lvl = lvl->next;
+    }
+
+    if (!lvl || lvl->price != o->price) {
+        me_level_t *fresh = mem_pool_alloc(&me->levels);
+        if (!fresh) {
+            return -1;
+        }
+        fresh->price = o->price;
+        fresh->prev = prev;
+        fresh->next = lvl;
+        if (lvl) {
+            lvl->prev = fresh;
+        }
+        if (prev) {
+            prev->next = fresh;
+        } else {
+            *side = fresh;
+        }
+        lvl = fresh;
+    }
+
+    o->level = lvl;
+    o->next = NULL;
+    o->prev = lvl->tail;
+    if (lvl->tail) {
+        lvl->tail->next = o;
+    } else {
+        lvl->head = o;
+    }
+    lvl->tail = o;
+    lvl->total_qty += o->remaining;
+    lvl->count++;
+    return 0;
+}
+
+/**
+ * @brief Match an incoming order and rest any remainder
+ *
+ * @param me Engine
+ * @param taker Order from me_new_order()
+ * @param on_exec Execution callback (may be NULL)
+ * @param ctx Callback context
+ * @return Quantity left resting; 0 means the order was fully filled and
+ *         released, -1 means the remainder could not rest (level pool
+ *         exhausted) and the order was released
+ */
+static inline int64_t me_match(me_engine_t *me, me_order_t *taker, me_exec_fn on_exec, void *ctx) {
+    me_book_t *book = &me->books[taker->book];
+    me_level_t **opposite = taker->side == SIDE_BUY ? &book->asks : &book->bids;
+
+    while (taker->remaining > 0 && *opposite) {
+        me_level_t *lvl = *opposite;
+        int crosses = taker->side == SIDE_BUY ? lvl->price <= taker->price
+                                              : lvl->price >= taker->price;
+        if (!crosses) {
+            break;
+        }
+
+        me_order_t *maker = lvl->head;
+        uint32_t qty = maker->remaining < taker->remaining ? maker->remaining : taker->remaining;
+        int64_t price = lvl->price;
+
+        maker->remaining -= qty;
+        taker->remaining -= qty;
+        lvl->total_qty -= qty;
+        book->last_price = price;
+        book->volume += qty;
+        me->executions++;
+
+        if (on_exec) {
+            on_exec(ctx, maker, taker, price, qty);
+        }
+
+        if (maker->remaining == 0) {
+            me_unlink_order(me, maker);
+            me_release_order(me, maker);
+        }
+    }
+
+    if (taker->remaining == 0) {
+        me_release_order(me, taker);
+        return 0;
+    }
+    if (me_rest_order(me, taker) < 0) {
+        me_release_order(me, taker);
+        return -1;
+    }
+    return taker->remaining;
+}
+
+/**
+ * @brief Look up a live order by exchange ID
+ *
+ * @return Order, or NULL if the ID is unknown or no longer resting
+ */
+static inline me_order_t *me_find_order(me_engine_t *me, uint64_t id) {
+    uint64_t slot = id & ((1ULL << ME_SLOT_BITS) - 1);
+    if (id == 0 || slot >= me->orders.capacity) {
+        return NULL;
+    }
+    me_order_t *o = (me_order_t *)((char *)me->orders.arena.base + slot * me->orders.obj_size);
+    return (o->id == id && o->level) ? o : NULL;
+}
+
+/**
+ * @brief Cancel a resting order
+ *
+ * @param me Engine
+ * @param id Exchange order ID
+ * @param out Receives a copy of the order before release (may be NULL)
+ * @return 0 on success, -1 if the order is not resting
+ */
+static inline int me_cancel(me_engine_t *me, uint64_t id, me_order_t *out) {
+    me_order_t *o = me_find_order(me, id);
+    if (!o) {
+        return -1;
+    }
+    if (out) {
+        *out = *o;
+    }
+    me_unlink_order(me, o);
+    me_release_order(me, o);
+    return 0;
+}
+
+/**
+ * @brief Replace a quote: cancel the order in *id, enter a new one and match it
+ *
+ * Fills against resting orders go to on_exec like any other execution, so
+ * the owners of orders the new quote crosses hear about them.
+ *
+ * @param id Resting quote to replace (0 for none); set to the new quote's
+ *           ID if it rests, 0 otherwise
+ * @param owner Owner of the new quote (NULL for the exchange's own)
+ * @return Quantity left resting, as me_match(); -1 if the order pool is exhausted
+ */
+static inline int64_t me_requote(me_engine_t *me, int book, uint64_t *id, uint8_t side, int64_t price,
+                                 uint32_t qty, void *owner, me_exec_fn on_exec, void *ctx) {
+    if (*id) {
+        me_cancel(me, *id, NULL);
+        *id = 0;
+    }
+    me_order_t *o = me_new_order(me, book, side, price, qty, 0, owner);
+    if (!o) {
+        return -1;
+    }
+    uint64_t new_id = o->id;
+    int64_t resting = me_match(me, o, on_exec, ctx);
+    if (resting > 0) {
+        *id = new_id;
+    }
+    return resting;
+}
+
+#endif /* MATCHING_ENGINE_H */
@@ -0,0 +1,276 @@
+/**
+ * @file mem_pool.h
+ * @brief Hugepage-backed, NUMA-aware memory arenas and object pools
+ *
+ * Large long-lived arrays (connection tables, packet buffers) are a poor
+ * fit for the default heap: they are spread over 4 KB pages, which costs
+ * a dTLB entry per page, and on multi-socket machines the pages land on
+ * whichever node first touched them. An arena maps its memory once,
+ * preferring explicit hugepages (MAP_HUGETLB), then transparent hugepages
+ * (madvise(MADV_HUGEPAGE) on a 2 MB aligned mapping), then plain pages.
+ * The range is bound to a NUMA node with mbind() before it is prefaulted,
+ * so every page is resident and local before the hot path runs.
+ *
+ * mbind/getcpu are invoked as raw system calls so no libnuma is needed;
+ * on single-node machines or kernels without NUMA support the binding step
+ * is skipped and the arena still works.
+ *
+ * mem_pool_t carves a fixed-size object pool out of an arena. It is not
+ * thread-safe: give each worker its own pool, created from that worker's
+ * thread so MEM_NODE_LOCAL resolves to the worker's node.
+ */
+
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define MEM_HUGE_PAGE_SIZE (2UL * 1024 * 1024)   /**< x86-64/arm64 default hugepage */
+#define MEM_CACHE_LINE 64                        /**< Object alignment in pools */
+#define MEM_NODE_ANY (-1)                        /**< Do not bind to a node */
+#define MEM_NODE_LOCAL (-2)                      /**< Bind to the calling CPU's node */
+
+/**
+ * @brief How an arena's memory is backed
+ */
+typedef enum {
+    MEM_BACKING_PAGES = 0,      /**< Regular 4 KB pages */
+    MEM_BACKING_THP,            /**< Transparent hugepages requested via madvise */
+    MEM_BACKING_HUGETLB         /**< Explicit hugepages from the hugetlbfs pool */
+} mem_backing_t;
+
+/**
+ * @brief Contiguous mapping bound to a NUMA node
+ */
+typedef struct {
+    void *base;                 /**< Start of usable memory */
+    size_t size;                /**< Usable size in bytes */
+    void *map_base;             /**< Start of the mapping (for munmap) */
+    size_t map_size;            /**< Length of the mapping */
+    int node;                   /**< Bound node, or MEM_NODE_ANY */
+    mem_backing_t backing;      /**< Page backing that was obtained */
+} mem_arena_t;
+
+/**
+ * @brief Fixed-size object pool inside an arena
+ */
+typedef struct {
+    mem_arena_t arena;          /**< Backing memory */
+    size_t obj_size;            /**< Object stride (cache-line rounded) */
+    size_t capacity;            /**< Number of objects */
+    size_t free_count;          /**< Objects currently free */
+    void *free_list;            /**< Singly linked free objects */
+} mem_pool_t;
+
+/**
+ * @brief NUMA node of the CPU the caller is running on
+ *
+ * @return Node number (0 when the kernel cannot tell)
+ */
+static inline int mem_current_node(void) {
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0) {
+        return 0;
+    }
+    return (int)node;
+}
+
+/**
+ * @brief Human-readable name of a backing type
+ */
+static inline const char *mem_backing_name(mem_backing_t backing) {
+    switch (backing) {
+        case MEM_BACKING_HUGETLB: return "hugetlb";
+        case MEM_BACKING_THP:     return "transparent hugepages";
+        default:                  return "4K pages";
+    }
+}
+
+/**
+ * @brief Bind a range to one NUMA node
+ *
+ * @return 0 on success, -1 if the kernel refused (no NUMA, no permission)
+ */
+static inline int mem_bind_node(void *addr, size_t len, int node) {
+    unsigned long mask[4] = {0};
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) {
+        errno = EINVAL;
+        return -1;
+    }
+    mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+    return (int)syscall(SYS_mbind, addr, len, MPOL_BIND, mask, sizeof(mask) * 8 + 1, 0);
+}
+
+/**
+ * @brief Map an arena, preferring hugepages, and bind it to a node
+ *
+ * Sizes of at least MEM_HUGE_PAGE_SIZE are rounded up to a whole number of
+ * hugepages; smaller arenas use regular pages. The memory is zeroed and
+ * prefaulted on return.
+ *
+ * @param arena Arena to initialize
+ * @param size Requested size in bytes
+ * @param node NUMA node, MEM_NODE_LOCAL or MEM_NODE_ANY
+ * @return 0 on success, -1 on failure
+ */
+static inline int mem_arena_init(mem_arena_t *arena, size_t size, int node) {
+    memset(arena, 0, sizeof(*arena));
+    arena->node = MEM_NODE_ANY;
+
+    long page = sysconf(_SC_PAGESIZE);
+    int huge = size >= MEM_HUGE_PAGE_SIZE;
+    size_t align = huge ? MEM_HUGE_PAGE_SIZE : (size_t)page;
+    size = (size + align - 1) & ~(align - 1);
+
+    void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {
+            arena->backing = MEM_BACKING_HUGETLB;
+            arena->map_base = mem;
+            arena->map_size = size;
+        }
+    }
+#endif
+
+    if (mem == MAP_FAILED && huge) {
+        // No reserved hugepages: over-map so the range can be 2 MB aligned,
+        // which THP needs to back it with huge pages
+        size_t map_size = size + MEM_HUGE_PAGE_SIZE;
+        char *raw = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            perror("mmap arena");
+            return -1;
+        }
+        uintptr_t start = ((uintptr_t)raw + MEM_HUGE_PAGE_SIZE - 1) & ~(MEM_HUGE_PAGE_SIZE - 1);
+        size_t head = start - (uintptr_t)raw;
+        if (head > 0) {
+            munmap(raw, head);
+        }
+        size_t tail = map_size - head - size;
+        if (tail > 0) {
+            munmap((char *)start + size, tail);
+        }
+        mem = (void *)start;
+        arena->map_base = mem;
+        arena->map_size = size;
+#ifdef MADV_HUGEPAGE
+        if (madvise(mem, size, MADV_HUGEPAGE) == 0) {
+            arena->backing = MEM_BACKING_THP;
+        }
+#endif
+    } else if (mem == MAP_FAILED) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("mmap arena");
+            return -1;
+        }
+        arena->map_base = mem;
+        arena->map_size = size;
+    }
+
+    // Bind before the first touch so pages are allocated on the target node
+    if (node == MEM_NODE_LOCAL) {
+        node = mem_current_node();
+    }
+    if (node >= 0 && mem_bind_node(mem, size, node) == 0) {
+        arena->node = node;
+    }
+
+    // Prefault so page faults and zeroing happen here, not on the hot path
+    for (size_t off = 0; off < size; off += (size_t)page) {
+        ((volatile char *)mem)[off] = 0;
+    }
+
+    arena->base = mem;
+    arena->size = size;
+    return 0;
+}
+
+/**
+ * @brief Unmap an arena
+ */
+static inline void mem_arena_destroy(mem_arena_t *arena) {
+    if (arena->map_base) {
+        munmap(arena->map_base, arena->map_size);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * @brief Create a pool of fixed-size objects
+ *
+ * @param pool Pool to initialize
+ * @param obj_size Size of each object
+ * @param capacity Number of objects
+ * @param node NUMA node, MEM_NODE_LOCAL or MEM_NODE_ANY
+ * @return 0 on success, -1 on failure
+ */
+static inline int mem_pool_init(mem_pool_t *pool, size_t obj_size, size_t capacity, int node) {
+    memset(pool, 0, sizeof(*pool));
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    pool->obj_size = (obj_size + MEM_CACHE_LINE - 1) & ~((size_t)MEM_CACHE_LINE - 1);
+    pool->capacity = capacity;
+
+    if (mem_arena_init(&pool->arena, pool->obj_size * capacity, node) < 0) {
+        return -1;
+    }
+
+    // Thread the free list in address order so early allocations are dense
+    char *base = pool->arena.base;
+    for (size_t i = capacity; i > 0; i--) {
+        void *obj = base + (i - 1) * pool->obj_size;
+        *(void **)obj = pool->free_list;
+        pool->free_list = obj;
+    }
+    pool->free_count = capacity;
+    return 0;
+}
+
+/**
+ * @brief Take an object from the pool
+ *
+ * @return Zeroed object, or NULL if the pool is exhausted
+ */
+static inline void *mem_pool_alloc(mem_pool_t *pool) {
+    void *obj = pool->free_list;
+    if (!obj) {
+        return NULL;
+    }
+    pool->free_list = *(void **)obj;
+    pool->free_count--;
+    memset(obj, 0, pool->obj_size);
+    return obj;
+}
+
+/**
+ * @brief Return an object to the pool
+ */
+static inline void mem_pool_free(mem_pool_t *pool, void *obj) {
+    *(void **)obj = pool->free_list;
+    pool->free_list = obj;
+    pool->free_count++;
+}
+
+/**
+ * @brief Release the pool's arena
+ */
+static inline void mem_pool_destroy(mem_pool_t *pool) {
+    mem_arena_destroy(&pool->arena);
+    memset(pool, 0, sizeof(*pool));
+}
+
+#endif /* MEM_POOL_H */
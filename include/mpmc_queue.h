@@ -0,0 +1,172 @@
+/**
+ * @file mpmc_queue.h
+ * @brief Bounded lock-free multi-producer/multi-consumer queue
+ *
+ * Implementation of Dmitry Vyukov's bounded MPMC queue. Each cell carries a
+ * sequence number that tells producers and consumers whether the cell is
+ * ready for them, so an enqueue or dequeue is one CAS on the shared position
+ * plus one release store on the cell. Producers and consumers only contend
+ * with their own kind; the two positions live on separate cache lines.
+ *
+ * Items are opaque pointers. NULL cannot be stored since it is the "empty"
+ * return value of mpmc_queue_pop().
+ */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define MPMC_CACHE_LINE 64      /**< Cache line size used for padding */
+
+/**
+ * @brief Queue cell: sequence number plus payload
+ */
+typedef struct {
+    atomic_size_t seq;          /**< Position this cell is ready for */
+    void *data;                 /**< Stored item */
+} mpmc_cell_t;
+
+/**
+ * @brief Bounded MPMC queue
+ */
+typedef struct {
+    _Alignas(MPMC_CACHE_LINE) mpmc_cell_t *cells;   /**< Ring of cells */
+    size_t mask;                                    /**< Capacity - 1 */
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t enqueue_pos;  /**< Next producer slot */
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t dequeue_pos;  /**< Next consumer slot */
+} mpmc_queue_t;
+
+/**
+ * @brief Initialize a queue
+ *
+ * @param q Queue to initialize
+ * @param capacity Number of slots (rounded up to a power of 2, minimum 2)
+ * @return 0 on success, -1 on failure
+ */
+static inline int mpmc_queue_init(mpmc_queue_t *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    memset(q, 0, sizeof(*q));
+    q->cells = aligned_alloc(MPMC_CACHE_LINE,
+                             (size * sizeof(mpmc_cell_t) + MPMC_CACHE_LINE - 1) &
+                             ~((size_t)MPMC_CACHE_LINE - 1));
+    if (!q->cells) {
+        return -1;
+    }
+    q->mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].data = NULL;
+    }
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+/**
+ * @brief Free queue storage (items still queued are not touched)
+ */
+static inline void mpmc_queue_destroy(mpmc_queue_t *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+/**
+ * @brief Enqueue an item
+ *
+ * @param q Queue
+ * @param item Non-NULL item
+ * @return 0 on success, -1 if the queue is full
+ */
+static inline int mpmc_queue_push(mpmc_queue_t *q, void *item) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    mpmc_cell_t *cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Cell is free for this position: claim it
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Cell still holds an item from the previous lap
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->data = item;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Dequeue an item
+ *
+ * @param q Queue
+ * @return Oldest item, or NULL if the queue is empty
+ */
+static inline void *mpmc_queue_pop(mpmc_queue_t *q) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    mpmc_cell_t *cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Producer has not filled this cell yet
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    void *item = cell->data;
+    // Hand the cell to the producer one lap ahead
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return item;
+}
+
+/**
+ * @brief Approximate number of queued items (exact when quiescent)
+ */
+static inline size_t mpmc_queue_size(mpmc_queue_t *q) {
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+/**
+ * @brief Queue capacity
+ */
+static inline size_t mpmc_queue_capacity(const mpmc_queue_t *q) {
+    return q->mask + 1;
+}
+
+#endif /* MPMC_QUEUE_H */
@@ -0,0 +1,207 @@
+/**
+ * @file order_journal.h
+ * @brief Memory-mapped journal of outbound sequenced session messages
+ *
+ * Every sequenced message a session sends is encoded directly into its
+ * journal slot and sent from there. The slot for sequence n is
+ * (n - 1) % capacity. The slot for the next message is kept free, since
+ * it is encoded in place before it is committed, so the most recent
+ * `capacity - 1` messages can be resent byte for byte. Each slot is one
+ * cache line.
+ *
+ * The header also holds the session's persistent state:
+ *  - the session ID;
+ *  - the last sequence number sent;
+ *  - the next sequence number expected from the peer.
+ * With a file-backed journal this state survives a restart of the
+ * process. Because the mapping is MAP_SHARED, it also survives the process
+ * being killed, but not a machine crash: pages are not synced to disk
+ * per message. A NULL path gives an anonymous in-memory journal, as used
+ * by the exchange side for each session it accepts.
+ */
+
+#ifndef ORDER_JOURNAL_H
+#define ORDER_JOURNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trading_protocol.h"
+
+#define ORDER_JOURNAL_MAGIC 0x4f4a524eu     /**< "OJRN" */
+#define ORDER_JOURNAL_VERSION 1
+#define ORDER_JOURNAL_SLOT 64               /**< Bytes per message slot */
+
+_Static_assert(sizeof(trading_msg_t) <= ORDER_JOURNAL_SLOT, "journal slot too small");
+
+/**
+ * @brief Journal file header, one slot long
+ */
+typedef struct {
+    uint32_t magic;                 /**< ORDER_JOURNAL_MAGIC once initialized */
+    uint32_t version;               /**< ORDER_JOURNAL_VERSION */
+    uint32_t capacity;              /**< Slots, power of 2 */
+    uint32_t slot_size;             /**< ORDER_JOURNAL_SLOT */
+    uint64_t session_id;            /**< Session this journal belongs to */
+    uint32_t out_seq;               /**< Last sequence number sent */
+    uint32_t in_next;               /**< Next sequence number expected from the peer */
+    uint8_t reserved[ORDER_JOURNAL_SLOT - 32];
+} order_journal_header_t;
+
+/**
+ * @brief Process-local journal handle
+ */
+typedef struct {
+    order_journal_header_t *hdr;    /**< Mapped header; slots follow */
+    uint8_t *slots;                 /**< First slot */
+    size_t map_size;                /**< Bytes mapped */
+    int fd;                         /**< Backing file, -1 for anonymous */
+    int recovered;                  /**< Set if an existing journal was reopened */
+} order_journal_t;
+
+/**
+ * @brief Open or create a journal
+ *
+ * An existing file with a matching header is reopened as-is, keeping its
+ * session ID and sequence numbers. Anything else is reinitialized.
+ *
+ * @param j Handle to initialize
+ * @param path Journal file, or NULL for an anonymous in-memory journal
+ * @param capacity Slots (rounded up to a power of 2, at least 2); one fewer messages are retained
+ * @param session_id Session ID for a new journal
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int order_journal_open(order_journal_t *j, const char *path, uint32_t capacity,
+                                     uint64_t session_id) {
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+
+    uint32_t count = 2;
+    while (count < capacity) {
+        count <<= 1;
+    }
+    size_t size = (size_t)(count + 1) * ORDER_JOURNAL_SLOT;
+
+    void *base;
+    if (path) {
+        j->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (j->fd < 0) {
+            return -1;
+        }
+        struct stat st;
+        if (fstat(j->fd, &st) < 0) {
+            goto fail;
+        }
+        j->recovered = (size_t)st.st_size == size;
+        if (!j->recovered && ftruncate(j->fd, (off_t)size) < 0) {
+            goto fail;
+        }
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+    } else {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base == MAP_FAILED) {
+        goto fail;
+    }
+    j->hdr = base;
+    j->slots = (uint8_t *)base + ORDER_JOURNAL_SLOT;
+    j->map_size = size;
+
+    order_journal_header_t *hdr = j->hdr;
+    if (j->recovered && (hdr->magic != ORDER_JOURNAL_MAGIC || hdr->version != ORDER_JOURNAL_VERSION ||
+                         hdr->capacity != count || hdr->slot_size != ORDER_JOURNAL_SLOT)) {
+        j->recovered = 0;
+    }
+    if (!j->recovered) {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->version = ORDER_JOURNAL_VERSION;
+        hdr->capacity = count;
+        hdr->slot_size = ORDER_JOURNAL_SLOT;
+        hdr->session_id = session_id;
+        hdr->in_next = 1;
+        hdr->magic = ORDER_JOURNAL_MAGIC;
+    }
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        if (j->fd >= 0) {
+            close(j->fd);
+            j->fd = -1;
+        }
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Slot that sequence number seq is (or will be) stored in
+ */
+static inline trading_msg_t *order_journal_slot(const order_journal_t *j, uint32_t seq) {
+    return (trading_msg_t *)(j->slots + (size_t)((seq - 1) & (j->hdr->capacity - 1)) * ORDER_JOURNAL_SLOT);
+}
+
+/**
+ * @brief Slot for the next message to be journaled
+ *
+ * Encode the message body in place, then call order_journal_commit(). The
+ * slot holds no retained message, so claiming without committing is
+ * harmless.
+ */
+static inline trading_msg_t *order_journal_claim(const order_journal_t *j) {
+    return order_journal_slot(j, j->hdr->out_seq + 1);
+}
+
+/**
+ * @brief Assign the next sequence number to the claimed slot
+ *
+ * @return The committed message, ready to send
+ */
+static inline trading_msg_t *order_journal_commit(order_journal_t *j, uint16_t type, uint16_t length,
+                                                  uint64_t now_ns) {
+    trading_msg_t *msg = order_journal_claim(j);
+    msg_header_init(&msg->hdr, type, length, j->hdr->out_seq + 1, now_ns);
+    j->hdr->out_seq++;
+    return msg;
+}
+
+/**
+ * @brief Oldest sequence number still held; its predecessor's slot is the claim slot
+ */
+static inline uint32_t order_journal_oldest(const order_journal_t *j) {
+    uint32_t out = j->hdr->out_seq;
+    return out >= j->hdr->capacity ? out - j->hdr->capacity + 2 : 1;
+}
+
+/**
+ * @brief Stored message for seq, or NULL if it was never sent or has been overwritten
+ */
+static inline const trading_msg_t *order_journal_get(const order_journal_t *j, uint32_t seq) {
+    if (seq == 0 || seq > j->hdr->out_seq || seq < order_journal_oldest(j)) {
+        return NULL;
+    }
+    return order_journal_slot(j, seq);
+}
+
+/**
+ * @brief Unmap and close the journal
+ */
+static inline void order_journal_close(order_journal_t *j) {
+    if (j->hdr) {
+        munmap(j->hdr, j->map_size);
+        j->hdr = NULL;
+    }
+    if (j->fd >= 0) {
+        close(j->fd);
+        j->fd = -1;
+    }
+}
+
+#endif /* ORDER_JOURNAL_H */
@@ -0,0 +1,584 @@
+/**
+ * @file order_session.h
+ * @brief Sequenced order-entry session over a persistent TCP connection
+ *
+ * Carries trading_protocol.h messages over a non-blocking TCP connection
+ * with TCP_NODELAY. Messages are framed by hdr.length. The session layer
+ * adds:
+ *  - Logon: each side states the next sequence number it expects, and
+ *    the other side immediately resends anything after that.
+ *  - Heartbeats: sent after heartbeat_ms without other traffic. A peer
+ *    that stays silent for SESSION_TIMEOUT_HEARTBEATS intervals is
+ *    dropped.
+ *  - Sequence numbers: every application message gets one, and each
+ *    direction counts from 1. A duplicate is dropped. A gap triggers a
+ *    resend request, and later messages are dropped until the replay
+ *    arrives. TCP keeps the replay in order.
+ *  - A journal (order_journal.h) holding every sequenced message sent,
+ *    for replay. The caller encodes a message straight into its journal
+ *    slot with order_session_claim() and sends it from there with
+ *    order_session_send(). The hot path makes no extra copy.
+ *
+ * Messages sent while disconnected are only journaled. They go out at the
+ * next logon, when the peer says what it is missing.
+ *
+ * The initiator (client) connects and sends the first logon. The acceptor
+ * (exchange) waits for it and maps the session ID to a journal through a
+ * resolve callback, so a reconnecting client resumes its old session.
+ *
+ * Single-threaded: all calls for one session come from one thread.
+ */
+
+#ifndef ORDER_SESSION_H
+#define ORDER_SESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "trading_protocol.h"
+#include "order_journal.h"
+
+#define SESSION_RX_BUFFER 4096          /**< Partial-frame reassembly */
+#define SESSION_TX_BUFFER 16384         /**< Bytes queued while the socket is full */
+#define SESSION_DEFAULT_HEARTBEAT_MS 1000
+#define SESSION_TIMEOUT_HEARTBEATS 3    /**< Silent intervals before the peer is dropped */
+
+/**
+ * @brief Session state
+ */
+typedef enum {
+    SESSION_DISCONNECTED,   /**< No connection */
+    SESSION_CONNECTING,     /**< Initiator: TCP connect in progress */
+    SESSION_LOGON_SENT,     /**< Initiator: waiting for the logon reply */
+    SESSION_LOGON_WAIT,     /**< Acceptor: waiting for the client's logon */
+    SESSION_ACTIVE          /**< Logged on */
+} session_state_t;
+
+/**
+ * @brief Acceptor callback: journal for a session ID, or NULL to refuse the logon
+ */
+typedef order_journal_t *(*session_resolve_fn)(void *ctx, uint64_t session_id);
+
+/**
+ * @brief Application message callback, called in sequence order
+ */
+typedef void (*session_message_fn)(void *ctx, const trading_msg_t *msg, int type, uint64_t rx_ns);
+
+/**
+ * @brief Session counters
+ */
+typedef struct {
+    uint64_t messages_in;           /**< Application messages delivered */
+    uint64_t messages_out;          /**< Application messages sent live */
+    uint64_t heartbeats_in;
+    uint64_t heartbeats_out;
+    uint64_t duplicates;            /**< Sequenced messages dropped as already seen */
+    uint64_t gaps;                  /**< Resend requests sent */
+    uint64_t resent;                /**< Messages replayed to the peer */
+    uint64_t logons;                /**< Completed logons */
+    uint64_t disconnects;
+} session_stats_t;
+
+/**
+ * @brief One end of an order-entry session
+ */
+typedef struct {
+    int fd;                         /**< Connection, -1 when disconnected */
+    session_state_t state;
+    int initiator;                  /**< Set on the connecting side */
+    order_journal_t *journal;       /**< Outbound messages and sequence state */
+    uint32_t heartbeat_ms;
+    uint32_t resend_target;         /**< Gap being filled: wait until in_next passes it */
+    uint32_t resend_next;           /**< Next sequence number to replay, 0 = no replay pending */
+    uint32_t resend_end;            /**< Last sequence number to replay */
+    uint64_t last_rx_ns;
+    uint64_t last_tx_ns;
+    session_stats_t stats;
+    size_t rx_len;
+    size_t tx_len;
+    uint8_t rx_buf[SESSION_RX_BUFFER];
+    uint8_t tx_buf[SESSION_TX_BUFFER];
+} order_session_t;
+
+/**
+ * @brief Initialize a session
+ *
+ * @param s Session
+ * @param journal Initiator: its journal. Acceptor: NULL (resolved at logon)
+ * @param heartbeat_ms Heartbeat interval the initiator asks for
+ */
+static inline void order_session_init(order_session_t *s, order_journal_t *journal,
+                                      uint32_t heartbeat_ms) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->state = SESSION_DISCONNECTED;
+    s->journal = journal;
+    s->heartbeat_ms = heartbeat_ms ? heartbeat_ms : SESSION_DEFAULT_HEARTBEAT_MS;
+}
+
+/**
+ * @brief Drop the connection; the journal and sequence numbers are kept
+ */
+static inline void order_session_disconnect(order_session_t *s) {
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+        s->stats.disconnects++;
+    }
+    s->state = SESSION_DISCONNECTED;
+    s->rx_len = 0;
+    s->tx_len = 0;
+    s->resend_target = 0;
+    s->resend_next = 0;
+}
+
+// Queue or write bytes; anything the socket does not take is queued
+static inline int order_session_write(order_session_t *s, const void *data, size_t len, uint64_t now_ns) {
+    size_t sent = 0;
+    if (s->tx_len == 0) {
+        ssize_t n = send(s->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                order_session_disconnect(s);
+                return -1;
+            }
+            n = 0;
+        }
+        sent = (size_t)n;
+    }
+    if (sent < len) {
+        if (s->tx_len + (len - sent) > SESSION_TX_BUFFER) {
+            order_session_disconnect(s);     // Peer is not reading
+            errno = ENOBUFS;
+            return -1;
+        }
+        memcpy(s->tx_buf + s->tx_len, (const uint8_t *)data + sent, len - sent);
+        s->tx_len += len - sent;
+    }
+    s->last_tx_ns = now_ns;
+    return 0;
+}
+
+// Write out queued bytes
+static inline int order_session_flush(order_session_t *s) {
+    if (s->tx_len == 0) {
+        return 0;
+    }
+    ssize_t n = send(s->fd, s->tx_buf, s->tx_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        order_session_disconnect(s);
+        return -1;
+    }
+    memmove(s->tx_buf, s->tx_buf + n, s->tx_len - (size_t)n);
+    s->tx_len -= (size_t)n;
+    return 0;
+}
+
+// Send an unsequenced session message
+static inline int order_session_send_admin(order_session_t *s, void *msg, uint16_t type,
+                                           uint16_t length, uint32_t seq, uint64_t now_ns) {
+    msg_header_init((msg_header_t *)msg, type, length, seq, now_ns);
+    return order_session_write(s, msg, length, now_ns);
+}
+
+static inline int order_session_send_logon(order_session_t *s, uint64_t now_ns) {
+    logon_msg_t logon;
+    memset(&logon, 0, sizeof(logon));
+    logon.session_id = s->journal->hdr->session_id;
+    logon.next_expected_seq = s->journal->hdr->in_next;
+    logon.heartbeat_ms = s->heartbeat_ms;
+    return order_session_send_admin(s, &logon, MSG_LOGON, sizeof(logon), 0, now_ns);
+}
+
+// Replay from the resend cursor while the tx buffer has room for the next
+// message; order_session_poll() continues as the socket drains
+static inline int order_session_resend_pump(order_session_t *s, uint64_t now_ns) {
+    order_journal_t *j = s->journal;
+    while (s->resend_next) {
+        if (s->resend_next > s->resend_end) {
+            s->resend_next = 0;
+            break;
+        }
+        const trading_msg_t *msg = order_journal_get(j, s->resend_next);
+        size_t len = msg ? msg->hdr.length : sizeof(sequence_reset_msg_t);
+        if (s->tx_len + len > SESSION_TX_BUFFER) {
+            return 0;
+        }
+        if (!msg) {
+            // No longer journaled, possibly overwritten while the replay waited
+            sequence_reset_msg_t reset;
+            memset(&reset, 0, sizeof(reset));
+            reset.new_seq = order_journal_oldest(j);
+            if (order_session_send_admin(s, &reset, MSG_SEQUENCE_RESET, sizeof(reset), 0, now_ns) < 0) {
+                return -1;
+            }
+            s->resend_next = reset.new_seq;
+            continue;
+        }
+        if (order_session_write(s, msg, msg->hdr.length, now_ns) < 0) {
+            return -1;
+        }
+        s->resend_next++;
+        s->stats.resent++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replay journaled messages to the peer
+ *
+ * Messages no longer in the journal are covered by a sequence reset. The
+ * replay goes out as fast as the tx buffer takes it; the rest is sent from
+ * order_session_poll(), so a gap of any size short of the journal capacity
+ * can be filled. Messages sent meanwhile join the end of the replay.
+ *
+ * @param begin First sequence number
+ * @param end Last sequence number, 0 = last sent
+ * @return 0 on success, -1 if the connection failed
+ */
+static inline int order_session_resend(order_session_t *s, uint32_t begin, uint32_t end,
+                                       uint64_t now_ns) {
+    order_journal_t *j = s->journal;
+    if (end == 0 || end > j->hdr->out_seq) {
+        end = j->hdr->out_seq;
+    }
+    if (begin > end) {
+        return 0;
+    }
+    // A new request restarts the replay; the peer drops what it already has
+    s->resend_next = begin ? begin : 1;
+    s->resend_end = end;
+    return order_session_resend_pump(s, now_ns);
+}
+
+// Ask for everything from in_next on, once per gap
+static inline int order_session_request_resend(order_session_t *s, uint32_t seen_seq, uint64_t now_ns) {
+    if (s->resend_target) {
+        return 0;
+    }
+    resend_request_msg_t req;
+    memset(&req, 0, sizeof(req));
+    req.begin_seq = s->journal->hdr->in_next;
+    req.end_seq = 0;
+    s->resend_target = seen_seq;
+    s->stats.gaps++;
+    return order_session_send_admin(s, &req, MSG_RESEND_REQUEST, sizeof(req), 0, now_ns);
+}
+
+/**
+ * @brief Connect as the initiator
+ *
+ * The connect is non-blocking; order_session_poll() completes it and logs on.
+ *
+ * @return 0 if the connection is in progress or established, -1 on failure
+ */
+static inline int order_session_connect(order_session_t *s, const char *ip, int port, uint64_t now_ns) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    s->initiator = 1;
+    s->fd = fd;
+    s->rx_len = s->tx_len = 0;
+    s->resend_target = s->resend_next = 0;
+    s->last_rx_ns = s->last_tx_ns = now_ns;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        s->state = SESSION_LOGON_SENT;
+        return order_session_send_logon(s, now_ns);
+    }
+    if (errno != EINPROGRESS) {
+        int saved = errno;
+        close(fd);
+        s->fd = -1;
+        errno = saved;
+        return -1;
+    }
+    s->state = SESSION_CONNECTING;
+    return 0;
+}
+
+/**
+ * @brief Take over an accepted connection as the acceptor
+ */
+static inline void order_session_accept(order_session_t *s, int fd, uint64_t now_ns) {
+    int one = 1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    s->initiator = 0;
+    s->fd = fd;
+    s->state = SESSION_LOGON_WAIT;
+    s->rx_len = s->tx_len = 0;
+    s->resend_target = s->resend_next = 0;
+    s->last_rx_ns = s->last_tx_ns = now_ns;
+}
+
+/**
+ * @brief Journal slot for the next sequenced message
+ *
+ * Encode the message body here, then call order_session_send(). Claiming
+ * without sending is harmless: the journal keeps this slot free of
+ * retained messages, and the next claim reuses it.
+ */
+static inline trading_msg_t *order_session_claim(order_session_t *s) {
+    return order_journal_claim(s->journal);
+}
+
+/**
+ * @brief Sequence, journal and send the message in the claimed slot
+ *
+ * When the session is not logged on the message is only journaled; it is
+ * sent when the peer next logs on and asks for it.
+ *
+ * @param s Session
+ * @param type MSG_* type
+ * @param length Message size
+ * @param now_ns Send timestamp for the header
+ * @return 0 if sent or journaled, -1 if the connection failed (message is journaled)
+ */
+static inline int order_session_send(order_session_t *s, uint16_t type, uint16_t length,
+                                     uint64_t now_ns) {
+    trading_msg_t *msg = order_journal_commit(s->journal, type, length, now_ns);
+    if (s->state != SESSION_ACTIVE) {
+        return 0;
+    }
+    if (s->resend_next) {
+        s->resend_end = msg->hdr.seq;   // Goes out after the replay, in sequence
+        return order_session_resend_pump(s, now_ns);
+    }
+    s->stats.messages_out++;
+    return order_session_write(s, msg, length, now_ns);
+}
+
+// Handle one complete frame
+static inline int order_session_dispatch(order_session_t *s, const trading_msg_t *msg, int type,
+                                         uint64_t now_ns, session_resolve_fn resolve,
+                                         session_message_fn on_message, void *ctx) {
+    if (type == MSG_LOGON) {
+        if (s->state == SESSION_LOGON_WAIT) {
+            order_journal_t *j = resolve ? resolve(ctx, msg->logon.session_id) : NULL;
+            if (!j) {
+                logout_msg_t out;
+                memset(&out, 0, sizeof(out));
+                out.reason = LOGOUT_UNKNOWN_SESSION;
+                order_session_send_admin(s, &out, MSG_LOGOUT, sizeof(out), 0, now_ns);
+                order_session_disconnect(s);
+                return -1;
+            }
+            s->journal = j;
+            s->heartbeat_ms = msg->logon.heartbeat_ms ? msg->logon.heartbeat_ms
+                                                      : SESSION_DEFAULT_HEARTBEAT_MS;
+            if (order_session_send_logon(s, now_ns) < 0) {
+                return -1;
+            }
+        } else if (s->state != SESSION_LOGON_SENT) {
+            return 0;   // Repeated logon; ignore
+        }
+        s->state = SESSION_ACTIVE;
+        s->stats.logons++;
+        // Bring the peer up to date
+        return order_session_resend(s, msg->logon.next_expected_seq, 0, now_ns);
+    }
+    if (s->state != SESSION_ACTIVE) {
+        order_session_disconnect(s);     // Only a logon is valid before logon
+        return -1;
+    }
+
+    order_journal_header_t *hdr = s->journal->hdr;
+    switch (type) {
+    case MSG_HEARTBEAT:
+        s->stats.heartbeats_in++;
+        if (msg->hdr.seq >= hdr->in_next) {
+            return order_session_request_resend(s, msg->hdr.seq, now_ns);
+        }
+        return 0;
+    case MSG_RESEND_REQUEST:
+        return order_session_resend(s, msg->resend.begin_seq, msg->resend.end_seq, now_ns);
+    case MSG_SEQUENCE_RESET:
+        if (msg->reset.new_seq > hdr->in_next) {
+            hdr->in_next = msg->reset.new_seq;
+        }
+        return 0;
+    case MSG_LOGOUT:
+        order_session_disconnect(s);
+        return -1;
+    default:
+        break;
+    }
+
+    // Sequenced application message
+    uint32_t seq = msg->hdr.seq;
+    if (seq < hdr->in_next) {
+        s->stats.duplicates++;
+        return 0;
+    }
+    if (seq > hdr->in_next) {
+        return order_session_request_resend(s, seq, now_ns);
+    }
+    hdr->in_next++;
+    if (s->resend_target && hdr->in_next > s->resend_target) {
+        s->resend_target = 0;
+    }
+    s->stats.messages_in++;
+    if (on_message) {
+        on_message(ctx, msg, type, now_ns);
+    }
+    return 1;
+}
+
+/**
+ * @brief Service the connection: complete connect, read, deliver, heartbeat
+ *
+ * @param s Session
+ * @param now_ns Current time
+ * @param resolve Acceptor's session lookup (NULL on the initiator)
+ * @param on_message Called for each in-sequence application message
+ * @param ctx Passed to the callbacks
+ * @return Application messages delivered, or -1 if the session is disconnected
+ */
+static inline int order_session_poll(order_session_t *s, uint64_t now_ns, session_resolve_fn resolve,
+                                     session_message_fn on_message, void *ctx) {
+    if (s->state == SESSION_DISCONNECTED) {
+        return -1;
+    }
+
+    if (s->state == SESSION_CONNECTING) {
+        struct pollfd p = { .fd = s->fd, .events = POLLOUT };
+        if (poll(&p, 1, 0) <= 0) {
+            if (now_ns > s->last_tx_ns + (uint64_t)s->heartbeat_ms * SESSION_TIMEOUT_HEARTBEATS * 1000000ULL) {
+                order_session_disconnect(s);
+                return -1;
+            }
+            return 0;
+        }
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+            order_session_disconnect(s);
+            errno = err ? err : errno;
+            return -1;
+        }
+        s->state = SESSION_LOGON_SENT;
+        s->last_rx_ns = now_ns;
+        if (order_session_send_logon(s, now_ns) < 0) {
+            return -1;
+        }
+    }
+
+    if (order_session_flush(s) < 0 || order_session_resend_pump(s, now_ns) < 0) {
+        return -1;
+    }
+
+    int delivered = 0;
+    for (;;) {
+        ssize_t n = recv(s->fd, s->rx_buf + s->rx_len, sizeof(s->rx_buf) - s->rx_len, MSG_DONTWAIT);
+        if (n == 0) {
+            order_session_disconnect(s);
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+            order_session_disconnect(s);
+            return -1;
+        }
+        s->rx_len += (size_t)n;
+        s->last_rx_ns = now_ns;
+
+        // Deliver every complete frame; keep a partial one for the next read
+        size_t off = 0;
+        while (s->rx_len - off >= sizeof(msg_header_t)) {
+            const msg_header_t *hdr = (const msg_header_t *)(s->rx_buf + off);
+            if (hdr->length < sizeof(msg_header_t) || hdr->length > sizeof(trading_msg_t)) {
+                order_session_disconnect(s);
+                return -1;
+            }
+            if (s->rx_len - off < hdr->length) {
+                break;
+            }
+            trading_msg_t msg;
+            memcpy(&msg, hdr, hdr->length);
+            off += hdr->length;
+
+            int type = msg_validate(&msg, hdr->length);
+            if (type == 0) {
+                order_session_disconnect(s);
+                return -1;
+            }
+            int r = order_session_dispatch(s, &msg, type, now_ns, resolve, on_message, ctx);
+            if (r < 0 || s->state == SESSION_DISCONNECTED) {
+                return -1;
+            }
+            delivered += r;
+        }
+        memmove(s->rx_buf, s->rx_buf + off, s->rx_len - off);
+        s->rx_len -= off;
+    }
+
+    // Heartbeat when idle; drop a silent peer. Callbacks may have sent with a
+    // timestamp later than now_ns, so compare without subtracting.
+    uint64_t interval = (uint64_t)s->heartbeat_ms * 1000000ULL;
+    if (now_ns > s->last_rx_ns + interval * SESSION_TIMEOUT_HEARTBEATS) {
+        order_session_disconnect(s);
+        return -1;
+    }
+    // No heartbeat during a replay: its sequence number would look like a gap
+    if (s->state == SESSION_ACTIVE && !s->resend_next && now_ns >= s->last_tx_ns + interval) {
+        msg_header_t hb;
+        s->stats.heartbeats_out++;
+        if (order_session_send_admin(s, &hb, MSG_HEARTBEAT, sizeof(hb), s->journal->hdr->out_seq,
+                                     now_ns) < 0) {
+            return -1;
+        }
+    }
+    return delivered;
+}
+
+/**
+ * @brief Events to wait for on s->fd
+ */
+static inline short order_session_events(const order_session_t *s) {
+    return (short)(POLLIN | (s->state == SESSION_CONNECTING || s->tx_len ? POLLOUT : 0));
+}
+
+/**
+ * @brief Log out and close
+ */
+static inline void order_session_logout(order_session_t *s, uint64_t now_ns) {
+    if (s->fd >= 0 && s->state == SESSION_ACTIVE) {
+        logout_msg_t out;
+        memset(&out, 0, sizeof(out));
+        out.reason = LOGOUT_NORMAL;
+        order_session_send_admin(s, &out, MSG_LOGOUT, sizeof(out), 0, now_ns);
+        order_session_flush(s);
+    }
+    order_session_disconnect(s);
+}
+
+#endif /* ORDER_SESSION_H */
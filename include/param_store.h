@@ -0,0 +1,672 @@
+/**
+ * @file param_store.h
+ * @brief Concurrent parameter store with a group-commit journal
+ *
+ * Parameters are name/value strings in a fixed-capacity hash table:
+ *  - Reads take no lock and write nothing shared. They follow the bucket
+ *    chain (entries are only ever added, never moved or freed) and copy the
+ *    value under its entry's sequence counter, retrying if a writer was
+ *    replacing it (cst_read() in can_stats.h works the same way).
+ *  - Writes lock one of PS_STRIPES mutexes, chosen by bucket, so writers
+ *    to different parts of the table run in parallel.
+ *
+ * With a journal file every change is appended as a record before it is
+ * applied. The record is copied into an in-memory buffer under the
+ * journal lock; ps_set() does not wait for the disk unless that buffer is
+ * full, and then it waits with no stripe lock held. ps_commit(lsn) makes
+ * everything up to lsn durable with group commit. The first waiter becomes
+ * the leader: it takes the whole buffer, writes it and calls fdatasync().
+ * Meanwhile other writers fill a second buffer, and their waits are
+ * satisfied by the next leader's single sync. One sync covers as many
+ * changes as arrive while the previous one runs.
+ *
+ * A reader may see a value before it is durable; callers acknowledge a
+ * change to the outside only after ps_commit() returns.
+ *
+ * On open the journal is replayed. A torn record at the end, from a crash
+ * during a write, is detected by its checksum and cut off.
+ * ps_checkpoint() rewrites the journal as one record per parameter. It
+ * writes a new file and renames it into place.
+ *
+ * ps_dump() and ps_load() are the bulk path, as text lines of
+ * "set <name> <value>". A dump can therefore also be replayed by any
+ * client that pipelines commands.
+ *
+ * Record layout, little-endian: name length (16 bits), value length (16
+ * bits), FNV-1a checksum of lengths, name and value (32 bits), then name
+ * and value.
+ */
+
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wire_codec.h"
+
+#define PS_MAX_KEY 64               /**< Longest name, terminator included */
+#define PS_MAX_VALUE 128            /**< Longest value, terminator included */
+#define PS_STRIPES 64               /**< Writer locks */
+#define PS_JOURNAL_BUFFER (1 << 20) /**< Each of the two journal buffers */
+#define PS_RECORD_HEADER 8
+#define PS_MAX_RECORD (PS_RECORD_HEADER + PS_MAX_KEY + PS_MAX_VALUE)
+#define PS_CACHE_LINE 64
+
+/**
+ * @brief One parameter; never moved or freed once published
+ */
+typedef struct {
+    _Alignas(PS_CACHE_LINE) atomic_uint seq;    /**< Odd while the value is being replaced */
+    uint32_t next;                  /**< Next entry in the bucket, 1-based; 0 ends the chain */
+    uint8_t key_len;
+    uint8_t value_len;
+    char key[PS_MAX_KEY];
+    char value[PS_MAX_VALUE];
+} ps_entry_t;
+
+typedef struct {
+    _Alignas(PS_CACHE_LINE) pthread_mutex_t lock;
+} ps_stripe_t;
+
+/**
+ * @brief Append-only journal with group commit
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;            /**< Broadcast when a flush ends */
+    int fd;                         /**< -1 without a journal */
+    int sync;                       /**< fdatasync() each flush */
+    char *buf[2];                   /**< One filling while the other is written */
+    int active;
+    size_t len;                     /**< Bytes in buf[active] */
+    int flushing;                   /**< A leader is writing the other buffer */
+    int error;                      /**< errno of a failed flush; the journal stops */
+    uint64_t appended;              /**< LSN: bytes appended since open */
+    uint64_t durable;               /**< LSN written (and synced) */
+    uint64_t records;
+    uint64_t flushes;               /**< Writes to the file, one sync each */
+} ps_journal_t;
+
+/**
+ * @brief Parameter store
+ */
+typedef struct {
+    ps_entry_t *entries;
+    uint32_t capacity;
+    atomic_uint used;               /**< Entries handed out; may pass capacity when full */
+    atomic_uint *buckets;           /**< Chain heads, 1-based entry index */
+    uint32_t bucket_mask;
+    ps_stripe_t stripes[PS_STRIPES];
+    ps_journal_t journal;
+    char path[256];                 /**< Journal file, empty for memory only */
+    uint64_t recovered;             /**< Records replayed on open */
+    uint64_t truncated;             /**< Bytes of torn tail cut off on open */
+} param_store_t;
+
+// FNV-1a over a name: the bucket
+static inline uint64_t ps_hash(const char *key, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)key[i]) * 1099511628211ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+// FNV-1a 32 over a record's lengths, name and value
+static inline uint32_t ps_checksum(const uint8_t *rec, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        if (i < 4 || i >= PS_RECORD_HEADER) {
+            h = (h ^ rec[i]) * 16777619u;
+        }
+    }
+    return h;
+}
+
+// Encode one record into rec (PS_MAX_RECORD bytes); returns its length
+static inline size_t ps_record_encode(uint8_t *rec, const char *key, size_t key_len, const char *value,
+                                      size_t value_len) {
+    wire_put16(rec, (uint16_t)key_len, WIRE_SWAP_LE);
+    wire_put16(rec + 2, (uint16_t)value_len, WIRE_SWAP_LE);
+    memcpy(rec + PS_RECORD_HEADER, key, key_len);
+    memcpy(rec + PS_RECORD_HEADER + key_len, value, value_len);
+    size_t len = PS_RECORD_HEADER + key_len + value_len;
+    wire_put32(rec + 4, ps_checksum(rec, len), WIRE_SWAP_LE);
+    return len;
+}
+
+// Entry for a name, NULL if absent; safe without a lock
+static inline ps_entry_t *ps_find(const param_store_t *ps, const char *key, size_t key_len, uint32_t bucket) {
+    uint32_t idx = atomic_load_explicit(&ps->buckets[bucket], memory_order_acquire);
+    while (idx) {
+        ps_entry_t *e = &ps->entries[idx - 1];
+        if (e->key_len == key_len && memcmp(e->key, key, key_len) == 0) {
+            return e;
+        }
+        idx = e->next;
+    }
+    return NULL;
+}
+
+// Write all of data; returns 0 or an errno value
+static inline int ps_write_all(int fd, const void *data, size_t len) {
+    for (size_t off = 0; off < len;) {
+        ssize_t n = write(fd, (const char *)data + off, len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        off += (size_t)n;
+    }
+    return 0;
+}
+
+// Write out one buffer as the leader; called and returns with the journal lock held
+static inline void ps_journal_flush_locked(ps_journal_t *j) {
+    char *data = j->buf[j->active];
+    size_t len = j->len;
+    uint64_t upto = j->appended;
+    j->active ^= 1;
+    j->len = 0;
+    j->flushing = 1;
+    pthread_mutex_unlock(&j->lock);
+
+    int err = ps_write_all(j->fd, data, len);
+    if (!err && j->sync && fdatasync(j->fd) < 0) {
+        err = errno;
+    }
+
+    pthread_mutex_lock(&j->lock);
+    j->flushing = 0;
+    j->flushes++;
+    if (err) {
+        j->error = err;
+    } else {
+        j->durable = upto;
+    }
+    pthread_cond_broadcast(&j->done);
+}
+
+// Wait until the active buffer has room for len bytes, flushing it if no
+// leader is. Called and returns with the journal lock held; the caller must
+// not hold a stripe lock, since a flush writes and syncs the file.
+static inline void ps_journal_wait_room(ps_journal_t *j, size_t len) {
+    while (j->len + len > PS_JOURNAL_BUFFER && !j->error) {
+        if (j->flushing) {
+            pthread_cond_wait(&j->done, &j->lock);
+        } else {
+            ps_journal_flush_locked(j);
+        }
+    }
+}
+
+/**
+ * @brief Wait until every change up to lsn is on disk
+ *
+ * Concurrent callers share flushes: one leader writes and syncs everything
+ * appended so far while the others wait.
+ *
+ * @return 0 on success, -1 if the journal failed (errno set)
+ */
+static inline int ps_commit(param_store_t *ps, uint64_t lsn) {
+    ps_journal_t *j = &ps->journal;
+    if (j->fd < 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&j->lock);
+    while (j->durable < lsn && !j->error) {
+        if (j->flushing) {
+            pthread_cond_wait(&j->done, &j->lock);
+        } else {
+            ps_journal_flush_locked(j);
+        }
+    }
+    int rc = j->durable >= lsn ? 0 : -1;
+    if (rc < 0) {
+        errno = j->error;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return rc;
+}
+
+/**
+ * @brief Set a parameter from counted strings (any thread)
+ *
+ * @param lsn Set to the change's journal position for ps_commit(); 0 without a journal
+ * @return 0 on success; -1 with errno EINVAL (name empty or too long, value
+ *         too long), ENOSPC (store full) or the journal's error
+ */
+static inline int ps_put(param_store_t *ps, const char *key, size_t key_len, const char *value, size_t value_len,
+                         uint64_t *lsn) {
+    *lsn = 0;
+    if (key_len == 0 || key_len >= PS_MAX_KEY || value_len >= PS_MAX_VALUE) {
+        errno = EINVAL;
+        return -1;
+    }
+    ps_journal_t *j = &ps->journal;
+    int journaled = j->fd >= 0;
+    uint8_t rec[PS_MAX_RECORD];
+    size_t len = journaled ? ps_record_encode(rec, key, key_len, value, value_len) : 0;
+    uint32_t bucket = (uint32_t)ps_hash(key, key_len) & ps->bucket_mask;
+    pthread_mutex_t *lock = &ps->stripes[bucket % PS_STRIPES].lock;
+
+    // Journal under the stripe lock, in the order this stripe applies changes
+    // to the name. Only the memcpy happens there: if the buffer is full, drop
+    // the stripe lock while it is flushed and start over.
+    ps_entry_t *e;
+    for (;;) {
+        pthread_mutex_lock(lock);
+        e = ps_find(ps, key, key_len, bucket);
+        if (!journaled) {
+            break;
+        }
+        pthread_mutex_lock(&j->lock);
+        if (j->len + len <= PS_JOURNAL_BUFFER || j->error) {
+            break;
+        }
+        pthread_mutex_unlock(lock);
+        ps_journal_wait_room(j, len);
+        pthread_mutex_unlock(&j->lock);
+    }
+    if (journaled && j->error) {
+        errno = j->error;
+        pthread_mutex_unlock(&j->lock);
+        pthread_mutex_unlock(lock);
+        return -1;
+    }
+
+    // A new name reserves its entry in journal order, so replay fills the same entries
+    uint32_t idx = 0;
+    if (!e) {
+        idx = atomic_fetch_add_explicit(&ps->used, 1, memory_order_relaxed);
+        if (idx >= ps->capacity) {
+            if (journaled) {
+                pthread_mutex_unlock(&j->lock);
+            }
+            pthread_mutex_unlock(lock);
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    if (journaled) {
+        memcpy(j->buf[j->active] + j->len, rec, len);
+        j->len += len;
+        j->appended += len;
+        j->records++;
+        *lsn = j->appended;
+        pthread_mutex_unlock(&j->lock);
+    }
+
+    if (e) {
+        unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+        atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(e->value, value, value_len);
+        e->value[value_len] = '\0';
+        e->value_len = (uint8_t)value_len;
+        atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+    } else {
+        e = &ps->entries[idx];
+        memcpy(e->key, key, key_len);
+        e->key[key_len] = '\0';
+        e->key_len = (uint8_t)key_len;
+        memcpy(e->value, value, value_len);
+        e->value[value_len] = '\0';
+        e->value_len = (uint8_t)value_len;
+        e->next = atomic_load_explicit(&ps->buckets[bucket], memory_order_relaxed);
+        atomic_store_explicit(&ps->buckets[bucket], idx + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(lock);
+    return 0;
+}
+
+/**
+ * @brief Set a parameter (any thread); see ps_put()
+ */
+static inline int ps_set(param_store_t *ps, const char *key, const char *value, uint64_t *lsn) {
+    return ps_put(ps, key, strlen(key), value, strlen(value), lsn);
+}
+
+// Copy an entry's value under its sequence counter; returns the value length
+static inline size_t ps_read_entry(const ps_entry_t *e, char *value, size_t cap) {
+    for (;;) {
+        unsigned before = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (before & 1) {
+            continue;               // Being replaced
+        }
+        size_t len = e->value_len;
+        if (len >= PS_MAX_VALUE) {
+            len = PS_MAX_VALUE - 1;
+        }
+        size_t copy = len < cap ? len : cap - 1;
+        memcpy(value, e->value, copy);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == before) {
+            value[copy] = '\0';
+            return len;
+        }
+    }
+}
+
+/**
+ * @brief Read a parameter (any thread, no lock)
+ *
+ * @param value Receives the value, truncated to cap - 1 bytes and terminated
+ * @return Value length, or -1 if the name is not set (errno ENOENT)
+ */
+static inline int ps_get(const param_store_t *ps, const char *key, char *value, size_t cap) {
+    size_t key_len = strlen(key);
+    const ps_entry_t *e = ps_find(ps, key, key_len, (uint32_t)ps_hash(key, key_len) & ps->bucket_mask);
+    if (!e || cap == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    return (int)ps_read_entry(e, value, cap);
+}
+
+/**
+ * @brief Entries handed out so far: the parameters set, unless a journal write failed
+ */
+static inline uint32_t ps_count(const param_store_t *ps) {
+    uint32_t used = atomic_load_explicit(&ps->used, memory_order_acquire);
+    return used < ps->capacity ? used : ps->capacity;
+}
+
+// Apply every valid record of a journal file; cut off a torn tail
+static inline int ps_replay(param_store_t *ps, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    size_t size = (size_t)st.st_size, off = 0;
+    if (size == 0) {
+        return 0;
+    }
+    uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    while (off + PS_RECORD_HEADER <= size) {
+        size_t key_len = wire_get16(data + off, WIRE_SWAP_LE);
+        size_t value_len = wire_get16(data + off + 2, WIRE_SWAP_LE);
+        size_t len = PS_RECORD_HEADER + key_len + value_len;
+        if (key_len == 0 || key_len >= PS_MAX_KEY || value_len >= PS_MAX_VALUE || off + len > size ||
+            wire_get32(data + off + 4, WIRE_SWAP_LE) != ps_checksum(data + off, len)) {
+            break;
+        }
+        uint64_t lsn;
+        ps_put(ps, (const char *)data + off + PS_RECORD_HEADER, key_len,
+               (const char *)data + off + PS_RECORD_HEADER + key_len, value_len, &lsn);
+        ps->recovered++;
+        off += len;
+    }
+    munmap(data, size);
+    if (off < size) {
+        ps->truncated = size - off;
+        if (ftruncate(fd, (off_t)off) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Create a store, replaying its journal if there is one
+ *
+ * @param ps Store to initialize
+ * @param path Journal file, created if missing; NULL for a memory-only store
+ * @param capacity Most parameters held
+ * @param sync fdatasync() on each group commit; 0 leaves durability to the page cache
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int ps_open(param_store_t *ps, const char *path, uint32_t capacity, int sync) {
+    memset(ps, 0, sizeof(*ps));
+    ps->journal.fd = -1;
+    if (capacity == 0 || capacity > UINT32_MAX / 4 || (path && strlen(path) >= sizeof(ps->path))) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t buckets = 1;
+    while (buckets < 2 * capacity) {
+        buckets *= 2;
+    }
+    ps->capacity = capacity;
+    ps->bucket_mask = buckets - 1;
+    ps->entries = aligned_alloc(PS_CACHE_LINE, (size_t)capacity * sizeof(ps_entry_t));
+    ps->buckets = calloc(buckets, sizeof(atomic_uint));
+    if (!ps->entries || !ps->buckets) {
+        free(ps->entries);
+        free(ps->buckets);
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(ps->entries, 0, (size_t)capacity * sizeof(ps_entry_t));
+    for (int i = 0; i < PS_STRIPES; i++) {
+        pthread_mutex_init(&ps->stripes[i].lock, NULL);
+    }
+    ps_journal_t *j = &ps->journal;
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->done, NULL);
+    j->sync = sync;
+    if (!path) {
+        return 0;
+    }
+
+    snprintf(ps->path, sizeof(ps->path), "%s", path);
+    j->buf[0] = malloc(PS_JOURNAL_BUFFER);
+    j->buf[1] = malloc(PS_JOURNAL_BUFFER);
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (!j->buf[0] || !j->buf[1] || fd < 0 || ps_replay(ps, fd) < 0) {
+        int saved = j->buf[0] && j->buf[1] ? errno : ENOMEM;
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(j->buf[0]);
+        free(j->buf[1]);
+        free(ps->entries);
+        free(ps->buckets);
+        errno = saved;
+        return -1;
+    }
+    j->fd = fd;                     // Set after the replay so it is not journaled again
+    return 0;
+}
+
+// Sync the directory holding path, so a rename in it is durable
+static inline int ps_sync_dir(const char *path) {
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) + 1 : 1, slash ? path : ".");
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+/**
+ * @brief Rewrite the journal as one record per parameter
+ *
+ * Writers wait while the new file is written; readers do not. Changes
+ * still buffered are covered by the new file, so they count as committed.
+ *
+ * @return Parameters written, or -1 on failure (errno set; the old journal stays)
+ */
+static inline long ps_checkpoint(param_store_t *ps) {
+    ps_journal_t *j = &ps->journal;
+    if (j->fd < 0) {
+        return 0;
+    }
+    for (int i = 0; i < PS_STRIPES; i++) {
+        pthread_mutex_lock(&ps->stripes[i].lock);
+    }
+    pthread_mutex_lock(&j->lock);
+    while (j->flushing) {
+        pthread_cond_wait(&j->done, &j->lock);
+    }
+
+    char tmp[sizeof(ps->path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", ps->path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    long count = 0;
+    int err = fd < 0 ? errno : 0;
+
+    // No flush is running, so the inactive buffer is free to batch the records
+    uint8_t *out = (uint8_t *)j->buf[j->active ^ 1];
+    size_t len = 0;
+    for (uint32_t b = 0; b <= ps->bucket_mask && !err; b++) {
+        uint32_t idx = atomic_load_explicit(&ps->buckets[b], memory_order_relaxed);
+        for (; idx && !err; idx = ps->entries[idx - 1].next) {
+            if (len + PS_MAX_RECORD > PS_JOURNAL_BUFFER) {
+                err = ps_write_all(fd, out, len);
+                len = 0;
+            }
+            const ps_entry_t *e = &ps->entries[idx - 1];
+            len += ps_record_encode(out + len, e->key, e->key_len, e->value, e->value_len);
+            count++;
+        }
+    }
+    if (!err) {
+        err = ps_write_all(fd, out, len);
+    }
+    if (!err && (fdatasync(fd) < 0 || rename(tmp, ps->path) < 0 || ps_sync_dir(ps->path) < 0)) {
+        err = errno;
+    }
+    if (err) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        count = -1;
+    } else {
+        close(j->fd);
+        j->fd = fd;
+        j->len = 0;
+        j->durable = j->appended;
+        j->error = 0;
+        pthread_cond_broadcast(&j->done);
+    }
+
+    pthread_mutex_unlock(&j->lock);
+    for (int i = PS_STRIPES - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&ps->stripes[i].lock);
+    }
+    errno = err;
+    return count;
+}
+
+/**
+ * @brief Write every parameter as a "set <name> <value>" line (any thread)
+ *
+ * Entries are read like ps_get(); parameters set during the dump may or
+ * may not appear.
+ *
+ * @return Parameters written, or -1 on a write error
+ */
+static inline long ps_dump(const param_store_t *ps, FILE *out) {
+    char value[PS_MAX_VALUE];
+    long count = 0;
+    for (uint32_t b = 0; b <= ps->bucket_mask; b++) {
+        uint32_t idx = atomic_load_explicit(&ps->buckets[b], memory_order_acquire);
+        for (; idx; idx = ps->entries[idx - 1].next) {
+            const ps_entry_t *e = &ps->entries[idx - 1];
+            ps_read_entry(e, value, sizeof(value));
+            if (fprintf(out, "set %s %s\n", e->key, value) < 0) {
+                return -1;
+            }
+            count++;
+        }
+    }
+    return fflush(out) == 0 ? count : -1;
+}
+
+/**
+ * @brief Apply "set <name> <value>" lines, as written by ps_dump(), with one commit
+ *
+ * Blank lines and lines starting with '#' are skipped.
+ *
+ * @return Parameters set, or -1 on a malformed line or store error (errno
+ *         set; lines before it are applied and committed)
+ */
+static inline long ps_load(param_store_t *ps, FILE *in) {
+    char line[PS_MAX_KEY + PS_MAX_VALUE + 16];
+    long count = 0;
+    uint64_t lsn = 0, last = 0;
+    int err = 0;
+    while (fgets(line, sizeof(line), in)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        char *key = p + 3, *value;
+        if (strncmp(p, "set", 3) != 0 || !isspace((unsigned char)*key)) {
+            err = EINVAL;
+            break;
+        }
+        while (isspace((unsigned char)*key)) {
+            key++;
+        }
+        value = key + strcspn(key, " \t");
+        size_t key_len = (size_t)(value - key);
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        if (key_len == 0 || ps_put(ps, key, key_len, value, strlen(value), &lsn) < 0) {
+            err = key_len == 0 ? EINVAL : errno;
+            break;
+        }
+        if (lsn) {
+            last = lsn;
+        }
+        count++;
+    }
+    if (ps_commit(ps, last) < 0 && !err) {
+        err = errno;
+    }
+    errno = err;
+    return err ? -1 : count;
+}
+
+/**
+ * @brief Commit what is buffered and free the store
+ */
+static inline void ps_close(param_store_t *ps) {
+    ps_journal_t *j = &ps->journal;
+    if (j->fd >= 0) {
+        ps_commit(ps, j->appended);
+        close(j->fd);
+        j->fd = -1;
+    }
+    free(j->buf[0]);
+    free(j->buf[1]);
+    for (int i = 0; i < PS_STRIPES; i++) {
+        pthread_mutex_destroy(&ps->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&j->lock);
+    pthread_cond_destroy(&j->done);
+    free(ps->entries);
+    free(ps->buckets);
+    ps->entries = NULL;
+    ps->buckets = NULL;
+}
+
+#endif // PARAM_STORE_H
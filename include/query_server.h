@@ -0,0 +1,450 @@
+/**
+ * @file query_server.h
+ * @brief Small read-only query endpoint over HTTP and a Unix domain socket
+ *
+ * One thread runs qs_server_poll() in a loop. It serves two listeners from
+ * one epoll set:
+ *  - HTTP: "GET <path> HTTP/1.x" is answered with a JSON body and the
+ *    connection is closed;
+ *  - UDS: each request is one line holding the path. Each response is one
+ *    line of JSON. The connection stays open, and requests may be pipelined.
+ *
+ * The application supplies one handler that writes the JSON for a path into
+ * a qs_response_t and returns an HTTP status. Response buffers come from a
+ * fixed pool (mem_pool.h) and so do connections, so serving a query does not
+ * call malloc. The HTTP header is written into space reserved in front of
+ * the body and the whole response goes out in one write. When the pools are
+ * exhausted, a request gets 503 instead of queueing.
+ *
+ * The handler runs on the query thread. To keep queries off the ingest path
+ * it should read from lock-free snapshots, not from data under the ingest
+ * lock.
+ */
+
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "mem_pool.h"
+
+#define QS_MAX_REQUEST 1024         /**< Longest request line/header block */
+#define QS_HEADER_RESERVE 128       /**< Room for the HTTP header before the body */
+#define QS_MAX_EVENTS 64
+
+/**
+ * @brief JSON response being built in a pooled buffer
+ */
+typedef struct {
+    char *data;                     /**< Body start */
+    size_t len;                     /**< Body bytes */
+    size_t cap;                     /**< Body capacity */
+    int overflow;                   /**< Set if an append did not fit */
+} qs_response_t;
+
+/**
+ * @brief Writes the response for path; returns an HTTP status (200, 404, ...)
+ */
+typedef int (*qs_handler_fn)(void *ctx, const char *path, qs_response_t *resp);
+
+enum { QS_LISTEN_HTTP = 1, QS_LISTEN_UDS = 2 };
+
+typedef struct {
+    int fd;
+    int kind;                       /**< QS_LISTEN_HTTP or QS_LISTEN_UDS */
+    char request[QS_MAX_REQUEST];
+    size_t request_len;
+    char *buffer;                   /**< Pooled response buffer while sending */
+    char error[160];                /**< Error responses, which need no buffer */
+    const char *out;                /**< Next byte to send */
+    size_t out_len;                 /**< Bytes left to send */
+} qs_conn_t;
+
+/**
+ * @brief Query server
+ */
+typedef struct {
+    int epfd;
+    int http_fd;                    /**< -1 if disabled */
+    int uds_fd;                     /**< -1 if disabled */
+    int http_port;                  /**< Bound port (useful with port 0) */
+    char uds_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    mem_pool_t conns;
+    mem_pool_t buffers;
+    size_t buffer_size;
+    qs_handler_fn handler;
+    void *ctx;
+
+    // Counters, written by the query thread
+    unsigned long requests;         /**< Requests answered */
+    unsigned long rejected;         /**< 503s: no connection or buffer free */
+    unsigned long overflows;        /**< Responses larger than a buffer */
+} qs_server_t;
+
+/**
+ * @brief Append formatted text to a response
+ */
+__attribute__((format(printf, 2, 3)))
+static inline void qs_printf(qs_response_t *r, const char *fmt, ...) {
+    if (r->overflow) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(r->data + r->len, r->cap - r->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= r->cap - r->len) {
+        r->overflow = 1;
+        return;
+    }
+    r->len += (size_t)n;
+}
+
+/**
+ * @brief Append s as a quoted, escaped JSON string
+ */
+static inline void qs_json_string(qs_response_t *r, const char *s) {
+    qs_printf(r, "\"");
+    for (; *s && !r->overflow; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            qs_printf(r, "\\%c", c);
+        } else if (c < 0x20) {
+            qs_printf(r, "\\u%04x", c);
+        } else if (r->len + 1 < r->cap) {
+            r->data[r->len++] = (char)c;
+        } else {
+            r->overflow = 1;
+        }
+    }
+    qs_printf(r, "\"");
+}
+
+static inline int qs_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Watch fd; data.ptr is the connection, or the listener's fd field
+static inline int qs_watch(qs_server_t *s, int fd, void *ptr, uint32_t events, int op) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = ptr;
+    return epoll_ctl(s->epfd, op, fd, &ev);
+}
+
+/**
+ * @brief Release sockets, the UDS path and the pools
+ */
+static inline void qs_server_close(qs_server_t *s) {
+    if (s->http_fd >= 0) {
+        close(s->http_fd);
+    }
+    if (s->uds_fd >= 0) {
+        close(s->uds_fd);
+        unlink(s->uds_path);
+    }
+    if (s->epfd >= 0) {
+        close(s->epfd);
+    }
+    mem_pool_destroy(&s->conns);
+    mem_pool_destroy(&s->buffers);
+    s->http_fd = s->uds_fd = s->epfd = -1;
+}
+
+/**
+ * @brief Create the listeners and pools
+ *
+ * @param s Server
+ * @param http_port TCP port for HTTP (0 picks a free one), or -1 to disable
+ * @param uds_path Unix socket path, or NULL to disable
+ * @param max_conns Concurrent connections
+ * @param buffers Response buffers (concurrent responses in flight)
+ * @param buffer_size Bytes per response buffer, including the HTTP header
+ * @param handler Request handler
+ * @param ctx Handler argument
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int qs_server_init(qs_server_t *s, int http_port, const char *uds_path, size_t max_conns,
+                                 size_t buffers, size_t buffer_size, qs_handler_fn handler, void *ctx) {
+    memset(s, 0, sizeof(*s));
+    s->http_fd = s->uds_fd = -1;
+    s->handler = handler;
+    s->ctx = ctx;
+    s->buffer_size = buffer_size;
+
+    s->epfd = epoll_create1(0);
+    if (s->epfd < 0 || buffer_size <= QS_HEADER_RESERVE + 1 ||
+        mem_pool_init(&s->conns, sizeof(qs_conn_t), max_conns, MEM_NODE_ANY) < 0 ||
+        mem_pool_init(&s->buffers, buffer_size, buffers, MEM_NODE_ANY) < 0) {
+        if (errno == 0) {
+            errno = EINVAL;
+        }
+        qs_server_close(s);
+        return -1;
+    }
+
+    if (http_port >= 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t)http_port);
+        socklen_t len = sizeof(addr);
+        int opt = 1;
+        s->http_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (s->http_fd < 0 ||
+            setsockopt(s->http_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+            bind(s->http_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(s->http_fd, 64) < 0 ||
+            getsockname(s->http_fd, (struct sockaddr *)&addr, &len) < 0 ||
+            qs_set_nonblocking(s->http_fd) < 0 ||
+            qs_watch(s, s->http_fd, &s->http_fd, EPOLLIN, EPOLL_CTL_ADD) < 0) {
+            qs_server_close(s);
+            return -1;
+        }
+        s->http_port = ntohs(addr.sin_port);
+    }
+
+    if (uds_path) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(uds_path) >= sizeof(addr.sun_path)) {
+            qs_server_close(s);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(addr.sun_path, uds_path);
+        unlink(uds_path);   // Left behind by a previous run
+        s->uds_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s->uds_fd < 0 || bind(s->uds_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            qs_server_close(s);
+            return -1;
+        }
+        strcpy(s->uds_path, uds_path);
+        if (listen(s->uds_fd, 64) < 0 || qs_set_nonblocking(s->uds_fd) < 0 ||
+            qs_watch(s, s->uds_fd, &s->uds_fd, EPOLLIN, EPOLL_CTL_ADD) < 0) {
+            qs_server_close(s);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline void qs_drop(qs_server_t *s, qs_conn_t *c) {
+    close(c->fd);
+    if (c->buffer) {
+        mem_pool_free(&s->buffers, c->buffer);
+    }
+    mem_pool_free(&s->conns, c);
+}
+
+static inline const char *qs_reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Error";
+    }
+}
+
+// Queue an error response that needs no pooled buffer
+static inline void qs_error(qs_conn_t *c, int status, const char *message) {
+    char body[64];
+    int len = snprintf(body, sizeof(body), "{\"error\":\"%s\"}", message);
+    int n;
+    if (c->kind == QS_LISTEN_HTTP) {
+        n = snprintf(c->error, sizeof(c->error),
+                     "HTTP/1.0 %d %s\r\nContent-Type: application/json\r\n"
+                     "Content-Length: %d\r\nConnection: close\r\n\r\n%s",
+                     status, qs_reason(status), len, body);
+    } else {
+        n = snprintf(c->error, sizeof(c->error), "%s\n", body);
+    }
+    c->out = c->error;
+    c->out_len = (size_t)n;
+}
+
+// Run the handler for path into a pooled buffer and queue the response
+static inline void qs_dispatch(qs_server_t *s, qs_conn_t *c, const char *path) {
+    c->buffer = mem_pool_alloc(&s->buffers);
+    if (!c->buffer) {
+        s->rejected++;
+        qs_error(c, 503, "busy");
+        return;
+    }
+    qs_response_t r = { c->buffer + QS_HEADER_RESERVE, 0, s->buffer_size - QS_HEADER_RESERVE - 1, 0 };
+    int status = s->handler(s->ctx, path, &r);
+    if (r.overflow) {
+        s->overflows++;
+        status = 500;
+        r.len = 0;
+        r.overflow = 0;
+        qs_printf(&r, "{\"error\":\"response too large\"}");
+    }
+    s->requests++;
+
+    if (c->kind == QS_LISTEN_UDS) {
+        r.data[r.len++] = '\n';
+        c->out = r.data;
+        c->out_len = r.len;
+        return;
+    }
+
+    // Header goes immediately in front of the body
+    char header[QS_HEADER_RESERVE];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 %d %s\r\nContent-Type: application/json\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, qs_reason(status), r.len);
+    c->out = r.data - n;
+    memcpy((char *)c->out, header, (size_t)n);
+    c->out_len = (size_t)n + r.len;
+}
+
+// Take the next complete request from the connection buffer; 1 if dispatched
+static inline int qs_next_request(qs_server_t *s, qs_conn_t *c) {
+    char *end;
+    size_t consumed;
+    if (c->kind == QS_LISTEN_UDS) {
+        end = memchr(c->request, '\n', c->request_len);
+        if (!end) {
+            return 0;
+        }
+        consumed = (size_t)(end - c->request) + 1;
+        if (end > c->request && end[-1] == '\r') {
+            end--;
+        }
+        *end = '\0';
+        qs_dispatch(s, c, c->request);
+    } else {
+        c->request[c->request_len] = '\0';
+        end = strstr(c->request, "\r\n\r\n");
+        if (!end) {
+            end = strstr(c->request, "\n\n");
+        }
+        if (!end) {
+            return 0;
+        }
+        consumed = c->request_len;  // Connection closes after the response
+        char path[QS_MAX_REQUEST];
+        if (sscanf(c->request, "GET %1023s HTTP/1.%*d", path) != 1) {
+            qs_error(c, 400, "bad request");
+        } else {
+            qs_dispatch(s, c, path);
+        }
+    }
+    memmove(c->request, c->request + consumed, c->request_len - consumed);
+    c->request_len -= consumed;
+    return 1;
+}
+
+// Send what is queued; returns -1 when the connection should be dropped
+static inline int qs_flush(qs_server_t *s, qs_conn_t *c) {
+    do {
+        while (c->out_len > 0) {
+            ssize_t n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return qs_watch(s, c->fd, c, EPOLLOUT, EPOLL_CTL_MOD);
+                }
+                return -1;
+            }
+            c->out += n;
+            c->out_len -= (size_t)n;
+        }
+        if (c->buffer) {
+            mem_pool_free(&s->buffers, c->buffer);
+            c->buffer = NULL;
+        }
+        if (c->kind == QS_LISTEN_HTTP) {
+            return -1;  // HTTP/1.0: one request per connection
+        }
+    } while (qs_next_request(s, c));    // Pipelined lines before reading more
+    return qs_watch(s, c->fd, c, EPOLLIN, EPOLL_CTL_MOD);
+}
+
+static inline void qs_accept(qs_server_t *s, int listen_fd, int kind) {
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;     // EAGAIN, or an error the next poll will retry
+        }
+        qs_conn_t *c = mem_pool_alloc(&s->conns);
+        if (!c) {
+            s->rejected++;
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->kind = kind;
+        if (qs_set_nonblocking(fd) < 0 || qs_watch(s, fd, c, EPOLLIN, EPOLL_CTL_ADD) < 0) {
+            qs_drop(s, c);
+        }
+    }
+}
+
+static inline void qs_readable(qs_server_t *s, qs_conn_t *c) {
+    ssize_t n = recv(c->fd, c->request + c->request_len, sizeof(c->request) - 1 - c->request_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        qs_drop(s, c);
+        return;
+    }
+    if (n < 0) {
+        return;
+    }
+    c->request_len += (size_t)n;
+    if (!qs_next_request(s, c)) {
+        if (c->request_len < sizeof(c->request) - 1) {
+            return;     // Wait for the rest
+        }
+        c->request_len = 0;
+        qs_error(c, 400, "request too long");
+    }
+    if (qs_flush(s, c) < 0) {
+        qs_drop(s, c);
+    }
+}
+
+/**
+ * @brief Wait up to timeout_ms for activity and serve it
+ *
+ * @return Number of events handled, or -1 on error other than EINTR
+ */
+static inline int qs_server_poll(qs_server_t *s, int timeout_ms) {
+    struct epoll_event events[QS_MAX_EVENTS];
+    int n = epoll_wait(s->epfd, events, QS_MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n; i++) {
+        void *ptr = events[i].data.ptr;
+        if (ptr == &s->http_fd) {
+            qs_accept(s, s->http_fd, QS_LISTEN_HTTP);
+        } else if (ptr == &s->uds_fd) {
+            qs_accept(s, s->uds_fd, QS_LISTEN_UDS);
+        } else if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+            qs_drop(s, ptr);
+        } else if (events[i].events & EPOLLOUT) {
+            if (qs_flush(s, ptr) < 0) {
+                qs_drop(s, ptr);
+            }
+        } else {
+            qs_readable(s, ptr);
+        }
+    }
+    return n;
+}
+
+#endif /* QUERY_SERVER_H */
@@ -0,0 +1,387 @@
+/**
+ * @file risk_engine.h
+ * @brief Inline pre-trade risk checks with lock-free limit updates
+ *
+ * Every order passes risk_check_order() before it is sent. It checks a
+ * global kill switch, a global order-rate token bucket, and per-symbol
+ * limits: maximum order size, a fat-finger price band around the last
+ * trade, worst-case position, and worst-case notional. Resting and
+ * in-flight orders count towards position and notional until they fill or
+ * are released.
+ *
+ * Threading model: one strategy thread owns all risk state and is the
+ * only caller of the check and update functions. One control thread
+ * changes limits with risk_set_limits(), risk_set_rate() and risk_halt().
+ * Limits are published through a per-record sequence lock, so the strategy
+ * thread never takes a lock. It always sees a complete set of limits,
+ * either the old one or the new one.
+ *
+ * Each symbol record is two cache lines. The first holds state that only
+ * the strategy thread writes; the second holds the limits that the control
+ * thread writes. Keeping them apart means a limit update never invalidates
+ * the line with the hot counters.
+ */
+
+#ifndef RISK_ENGINE_H
+#define RISK_ENGINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "trading_protocol.h"
+
+#define RISK_MAX_SYMBOLS 128        /**< Symbol records per engine */
+#define RISK_CACHE_LINE 64
+#define RISK_BPS 10000              /**< Basis points per unit */
+
+/**
+ * @brief Check results
+ */
+typedef enum {
+    RISK_OK = 0,
+    RISK_HALTED,            /**< Kill switch engaged */
+    RISK_RATE,              /**< Order-rate token bucket empty */
+    RISK_ORDER_QTY,         /**< Order larger than max_order_qty */
+    RISK_PRICE_BAND,        /**< Price too far from the last trade */
+    RISK_POSITION,          /**< Worst-case position over max_position */
+    RISK_NOTIONAL,          /**< Worst-case notional over max_notional */
+    RISK_UNKNOWN_SYMBOL     /**< Symbol index out of range */
+} risk_result_t;
+
+/**
+ * @brief Per-symbol limits (values used by set/get, not the shared layout)
+ */
+typedef struct {
+    int64_t max_position;       /**< Max absolute shares, including open orders */
+    int64_t max_notional;       /**< Max |position| x price, in ticks */
+    int64_t max_order_qty;      /**< Max shares per order */
+    int64_t price_band_bps;     /**< Max distance from last trade in bps, 0 = off */
+} risk_limits_t;
+
+/**
+ * @brief Per-symbol risk record
+ */
+typedef struct {
+    // Strategy thread only
+    _Alignas(RISK_CACHE_LINE) int64_t position;     /**< Filled shares, + long / - short */
+    int64_t open_buy;                   /**< Shares in live buy orders */
+    int64_t open_sell;                  /**< Shares in live sell orders */
+    int64_t ref_price;                  /**< Last trade price in ticks, 0 = unknown */
+    uint64_t checks;                    /**< Orders checked */
+    uint64_t rejects;                   /**< Orders refused */
+    char symbol[SYMBOL_LEN + 1];        /**< Name, valid once registered is set */
+    atomic_int registered;              /**< Published by risk_register_symbol() */
+
+    // Control thread writes, strategy thread reads (sequence lock)
+    _Alignas(RISK_CACHE_LINE) atomic_uint seq;
+    atomic_llong max_position;
+    atomic_llong max_notional;
+    atomic_llong max_order_qty;
+    atomic_llong price_band_bps;
+} risk_symbol_t;
+
+/**
+ * @brief Risk engine
+ */
+typedef struct {
+    risk_symbol_t *symbols;             /**< RISK_MAX_SYMBOLS records */
+
+    // Order-rate limit (GCRA): the bucket is full when tat <= now
+    _Alignas(RISK_CACHE_LINE) uint64_t tat_ns;  /**< Theoretical arrival time */
+    uint64_t rate_rejects;              /**< Orders refused by the rate limit */
+
+    // Control thread writes, strategy thread reads
+    _Alignas(RISK_CACHE_LINE) atomic_uint rate_seq;
+    atomic_ullong interval_ns;          /**< ns per token, 0 = unlimited */
+    atomic_ullong burst_ns;             /**< Bucket depth as time (burst x interval) */
+    atomic_int halted;                  /**< Kill switch */
+} risk_engine_t;
+
+// Sequence lock writer side: the count is odd while an update is in progress
+static inline void risk_seq_begin(atomic_uint *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void risk_seq_end(atomic_uint *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/**
+ * @brief Set per-symbol limits (control thread)
+ */
+static inline void risk_set_limits(risk_engine_t *re, int idx, const risk_limits_t *limits) {
+    if (idx < 0 || idx >= RISK_MAX_SYMBOLS) {
+        return;
+    }
+    risk_symbol_t *s = &re->symbols[idx];
+    risk_seq_begin(&s->seq);
+    atomic_store_explicit(&s->max_position, limits->max_position, memory_order_relaxed);
+    atomic_store_explicit(&s->max_notional, limits->max_notional, memory_order_relaxed);
+    atomic_store_explicit(&s->max_order_qty, limits->max_order_qty, memory_order_relaxed);
+    atomic_store_explicit(&s->price_band_bps, limits->price_band_bps, memory_order_relaxed);
+    risk_seq_end(&s->seq);
+}
+
+/**
+ * @brief Read a consistent copy of per-symbol limits
+ */
+static inline void risk_get_limits(risk_engine_t *re, int idx, risk_limits_t *out) {
+    risk_symbol_t *s = &re->symbols[idx];
+    for (;;) {
+        unsigned before = atomic_load_explicit(&s->seq, memory_order_acquire);
+        out->max_position = atomic_load_explicit(&s->max_position, memory_order_relaxed);
+        out->max_notional = atomic_load_explicit(&s->max_notional, memory_order_relaxed);
+        out->max_order_qty = atomic_load_explicit(&s->max_order_qty, memory_order_relaxed);
+        out->price_band_bps = atomic_load_explicit(&s->price_band_bps, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if ((before & 1) == 0 && atomic_load_explicit(&s->seq, memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Set the global order rate (control thread)
+ *
+ * @param re Engine
+ * @param orders_per_sec Sustained rate, 0 = unlimited
+ * @param burst Orders allowed back to back
+ */
+static inline void risk_set_rate(risk_engine_t *re, uint32_t orders_per_sec, uint32_t burst) {
+    uint64_t interval = orders_per_sec ? 1000000000ULL / orders_per_sec : 0;
+    risk_seq_begin(&re->rate_seq);
+    atomic_store_explicit(&re->interval_ns, interval, memory_order_relaxed);
+    atomic_store_explicit(&re->burst_ns, interval * (burst ? burst : 1), memory_order_relaxed);
+    risk_seq_end(&re->rate_seq);
+}
+
+/**
+ * @brief Engage or release the kill switch (any thread)
+ */
+static inline void risk_halt(risk_engine_t *re, int halted) {
+    atomic_store_explicit(&re->halted, halted, memory_order_release);
+}
+
+/**
+ * @brief Create an engine; every symbol starts with the given limits
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static inline int risk_engine_init(risk_engine_t *re, const risk_limits_t *defaults,
+                                   uint32_t orders_per_sec, uint32_t burst) {
+    memset(re, 0, sizeof(*re));
+    re->symbols = aligned_alloc(RISK_CACHE_LINE, sizeof(risk_symbol_t) * RISK_MAX_SYMBOLS);
+    if (!re->symbols) {
+        return -1;
+    }
+    memset(re->symbols, 0, sizeof(risk_symbol_t) * RISK_MAX_SYMBOLS);
+    for (int i = 0; i < RISK_MAX_SYMBOLS; i++) {
+        risk_set_limits(re, i, defaults);
+    }
+    risk_set_rate(re, orders_per_sec, burst);
+    return 0;
+}
+
+/**
+ * @brief Release engine memory
+ */
+static inline void risk_engine_destroy(risk_engine_t *re) {
+    free(re->symbols);
+    re->symbols = NULL;
+}
+
+/**
+ * @brief Name a symbol slot so the control thread can find it (strategy thread)
+ */
+static inline void risk_register_symbol(risk_engine_t *re, int idx, const char *symbol) {
+    if (idx < 0 || idx >= RISK_MAX_SYMBOLS) {
+        return;
+    }
+    risk_symbol_t *s = &re->symbols[idx];
+    strncpy(s->symbol, symbol, SYMBOL_LEN);
+    s->symbol[SYMBOL_LEN] = '\0';
+    atomic_store_explicit(&s->registered, 1, memory_order_release);
+}
+
+/**
+ * @brief Find a registered symbol by name (control thread)
+ *
+ * @return Symbol index, or -1 if not registered
+ */
+static inline int risk_find_symbol(risk_engine_t *re, const char *symbol) {
+    for (int i = 0; i < RISK_MAX_SYMBOLS; i++) {
+        risk_symbol_t *s = &re->symbols[i];
+        if (atomic_load_explicit(&s->registered, memory_order_acquire) &&
+            strncmp(s->symbol, symbol, SYMBOL_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Update the reference price for the price band (strategy thread)
+ */
+static inline void risk_on_trade_price(risk_engine_t *re, int idx, int64_t price) {
+    if (idx >= 0 && idx < RISK_MAX_SYMBOLS && price > 0) {
+        re->symbols[idx].ref_price = price;
+    }
+}
+
+// Shared body of the real and dry-run checks; commit is constant at each call site
+static inline risk_result_t risk_check_order_impl(risk_engine_t *re, int idx, uint8_t side,
+                                                  int64_t price, int64_t qty, uint64_t now_ns,
+                                                  int commit) {
+    if (__builtin_expect(idx < 0 || idx >= RISK_MAX_SYMBOLS, 0)) {
+        return RISK_UNKNOWN_SYMBOL;
+    }
+    if (__builtin_expect(atomic_load_explicit(&re->halted, memory_order_acquire), 0)) {
+        return RISK_HALTED;
+    }
+
+    risk_symbol_t *s = &re->symbols[idx];
+    risk_limits_t lim;
+    risk_get_limits(re, idx, &lim);
+    if (commit) {
+        s->checks++;
+    }
+
+    risk_result_t result = RISK_OK;
+    int64_t exposure = side == SIDE_BUY ? s->position + s->open_buy + qty
+                                        : s->position - s->open_sell - qty;
+    if (exposure < 0) {
+        exposure = -exposure;
+    }
+
+    if (qty <= 0 || qty > lim.max_order_qty) {
+        result = RISK_ORDER_QTY;
+    } else if (lim.price_band_bps > 0 && s->ref_price > 0 &&
+               (price > s->ref_price ? price - s->ref_price : s->ref_price - price) * RISK_BPS >
+                   lim.price_band_bps * s->ref_price) {
+        result = RISK_PRICE_BAND;
+    } else if (exposure > lim.max_position) {
+        result = RISK_POSITION;
+    } else if (exposure * price > lim.max_notional) {
+        result = RISK_NOTIONAL;
+    }
+    if (result != RISK_OK) {
+        if (commit) {
+            s->rejects++;
+        }
+        return result;
+    }
+
+    // Rate limit last, so refused orders do not consume tokens
+    uint64_t interval, burst;
+    for (;;) {
+        unsigned before = atomic_load_explicit(&re->rate_seq, memory_order_acquire);
+        interval = atomic_load_explicit(&re->interval_ns, memory_order_relaxed);
+        burst = atomic_load_explicit(&re->burst_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if ((before & 1) == 0 && atomic_load_explicit(&re->rate_seq, memory_order_relaxed) == before) {
+            break;
+        }
+    }
+    if (interval) {
+        uint64_t tat = re->tat_ns > now_ns ? re->tat_ns : now_ns;
+        if (tat + interval > now_ns + burst) {
+            if (commit) {
+                re->rate_rejects++;
+                s->rejects++;
+            }
+            return RISK_RATE;
+        }
+        if (commit) {
+            re->tat_ns = tat + interval;
+        }
+    }
+
+    if (!commit) {
+        return RISK_OK;
+    }
+    if (side == SIDE_BUY) {
+        s->open_buy += qty;
+    } else {
+        s->open_sell += qty;
+    }
+    return RISK_OK;
+}
+
+/**
+ * @brief Pre-trade check; on RISK_OK the order's quantity is booked as open
+ *
+ * @param re Engine
+ * @param idx Symbol index
+ * @param side SIDE_BUY or SIDE_SELL
+ * @param price Limit price in ticks
+ * @param qty Shares
+ * @param now_ns Current time, any monotonic nanosecond clock
+ * @return RISK_OK, or the first limit the order breaches
+ */
+static inline risk_result_t risk_check_order(risk_engine_t *re, int idx, uint8_t side,
+                                             int64_t price, int64_t qty, uint64_t now_ns) {
+    return risk_check_order_impl(re, idx, side, price, qty, now_ns, 1);
+}
+
+/**
+ * @brief Run the full check without changing any state
+ *
+ * Used to keep the check's code and data warm while no orders are being
+ * sent. Counters, the rate bucket and open quantities are left untouched.
+ *
+ * @return Same verdict risk_check_order() would give
+ */
+static inline risk_result_t risk_check_order_dry(risk_engine_t *re, int idx, uint8_t side,
+                                                 int64_t price, int64_t qty, uint64_t now_ns) {
+    return risk_check_order_impl(re, idx, side, price, qty, now_ns, 0);
+}
+
+/**
+ * @brief Apply a fill: open quantity becomes position (strategy thread)
+ */
+static inline void risk_on_fill(risk_engine_t *re, int idx, uint8_t side, int64_t qty) {
+    if (idx < 0 || idx >= RISK_MAX_SYMBOLS) {
+        return;
+    }
+    risk_symbol_t *s = &re->symbols[idx];
+    if (side == SIDE_BUY) {
+        s->open_buy -= qty;
+        s->position += qty;
+    } else {
+        s->open_sell -= qty;
+        s->position -= qty;
+    }
+}
+
+/**
+ * @brief Release open quantity of a rejected or cancelled order (strategy thread)
+ */
+static inline void risk_on_order_done(risk_engine_t *re, int idx, uint8_t side, int64_t leaves) {
+    if (idx < 0 || idx >= RISK_MAX_SYMBOLS) {
+        return;
+    }
+    risk_symbol_t *s = &re->symbols[idx];
+    if (side == SIDE_BUY) {
+        s->open_buy -= leaves;
+    } else {
+        s->open_sell -= leaves;
+    }
+}
+
+/**
+ * @brief Human-readable check result
+ */
+static inline const char *risk_result_name(risk_result_t r) {
+    static const char *names[] = {
+        "ok", "halted", "order rate", "order size", "price band",
+        "position", "notional", "unknown symbol"
+    };
+    return (unsigned)r < sizeof(names) / sizeof(names[0]) ? names[r] : "?";
+}
+
+#endif /* RISK_ENGINE_H */
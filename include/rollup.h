@@ -0,0 +1,244 @@
+/**
+ * @file rollup.h
+ * @brief Incremental min/max/avg rollups at 1 s, 1 min and 1 h resolution
+ *
+ * A series keeps a ring of buckets per resolution: 60 one-second buckets,
+ * 60 one-minute buckets and 24 one-hour buckets. Each bucket holds the
+ * count and the per-metric min, max and sum of the readings in it. A
+ * reading only updates the open one-second bucket. When a bucket closes,
+ * it is merged once into the open bucket of the next resolution (cascading
+ * aggregation). Recording is therefore O(1), memory per series is fixed,
+ * and raw readings are never stored.
+ *
+ * Queries merge the buckets that cover a window, plus the still-open
+ * buckets of the finer resolutions that fall inside it. A "last minute"
+ * query reads at most 60 buckets, whatever the reading rate.
+ *
+ * One writer per series. Any number of readers on other threads query it
+ * without locks: the writer bumps a sequence stamp around each update
+ * (odd while writing) and a reader retries a query that raced with one,
+ * like conflator.h. The writer never waits for readers.
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <float.h>
+#include <stdatomic.h>
+
+#define ROLLUP_MAX_METRICS 4        /**< Values per reading */
+#define ROLLUP_LEVELS 3
+
+/** Resolutions */
+enum {
+    ROLLUP_SECOND = 0,
+    ROLLUP_MINUTE = 1,
+    ROLLUP_HOUR = 2,
+};
+
+static const uint64_t rollup_width_ms[ROLLUP_LEVELS] = { 1000, 60000, 3600000 };
+static const uint32_t rollup_buckets[ROLLUP_LEVELS] = { 60, 60, 24 };
+
+#define ROLLUP_TOTAL_BUCKETS (60 + 60 + 24)
+
+/**
+ * @brief Aggregate of the readings in one interval
+ */
+typedef struct {
+    uint64_t epoch;                         /**< Start time / resolution width */
+    uint64_t count;                         /**< Readings merged */
+    float min[ROLLUP_MAX_METRICS];
+    float max[ROLLUP_MAX_METRICS];
+    double sum[ROLLUP_MAX_METRICS];
+} rollup_bucket_t;
+
+/**
+ * @brief Rollups of one series (e.g. one sensor)
+ */
+typedef struct {
+    atomic_uint stamp;                      /**< Odd while the writer updates */
+    uint32_t metrics;                       /**< Values per reading */
+    uint64_t open[ROLLUP_LEVELS];           /**< Epoch of the open bucket per level */
+    rollup_bucket_t buckets[ROLLUP_TOTAL_BUCKETS];
+} rollup_t;
+
+#define ROLLUP_NONE UINT64_MAX
+
+/**
+ * @brief Initialize an empty series of readings with the given number of values
+ *
+ * @return 0 on success, -1 if metrics is out of range (errno set)
+ */
+static inline int rollup_init(rollup_t *r, uint32_t metrics) {
+    memset(r, 0, sizeof(*r));
+    if (metrics == 0 || metrics > ROLLUP_MAX_METRICS) {
+        errno = EINVAL;
+        return -1;
+    }
+    r->metrics = metrics;
+    for (int l = 0; l < ROLLUP_LEVELS; l++) {
+        r->open[l] = ROLLUP_NONE;
+    }
+    for (int i = 0; i < ROLLUP_TOTAL_BUCKETS; i++) {
+        r->buckets[i].epoch = ROLLUP_NONE;
+    }
+    return 0;
+}
+
+// Ring slot of epoch at level
+static inline rollup_bucket_t *rollup_slot(const rollup_t *r, int level, uint64_t epoch) {
+    uint32_t base = 0;
+    for (int l = 0; l < level; l++) {
+        base += rollup_buckets[l];
+    }
+    return (rollup_bucket_t *)&r->buckets[base + epoch % rollup_buckets[level]];
+}
+
+static inline void rollup_reset(rollup_bucket_t *b, uint64_t epoch) {
+    b->epoch = epoch;
+    b->count = 0;
+    for (int m = 0; m < ROLLUP_MAX_METRICS; m++) {
+        b->min[m] = FLT_MAX;
+        b->max[m] = -FLT_MAX;
+        b->sum[m] = 0.0;
+    }
+}
+
+// Fold src into dst
+static inline void rollup_merge(rollup_bucket_t *dst, const rollup_bucket_t *src, uint32_t metrics) {
+    if (src->count == 0) {
+        return;
+    }
+    dst->count += src->count;
+    for (uint32_t m = 0; m < metrics; m++) {
+        if (src->min[m] < dst->min[m]) {
+            dst->min[m] = src->min[m];
+        }
+        if (src->max[m] > dst->max[m]) {
+            dst->max[m] = src->max[m];
+        }
+        dst->sum[m] += src->sum[m];
+    }
+}
+
+// Open the bucket for epoch at level. The bucket open there is merged into
+// the open bucket of the next level up, which may have to roll over first,
+// and so on up. Find the highest level that rolls over, then work down from
+// it so each parent is open before its child is merged in. Coarsest buckets
+// just age out of the ring.
+static inline rollup_bucket_t *rollup_open(rollup_t *r, int level, uint64_t epoch) {
+    int top = level;
+    while (top < ROLLUP_LEVELS - 1 && r->open[top] != ROLLUP_NONE &&
+           r->open[top + 1] != r->open[top] * rollup_width_ms[top] / rollup_width_ms[top + 1]) {
+        top++;
+    }
+    for (int l = top; l >= level; l--) {
+        // Above level, the new bucket is the parent of the one closing below
+        uint64_t next = l == level ? epoch : r->open[l - 1] * rollup_width_ms[l - 1] / rollup_width_ms[l];
+        if (l < ROLLUP_LEVELS - 1 && r->open[l] != ROLLUP_NONE) {
+            rollup_merge(rollup_slot(r, l + 1, r->open[l + 1]), rollup_slot(r, l, r->open[l]), r->metrics);
+        }
+        rollup_reset(rollup_slot(r, l, next), next);
+        r->open[l] = next;
+    }
+    return rollup_slot(r, level, epoch);
+}
+
+/**
+ * @brief Record one reading (writer only)
+ *
+ * @param r Series
+ * @param now_ms Reading time in milliseconds (wall clock, so buckets align to
+ *               minutes and hours); a time before the open second counts
+ *               towards the open second
+ * @param values r->metrics values
+ */
+static inline void rollup_record(rollup_t *r, uint64_t now_ms, const float *values) {
+    unsigned stamp = atomic_load_explicit(&r->stamp, memory_order_relaxed);
+    atomic_store_explicit(&r->stamp, stamp + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint64_t epoch = now_ms / rollup_width_ms[ROLLUP_SECOND];
+    rollup_bucket_t *b;
+    if (r->open[ROLLUP_SECOND] != ROLLUP_NONE && epoch <= r->open[ROLLUP_SECOND]) {
+        b = rollup_slot(r, ROLLUP_SECOND, r->open[ROLLUP_SECOND]);
+    } else {
+        b = rollup_open(r, ROLLUP_SECOND, epoch);
+    }
+    b->count++;
+    for (uint32_t m = 0; m < r->metrics; m++) {
+        if (values[m] < b->min[m]) {
+            b->min[m] = values[m];
+        }
+        if (values[m] > b->max[m]) {
+            b->max[m] = values[m];
+        }
+        b->sum[m] += values[m];
+    }
+
+    atomic_store_explicit(&r->stamp, stamp + 2, memory_order_release);
+}
+
+// Aggregate of one interval: its stored bucket plus the open finer buckets inside it
+static inline void rollup_gather(const rollup_t *r, int level, uint64_t epoch, rollup_bucket_t *out) {
+    const rollup_bucket_t *b = rollup_slot(r, level, epoch);
+    if (b->epoch == epoch) {
+        rollup_merge(out, b, r->metrics);
+    }
+    for (int l = 0; l < level; l++) {
+        uint64_t open = r->open[l];
+        if (open != ROLLUP_NONE && open * rollup_width_ms[l] / rollup_width_ms[level] == epoch) {
+            rollup_merge(out, rollup_slot(r, l, open), r->metrics);
+        }
+    }
+}
+
+/**
+ * @brief Aggregate the last n intervals of a resolution, up to and including now
+ *
+ * For example, (ROLLUP_SECOND, 60) is a sliding one-minute window and
+ * (ROLLUP_MINUTE, 60) a sliding one-hour window. Intervals that have left
+ * the ring contribute nothing, so n is capped at the ring size.
+ *
+ * @param r Series
+ * @param level ROLLUP_SECOND, ROLLUP_MINUTE or ROLLUP_HOUR
+ * @param n Intervals to merge
+ * @param now_ms Current time in milliseconds
+ * @param out Receives the aggregate; out->epoch is the first interval
+ * @return Number of readings in the window
+ */
+static inline uint64_t rollup_query(const rollup_t *r, int level, uint32_t n, uint64_t now_ms,
+                                    rollup_bucket_t *out) {
+    if (n > rollup_buckets[level]) {
+        n = rollup_buckets[level];
+    }
+    uint64_t last = now_ms / rollup_width_ms[level];
+    uint64_t first = last + 1 >= n ? last + 1 - n : 0;
+
+    for (;;) {
+        unsigned before = atomic_load_explicit(&r->stamp, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        rollup_reset(out, first);
+        for (uint64_t e = first; e <= last; e++) {
+            rollup_gather(r, level, e, out);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&r->stamp, memory_order_relaxed) == before) {
+            return out->count;
+        }
+    }
+}
+
+/**
+ * @brief Mean of a metric in an aggregate, 0 if it is empty
+ */
+static inline double rollup_mean(const rollup_bucket_t *b, uint32_t metric) {
+    return b->count ? b->sum[metric] / (double)b->count : 0.0;
+}
+
+#endif /* ROLLUP_H */
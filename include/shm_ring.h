@@ -0,0 +1,331 @@
+/**
+ * @file shm_ring.h
+ * @brief Single-writer, multi-reader broadcast ring in shared memory
+ *
+ * One writer process publishes variable-length messages (up to a fixed
+ * maximum) into a ring of slots. Any number of reader processes map the
+ * same memory read-only and follow it with their own private cursor. The
+ * writer never waits for readers and does not know how many there are, so
+ * fan-out costs the writer nothing. A reader that falls more than a ring's
+ * length behind is lapped: the lap is detected, counted as lost messages,
+ * and the reader resumes at the oldest message still intact.
+ *
+ * Each slot carries a sequence stamp: 2n-1 while message n is being
+ * written, 2n once it is complete. A reader expecting message n checks the
+ * stamp before and after copying. A lower stamp means the message is not
+ * there yet; a higher one means the slot was overwritten.
+ *
+ * The ring lives in a memfd (anonymous; share the fd or its
+ * /proc/<pid>/fd/<n> path) or in a named POSIX shared memory object under
+ * /dev/shm. Readers do not need write access.
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+
+#define SHM_RING_MAGIC 0x53524e47u      /**< "SRNG" */
+#define SHM_RING_VERSION 1
+#define SHM_RING_CACHE_LINE 64
+
+// File sealing constants (fcntl.h only exposes them with _GNU_SOURCE)
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+/**
+ * @brief Ring header at the start of the shared mapping
+ */
+typedef struct {
+    uint32_t magic;                     /**< SHM_RING_MAGIC once initialized */
+    uint32_t version;                   /**< SHM_RING_VERSION */
+    uint32_t slot_count;                /**< Power of 2 */
+    uint32_t slot_stride;               /**< Bytes per slot, cache-line multiple */
+    uint32_t max_message;               /**< Largest payload */
+    uint32_t writer_pid;                /**< Publishing process */
+    _Alignas(SHM_RING_CACHE_LINE) atomic_ullong write_seq;  /**< Last complete message */
+} shm_ring_header_t;
+
+/**
+ * @brief Slot header; the payload follows
+ */
+typedef struct {
+    atomic_ullong stamp;                /**< 2n-1 while writing n, 2n when complete */
+    uint32_t length;                    /**< Payload bytes */
+    uint32_t reserved;
+} shm_ring_slot_t;
+
+/**
+ * @brief Process-local handle to a ring
+ */
+typedef struct {
+    shm_ring_header_t *hdr;             /**< Shared header */
+    unsigned char *slots;               /**< First slot */
+    size_t map_size;                    /**< Bytes mapped */
+    int fd;                             /**< Backing memfd or shm object */
+    int writer;                         /**< Set for the creating process */
+    uint32_t mask;                      /**< slot_count - 1 */
+    uint64_t cursor;                    /**< Reader: next message number to read */
+    uint64_t lost;                      /**< Reader: messages lost to laps */
+    char name[64];                      /**< shm name, empty for memfd */
+} shm_ring_t;
+
+// Map an initialized ring from fd
+static inline int shm_ring_map(shm_ring_t *ring, int fd, int writable) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_ring_header_t)) {
+        errno = errno ? errno : EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    ring->hdr = base;
+    ring->map_size = (size_t)st.st_size;
+    ring->slots = (unsigned char *)base + sizeof(shm_ring_header_t);
+    ring->fd = fd;
+    return 0;
+}
+
+// Slot for message number n
+static inline shm_ring_slot_t *shm_ring_slot(const shm_ring_t *ring, uint64_t n) {
+    return (shm_ring_slot_t *)(ring->slots + (size_t)(n & ring->mask) * ring->hdr->slot_stride);
+}
+
+/**
+ * @brief Create a ring as its writer
+ *
+ * @param ring Handle to initialize
+ * @param name POSIX shm name (e.g. "/market_data"), or NULL for an anonymous memfd
+ * @param slot_count Number of messages retained (rounded up to a power of 2)
+ * @param max_message Largest payload in bytes
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int shm_ring_create(shm_ring_t *ring, const char *name, uint32_t slot_count,
+                                  uint32_t max_message) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    uint32_t count = 1;
+    while (count < slot_count) {
+        count <<= 1;
+    }
+    uint32_t stride = (uint32_t)((sizeof(shm_ring_slot_t) + max_message + SHM_RING_CACHE_LINE - 1) &
+                                 ~(size_t)(SHM_RING_CACHE_LINE - 1));
+    size_t size = sizeof(shm_ring_header_t) + (size_t)count * stride;
+
+    int fd;
+    if (name) {
+        fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        snprintf(ring->name, sizeof(ring->name), "%s", name);
+    } else {
+        fd = (int)syscall(SYS_memfd_create, "shm_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) < 0) {
+        goto fail;
+    }
+    if (!name) {
+        // Readers map the whole file; make sure it can never shrink under them
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+    }
+    if (shm_ring_map(ring, fd, 1) < 0) {
+        goto fail;
+    }
+
+    // Fresh pages are zero: every stamp starts as "nothing written"
+    shm_ring_header_t *hdr = ring->hdr;
+    hdr->version = SHM_RING_VERSION;
+    hdr->slot_count = count;
+    hdr->slot_stride = stride;
+    hdr->max_message = max_message;
+    hdr->writer_pid = (uint32_t)getpid();
+    atomic_store_explicit(&hdr->write_seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = SHM_RING_MAGIC;
+
+    ring->mask = count - 1;
+    ring->writer = 1;
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        errno = saved;
+    }
+    return -1;
+}
+
+/**
+ * @brief Attach to a ring read-only through an open descriptor
+ *
+ * The reader starts at the newest message; earlier ones are skipped.
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int shm_ring_attach_fd(shm_ring_t *ring, int fd) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    errno = 0;
+    if (shm_ring_map(ring, fd, 0) < 0) {
+        return -1;
+    }
+    shm_ring_header_t *hdr = ring->hdr;
+    if (hdr->magic != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION ||
+        sizeof(shm_ring_header_t) + (size_t)hdr->slot_count * hdr->slot_stride > ring->map_size) {
+        munmap(hdr, ring->map_size);
+        ring->hdr = NULL;
+        ring->fd = -1;
+        errno = EPROTO;
+        return -1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    ring->mask = hdr->slot_count - 1;
+    ring->cursor = atomic_load_explicit(&hdr->write_seq, memory_order_acquire) + 1;
+    return 0;
+}
+
+/**
+ * @brief Attach to a ring read-only by name
+ *
+ * @param name POSIX shm name ("/market_data") or a file path such as the
+ *        writer's /proc/<pid>/fd/<n> for a memfd ring
+ * @return 0 on success, -1 on failure (errno set)
+ */
+static inline int shm_ring_attach(shm_ring_t *ring, const char *name) {
+    if (!name[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = strchr(name + 1, '/') ? open(name, O_RDONLY | O_CLOEXEC)
+                                   : shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (shm_ring_attach_fd(ring, fd) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Publish one message (writer only)
+ *
+ * @return 0 on success, -1 if the message exceeds max_message
+ */
+static inline int shm_ring_publish(shm_ring_t *ring, const void *data, uint32_t length) {
+    shm_ring_header_t *hdr = ring->hdr;
+    if (length > hdr->max_message) {
+        return -1;
+    }
+    uint64_t n = atomic_load_explicit(&hdr->write_seq, memory_order_relaxed) + 1;
+    shm_ring_slot_t *slot = shm_ring_slot(ring, n);
+
+    atomic_store_explicit(&slot->stamp, 2 * n - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->length = length;
+    memcpy(slot + 1, data, length);
+    atomic_store_explicit(&slot->stamp, 2 * n, memory_order_release);
+    atomic_store_explicit(&hdr->write_seq, n, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Read the next message, if any (reader)
+ *
+ * On a lap the lost messages are added to ring->lost and reading resumes
+ * at the oldest message that is still intact.
+ *
+ * @param ring Reader handle
+ * @param buf Destination, at least max_message bytes
+ * @param buf_size Size of buf
+ * @return Payload length, 0 if no new message, -1 if buf is too small
+ */
+static inline int shm_ring_read(shm_ring_t *ring, void *buf, size_t buf_size) {
+    shm_ring_header_t *hdr = ring->hdr;
+    if (buf_size < hdr->max_message) {
+        return -1;
+    }
+
+    for (;;) {
+        uint64_t n = ring->cursor;
+        shm_ring_slot_t *slot = shm_ring_slot(ring, n);
+        uint64_t before = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+
+        if (before < 2 * n) {
+            return 0;   // Not written yet (or being written)
+        }
+        if (before == 2 * n) {
+            uint32_t length = slot->length;
+            if (length > hdr->max_message) {
+                length = hdr->max_message;  // Torn; the stamp check below catches it
+            }
+            memcpy(buf, slot + 1, length);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->stamp, memory_order_relaxed) == before) {
+                ring->cursor = n + 1;
+                return (int)length;
+            }
+        }
+
+        // Lapped: skip to the oldest message the writer cannot be overwriting
+        uint64_t head = atomic_load_explicit(&hdr->write_seq, memory_order_acquire);
+        uint64_t oldest = head + 2 > hdr->slot_count ? head + 2 - hdr->slot_count : 1;
+        if (oldest > n) {
+            ring->lost += oldest - n;
+            ring->cursor = oldest;
+        }
+    }
+}
+
+/**
+ * @brief Messages published but not yet read by this reader
+ */
+static inline uint64_t shm_ring_backlog(const shm_ring_t *ring) {
+    uint64_t head = atomic_load_explicit(&ring->hdr->write_seq, memory_order_acquire);
+    return head >= ring->cursor ? head + 1 - ring->cursor : 0;
+}
+
+/**
+ * @brief Unmap the ring; the writer also removes a named ring
+ */
+static inline void shm_ring_close(shm_ring_t *ring) {
+    if (ring->hdr) {
+        munmap(ring->hdr, ring->map_size);
+        ring->hdr = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->writer && ring->name[0]) {
+        shm_unlink(ring->name);
+    }
+}
+
+#endif /* SHM_RING_H */
@@ -0,0 +1,555 @@
+/**
+ * @file thread_pool.h
+ * @brief Work-stealing thread pool for offloading CPU-bound handler work
+ *
+ * This header provides a small work-stealing task pool intended to keep
+ * expensive request processing (HTTP handling, command execution, crypto)
+ * off the I/O thread. Each worker owns a Chase-Lev deque; tasks spawned
+ * from inside a worker go to its own deque, tasks submitted from outside
+ * (e.g. an event loop) go to a shared injection queue. Idle workers steal
+ * from random victims and park on a condition variable when no work is left.
+ *
+ * Finished jobs can be handed back to their "home" event loop through a
+ * completion queue whose eventfd is registered in that loop's epoll set,
+ * so the connection resumes on the thread that owns it.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+
+#define TP_DEQUE_SIZE 1024      /**< Per-worker deque capacity (power of 2) */
+#define TP_MAX_WORKERS 64       /**< Upper bound on worker threads */
+#define TP_SPIN_ROUNDS 64       /**< Steal attempts before a worker parks */
+#define TP_CACHE_LINE 64        /**< Cache line size used for padding */
+
+struct tp_job;
+struct tp_completion_queue;
+
+/**
+ * @brief Job callback type, used both for the work and completion phases
+ */
+typedef void (*tp_job_fn)(struct tp_job *job);
+
+/**
+ * @brief Unit of work executed by the pool
+ *
+ * Jobs are owned by the caller (typically embedded in a connection) and
+ * must stay valid until the completion callback has run.
+ */
+typedef struct tp_job {
+    struct tp_job *next;                 /**< Intrusive link for queues */
+    tp_job_fn work;                      /**< Runs on a pool worker */
+    tp_job_fn done;                      /**< Runs on the home loop (may be NULL) */
+    void *arg;                           /**< User data */
+    struct tp_completion_queue *home;    /**< Loop to resume on (may be NULL) */
+} tp_job_t;
+
+/**
+ * @brief Completion queue drained by an event loop
+ *
+ * The eventfd becomes readable when at least one job has completed; it is
+ * only written on the empty to non-empty transition.
+ */
+typedef struct tp_completion_queue {
+    int efd;                 /**< eventfd to register with epoll */
+    pthread_mutex_t lock;    /**< Protects the job list */
+    tp_job_t *head;          /**< Oldest completed job */
+    tp_job_t *tail;          /**< Newest completed job */
+} tp_completion_queue_t;
+
+/**
+ * @brief Chase-Lev work-stealing deque (fixed capacity)
+ */
+typedef struct {
+    _Alignas(TP_CACHE_LINE) atomic_long top;      /**< Steal end (thieves) */
+    _Alignas(TP_CACHE_LINE) atomic_long bottom;   /**< Push/pop end (owner) */
+    _Atomic(tp_job_t *) slots[TP_DEQUE_SIZE];     /**< Ring of job pointers */
+} tp_deque_t;
+
+struct thread_pool;
+
+/**
+ * @brief Per-worker state
+ */
+typedef struct {
+    tp_deque_t deque;             /**< Local work deque */
+    struct thread_pool *pool;     /**< Owning pool */
+    pthread_t thread;             /**< Worker thread handle */
+    uint32_t rng;                 /**< Victim selection state */
+    int index;                    /**< Worker index */
+    uint64_t executed;            /**< Jobs run by this worker */
+    uint64_t stolen;              /**< Jobs stolen from other workers */
+} tp_worker_t;
+
+/**
+ * @brief Work-stealing thread pool
+ */
+typedef struct thread_pool {
+    tp_worker_t *workers;         /**< Worker array */
+    int num_workers;              /**< Number of workers */
+    pthread_mutex_t lock;         /**< Protects injection queue and parking */
+    pthread_cond_t wake;          /**< Signalled when work arrives */
+    tp_job_t *inject_head;        /**< External submissions (FIFO) */
+    tp_job_t *inject_tail;
+    atomic_long inject_count;     /**< Length of injection queue */
+    atomic_int idle_workers;      /**< Workers parked or about to park */
+    atomic_int stop;              /**< Set to request shutdown */
+} thread_pool_t;
+
+/** Worker running on the current thread, NULL outside the pool */
+static _Thread_local tp_worker_t *tp_current_worker = NULL;
+
+/**
+ * @brief Push a job on the owner end of a deque
+ *
+ * @return 0 on success, -1 if the deque is full
+ */
+static inline int tp_deque_push(tp_deque_t *dq, tp_job_t *job) {
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+
+    if (b - t >= TP_DEQUE_SIZE) {
+        return -1;
+    }
+
+    atomic_store_explicit(&dq->slots[b & (TP_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * @brief Pop a job from the owner end of a deque (LIFO)
+ *
+ * @return Job pointer or NULL if empty
+ */
+static inline tp_job_t *tp_deque_pop(tp_deque_t *dq) {
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+    if (t > b) {
+        // Deque was empty
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    tp_job_t *job = atomic_load_explicit(&dq->slots[b & (TP_DEQUE_SIZE - 1)],
+                                         memory_order_relaxed);
+    if (t == b) {
+        // Last element: race against thieves
+        if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            job = NULL;
+        }
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+/**
+ * @brief Steal a job from the thief end of a deque (FIFO)
+ *
+ * @return Job pointer or NULL if empty or the race was lost
+ */
+static inline tp_job_t *tp_deque_steal(tp_deque_t *dq) {
+    long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
+    }
+
+    tp_job_t *job = atomic_load_explicit(&dq->slots[t & (TP_DEQUE_SIZE - 1)],
+                                         memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return NULL;
+    }
+
+    return job;
+}
+
+/**
+ * @brief Check whether a deque currently holds work
+ */
+static inline int tp_deque_nonempty(tp_deque_t *dq) {
+    long t = atomic_load_explicit(&dq->top, memory_order_seq_cst);
+    long b = atomic_load_explicit(&dq->bottom, memory_order_seq_cst);
+    return b > t;
+}
+
+/**
+ * @brief Initialize a completion queue
+ *
+ * @param cq Completion queue
+ * @return 0 on success, -1 on failure
+ */
+static inline int tp_completion_init(tp_completion_queue_t *cq) {
+    cq->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (cq->efd < 0) {
+        perror("eventfd failed");
+        return -1;
+    }
+
+    pthread_mutex_init(&cq->lock, NULL);
+    cq->head = NULL;
+    cq->tail = NULL;
+    return 0;
+}
+
+/**
+ * @brief Release completion queue resources
+ */
+static inline void tp_completion_destroy(tp_completion_queue_t *cq) {
+    if (cq->efd >= 0) {
+        close(cq->efd);
+        cq->efd = -1;
+    }
+    pthread_mutex_destroy(&cq->lock);
+}
+
+/**
+ * @brief Hand a finished job back to its home loop
+ */
+static inline void tp_completion_post(tp_completion_queue_t *cq, tp_job_t *job) {
+    job->next = NULL;
+
+    pthread_mutex_lock(&cq->lock);
+    int was_empty = (cq->head == NULL);
+    if (cq->tail) {
+        cq->tail->next = job;
+    } else {
+        cq->head = job;
+    }
+    cq->tail = job;
+    pthread_mutex_unlock(&cq->lock);
+
+    // Only wake the loop on the empty -> non-empty transition
+    if (was_empty) {
+        uint64_t one = 1;
+        ssize_t res = write(cq->efd, &one, sizeof(one));
+        (void)res;
+    }
+}
+
+/**
+ * @brief Run completion callbacks for all finished jobs
+ *
+ * Call this from the home loop when the eventfd is readable.
+ *
+ * @param cq Completion queue
+ * @return Number of jobs completed
+ */
+static inline int tp_completion_drain(tp_completion_queue_t *cq) {
+    uint64_t counter;
+    ssize_t res = read(cq->efd, &counter, sizeof(counter));
+    (void)res;
+
+    pthread_mutex_lock(&cq->lock);
+    tp_job_t *job = cq->head;
+    cq->head = NULL;
+    cq->tail = NULL;
+    pthread_mutex_unlock(&cq->lock);
+
+    int count = 0;
+    while (job) {
+        tp_job_t *next = job->next;
+        if (job->done) {
+            job->done(job);
+        }
+        job = next;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Execute a job and route its completion
+ */
+static inline void tp_run_job(tp_job_t *job) {
+    job->work(job);
+    if (job->home) {
+        tp_completion_post(job->home, job);
+    } else if (job->done) {
+        job->done(job);
+    }
+}
+
+/**
+ * @brief Take a job from the injection queue
+ */
+static inline tp_job_t *tp_take_injected(thread_pool_t *pool) {
+    if (atomic_load_explicit(&pool->inject_count, memory_order_acquire) == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    tp_job_t *job = pool->inject_head;
+    if (job) {
+        pool->inject_head = job->next;
+        if (!pool->inject_head) {
+            pool->inject_tail = NULL;
+        }
+        atomic_fetch_sub_explicit(&pool->inject_count, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return job;
+}
+
+/**
+ * @brief Try to steal from other workers, starting at a random victim
+ */
+static inline tp_job_t *tp_steal_any(tp_worker_t *self) {
+    thread_pool_t *pool = self->pool;
+    int n = pool->num_workers;
+
+    // xorshift32 for victim selection
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+
+    int start = (int)(self->rng % (uint32_t)n);
+    for (int i = 0; i < n; i++) {
+        tp_worker_t *victim = &pool->workers[(start + i) % n];
+        if (victim == self) {
+            continue;
+        }
+        tp_job_t *job = tp_deque_steal(&victim->deque);
+        if (job) {
+            self->stolen++;
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check for any runnable work visible to a parking worker
+ */
+static inline int tp_has_work(thread_pool_t *pool) {
+    if (pool->inject_head) {
+        return 1;
+    }
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (tp_deque_nonempty(&pool->workers[i].deque)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Wake one parked worker if any are idle
+ */
+static inline void tp_notify(thread_pool_t *pool) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->idle_workers, memory_order_seq_cst) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ * @brief Worker thread main loop
+ */
+static inline void *tp_worker_main(void *arg) {
+    tp_worker_t *self = (tp_worker_t *)arg;
+    thread_pool_t *pool = self->pool;
+    tp_current_worker = self;
+
+    while (1) {
+        tp_job_t *job = tp_deque_pop(&self->deque);
+
+        if (!job) {
+            job = tp_take_injected(pool);
+        }
+
+        for (int spin = 0; !job && spin < TP_SPIN_ROUNDS; spin++) {
+            job = tp_steal_any(self);
+            if (!job) {
+                job = tp_take_injected(pool);
+            }
+            if (!job && (spin & 7) == 7) {
+                sched_yield();
+            }
+        }
+
+        if (job) {
+            tp_run_job(job);
+            self->executed++;
+            continue;
+        }
+
+        // No work found: park. Advertise idleness before the final check so
+        // a concurrent producer either sees us idle or we see its work.
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add_explicit(&pool->idle_workers, 1, memory_order_seq_cst);
+        while (!atomic_load(&pool->stop) && !tp_has_work(pool)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        atomic_fetch_sub_explicit(&pool->idle_workers, 1, memory_order_seq_cst);
+        int stopping = atomic_load(&pool->stop) && !tp_has_work(pool);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stopping) {
+            break;
+        }
+    }
+
+    tp_current_worker = NULL;
+    return NULL;
+}
+
+/**
+ * @brief Create a thread pool
+ *
+ * @param pool Pool to initialize
+ * @param num_workers Number of worker threads (<= 0 uses the online CPU count)
+ * @return 0 on success, -1 on failure
+ */
+static inline int thread_pool_init(thread_pool_t *pool, int num_workers) {
+    if (num_workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (num_workers > TP_MAX_WORKERS) {
+        num_workers = TP_MAX_WORKERS;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = aligned_alloc(TP_CACHE_LINE,
+                                  sizeof(tp_worker_t) * (size_t)num_workers);
+    if (!pool->workers) {
+        perror("thread pool allocation failed");
+        return -1;
+    }
+    memset(pool->workers, 0, sizeof(tp_worker_t) * (size_t)num_workers);
+
+    pool->num_workers = num_workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (int i = 0; i < num_workers; i++) {
+        tp_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->rng = 0x9E3779B9u * (uint32_t)(i + 1);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, tp_worker_main,
+                           &pool->workers[i]) != 0) {
+            perror("failed to create worker thread");
+            atomic_store(&pool->stop, 1);
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_broadcast(&pool->wake);
+            pthread_mutex_unlock(&pool->lock);
+            for (int j = 0; j < i; j++) {
+                pthread_join(pool->workers[j].thread, NULL);
+            }
+            free(pool->workers);
+            pool->workers = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Submit a job to the pool
+ *
+ * From a worker thread the job goes to that worker's deque; from any other
+ * thread it goes to the shared injection queue.
+ *
+ * @param pool Thread pool
+ * @param job Job with work (and optionally done/home) set
+ */
+static inline void thread_pool_submit(thread_pool_t *pool, tp_job_t *job) {
+    tp_worker_t *self = tp_current_worker;
+
+    if (self && self->pool == pool && tp_deque_push(&self->deque, job) == 0) {
+        tp_notify(pool);
+        return;
+    }
+
+    job->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->inject_tail) {
+        pool->inject_tail->next = job;
+    } else {
+        pool->inject_head = job;
+    }
+    pool->inject_tail = job;
+    atomic_fetch_add_explicit(&pool->inject_count, 1, memory_order_release);
+    if (atomic_load(&pool->idle_workers) > 0) {
+        pthread_cond_signal(&pool->wake);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Offload work and resume on the caller's event loop
+ *
+ * @param pool Thread pool
+ * @param job Caller-owned job storage
+ * @param work Function run on a pool worker
+ * @param done Function run on the home loop after work finishes
+ * @param arg User data stored in job->arg
+ * @param home Completion queue of the loop that owns the request
+ */
+static inline void thread_pool_offload(thread_pool_t *pool, tp_job_t *job,
+                                       tp_job_fn work, tp_job_fn done,
+                                       void *arg, tp_completion_queue_t *home) {
+    job->work = work;
+    job->done = done;
+    job->arg = arg;
+    job->home = home;
+    thread_pool_submit(pool, job);
+}
+
+/**
+ * @brief Stop the pool after queued work has drained and join all workers
+ */
+static inline void thread_pool_destroy(thread_pool_t *pool) {
+    if (!pool->workers) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+#endif /* THREAD_POOL_H */
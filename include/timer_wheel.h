@@ -0,0 +1,185 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel for large numbers of re-armed deadlines
+ *
+ * Timers are intrusive list nodes embedded in the owner's structure, so
+ * arming, re-arming and cancelling are O(1) pointer updates and never
+ * allocate. Time is counted in ticks whose length the caller chooses.
+ *
+ * There are TW_LEVELS wheels of TW_SLOTS slots. Level 0 holds timers due
+ * within TW_SLOTS ticks, one slot per tick. Each level up covers TW_SLOTS
+ * times the range of the one below, one slot per block. When level 0 wraps,
+ * the next slot of level 1 is redistributed downwards (cascaded), and so on
+ * up the levels. A timer is therefore moved at most TW_LEVELS - 1 times
+ * before it fires, and it fires on exactly the tick it was set for.
+ *
+ * Advancing costs one slot visit per tick plus the timers that fire or
+ * cascade. It never depends on the number of timers still pending. With no
+ * timers pending, the wheel jumps straight to the new time.
+ *
+ * Single-threaded: arm and advance from the same thread.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)             /**< Slots per level */
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 4                         /**< Range: 2^24 ticks (~19 days at 100 ms) */
+
+/**
+ * @brief A timer; embed in the owning structure
+ */
+typedef struct tw_timer {
+    struct tw_timer *next;                  /**< NULL while not armed */
+    struct tw_timer *prev;
+    uint64_t expires;                       /**< Tick it fires on */
+} tw_timer_t;
+
+/**
+ * @brief Called for each expired timer; it may re-arm the timer
+ */
+typedef void (*tw_expire_fn)(void *ctx, tw_timer_t *timer);
+
+/**
+ * @brief Timing wheel
+ */
+typedef struct {
+    uint64_t now;                           /**< Last tick processed */
+    uint64_t pending;                       /**< Armed timers */
+    tw_timer_t slots[TW_LEVELS][TW_SLOTS];  /**< List heads (sentinels) */
+} timer_wheel_t;
+
+/**
+ * @brief Initialize an empty wheel at tick now
+ */
+static inline void tw_init(timer_wheel_t *w, uint64_t now) {
+    w->now = now;
+    w->pending = 0;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int i = 0; i < TW_SLOTS; i++) {
+            w->slots[l][i].next = w->slots[l][i].prev = &w->slots[l][i];
+        }
+    }
+}
+
+/**
+ * @brief Initialize a timer as not armed
+ */
+static inline void tw_timer_init(tw_timer_t *t) {
+    t->next = t->prev = NULL;
+    t->expires = 0;
+}
+
+/**
+ * @brief Whether the timer is armed
+ */
+static inline int tw_armed(const tw_timer_t *t) {
+    return t->next != NULL;
+}
+
+// Link t into the slot for its expiry, relative to w->now
+static inline void tw_insert(timer_wheel_t *w, tw_timer_t *t) {
+    uint64_t delta = t->expires - w->now;
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ULL << (TW_BITS * (level + 1)))) {
+        level++;
+    }
+    uint64_t when = t->expires;
+    if (delta >= (1ULL << (TW_BITS * TW_LEVELS))) {
+        // Beyond the wheel: park in the farthest slot, re-placed when cascaded
+        when = w->now + (1ULL << (TW_BITS * TW_LEVELS)) - 1;
+    }
+    tw_timer_t *head = &w->slots[level][(when >> (TW_BITS * level)) & TW_MASK];
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static inline void tw_unlink(tw_timer_t *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+/**
+ * @brief Disarm a timer; no effect if it is not armed
+ */
+static inline void tw_cancel(timer_wheel_t *w, tw_timer_t *t) {
+    if (tw_armed(t)) {
+        tw_unlink(t);
+        w->pending--;
+    }
+}
+
+/**
+ * @brief Arm or re-arm a timer to fire on tick expires
+ *
+ * A tick that has already been processed fires on the next advance.
+ */
+static inline void tw_schedule(timer_wheel_t *w, tw_timer_t *t, uint64_t expires) {
+    if (tw_armed(t)) {
+        tw_unlink(t);
+    } else {
+        w->pending++;
+    }
+    t->expires = expires > w->now ? expires : w->now + 1;
+    tw_insert(w, t);
+}
+
+// Move every timer in a slot down the wheel
+static inline void tw_cascade(timer_wheel_t *w, int level, uint64_t index) {
+    tw_timer_t *head = &w->slots[level][index];
+    tw_timer_t *t = head->next;
+    head->next = head->prev = head;
+    while (t != head) {
+        tw_timer_t *next = t->next;
+        tw_insert(w, t);
+        t = next;
+    }
+}
+
+/**
+ * @brief Process ticks up to and including now, firing due timers in order
+ *
+ * @param w Wheel
+ * @param now Current tick
+ * @param expire Called for each expired timer, which is disarmed first
+ * @param ctx Callback argument
+ * @return Number of timers fired
+ */
+static inline uint64_t tw_advance(timer_wheel_t *w, uint64_t now, tw_expire_fn expire, void *ctx) {
+    uint64_t fired = 0;
+    while (w->now < now) {
+        if (w->pending == 0) {
+            w->now = now;
+            break;
+        }
+        uint64_t tick = ++w->now;
+
+        // Crossing a block boundary: bring the next block down from above
+        for (int level = 1; level < TW_LEVELS; level++) {
+            if ((tick & ((1ULL << (TW_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            tw_cascade(w, level, (tick >> (TW_BITS * level)) & TW_MASK);
+        }
+
+        tw_timer_t *head = &w->slots[0][tick & TW_MASK];
+        while (head->next != head) {
+            tw_timer_t *t = head->next;
+            tw_unlink(t);
+            w->pending--;
+            fired++;
+            expire(ctx, t);
+        }
+    }
+    return fired;
+}
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,260 @@
+/**
+ * @file trading_protocol.h
+ * @brief Binary order-entry messages shared by the trading client and sim_exchange
+ *
+ * Fixed-size, packed messages in host byte order (both ends run on the
+ * same machine in the examples). Every message starts with msg_header_t;
+ * send_ns is the sender's CLOCK_REALTIME when the message was sent.
+ *
+ * An ack echoes the order's send_ns so the client can compute a true
+ * order-to-ack round trip on its own clock. Prices are fixed-point ticks
+ * (PRICE_SCALE per currency unit) so the matching engine never compares
+ * floating point values.
+ *
+ * Over UDP each datagram is one message. Over the TCP order-entry session
+ * (order_session.h) messages are framed by hdr.length, and hdr.seq is the
+ * session sequence number of application messages. The session messages
+ * (logon, heartbeat, resend request, sequence reset, logout) are not
+ * sequenced; a heartbeat carries the sender's last sequence number so an
+ * idle peer can still notice a gap.
+ */
+
+#ifndef TRADING_PROTOCOL_H
+#define TRADING_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PRICE_SCALE 10000           /**< Ticks per currency unit */
+#define SYMBOL_LEN 8                /**< Fixed symbol field width */
+
+#define PRICE_TO_TICKS(p) ((int64_t)((p) * PRICE_SCALE + ((p) >= 0 ? 0.5 : -0.5)))
+#define TICKS_TO_PRICE(t) ((double)(t) / PRICE_SCALE)
+
+/**
+ * @brief Message types
+ */
+enum {
+    MSG_NEW_ORDER = 1,      /**< Client -> exchange */
+    MSG_CANCEL = 2,         /**< Client -> exchange */
+    MSG_ACK = 3,            /**< Exchange -> client, order accepted */
+    MSG_FILL = 4,           /**< Exchange -> client, execution */
+    MSG_REJECT = 5,         /**< Exchange -> client, order refused */
+    MSG_CANCELLED = 6,      /**< Exchange -> client, cancel confirmed */
+    MSG_LOGON = 7,          /**< Session: both directions */
+    MSG_HEARTBEAT = 8,      /**< Session: both directions, seq = last sent */
+    MSG_RESEND_REQUEST = 9, /**< Session: replay a range of sequence numbers */
+    MSG_SEQUENCE_RESET = 10, /**< Session: messages before new_seq are gone */
+    MSG_LOGOUT = 11         /**< Session: closing */
+};
+
+/**
+ * @brief Order side
+ */
+enum {
+    SIDE_BUY = 'B',
+    SIDE_SELL = 'S'
+};
+
+/**
+ * @brief Reject reasons
+ */
+enum {
+    REJECT_UNKNOWN_SYMBOL = 1,
+    REJECT_BAD_PRICE = 2,
+    REJECT_BAD_QUANTITY = 3,
+    REJECT_BOOK_FULL = 4,
+    REJECT_UNKNOWN_ORDER = 5,
+    REJECT_RISK = 6
+};
+
+/**
+ * @brief Common header
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t type;          /**< MSG_* */
+    uint16_t length;        /**< Total message size */
+    uint32_t seq;           /**< Sender's message sequence number */
+    uint64_t send_ns;       /**< Sender timestamp */
+} msg_header_t;
+
+/**
+ * @brief New limit order
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t client_order_id;       /**< Client-assigned ID */
+    char symbol[SYMBOL_LEN];        /**< NUL-padded symbol */
+    uint8_t side;                   /**< SIDE_BUY / SIDE_SELL */
+    uint8_t reserved[3];
+    uint32_t quantity;              /**< Shares */
+    int64_t price;                  /**< Limit price in ticks */
+} order_msg_t;
+
+/**
+ * @brief Cancel request
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t client_order_id;       /**< Order to cancel */
+    uint64_t exchange_order_id;     /**< Exchange ID from the ack */
+} cancel_msg_t;
+
+/**
+ * @brief Order accepted (or cancel confirmed)
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t client_order_id;
+    uint64_t exchange_order_id;
+    uint64_t order_send_ns;         /**< Echo of the order's hdr.send_ns */
+    uint64_t exchange_recv_ns;      /**< When the exchange received it */
+} ack_msg_t;
+
+/**
+ * @brief Execution report
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t client_order_id;
+    uint64_t exchange_order_id;
+    int64_t price;                  /**< Execution price in ticks */
+    uint32_t quantity;              /**< Shares filled */
+    uint32_t leaves;                /**< Shares still open */
+} fill_msg_t;
+
+/**
+ * @brief Order refused
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t client_order_id;
+    uint64_t order_send_ns;         /**< Echo of the order's hdr.send_ns */
+    uint32_t reason;                /**< REJECT_* */
+} reject_msg_t;
+
+/**
+ * @brief Session logon; the reply carries the acceptor's expectations
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint64_t session_id;            /**< Identifies the session across reconnects */
+    uint32_t next_expected_seq;     /**< Next sequence number the sender expects to receive */
+    uint32_t heartbeat_ms;          /**< Heartbeat interval */
+} logon_msg_t;
+
+/**
+ * @brief Ask the peer to send a range of sequenced messages again
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint32_t begin_seq;             /**< First sequence number wanted */
+    uint32_t end_seq;               /**< Last sequence number wanted, 0 = everything */
+} resend_request_msg_t;
+
+/**
+ * @brief Messages below new_seq cannot be resent
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint32_t new_seq;               /**< Next sequence number the sender will send */
+} sequence_reset_msg_t;
+
+/**
+ * @brief Session end
+ */
+typedef struct __attribute__((packed)) {
+    msg_header_t hdr;
+    uint32_t reason;                /**< LOGOUT_* */
+} logout_msg_t;
+
+/**
+ * @brief Logout reasons
+ */
+enum {
+    LOGOUT_NORMAL = 0,
+    LOGOUT_UNKNOWN_SESSION = 1,
+    LOGOUT_PROTOCOL_ERROR = 2
+};
+
+/**
+ * @brief Largest message, for receive buffers
+ */
+typedef union {
+    msg_header_t hdr;
+    order_msg_t order;
+    cancel_msg_t cancel;
+    ack_msg_t ack;
+    fill_msg_t fill;
+    reject_msg_t reject;
+    logon_msg_t logon;
+    resend_request_msg_t resend;
+    sequence_reset_msg_t reset;
+    logout_msg_t logout;
+} trading_msg_t;
+
+/**
+ * @brief Normalized top-of-book update, as fanned out to strategy processes
+ */
+typedef struct {
+    char symbol[SYMBOL_LEN];        /**< NUL-padded symbol */
+    int64_t last_price;             /**< Last trade in ticks */
+    int64_t bid;                    /**< Best bid in ticks */
+    int64_t ask;                    /**< Best ask in ticks */
+    uint32_t volume;                /**< Traded volume */
+    uint32_t symbol_index;          /**< Feed handler's slot for the symbol */
+    uint64_t exchange_ns;           /**< Sender timestamp from the feed, 0 if absent */
+    uint64_t feed_ns;               /**< When the feed handler published it */
+} md_update_t;
+
+/**
+ * @brief Fill in a message header
+ */
+static inline void msg_header_init(msg_header_t *hdr, uint16_t type, uint16_t length,
+                                   uint32_t seq, uint64_t send_ns) {
+    hdr->type = type;
+    hdr->length = length;
+    hdr->seq = seq;
+    hdr->send_ns = send_ns;
+}
+
+/**
+ * @brief Check that a buffer starts with a complete message of its type
+ *
+ * @return Message type, or 0 if the buffer is malformed
+ */
+static inline int msg_validate(const void *buf, size_t len) {
+    static const uint16_t sizes[] = {
+        [MSG_NEW_ORDER] = sizeof(order_msg_t),
+        [MSG_CANCEL] = sizeof(cancel_msg_t),
+        [MSG_ACK] = sizeof(ack_msg_t),
+        [MSG_FILL] = sizeof(fill_msg_t),
+        [MSG_REJECT] = sizeof(reject_msg_t),
+        [MSG_CANCELLED] = sizeof(ack_msg_t),
+        [MSG_LOGON] = sizeof(logon_msg_t),
+        [MSG_HEARTBEAT] = sizeof(msg_header_t),
+        [MSG_RESEND_REQUEST] = sizeof(resend_request_msg_t),
+        [MSG_SEQUENCE_RESET] = sizeof(sequence_reset_msg_t),
+        [MSG_LOGOUT] = sizeof(logout_msg_t)
+    };
+    if (len < sizeof(msg_header_t)) {
+        return 0;
+    }
+    const msg_header_t *hdr = buf;
+    if (hdr->type == 0 || hdr->type >= sizeof(sizes) / sizeof(sizes[0]) ||
+        hdr->length != sizes[hdr->type] || len < hdr->length) {
+        return 0;
+    }
+    return hdr->type;
+}
+
+/**
+ * @brief Copy a symbol into a fixed, NUL-padded field
+ */
+static inline void msg_set_symbol(char dst[SYMBOL_LEN], const char *symbol) {
+    memset(dst, 0, SYMBOL_LEN);
+    size_t len = strlen(symbol);
+    memcpy(dst, symbol, len < SYMBOL_LEN ? len : SYMBOL_LEN);
+}
+
+#endif /* TRADING_PROTOCOL_H */
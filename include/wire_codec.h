@@ -0,0 +1,173 @@
+/**
+ * @file wire_codec.h
+ * @brief Load/store primitives used by msgc-generated message codecs
+ *
+ * Generated codecs (see schemas/ and src/tools/msgc.c) read and write
+ * every field at a fixed offset through these helpers. The byte order of
+ * each message is fixed in its schema. The swap flag passed here is a
+ * compile-time constant (WIRE_SWAP_BE / WIRE_SWAP_LE), so each access
+ * compiles to a plain load or store, plus a bswap when the message and
+ * host byte orders differ.
+ *
+ * Arrays of 16-, 32- and 64-bit elements are copied in bulk. When the
+ * compiler targets SSSE3 (e.g. -mssse3, or the CODEC_SIMD CMake option),
+ * byte-swapped arrays are handled 16 bytes at a time with PSHUFB. Otherwise
+ * a scalar loop is used.
+ */
+
+#ifndef WIRE_CODEC_H
+#define WIRE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define WIRE_SIMD 1
+#else
+#define WIRE_SIMD 0
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WIRE_SWAP_BE 1      /**< Big-endian fields need a swap on this host */
+#define WIRE_SWAP_LE 0
+#else
+#define WIRE_SWAP_BE 0
+#define WIRE_SWAP_LE 1
+#endif
+
+// Scalar loads
+static inline uint16_t wire_get16(const uint8_t *p, int swap) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static inline uint32_t wire_get32(const uint8_t *p, int swap) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static inline uint64_t wire_get64(const uint8_t *p, int swap) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap64(v) : v;
+}
+
+static inline float wire_get_f32(const uint8_t *p, int swap) {
+    uint32_t bits = wire_get32(p, swap);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static inline double wire_get_f64(const uint8_t *p, int swap) {
+    uint64_t bits = wire_get64(p, swap);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// Scalar stores
+static inline void wire_put16(uint8_t *p, uint16_t v, int swap) {
+    v = swap ? __builtin_bswap16(v) : v;
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void wire_put32(uint8_t *p, uint32_t v, int swap) {
+    v = swap ? __builtin_bswap32(v) : v;
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void wire_put64(uint8_t *p, uint64_t v, int swap) {
+    v = swap ? __builtin_bswap64(v) : v;
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void wire_put_f32(uint8_t *p, float v, int swap) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    wire_put32(p, bits, swap);
+}
+
+static inline void wire_put_f64(uint8_t *p, double v, int swap) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    wire_put64(p, bits, swap);
+}
+
+#if WIRE_SIMD
+// Apply mask to each whole 16-byte block; returns bytes done
+static inline size_t wire_shuffle_blocks(uint8_t *d, const uint8_t *s, size_t bytes, __m128i mask) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief Copy n 16-bit elements, reversing each one's bytes if swap is set
+ */
+static inline void wire_copy16(void *dst, const void *src, size_t n, int swap) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if (!swap) {
+        memcpy(d, s, n * 2);
+        return;
+    }
+    size_t done = 0;
+#if WIRE_SIMD
+    done = wire_shuffle_blocks(d, s, n * 2,
+                               _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+#endif
+    for (; done < n * 2; done += 2) {
+        wire_put16(d + done, wire_get16(s + done, 0), 1);
+    }
+}
+
+/**
+ * @brief Copy n 32-bit elements, reversing each one's bytes if swap is set
+ */
+static inline void wire_copy32(void *dst, const void *src, size_t n, int swap) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if (!swap) {
+        memcpy(d, s, n * 4);
+        return;
+    }
+    size_t done = 0;
+#if WIRE_SIMD
+    done = wire_shuffle_blocks(d, s, n * 4,
+                               _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+#endif
+    for (; done < n * 4; done += 4) {
+        wire_put32(d + done, wire_get32(s + done, 0), 1);
+    }
+}
+
+/**
+ * @brief Copy n 64-bit elements, reversing each one's bytes if swap is set
+ */
+static inline void wire_copy64(void *dst, const void *src, size_t n, int swap) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if (!swap) {
+        memcpy(d, s, n * 8);
+        return;
+    }
+    size_t done = 0;
+#if WIRE_SIMD
+    done = wire_shuffle_blocks(d, s, n * 8,
+                               _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+#endif
+    for (; done < n * 8; done += 8) {
+        wire_put64(d + done, wire_get64(s + done, 0), 1);
+    }
+}
+
+#endif /* WIRE_CODEC_H */
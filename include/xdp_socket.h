@@ -0,0 +1,606 @@
+/**
+ * @file xdp_socket.h
+ * @brief Minimal AF_XDP receive path without libbpf/libxdp
+ *
+ * Sets up everything an AF_XDP RX socket needs using only kernel uAPI
+ * headers and raw system calls:
+ *  - a UMEM (frame area) backed by a hugepage arena, plus its fill and
+ *    completion rings and the socket's RX ring, all mmap()ed
+ *  - an XSKMAP and a small XDP program, assembled in place, that redirects
+ *    IPv4/UDP packets for one destination port to the socket bound to the
+ *    receiving queue and passes everything else to the kernel stack
+ *  - attachment through rtnetlink, native (driver) mode first, falling back
+ *    to generic/SKB mode, which is what veth and most test setups use
+ *
+ * Zero-copy is requested when the driver is in native mode and falls back
+ * to copy mode otherwise. Frames are recycled to the fill ring as soon as
+ * the caller's handler returns, so handlers must copy anything they keep.
+ *
+ * Requires CAP_NET_ADMIN and CAP_BPF (or root).
+ */
+
+#ifndef XDP_SOCKET_H
+#define XDP_SOCKET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "mem_pool.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+#define XSK_FRAME_SIZE 2048         /**< UMEM chunk size */
+#define XSK_NUM_FRAMES 2048         /**< Frames in the UMEM (== fill ring size) */
+#define XSK_RING_SIZE 2048          /**< RX / fill / completion ring entries */
+#define XSK_RX_BATCH 64             /**< Descriptors consumed per call */
+#define XSK_BUSY_POLL_USECS 20      /**< SO_BUSY_POLL value in busy-poll mode */
+
+/**
+ * @brief Producer/consumer ring shared with the kernel
+ */
+typedef struct {
+    uint32_t *producer;     /**< Kernel/user producer index */
+    uint32_t *consumer;     /**< Kernel/user consumer index */
+    uint32_t *flags;        /**< XDP_RING_NEED_WAKEUP etc. */
+    void *descs;            /**< Descriptor array */
+    uint32_t mask;          /**< Entries - 1 */
+    uint32_t cached_prod;   /**< Local copy of producer */
+    uint32_t cached_cons;   /**< Local copy of consumer */
+    void *map;              /**< mmap() base */
+    size_t map_len;         /**< mmap() length */
+} xsk_ring_t;
+
+/**
+ * @brief AF_XDP socket with its UMEM, rings and XDP program
+ */
+typedef struct {
+    int fd;                 /**< AF_XDP socket */
+    int ifindex;            /**< Interface the program is attached to */
+    uint32_t queue_id;      /**< RX queue bound */
+    int map_fd;             /**< XSKMAP */
+    int prog_fd;            /**< XDP program */
+    uint32_t xdp_flags;     /**< Flags used for attachment */
+    int zero_copy;          /**< 1 if bound in zero-copy mode */
+    int busy_poll;          /**< Drive NAPI from recvfrom() when idle */
+    mem_arena_t umem;       /**< Frame memory */
+    xsk_ring_t rx;          /**< Received descriptors */
+    xsk_ring_t fill;        /**< Frames handed to the kernel */
+    xsk_ring_t comp;        /**< TX completions (required, unused) */
+    uint64_t rx_packets;    /**< Descriptors consumed */
+    uint64_t wakeups;       /**< recvfrom() kicks issued */
+} xsk_socket_t;
+
+/**
+ * @brief Handler for one received frame
+ */
+typedef void (*xsk_packet_fn)(void *ctx, const uint8_t *frame, uint32_t len);
+
+// Raw BPF instruction (the uAPI has no builder macros)
+#define XSK_INSN(CODE, DST, SRC, OFF, IMM) \
+    ((struct bpf_insn){ .code = (CODE), .dst_reg = (DST), .src_reg = (SRC), \
+                        .off = (OFF), .imm = (IMM) })
+
+static inline long xsk_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * @brief Create the XSKMAP the program redirects into
+ *
+ * @return Map fd, or -1 on failure
+ */
+static inline int xsk_create_map(void) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 64;
+    return (int)xsk_bpf(BPF_MAP_CREATE, &attr);
+}
+
+/**
+ * @brief Load the UDP port filter program with a chosen action for unbound queues
+ *
+ * Equivalent C:
+ *   if (eth->h_proto == IPv4 && ip->ihl == 5 && !fragment &&
+ *       ip->protocol == UDP && udp->dest == port)
+ *       return bpf_redirect_map(&xsks, ctx->rx_queue_index, unbound);
+ *   return XDP_PASS;
+ *
+ * IPv4 packets with options are passed to the stack, which is fine for
+ * exchange feeds.
+ *
+ * @param map_fd XSKMAP to redirect into
+ * @param udp_port Destination port to capture (host order)
+ * @param unbound Action for matching packets when no socket is bound to the
+ *        queue. With XDP_DROP, BPF_PROG_TEST_RUN tells matches from passes
+ *        without a socket.
+ * @return Program fd, or -1 on failure
+ */
+static inline int xsk_load_filter(int map_fd, uint16_t udp_port, int unbound) {
+    const int hdrs = ETH_HLEN + 20 + 8;
+    struct bpf_insn prog[32];
+    int to_pass[8];
+    int n = 0, nj = 0;
+
+    // r6 = ctx; r2 = data; r3 = data_end
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6,
+                         offsetof(struct xdp_md, data), 0);
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6,
+                         offsetof(struct xdp_md, data_end), 0);
+    // Bounds check for Ethernet + IPv4 (no options) + UDP
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, hdrs);
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+    // EtherType
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0);
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_IP));
+    // Version 4, IHL 5
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN, 0);
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0x45);
+    // Not a fragment (MF flag or offset set)
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, ETH_HLEN + 6, 0);
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3fff));
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0);
+    // Protocol UDP
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN + 9, 0);
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, IPPROTO_UDP);
+    // Destination port
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, ETH_HLEN + 20 + 2, 0);
+    to_pass[nj++] = n;
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(udp_port));
+    // return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS)
+    prog[n++] = XSK_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6,
+                         offsetof(struct xdp_md, rx_queue_index), 0);
+    prog[n++] = XSK_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd);
+    prog[n++] = XSK_INSN(0, 0, 0, 0, 0);
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, unbound);
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+    // pass: return XDP_PASS
+    int pass = n;
+    prog[n++] = XSK_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);
+    prog[n++] = XSK_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    for (int i = 0; i < nj; i++) {
+        prog[to_pass[i]].off = (int16_t)(pass - to_pass[i] - 1);
+    }
+
+    static char verifier_log[8192];
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt = (uint32_t)n;
+    attr.license = (uint64_t)(uintptr_t)"Dual BSD/GPL";
+    attr.log_buf = (uint64_t)(uintptr_t)verifier_log;
+    attr.log_size = sizeof(verifier_log);
+    attr.log_level = 1;
+
+    int fd = (int)xsk_bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0) {
+        int saved = errno;
+        fprintf(stderr, "XDP program rejected: %s\n%s\n", strerror(saved), verifier_log);
+        errno = saved;
+    }
+    return fd;
+}
+
+/**
+ * @brief Load the UDP port filter program: matching packets go to the
+ *        queue's socket, or to the stack if none is bound
+ *
+ * @param map_fd XSKMAP to redirect into
+ * @param udp_port Destination port to capture (host order)
+ * @return Program fd, or -1 on failure
+ */
+static inline int xsk_load_port_filter(int map_fd, uint16_t udp_port) {
+    return xsk_load_filter(map_fd, udp_port, XDP_PASS);
+}
+
+/**
+ * @brief Attach (prog_fd >= 0) or detach (prog_fd == -1) an XDP program
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+static inline int xsk_set_link_xdp(int ifindex, int prog_fd, uint32_t flags) {
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+        char attrs[64];
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_type = RTM_SETLINK;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    req.ifi.ifi_index = ifindex;
+
+    // IFLA_XDP { IFLA_XDP_FD, IFLA_XDP_FLAGS }
+    struct rtattr *xdp = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+    xdp->rta_type = IFLA_XDP | NLA_F_NESTED;
+    xdp->rta_len = RTA_LENGTH(0);
+
+    struct rtattr *attr = (struct rtattr *)((char *)xdp + xdp->rta_len);
+    attr->rta_type = IFLA_XDP_FD;
+    attr->rta_len = RTA_LENGTH(sizeof(int32_t));
+    memcpy(RTA_DATA(attr), &prog_fd, sizeof(int32_t));
+    xdp->rta_len += RTA_ALIGN(attr->rta_len);
+
+    attr = (struct rtattr *)((char *)xdp + xdp->rta_len);
+    attr->rta_type = IFLA_XDP_FLAGS;
+    attr->rta_len = RTA_LENGTH(sizeof(uint32_t));
+    memcpy(RTA_DATA(attr), &flags, sizeof(uint32_t));
+    xdp->rta_len += RTA_ALIGN(attr->rta_len);
+
+    req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + RTA_ALIGN(xdp->rta_len);
+
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (sendto(sock, &req, req.nh.nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    char buf[4096];
+    ssize_t len = recv(sock, buf, sizeof(buf), 0);
+    close(sock);
+    if (len < 0) {
+        return -1;
+    }
+
+    struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+    if (NLMSG_OK(nh, (unsigned)len) && nh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *err = NLMSG_DATA(nh);
+        if (err->error != 0) {
+            errno = -err->error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// mmap() one of the socket's rings
+static inline int xsk_map_ring(int fd, xsk_ring_t *ring, const struct xdp_ring_offset *off,
+                               size_t desc_size, uint32_t entries, off_t pgoff) {
+    ring->map_len = off->desc + entries * desc_size;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (uint32_t *)((char *)ring->map + off->producer);
+    ring->consumer = (uint32_t *)((char *)ring->map + off->consumer);
+    ring->flags = (uint32_t *)((char *)ring->map + off->flags);
+    ring->descs = (char *)ring->map + off->desc;
+    ring->mask = entries - 1;
+    return 0;
+}
+
+/**
+ * @brief Release the socket, rings, UMEM and detach the program
+ */
+static inline void xsk_socket_close(xsk_socket_t *xsk) {
+    if (xsk->prog_fd >= 0 && xsk->ifindex > 0) {
+        xsk_set_link_xdp(xsk->ifindex, -1, xsk->xdp_flags);
+    }
+    xsk_ring_t *rings[] = { &xsk->rx, &xsk->fill, &xsk->comp };
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        if (rings[i]->map) {
+            munmap(rings[i]->map, rings[i]->map_len);
+        }
+    }
+    if (xsk->fd >= 0) {
+        close(xsk->fd);
+    }
+    if (xsk->prog_fd >= 0) {
+        close(xsk->prog_fd);
+    }
+    if (xsk->map_fd >= 0) {
+        close(xsk->map_fd);
+    }
+    mem_arena_destroy(&xsk->umem);
+    xsk->fd = xsk->prog_fd = xsk->map_fd = -1;
+}
+
+/**
+ * @brief Open an AF_XDP socket that receives one UDP port on one queue
+ *
+ * @param xsk Socket to initialize
+ * @param ifname Interface name
+ * @param queue_id RX queue to bind
+ * @param udp_port Destination port redirected to the socket
+ * @param force_skb Use generic/SKB mode even if the driver supports XDP
+ * @param busy_poll Enable SO_PREFER_BUSY_POLL / SO_BUSY_POLL
+ * @return 0 on success, -1 on failure
+ */
+static inline int xsk_socket_open(xsk_socket_t *xsk, const char *ifname, uint32_t queue_id,
+                                  uint16_t udp_port, int force_skb, int busy_poll) {
+    memset(xsk, 0, sizeof(*xsk));
+    xsk->fd = xsk->prog_fd = xsk->map_fd = -1;
+    xsk->queue_id = queue_id;
+    xsk->busy_poll = busy_poll;
+
+    xsk->ifindex = (int)if_nametoindex(ifname);
+    if (xsk->ifindex == 0) {
+        perror("if_nametoindex");
+        return -1;
+    }
+
+    xsk->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (xsk->fd < 0) {
+        perror("socket(AF_XDP)");
+        return -1;
+    }
+
+    // UMEM: frame memory registered with the kernel
+    if (mem_arena_init(&xsk->umem, (size_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE, MEM_NODE_LOCAL) < 0) {
+        goto fail;
+    }
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uint64_t)(uintptr_t)xsk->umem.base;
+    reg.len = (uint64_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE;
+    reg.chunk_size = XSK_FRAME_SIZE;
+    reg.headroom = 0;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+        perror("setsockopt(XDP_UMEM_REG)");
+        goto fail;
+    }
+
+    int ring_size = XSK_RING_SIZE;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0) {
+        perror("setsockopt(XDP rings)");
+        goto fail;
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        perror("getsockopt(XDP_MMAP_OFFSETS)");
+        goto fail;
+    }
+    if (xsk_map_ring(xsk->fd, &xsk->fill, &off.fr, sizeof(uint64_t), XSK_RING_SIZE,
+                     XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        xsk_map_ring(xsk->fd, &xsk->comp, &off.cr, sizeof(uint64_t), XSK_RING_SIZE,
+                     XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        xsk_map_ring(xsk->fd, &xsk->rx, &off.rx, sizeof(struct xdp_desc), XSK_RING_SIZE,
+                     XDP_PGOFF_RX_RING) < 0) {
+        perror("mmap(XDP rings)");
+        goto fail;
+    }
+
+    // Hand every frame to the kernel up front
+    uint64_t *fill_addrs = xsk->fill.descs;
+    for (uint32_t i = 0; i < XSK_NUM_FRAMES; i++) {
+        fill_addrs[i & xsk->fill.mask] = (uint64_t)i * XSK_FRAME_SIZE;
+    }
+    xsk->fill.cached_prod = XSK_NUM_FRAMES;
+    __atomic_store_n(xsk->fill.producer, xsk->fill.cached_prod, __ATOMIC_RELEASE);
+
+    // Program and map must exist before packets can be redirected
+    xsk->map_fd = xsk_create_map();
+    if (xsk->map_fd < 0) {
+        perror("bpf(BPF_MAP_CREATE)");
+        goto fail;
+    }
+    xsk->prog_fd = xsk_load_port_filter(xsk->map_fd, udp_port);
+    if (xsk->prog_fd < 0) {
+        goto fail;
+    }
+
+    // Native mode first (zero-copy capable), generic mode as fallback
+    int attached = 0;
+    if (!force_skb) {
+        xsk->xdp_flags = XDP_FLAGS_DRV_MODE | XDP_FLAGS_UPDATE_IF_NOEXIST;
+        attached = xsk_set_link_xdp(xsk->ifindex, xsk->prog_fd, xsk->xdp_flags) == 0;
+    }
+    if (!attached) {
+        xsk->xdp_flags = XDP_FLAGS_SKB_MODE | XDP_FLAGS_UPDATE_IF_NOEXIST;
+        if (xsk_set_link_xdp(xsk->ifindex, xsk->prog_fd, xsk->xdp_flags) < 0) {
+            perror("attach XDP program");
+            xsk->ifindex = 0;  // Nothing to detach
+            goto fail;
+        }
+    }
+
+    // Bind: zero-copy where the driver supports it, copy mode otherwise
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = (uint32_t)xsk->ifindex;
+    sxdp.sxdp_queue_id = queue_id;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+    if (!(xsk->xdp_flags & XDP_FLAGS_SKB_MODE) &&
+        bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == 0) {
+        xsk->zero_copy = 1;
+    } else {
+        sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        if (bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+            perror("bind(AF_XDP)");
+            goto fail;
+        }
+    }
+
+    uint32_t key = queue_id;
+    int value = xsk->fd;
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)xsk->map_fd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.value = (uint64_t)(uintptr_t)&value;
+    if (xsk_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        perror("bpf(BPF_MAP_UPDATE_ELEM)");
+        goto fail;
+    }
+
+    if (busy_poll) {
+        int one = 1, usecs = XSK_BUSY_POLL_USECS, budget = XSK_RX_BATCH;
+        // Best effort: older kernels lack the prefer/budget options
+        setsockopt(xsk->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+        setsockopt(xsk->fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+        setsockopt(xsk->fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget));
+    }
+
+    return 0;
+
+fail:
+    xsk_socket_close(xsk);
+    return -1;
+}
+
+/**
+ * @brief Consume up to XSK_RX_BATCH frames
+ *
+ * Each frame is passed to the handler and immediately returned to the
+ * fill ring. When the RX ring is empty, the kernel is kicked if it asked
+ * for a wakeup (or always in busy-poll mode, which runs NAPI inline).
+ *
+ * @param xsk Socket
+ * @param fn Handler called for each frame
+ * @param ctx Handler context
+ * @return Number of frames processed
+ */
+static inline int xsk_rx_burst(xsk_socket_t *xsk, xsk_packet_fn fn, void *ctx) {
+    xsk_ring_t *rx = &xsk->rx;
+    xsk_ring_t *fill = &xsk->fill;
+
+    uint32_t avail = __atomic_load_n(rx->producer, __ATOMIC_ACQUIRE) - rx->cached_cons;
+    if (avail == 0) {
+        if (xsk->busy_poll || (__atomic_load_n(fill->flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+            recvfrom(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+            xsk->wakeups++;
+        }
+        return 0;
+    }
+    if (avail > XSK_RX_BATCH) {
+        avail = XSK_RX_BATCH;
+    }
+
+    const struct xdp_desc *descs = rx->descs;
+    uint64_t *fill_addrs = fill->descs;
+    const uint8_t *umem = xsk->umem.base;
+
+    for (uint32_t i = 0; i < avail; i++) {
+        const struct xdp_desc *desc = &descs[(rx->cached_cons + i) & rx->mask];
+        fn(ctx, umem + desc->addr, desc->len);
+        // Every frame is either in the fill ring, the RX ring or here, so
+        // the fill ring always has room for it
+        fill_addrs[(fill->cached_prod + i) & fill->mask] =
+            desc->addr & ~((uint64_t)XSK_FRAME_SIZE - 1);
+    }
+
+    rx->cached_cons += avail;
+    fill->cached_prod += avail;
+    __atomic_store_n(rx->consumer, rx->cached_cons, __ATOMIC_RELEASE);
+    __atomic_store_n(fill->producer, fill->cached_prod, __ATOMIC_RELEASE);
+    xsk->rx_packets += avail;
+    return (int)avail;
+}
+
+/**
+ * @brief Locate the UDP payload for a destination port in an Ethernet frame
+ *
+ * Accepts IPv4 with options, unlike the XDP filter; rejects fragments. The
+ * UDP length must fit in the frame; trailing Ethernet padding is ignored.
+ * The IP header is only 2-byte aligned in the frame, so headers are copied
+ * out before their fields are read.
+ *
+ * @param payload_len Set to the payload length
+ * @return Payload, or NULL if the frame is not UDP to port
+ */
+static inline const char *xsk_udp_payload(const uint8_t *frame, size_t len, uint16_t port, size_t *payload_len) {
+    if (len < sizeof(struct ethhdr) + sizeof(struct iphdr) + sizeof(struct udphdr)) {
+        return NULL;
+    }
+    const struct ethhdr *eth = (const struct ethhdr *)frame;
+    if (eth->h_proto != htons(ETH_P_IP)) {
+        return NULL;
+    }
+
+    struct iphdr ip;
+    memcpy(&ip, frame + sizeof(struct ethhdr), sizeof(ip));
+    size_t ip_len = ip.ihl * 4;
+    if (ip.protocol != IPPROTO_UDP || ip_len < sizeof(struct iphdr) || (ip.frag_off & htons(IP_MF | IP_OFFMASK)) ||
+        len < sizeof(struct ethhdr) + ip_len + sizeof(struct udphdr)) {
+        return NULL;
+    }
+
+    const uint8_t *udp_start = frame + sizeof(struct ethhdr) + ip_len;
+    struct udphdr udp;
+    memcpy(&udp, udp_start, sizeof(udp));
+    size_t udp_len = ntohs(udp.len);
+    size_t available = len - sizeof(struct ethhdr) - ip_len;
+    if (udp.dest != htons(port) || udp_len < sizeof(struct udphdr) || udp_len > available) {
+        return NULL;
+    }
+
+    *payload_len = udp_len - sizeof(struct udphdr);
+    return (const char *)udp_start + sizeof(struct udphdr);
+}
+
+/**
+ * @brief Describe the active mode, e.g. "native, zero-copy"
+ */
+static inline const char *xsk_mode_name(const xsk_socket_t *xsk) {
+    if (xsk->xdp_flags & XDP_FLAGS_SKB_MODE) {
+        return "generic/SKB, copy";
+    }
+    return xsk->zero_copy ? "native, zero-copy" : "native, copy";
+}
+
+/**
+ * @brief Kernel-side drop counters
+ *
+ * @return 0 on success, -1 on failure
+ */
+static inline int xsk_get_stats(const xsk_socket_t *xsk, struct xdp_statistics *stats) {
+    socklen_t len = sizeof(*stats);
+    memset(stats, 0, sizeof(*stats));
+    return getsockopt(xsk->fd, SOL_XDP, XDP_STATISTICS, stats, &len);
+}
+
+#endif /* XDP_SOCKET_H */
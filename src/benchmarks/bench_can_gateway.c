@@ -0,0 +1,187 @@
+/**
+ * @file bench_can_gateway.c
+ * @brief Frames per second and forwarding latency of the CAN gateway
+ *
+ * A producer thread writes frames onto bus 0, the gateway routes them to
+ * bus 1 (half by a rewrite rule, half by the default route) and a consumer
+ * thread reads them there. Reports:
+ *  - burst throughput: frames forwarded per second with the producer
+ *    writing as fast as it can
+ *  - latency at a paced rate: kernel receive timestamp on bus 0 to the
+ *    completed sendmmsg() on bus 1, from the gateway's histogram
+ *
+ * Usage: bench_can_gateway [vcan0 vcan1]
+ * With two interface names the buses are SocketCAN interfaces (set up with
+ * `ip link add dev vcan0 type vcan && ip link set vcan0 up`). Without them,
+ * AF_UNIX SOCK_SEQPACKET pairs carrying struct can_frame stand in for the
+ * buses, which measures the gateway on machines without SocketCAN.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/time.h>
+#include "can_gateway.h"
+
+#define BURST_FRAMES 1000000
+#define PACED_FRAMES 20000
+#define PACED_GAP_NS 20000          // 50k frames/s, a busy 1 Mbit/s bus is ~8k
+
+static can_gateway_t gateway;
+static int producer_fd, consumer_fd;
+static atomic_int gateway_running;
+static atomic_int consumer_running;
+static atomic_ulong consumed;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *gateway_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&gateway_running)) {
+        cgw_poll(&gateway, 10);
+    }
+    return NULL;
+}
+
+static void *consumer_thread(void *arg) {
+    (void)arg;
+    struct can_frame f;
+    while (atomic_load(&consumer_running)) {
+        if (read(consumer_fd, &f, sizeof(f)) == (ssize_t)sizeof(f)) {
+            atomic_fetch_add(&consumed, 1);
+        }
+    }
+    return NULL;
+}
+
+// Write one frame, waiting while the bus is busy
+static void produce(uint32_t n) {
+    struct can_frame f;
+    memset(&f, 0, sizeof(f));
+    f.can_id = n & 1 ? 0x100 : 0x200;
+    f.can_dlc = 8;
+    memcpy(f.data, &n, sizeof(n));
+    while (write(producer_fd, &f, sizeof(f)) < 0) {
+        if (errno != EAGAIN && errno != ENOBUFS && errno != EINTR) {
+            perror("write");
+            exit(1);
+        }
+        sched_yield();
+    }
+}
+
+// Wait until the consumer has everything that was not dropped
+static void drain(uint64_t expected) {
+    uint64_t last = 0, idle_since = now_ns();
+    for (;;) {
+        uint64_t got = atomic_load(&consumed) + gateway.buses[1].dropped;
+        if (got >= expected) {
+            return;
+        }
+        if (got != last) {
+            last = got;
+            idle_since = now_ns();
+        } else if (now_ns() - idle_since > 1000000000ULL) {
+            printf("  (%lu frames unaccounted for)\n", (unsigned long)(expected - got));
+            return;
+        }
+        sched_yield();
+    }
+}
+
+// Blocking reads that give up after 100 ms, so the consumer can stop
+static void set_read_timeout(int fd) {
+    struct timeval tv = { 0, 100000 };
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+int main(int argc, char *argv[]) {
+    if (cgw_init(&gateway) < 0) {
+        perror("cgw_init");
+        return 1;
+    }
+    if (argc >= 3) {
+        int a = cgw_open_can(argv[1]), b = cgw_open_can(argv[2]);
+        producer_fd = cgw_open_can(argv[1]);
+        consumer_fd = cgw_open_can(argv[2]);
+        if (a < 0 || b < 0 || producer_fd < 0 || consumer_fd < 0) {
+            perror("cgw_open_can");
+            return 1;
+        }
+        cgw_add_bus(&gateway, a, argv[1]);
+        cgw_add_bus(&gateway, b, argv[2]);
+        printf("=== CAN gateway benchmark (%s -> %s) ===\n", argv[1], argv[2]);
+    } else {
+        int in[2], out[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, in) < 0 || socketpair(AF_UNIX, SOCK_SEQPACKET, 0, out) < 0) {
+            perror("socketpair");
+            return 1;
+        }
+        cgw_add_bus(&gateway, in[0], "in");
+        cgw_add_bus(&gateway, out[0], "out");
+        producer_fd = in[1];
+        consumer_fd = out[1];
+        printf("=== CAN gateway benchmark (AF_UNIX stand-in buses) ===\n");
+    }
+    cgw_parse_rule(&gateway, "0:0x100>1:0x101,and=ffffffffffffff00,or=00000000000000aa");
+    cgw_parse_rule(&gateway, "0:*>1");
+
+    set_read_timeout(consumer_fd);
+    atomic_store(&gateway_running, 1);
+    atomic_store(&consumer_running, 1);
+    pthread_t gw, consumer;
+    pthread_create(&gw, NULL, gateway_thread, NULL);
+    pthread_create(&consumer, NULL, consumer_thread, NULL);
+
+    // Burst
+    uint64_t start = now_ns();
+    for (uint32_t n = 0; n < BURST_FRAMES; n++) {
+        produce(n);
+    }
+    drain(BURST_FRAMES);
+    double seconds = (double)(now_ns() - start) / 1e9;
+    cgw_bus_t *out = &gateway.buses[1];
+    printf("burst: %.0f frames/s forwarded, %.1f frames per sendmmsg, %lu dropped\n",
+           (double)out->tx_frames / seconds, (double)out->tx_frames / (double)out->tx_batches,
+           (unsigned long)out->dropped);
+    latency_histogram_print(&gateway.latency, "burst latency");
+
+    // Paced
+    latency_histogram_init(&gateway.latency);
+    uint64_t before = atomic_load(&consumed) + out->dropped;
+    // Sleep between frames rather than spin, so a single CPU is left to the gateway
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t n = 0; n < PACED_FRAMES; n++) {
+        next.tv_nsec += PACED_GAP_NS;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        produce(n);
+    }
+    drain(before + PACED_FRAMES);
+    latency_histogram_print(&gateway.latency, "paced latency");
+
+    atomic_store(&gateway_running, 0);
+    atomic_store(&consumer_running, 0);
+    pthread_join(gw, NULL);
+    pthread_join(consumer, NULL);
+    close(producer_fd);
+    close(consumer_fd);
+    cgw_close(&gateway);
+    return 0;
+}
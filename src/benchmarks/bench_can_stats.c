@@ -0,0 +1,169 @@
+/**
+ * @file bench_can_stats.c
+ * @brief Cost of per-ID statistics on the CAN receive path
+ *
+ * Measures, per frame:
+ *  - cst_frame_bits(), the exact stuffed length, bit by bit, against
+ *    cst_frame_bits_fast(), which cst_record() uses;
+ *  - cst_record(), the full table update including the seqlock;
+ *  - draining a socket with and without statistics, to show what the
+ *    table adds to the receive loop.
+ * The frame mix spreads over 64 IDs with a rolling counter in byte 7, like
+ * the dashboard status message.
+ *
+ * Usage: bench_can_stats
+ * The socket is an AF_UNIX SOCK_SEQPACKET pair carrying struct can_frame,
+ * so no SocketCAN interface is needed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "can_stats.h"
+
+#define FRAMES 2000000
+#define IDS 64
+#define SOCKET_FRAMES 200000
+#define SOCKET_BATCH 128            // Frames written before each drain, below the socket buffer
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static struct can_frame frames[IDS];
+
+static void next_frame(int n, struct can_frame *f) {
+    *f = frames[n % IDS];
+    f->data[0] = (uint8_t)(n * 31);
+    f->data[7] = (uint8_t)(n / IDS);
+}
+
+// Plain drain: recvmmsg() into a batch and touch each frame, as a reader without statistics would
+static int drain_plain(int fd, struct can_frame *rx, struct mmsghdr *msgs, uint64_t *sum) {
+    int total = 0;
+    for (;;) {
+        int n = recvmmsg(fd, msgs, CST_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            return total;
+        }
+        for (int i = 0; i < n; i++) {
+            *sum += rx[i].can_id + rx[i].data[7];
+        }
+        total += n;
+    }
+}
+
+static double socket_ns_per_frame(int with_stats, can_stats_t *s) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    struct can_frame rx[CST_BATCH];
+    struct iovec iov[CST_BATCH];
+    struct mmsghdr msgs[CST_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < CST_BATCH; i++) {
+        iov[i].iov_base = &rx[i];
+        iov[i].iov_len = sizeof(rx[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t sum = 0, drain_ns = 0;
+    struct can_frame f;
+    for (int n = 0; n < SOCKET_FRAMES; n += SOCKET_BATCH) {
+        for (int i = 0; i < SOCKET_BATCH; i++) {
+            next_frame(n + i, &f);
+            if (write(sv[1], &f, sizeof(f)) != (ssize_t)sizeof(f)) {
+                perror("write");
+                exit(1);
+            }
+        }
+        uint64_t start = now_ns();
+        int got = with_stats ? cst_drain(s, sv[0]) : drain_plain(sv[0], rx, msgs, &sum);
+        drain_ns += now_ns() - start;
+        if (got != SOCKET_BATCH) {
+            fprintf(stderr, "drained %d of %d frames\n", got, SOCKET_BATCH);
+            exit(1);
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    if (sum == 1) {
+        printf(" ");                // Keep the plain loop's reads alive
+    }
+    return (double)drain_ns / SOCKET_FRAMES;
+}
+
+int main() {
+    printf("=== CAN statistics benchmark ===\n");
+
+    for (int i = 0; i < IDS; i++) {
+        memset(&frames[i], 0, sizeof(frames[i]));
+        frames[i].can_id = 0x100 + (canid_t)i * 17;
+        frames[i].can_dlc = 8;
+        memset(frames[i].data, 0x5A + i, 8);
+    }
+
+    can_stats_t s;
+    if (cst_create(&s, NULL, 500000) < 0) {
+        perror("cst_create");
+        return 1;
+    }
+    for (int i = 0; i < IDS; i++) {
+        cst_set_counter(&s, frames[i].can_id, 7, 0xFF);
+    }
+
+    // Frame length alone
+    struct can_frame f;
+    uint64_t bits = 0, start = now_ns();
+    for (int n = 0; n < FRAMES; n++) {
+        next_frame(n, &f);
+        bits += cst_frame_bits(&f);
+    }
+    double bits_ns = (double)(now_ns() - start) / FRAMES;
+    printf("cst_frame_bits:        %6.1f ns/frame (mean %.1f bits)\n", bits_ns, (double)bits / FRAMES);
+    uint64_t fast_bits = 0;
+    start = now_ns();
+    for (int n = 0; n < FRAMES; n++) {
+        next_frame(n, &f);
+        fast_bits += cst_frame_bits_fast(&s.tables, &f);
+    }
+    bits_ns = (double)(now_ns() - start) / FRAMES;
+    printf("cst_frame_bits_fast:   %6.1f ns/frame%s\n", bits_ns, fast_bits == bits ? "" : " (MISMATCH)");
+
+    // Full update, frames 250 us apart: a 4000 frames/s bus
+    uint64_t stamp = cgw_realtime_ns();
+    start = now_ns();
+    for (int n = 0; n < FRAMES; n++) {
+        next_frame(n, &f);
+        cst_record(&s, &f, stamp + (uint64_t)n * 250000);
+    }
+    double record_ns = (double)(now_ns() - start) / FRAMES;
+    printf("cst_record:            %6.1f ns/frame\n", record_ns);
+
+    cst_entry_t e;
+    cst_read(&s, frames[0].can_id, &e);
+    if (e.frames != FRAMES / IDS || e.counter_missed != 0) {
+        fprintf(stderr, "unexpected entry: %lu frames, %lu missed\n", (unsigned long)e.frames,
+                (unsigned long)e.counter_missed);
+        return 1;
+    }
+
+    // Receive loop with and without the table
+    double plain_ns = socket_ns_per_frame(0, &s);
+    double stats_ns = socket_ns_per_frame(1, &s);
+    printf("drain without stats:   %6.1f ns/frame\n", plain_ns);
+    printf("drain with stats:      %6.1f ns/frame (+%.1f%%)\n", stats_ns,
+           plain_ns > 0 ? (stats_ns - plain_ns) * 100.0 / plain_ns : 0.0);
+
+    cst_close(&s);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file bench_channel.c
+ * @brief Lock-free MPMC channel vs. mutex/condvar queue
+ *
+ * Measures, for both queue types:
+ *  - throughput with several producers and consumers (consumers block
+ *    when the queue is empty, producers retry when it is full)
+ *  - one-way hand-off latency from a ping-pong between two threads
+ *
+ * The channel consumers block through its eventfd exactly as a reactor
+ * would; the baseline is the classic mutex + condition variable queue.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "channel.h"
+
+#define NUM_PRODUCERS 2
+#define NUM_CONSUMERS 2
+#define THROUGHPUT_ITEMS 2000000
+#define PINGPONG_ROUNDS 100000
+#define QUEUE_SIZE 1024
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Baseline: bounded ring protected by a mutex with two condition variables
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    void *items[QUEUE_SIZE];
+    size_t head, count;
+    int closed;
+} locked_queue_t;
+
+static void lq_init(locked_queue_t *q) {
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void lq_destroy(locked_queue_t *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void lq_push(locked_queue_t *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == QUEUE_SIZE) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->items[(q->head + q->count) % QUEUE_SIZE] = item;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *lq_pop(locked_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    void *item = NULL;
+    if (q->count > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % QUEUE_SIZE;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void lq_close(locked_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static channel_t chan, chan_back;
+static locked_queue_t lq, lq_back;
+
+static void *chan_producer(void *arg) {
+    (void)arg;
+    for (uintptr_t i = 1; i <= THROUGHPUT_ITEMS / NUM_PRODUCERS; i++) {
+        while (channel_send(&chan, (void *)i) < 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *chan_consumer(void *arg) {
+    (void)arg;
+    while (channel_recv_wait(&chan, -1)) {
+    }
+    return NULL;
+}
+
+static void *lq_producer(void *arg) {
+    (void)arg;
+    for (uintptr_t i = 1; i <= THROUGHPUT_ITEMS / NUM_PRODUCERS; i++) {
+        lq_push(&lq, (void *)i);
+    }
+    return NULL;
+}
+
+static void *lq_consumer(void *arg) {
+    (void)arg;
+    while (lq_pop(&lq)) {
+    }
+    return NULL;
+}
+
+static double run_throughput(void *(*producer)(void *), void *(*consumer)(void *),
+                             void (*close_fn)(void)) {
+    pthread_t prod[NUM_PRODUCERS], cons[NUM_CONSUMERS];
+    uint64_t start = now_ns();
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        pthread_create(&cons[i], NULL, consumer, NULL);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_create(&prod[i], NULL, producer, NULL);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_join(prod[i], NULL);
+    }
+    close_fn();
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        pthread_join(cons[i], NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    return (double)THROUGHPUT_ITEMS / ((double)elapsed / 1e9) / 1e6;
+}
+
+static void chan_close(void) { channel_close(&chan); }
+static void lq_close_main(void) { lq_close(&lq); }
+
+static void *chan_echo(void *arg) {
+    (void)arg;
+    void *item;
+    while ((item = channel_recv_wait(&chan, -1)) != NULL) {
+        channel_send(&chan_back, item);
+    }
+    return NULL;
+}
+
+static void *lq_echo(void *arg) {
+    (void)arg;
+    void *item;
+    while ((item = lq_pop(&lq)) != NULL) {
+        lq_push(&lq_back, item);
+    }
+    return NULL;
+}
+
+static double pingpong_channel(void) {
+    pthread_t echo;
+    pthread_create(&echo, NULL, chan_echo, NULL);
+    uint64_t start = now_ns();
+    for (uintptr_t i = 1; i <= PINGPONG_ROUNDS; i++) {
+        channel_send(&chan, (void *)i);
+        channel_recv_wait(&chan_back, -1);
+    }
+    uint64_t elapsed = now_ns() - start;
+    channel_close(&chan);
+    pthread_join(echo, NULL);
+    return (double)elapsed / (double)(PINGPONG_ROUNDS * 2);
+}
+
+static double pingpong_locked(void) {
+    pthread_t echo;
+    pthread_create(&echo, NULL, lq_echo, NULL);
+    uint64_t start = now_ns();
+    for (uintptr_t i = 1; i <= PINGPONG_ROUNDS; i++) {
+        lq_push(&lq, (void *)i);
+        lq_pop(&lq_back);
+    }
+    uint64_t elapsed = now_ns() - start;
+    lq_close(&lq);
+    pthread_join(echo, NULL);
+    return (double)elapsed / (double)(PINGPONG_ROUNDS * 2);
+}
+
+int main() {
+    printf("=== Channel benchmark (%d producers, %d consumers) ===\n",
+           NUM_PRODUCERS, NUM_CONSUMERS);
+
+    channel_init(&chan, QUEUE_SIZE);
+    printf("channel throughput:          %6.2f M msgs/s\n",
+           run_throughput(chan_producer, chan_consumer, chan_close));
+    channel_destroy(&chan);
+
+    lq_init(&lq);
+    printf("mutex/condvar throughput:    %6.2f M msgs/s\n",
+           run_throughput(lq_producer, lq_consumer, lq_close_main));
+    lq_destroy(&lq);
+
+    channel_init(&chan, QUEUE_SIZE);
+    channel_init(&chan_back, QUEUE_SIZE);
+    printf("channel hand-off latency:    %6.0f ns\n", pingpong_channel());
+    channel_destroy(&chan);
+    channel_destroy(&chan_back);
+
+    lq_init(&lq);
+    lq_init(&lq_back);
+    printf("mutex/condvar hand-off:      %6.0f ns\n", pingpong_locked());
+    lq_destroy(&lq);
+    lq_destroy(&lq_back);
+
+    return 0;
+}
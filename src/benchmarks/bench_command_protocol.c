@@ -0,0 +1,230 @@
+/**
+ * @file bench_command_protocol.c
+ * @brief Command dispatch and bulk configuration push, lock-step vs pipelined
+ *
+ * Measures:
+ *  - lookup cost of the perfect-hash table against a strcmp() scan of the
+ *    same command list;
+ *  - a bulk push of `set` commands to a server thread. In lock-step mode
+ *    the client waits for each reply, and the server writes one reply per
+ *    command, as secure_command_server did. In pipelined mode the client
+ *    streams every command, and the server writes one batch per read.
+ *
+ * Usage: bench_command_protocol [commands]
+ * The connection is an AF_UNIX stream pair with no TLS. TLS adds a record
+ * and its MAC per write, so each reply saved counts for more there.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "command_protocol.h"
+
+#define DEFAULT_COMMANDS 20000
+#define LOOKUPS 10000000
+#define CHUNK 16384                 // Client writes, one TLS record each
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int handle_set(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    cmd_printf(out, "Setting parameter: %s", args ? args : "");
+    return CMD_CONTINUE;
+}
+
+static int handle_other(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "ok");
+    return CMD_CONTINUE;
+}
+
+static const cmd_def_t defs[] = {
+    {"status", "", handle_other},
+    {"reboot", "", handle_other},
+    {"shutdown", "", handle_other},
+    {"set", "", handle_set},
+    {"get", "", handle_other},
+    {"help", "", handle_other},
+    {"quit", "", handle_other},
+};
+#define NDEFS (sizeof(defs) / sizeof(defs[0]))
+
+static cmd_table_t table;
+
+// The old dispatch: scan the list with strcmp()
+static const cmd_def_t *scan_lookup(const char *name) {
+    for (size_t i = 0; i < NDEFS; i++) {
+        if (strcmp(name, defs[i].name) == 0) {
+            return &defs[i];
+        }
+    }
+    return NULL;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_batch(void *io, const char *data, size_t len) {
+    return write_all(*(int *)io, data, len);
+}
+
+typedef struct {
+    int fd;
+    int pipelined;
+    uint64_t writes;
+} server_t;
+
+// Server: lock-step writes each reply alone; pipelined batches every read
+static void *server_thread(void *arg) {
+    server_t *srv = arg;
+    static cmd_session_t s;
+    cmd_session_init(&s, &table, NULL, send_batch, &srv->fd);
+    char buf[CHUNK];
+    ssize_t n;
+    while ((n = read(srv->fd, buf, sizeof(buf))) > 0) {
+        cmd_session_feed(&s, buf, (size_t)n);
+        while (srv->pipelined && (n = recv(srv->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+            cmd_session_feed(&s, buf, (size_t)n);
+        }
+        cmd_session_flush(&s);
+    }
+    srv->writes = s.flushes;
+    return NULL;
+}
+
+typedef struct {
+    int fd;
+    const char *data;
+    size_t len;
+} writer_t;
+
+static void *writer_thread(void *arg) {
+    writer_t *w = arg;
+    for (size_t off = 0; off < w->len; off += CHUNK) {
+        size_t n = w->len - off < CHUNK ? w->len - off : CHUNK;
+        write_all(w->fd, w->data + off, n);
+    }
+    return NULL;
+}
+
+// Read until count prompts have arrived
+static void read_prompts(int fd, size_t count) {
+    char buf[CHUNK];
+    size_t seen = 0, state = 0;
+    const char *prompt = CMD_PROMPT;
+    while (seen < count) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            fprintf(stderr, "connection closed after %zu replies\n", seen);
+            exit(1);
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            state = buf[i] == prompt[state] ? state + 1 : buf[i] == prompt[0];
+            if (state == sizeof(CMD_PROMPT) - 1) {
+                seen++;
+                state = 0;
+            }
+        }
+    }
+}
+
+static double push(const char *commands, size_t len, size_t count, int pipelined, uint64_t *writes) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    server_t srv = { sv[1], pipelined, 0 };
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, &srv);
+
+    uint64_t start = now_ns();
+    if (pipelined) {
+        writer_t w = { sv[0], commands, len };
+        pthread_t writer;
+        pthread_create(&writer, NULL, writer_thread, &w);
+        read_prompts(sv[0], count);
+        pthread_join(writer, NULL);
+    } else {
+        const char *line = commands;
+        for (size_t i = 0; i < count; i++) {
+            const char *end = (const char *)memchr(line, '\n', (size_t)(commands + len - line)) + 1;
+            write_all(sv[0], line, (size_t)(end - line));
+            read_prompts(sv[0], 1);
+            line = end;
+        }
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    shutdown(sv[0], SHUT_WR);
+    pthread_join(server, NULL);
+    close(sv[0]);
+    close(sv[1]);
+    *writes = srv.writes;
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : DEFAULT_COMMANDS;
+    if (count == 0 || cmd_table_build(&table, defs, NDEFS) < 0) {
+        fprintf(stderr, "Usage: %s [commands]\n", argv[0]);
+        return 1;
+    }
+    printf("=== Command protocol benchmark ===\n");
+
+    // Dispatch alone, over a mix of commands and misses
+    const char *names[] = { "status", "set", "get", "help", "quit", "shutdown", "bogus", "sett" };
+    size_t nnames = sizeof(names) / sizeof(names[0]), lens[8];
+    for (size_t i = 0; i < nnames; i++) {
+        lens[i] = strlen(names[i]);
+    }
+    size_t found = 0;
+    uint64_t start = now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        found += scan_lookup(names[i % nnames]) != NULL;
+    }
+    double scan_ns = (double)(now_ns() - start) / LOOKUPS;
+    start = now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        found += cmd_lookup(&table, names[i % nnames], lens[i % nnames]) != NULL;
+    }
+    double hash_ns = (double)(now_ns() - start) / LOOKUPS;
+    printf("lookup: strcmp scan %.1f ns, perfect hash %.1f ns (%zu found)\n", scan_ns, hash_ns, found);
+
+    // Bulk configuration push
+    char *commands = malloc(count * 40);
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        len += (size_t)sprintf(commands + len, "set zone%zu.setpoint %zu.5\n", i % 64, i);
+    }
+    uint64_t lock_writes, pipe_writes;
+    double lock_s = push(commands, len, count, 0, &lock_writes);
+    double pipe_s = push(commands, len, count, 1, &pipe_writes);
+    printf("%zu set commands:\n", count);
+    printf("  lock-step: %8.3f s, %9.0f commands/s, %7lu reply writes\n", lock_s, (double)count / lock_s,
+           (unsigned long)lock_writes);
+    printf("  pipelined: %8.3f s, %9.0f commands/s, %7lu reply writes (%.0fx faster)\n", pipe_s,
+           (double)count / pipe_s, (unsigned long)pipe_writes, lock_s / pipe_s);
+
+    free(commands);
+    return 0;
+}
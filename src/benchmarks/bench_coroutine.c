@@ -0,0 +1,172 @@
+/**
+ * @file bench_coroutine.c
+ * @brief Context-switch cost of stackless coroutines vs. ucontext vs. threads
+ *
+ * Measures the cost of one suspend/resume round trip for:
+ *  - a stackless coroutine resumed directly (switch jump + return)
+ *  - stackless coroutines scheduled through the epoll-backed co_loop
+ *  - swapcontext() between two stackful contexts
+ *  - a pthread condition variable ping-pong (thread-per-connection model)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <pthread.h>
+#include "coroutine.h"
+
+#define DIRECT_ITERATIONS 50000000ULL
+#define LOOP_TASKS 1000
+#define LOOP_ROUNDS 2000
+#define UCTX_ITERATIONS 5000000ULL
+#define THREAD_ITERATIONS 200000ULL
+#define UCTX_STACK_SIZE (64 * 1024)
+
+typedef struct {
+    co_task_t co;
+    uint64_t count;
+} bench_task_t;
+
+// Coroutine that suspends forever, counting resumptions
+static int suspend_forever(co_task_t *co) {
+    bench_task_t *t = (bench_task_t *)co->arg;
+
+    CO_BEGIN(co);
+    while (1) {
+        t->count++;
+        CO_SUSPEND(co);
+    }
+    CO_END(co);
+}
+
+// Coroutine that yields a fixed number of times through the loop
+static int yield_rounds(co_task_t *co) {
+    bench_task_t *t = (bench_task_t *)co->arg;
+
+    CO_BEGIN(co);
+    while (t->count < LOOP_ROUNDS) {
+        t->count++;
+        CO_YIELD(co);
+    }
+    CO_END(co);
+}
+
+static void bench_direct(void) {
+    co_loop_t loop;
+    bench_task_t task;
+    memset(&task, 0, sizeof(task));
+    co_loop_init(&loop);
+    co_spawn(&loop, &task.co, suspend_forever, NULL, &task);
+
+    uint64_t start = co_now_ns();
+    for (uint64_t i = 0; i < DIRECT_ITERATIONS; i++) {
+        task.co.fn(&task.co);
+    }
+    uint64_t elapsed = co_now_ns() - start;
+
+    printf("stackless (direct resume):   %6.2f ns/switch\n",
+           (double)elapsed / (double)DIRECT_ITERATIONS);
+    co_loop_destroy(&loop);
+}
+
+static void bench_loop(void) {
+    co_loop_t loop;
+    bench_task_t *tasks = calloc(LOOP_TASKS, sizeof(bench_task_t));
+    co_loop_init(&loop);
+
+    for (int i = 0; i < LOOP_TASKS; i++) {
+        co_spawn(&loop, &tasks[i].co, yield_rounds, NULL, &tasks[i]);
+    }
+
+    uint64_t start = co_now_ns();
+    while (loop.active > 0) {
+        co_loop_run_once(&loop, 0);
+    }
+    uint64_t elapsed = co_now_ns() - start;
+
+    printf("stackless (co_loop yield):   %6.2f ns/switch (%d tasks)\n",
+           (double)elapsed / (double)loop.resumes, LOOP_TASKS);
+    co_loop_destroy(&loop);
+    free(tasks);
+}
+
+static ucontext_t main_ctx, peer_ctx;
+static volatile uint64_t uctx_count;
+
+static void uctx_peer(void) {
+    while (1) {
+        uctx_count++;
+        swapcontext(&peer_ctx, &main_ctx);
+    }
+}
+
+static void bench_ucontext(void) {
+    char *stack = malloc(UCTX_STACK_SIZE);
+    getcontext(&peer_ctx);
+    peer_ctx.uc_stack.ss_sp = stack;
+    peer_ctx.uc_stack.ss_size = UCTX_STACK_SIZE;
+    peer_ctx.uc_link = &main_ctx;
+    makecontext(&peer_ctx, uctx_peer, 0);
+
+    uint64_t start = co_now_ns();
+    for (uint64_t i = 0; i < UCTX_ITERATIONS; i++) {
+        swapcontext(&main_ctx, &peer_ctx);
+    }
+    uint64_t elapsed = co_now_ns() - start;
+
+    // Each iteration is two switches (there and back)
+    printf("swapcontext:                 %6.2f ns/switch\n",
+           (double)elapsed / (double)(UCTX_ITERATIONS * 2));
+    free(stack);
+}
+
+static pthread_mutex_t pp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pp_cond = PTHREAD_COND_INITIALIZER;
+static int pp_turn = 0;
+
+static void *thread_peer(void *arg) {
+    (void)arg;
+    for (uint64_t i = 0; i < THREAD_ITERATIONS; i++) {
+        pthread_mutex_lock(&pp_lock);
+        while (pp_turn != 1) {
+            pthread_cond_wait(&pp_cond, &pp_lock);
+        }
+        pp_turn = 0;
+        pthread_cond_signal(&pp_cond);
+        pthread_mutex_unlock(&pp_lock);
+    }
+    return NULL;
+}
+
+static void bench_threads(void) {
+    pthread_t peer;
+    pthread_create(&peer, NULL, thread_peer, NULL);
+
+    uint64_t start = co_now_ns();
+    for (uint64_t i = 0; i < THREAD_ITERATIONS; i++) {
+        pthread_mutex_lock(&pp_lock);
+        pp_turn = 1;
+        pthread_cond_signal(&pp_cond);
+        while (pp_turn != 0) {
+            pthread_cond_wait(&pp_cond, &pp_lock);
+        }
+        pthread_mutex_unlock(&pp_lock);
+    }
+    uint64_t elapsed = co_now_ns() - start;
+    pthread_join(peer, NULL);
+
+    printf("pthread condvar ping-pong:   %6.2f ns/switch\n",
+           (double)elapsed / (double)(THREAD_ITERATIONS * 2));
+}
+
+int main() {
+    printf("=== Coroutine context-switch benchmark ===\n");
+
+    bench_direct();
+    bench_loop();
+    bench_ucontext();
+    bench_threads();
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file bench_isotp.c
+ * @brief ECU flashing throughput over ISO-TP for a range of BS and STmin
+ *
+ * A tester thread downloads an image to an ECU thread the way a UDS
+ * flashing session does:
+ *  - RequestDownload (0x34);
+ *  - TransferData (0x36) blocks of up to 4093 bytes, each acknowledged
+ *    before the next is sent;
+ *  - RequestTransferExit (0x37).
+ * Each block travels as one ISO-TP message. The ECU offers each block
+ * size and STmin in turn, and the image rate is reported in KB/s.
+ *
+ * Usage: bench_isotp [vcan0]
+ * With an interface name both ends sit on that SocketCAN interface (set
+ * up with `ip link add dev vcan0 type vcan && ip link set vcan0 up`). They
+ * use the kernel's CAN_ISOTP sockets when the kernel has them and the
+ * userspace link otherwise. Without an interface an AF_UNIX SOCK_SEQPACKET
+ * pair carrying struct can_frame stands in for the bus, which measures
+ * the userspace link on machines without SocketCAN.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "isotp.h"
+
+#define TESTER_ID 0x7E0
+#define ECU_ID 0x7E8
+#define BLOCK_LENGTH 4095               // maxNumberOfBlockLength: SID + counter + data
+#define IMAGE_BYTES (256 * 1024)
+#define PACED_IMAGE_BYTES (32 * 1024)   // STmin of 1 ms and up would take minutes otherwise
+
+typedef struct {
+    uint8_t block_size;
+    uint8_t stmin;
+} config_t;
+
+static const config_t configs[] = {
+    { 0, 0 }, { 32, 0 }, { 8, 0 }, { 0, 0xF1 }, { 0, 0xF5 }, { 8, 1 }, { 0, 1 },
+};
+
+static isotp_socket_t tester, ecu;
+static uint8_t tester_buf[BLOCK_LENGTH], ecu_buf[BLOCK_LENGTH];
+static uint8_t image[IMAGE_BYTES];
+static size_t flashed;
+
+// The ECU side: positive response to each request, data counted
+static void *ecu_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        ssize_t len = isotp_socket_recv(&ecu, 5000);
+        if (len <= 0) {
+            fprintf(stderr, "ECU receive: %s\n", strerror(errno));
+            return NULL;
+        }
+        uint8_t response[4] = { (uint8_t)(ecu_buf[0] + 0x40), 0, 0, 0 };
+        size_t response_len = 1;
+        if (ecu_buf[0] == 0x34) {
+            // lengthFormatIdentifier 0x20: two bytes of maxNumberOfBlockLength
+            response[1] = 0x20;
+            response[2] = BLOCK_LENGTH >> 8;
+            response[3] = BLOCK_LENGTH & 0xFF;
+            response_len = 4;
+            flashed = 0;
+        } else if (ecu_buf[0] == 0x36) {
+            response[1] = ecu_buf[1];
+            response_len = 2;
+            flashed += (size_t)len - 2;
+        }
+        if (isotp_socket_send(&ecu, response, response_len) < 0) {
+            fprintf(stderr, "ECU send: %s\n", strerror(errno));
+            return NULL;
+        }
+        if (ecu_buf[0] == 0x37) {
+            return NULL;
+        }
+    }
+}
+
+// One request and its response; the response code is returned
+static int request(const uint8_t *req, size_t len) {
+    if (isotp_socket_send(&tester, req, len) < 0 || isotp_socket_recv(&tester, 5000) < 1) {
+        perror("tester");
+        exit(1);
+    }
+    return tester_buf[0];
+}
+
+static int open_pair(const char *interface, const config_t *c) {
+    if (interface) {
+        // The tester accepts anything; the ECU's BS and STmin pace the download
+        if (isotp_socket_open(&tester, interface, TESTER_ID, ECU_ID, 0, 0, tester_buf, sizeof(tester_buf)) < 0 ||
+            isotp_socket_open(&ecu, interface, ECU_ID, TESTER_ID, c->block_size, c->stmin, ecu_buf,
+                              sizeof(ecu_buf)) < 0) {
+            perror("isotp_socket_open");
+            return -1;
+        }
+        return 0;
+    }
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    isotp_socket_attach(&tester, sv[0], TESTER_ID, ECU_ID, 0, 0, tester_buf, sizeof(tester_buf));
+    isotp_socket_attach(&ecu, sv[1], ECU_ID, TESTER_ID, c->block_size, c->stmin, ecu_buf, sizeof(ecu_buf));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *interface = argc >= 2 ? argv[1] : NULL;
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t)(i * 7 + (i >> 9));
+    }
+
+    for (size_t n = 0; n < sizeof(configs) / sizeof(configs[0]); n++) {
+        const config_t *c = &configs[n];
+        if (open_pair(interface, c) < 0) {
+            return 1;
+        }
+        if (n == 0) {
+            printf("=== ISO-TP flashing benchmark (%s, %s) ===\n", interface ? interface : "AF_UNIX stand-in bus",
+                   tester.kernel ? "kernel CAN_ISOTP" : "userspace ISO-TP");
+        }
+        size_t image_bytes = isotp_stmin_us(c->stmin) >= 1000 ? PACED_IMAGE_BYTES : IMAGE_BYTES;
+        pthread_t tid;
+        pthread_create(&tid, NULL, ecu_thread, NULL);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // RequestDownload: no compression/encryption, 4-byte address and size
+        uint8_t download[11] = { 0x34, 0x00, 0x44, 0x00, 0x08, 0x00, 0x00 };
+        download[7] = (uint8_t)(image_bytes >> 24);
+        download[8] = (uint8_t)(image_bytes >> 16);
+        download[9] = (uint8_t)(image_bytes >> 8);
+        download[10] = (uint8_t)image_bytes;
+        if (request(download, sizeof(download)) != 0x74) {
+            fprintf(stderr, "RequestDownload refused\n");
+            return 1;
+        }
+        size_t block_data = (size_t)(tester_buf[2] << 8 | tester_buf[3]) - 2;
+        static uint8_t block[BLOCK_LENGTH];
+        uint8_t counter = 1;
+        for (size_t off = 0; off < image_bytes; off += block_data, counter++) {
+            size_t len = image_bytes - off < block_data ? image_bytes - off : block_data;
+            block[0] = 0x36;
+            block[1] = counter;
+            memcpy(block + 2, image + off, len);
+            if (request(block, len + 2) != 0x76 || tester_buf[1] != counter) {
+                fprintf(stderr, "TransferData block %u refused\n", counter);
+                return 1;
+            }
+        }
+        uint8_t exit_request[1] = { 0x37 };
+        request(exit_request, sizeof(exit_request));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pthread_join(tid, NULL);
+
+        double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        char stmin[16];
+        snprintf(stmin, sizeof(stmin), "%lu us", (unsigned long)isotp_stmin_us(c->stmin));
+        printf("BS %3u  STmin %8s: %8.1f KB/s, %9.0f frames/s (%zu KB image)%s\n", c->block_size, stmin,
+               (double)flashed / 1024 / seconds, (double)(image_bytes / 7) / seconds, image_bytes / 1024,
+               flashed == image_bytes ? "" : " INCOMPLETE");
+        isotp_socket_close(&tester);
+        isotp_socket_close(&ecu);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file bench_param_store.c
+ * @brief Parameter store reads, group commit and bulk load
+ *
+ * Measures:
+ *  - ps_get() throughput with 1, 2 and 4 reader threads while a writer
+ *    keeps changing values, against the same table behind one mutex;
+ *  - set-and-commit with fdatasync(), one thread against several: with
+ *    group commit the threads share syncs, so sets per sync rises with
+ *    the number of threads;
+ *  - ps_load() of a dump, committed once.
+ *
+ * Usage: bench_param_store [journal]
+ * The journal defaults to a file in the current directory, because /tmp
+ * is often tmpfs, where fdatasync() costs nothing. Reader scaling needs as
+ * many free cores as readers.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "param_store.h"
+
+#define KEYS 4096
+#define READ_SECONDS 0.5
+#define COMMIT_SETS 2000
+#define LOAD_KEYS 50000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static param_store_t store;
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static char keys[KEYS][24];
+static atomic_int running;
+
+typedef struct {
+    int id;
+    int locked;                     // Take global_lock around each get, the baseline
+    uint64_t ops;
+} reader_t;
+
+static void *reader_thread(void *arg) {
+    reader_t *r = arg;
+    char value[PS_MAX_VALUE];
+    uint64_t ops = 0;
+    unsigned k = (unsigned)r->id * 977;
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        for (int i = 0; i < 256; i++) {
+            k = (k + 7919) % KEYS;
+            if (r->locked) {
+                pthread_mutex_lock(&global_lock);
+            }
+            ps_get(&store, keys[k], value, sizeof(value));
+            if (r->locked) {
+                pthread_mutex_unlock(&global_lock);
+            }
+        }
+        ops += 256;
+    }
+    r->ops = ops;
+    return NULL;
+}
+
+// Keep one value changing so the readers meet writes
+static void *background_writer(void *arg) {
+    int locked = *(int *)arg;
+    char value[32];
+    uint64_t lsn, n = 0;
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        snprintf(value, sizeof(value), "%lu", (unsigned long)n++);
+        if (locked) {
+            pthread_mutex_lock(&global_lock);
+        }
+        ps_set(&store, keys[n % KEYS], value, &lsn);
+        if (locked) {
+            pthread_mutex_unlock(&global_lock);
+        }
+        usleep(100);
+    }
+    return NULL;
+}
+
+static double read_rate(int readers, int locked) {
+    pthread_t threads[4], writer;
+    reader_t r[4];
+    atomic_store(&running, 1);
+    pthread_create(&writer, NULL, background_writer, &locked);
+    for (int i = 0; i < readers; i++) {
+        r[i] = (reader_t){ i, locked, 0 };
+        pthread_create(&threads[i], NULL, reader_thread, &r[i]);
+    }
+    usleep((useconds_t)(READ_SECONDS * 1e6));
+    atomic_store(&running, 0);
+    uint64_t ops = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+        ops += r[i].ops;
+    }
+    pthread_join(writer, NULL);
+    return (double)ops / READ_SECONDS;
+}
+
+typedef struct {
+    param_store_t *ps;
+    int id;
+    int sets;
+} committer_t;
+
+static void *commit_thread(void *arg) {
+    committer_t *c = arg;
+    char key[16], value[16];
+    uint64_t lsn;
+    for (int i = 0; i < c->sets; i++) {
+        snprintf(key, sizeof(key), "c%d.%d", c->id, i % 64);
+        snprintf(value, sizeof(value), "%d", i);
+        if (ps_set(c->ps, key, value, &lsn) < 0 || ps_commit(c->ps, lsn) < 0) {
+            perror("set");
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+static void commit_rate(const char *path, int nthreads) {
+    param_store_t ps;
+    unlink(path);
+    if (ps_open(&ps, path, 1024, 1) < 0) {
+        perror("ps_open");
+        exit(1);
+    }
+    pthread_t threads[8];
+    committer_t c[8];
+    uint64_t start = now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        c[i] = (committer_t){ &ps, i, COMMIT_SETS / nthreads };
+        pthread_create(&threads[i], NULL, commit_thread, &c[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+    printf("  %d thread%s: %8.0f committed sets/s, %5.1f sets per sync\n", nthreads, nthreads > 1 ? "s" : " ",
+           (double)ps.journal.records / elapsed, (double)ps.journal.records / (double)ps.journal.flushes);
+    ps_close(&ps);
+    unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "bench_param_store.journal";
+    printf("=== Parameter store benchmark ===\n");
+
+    // Reads against a live writer
+    if (ps_open(&store, NULL, 2 * KEYS, 0) < 0) {
+        perror("ps_open");
+        return 1;
+    }
+    uint64_t lsn;
+    for (int k = 0; k < KEYS; k++) {
+        snprintf(keys[k], sizeof(keys[k]), "zone%d.setpoint", k);
+        ps_set(&store, keys[k], "21.5", &lsn);
+    }
+    printf("ps_get, one writer running (%ld CPUs):\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for (int readers = 1; readers <= 4; readers *= 2) {
+        double lock_free = read_rate(readers, 0);
+        double locked = read_rate(readers, 1);
+        printf("  %d reader%s: lock-free %6.1f M/s, one mutex %6.1f M/s\n", readers, readers > 1 ? "s" : " ",
+               lock_free / 1e6, locked / 1e6);
+    }
+    ps_close(&store);
+
+    // Durable sets: threads share each fdatasync()
+    printf("set + commit with fdatasync (%s):\n", path);
+    commit_rate(path, 1);
+    commit_rate(path, 4);
+    commit_rate(path, 8);
+
+    // Bulk load of a dump, one commit at the end
+    FILE *dump = tmpfile();
+    for (int k = 0; k < LOAD_KEYS; k++) {
+        fprintf(dump, "set zone%d.setpoint %d.5\n", k, k % 40);
+    }
+    rewind(dump);
+    unlink(path);
+    if (ps_open(&store, path, LOAD_KEYS, 1) < 0) {
+        perror("ps_open");
+        return 1;
+    }
+    uint64_t start = now_ns();
+    long loaded = ps_load(&store, dump);
+    double load_s = (double)(now_ns() - start) / 1e9;
+    printf("ps_load: %ld parameters in %.3f s (%.0f/s, %lu syncs)\n", loaded, load_s, (double)loaded / load_s,
+           (unsigned long)store.journal.flushes);
+    ps_close(&store);
+    fclose(dump);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file bench_risk.c
+ * @brief Cost of an inline pre-trade risk check
+ *
+ * Measures risk_check_order() plus the matching fill/release update, the
+ * round trip every order takes through risk_engine.h:
+ *  - with no limit changes
+ *  - while a control thread republishes limits in a tight loop
+ *  - the same checks behind a pthread mutex, for comparison
+ *
+ * Per-call latency is sampled over batches of BATCH calls so clock reads do
+ * not dominate. Exits non-zero if the median exceeds TARGET_NS. On a single
+ * CPU the wall-clock ns/order of the live-update runs includes the time the
+ * control thread was scheduled; the percentiles do not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "risk_engine.h"
+#include "latency_histogram.h"
+
+#define ITERATIONS 10000000ULL
+#define BATCH 64
+#define NUM_SYMBOLS 16
+#define TARGET_NS 100
+
+static risk_engine_t engine;
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int writer_running;
+static atomic_int use_lock;
+static uint64_t publishes;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Control thread: keep changing limits so the strategy sees live updates
+static void *control_thread(void *arg) {
+    (void)arg;
+    risk_limits_t lim = { 1000000, 1000000LL * 2000000, 10000, 500 };
+    while (atomic_load(&writer_running)) {
+        lim.max_order_qty = 10000 + (int64_t)(publishes & 1);
+        int idx = (int)(publishes % NUM_SYMBOLS);
+        if (atomic_load(&use_lock)) {
+            pthread_mutex_lock(&engine_lock);
+            risk_set_limits(&engine, idx, &lim);
+            pthread_mutex_unlock(&engine_lock);
+        } else {
+            risk_set_limits(&engine, idx, &lim);
+        }
+        publishes++;
+    }
+    return NULL;
+}
+
+// One order through risk: check, then fill half and release the rest
+static inline int order_cycle(uint64_t i, uint64_t now, int locked) {
+    int idx = (int)(i % NUM_SYMBOLS);
+    uint8_t side = (i & 16) ? SIDE_SELL : SIDE_BUY;
+    int64_t price = 1500000 + (int64_t)(i & 7);
+
+    if (locked) {
+        pthread_mutex_lock(&engine_lock);
+    }
+    risk_on_trade_price(&engine, idx, 1500000);
+    int ok = risk_check_order(&engine, idx, side, price, 100, now) == RISK_OK;
+    if (ok) {
+        risk_on_fill(&engine, idx, side, 50);
+        risk_on_order_done(&engine, idx, side, 50);
+    }
+    if (locked) {
+        pthread_mutex_unlock(&engine_lock);
+    }
+    return ok;
+}
+
+static void run(const char *label, int with_writer, int locked, latency_histogram_t *h) {
+    pthread_t writer;
+    atomic_store(&use_lock, locked);
+    if (with_writer) {
+        atomic_store(&writer_running, 1);
+        pthread_create(&writer, NULL, control_thread, NULL);
+    }
+
+    latency_histogram_init(h);
+    uint64_t accepted = 0;
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < ITERATIONS; i += BATCH) {
+        uint64_t t0 = now_ns();
+        for (uint64_t j = 0; j < BATCH; j++) {
+            accepted += order_cycle(i + j, t0, locked);
+        }
+        latency_histogram_record(h, (now_ns() - t0) / BATCH);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    if (with_writer) {
+        atomic_store(&writer_running, 0);
+        pthread_join(writer, NULL);
+    }
+
+    printf("%-28s %6.1f ns/order  p50 %3lu ns  p99 %4lu ns  (%lu accepted)\n", label,
+           (double)elapsed / (double)ITERATIONS,
+           (unsigned long)latency_histogram_percentile(h, 0.50),
+           (unsigned long)latency_histogram_percentile(h, 0.99),
+           (unsigned long)accepted);
+}
+
+int main() {
+    risk_limits_t defaults = { 1000000, 1000000LL * 2000000, 10000, 500 };
+    // 1e9 orders/s so the bucket is evaluated but never empties
+    if (risk_engine_init(&engine, &defaults, 1000000000, 1000000) < 0) {
+        fprintf(stderr, "Failed to initialize risk engine\n");
+        return 1;
+    }
+
+    printf("=== Pre-trade risk check benchmark (%llu orders, %d symbols) ===\n",
+           ITERATIONS, NUM_SYMBOLS);
+
+    latency_histogram_t quiet, live, locked;
+    run("lock-free, no updates", 0, 0, &quiet);
+    run("lock-free, live updates", 1, 0, &live);
+    printf("  (%lu limit publishes)\n", (unsigned long)publishes);
+    run("mutex, live updates", 1, 1, &locked);
+
+    uint64_t p50 = latency_histogram_percentile(&live, 0.50);
+    printf("\nTarget < %d ns per check with live updates: %s (p50 %lu ns)\n",
+           TARGET_NS, p50 < TARGET_NS ? "PASS" : "FAIL", (unsigned long)p50);
+
+    risk_engine_destroy(&engine);
+    return p50 < TARGET_NS ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file bench_timer_wheel.c
+ * @brief Sensor liveness with a timing wheel vs. a periodic full scan
+ *
+ * One million sensors with a 300 s deadline, each reporting about once a
+ * second. Measures:
+ *  - the periodic scan the sensor monitor used to run: compare every
+ *    sensor's last update with the current time
+ *  - re-arming a sensor's timer on a packet (timer_wheel.h)
+ *  - advancing the wheel by one 100 ms tick with nothing expiring, and with
+ *    1000 sensors going silent on that tick
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "timer_wheel.h"
+
+#define SENSORS 1000000
+#define DEADLINE_TICKS 3000         // 300 s at 100 ms per tick
+#define REARMS 20000000ULL
+#define SILENT 1000
+
+typedef struct {
+    uint64_t last_update;
+    tw_timer_t liveness;
+} sensor_t;
+
+static sensor_t *sensors;
+static timer_wheel_t wheel;
+static uint64_t expired;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void on_silent(void *ctx, tw_timer_t *timer) {
+    (void)ctx;
+    (void)timer;
+    expired++;
+}
+
+int main() {
+    sensors = calloc(SENSORS, sizeof(sensor_t));
+    if (!sensors) {
+        perror("calloc");
+        return 1;
+    }
+    printf("=== Sensor liveness benchmark (%d sensors) ===\n", SENSORS);
+
+    // Every sensor reported within the last 10 s (100 ticks)
+    uint64_t tick = 1000000;
+    tw_init(&wheel, tick);
+    srand(42);
+    for (int i = 0; i < SENSORS; i++) {
+        sensors[i].last_update = tick - (uint64_t)(rand() % 100);
+        tw_timer_init(&sensors[i].liveness);
+        tw_schedule(&wheel, &sensors[i].liveness, sensors[i].last_update + DEADLINE_TICKS);
+    }
+
+    // Full scan, as check_inactive_sensors() did
+    uint64_t start = now_ns();
+    uint64_t silent = 0;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < SENSORS; i++) {
+            silent += tick - sensors[i].last_update > DEADLINE_TICKS;
+        }
+    }
+    double scan_us = (double)(now_ns() - start) / 10 / 1000;
+    printf("full scan:                   %9.1f us per check (%lu silent)\n", scan_us, (unsigned long)silent);
+
+    // Packets re-arm random sensors
+    start = now_ns();
+    for (uint64_t n = 0; n < REARMS; n++) {
+        sensor_t *s = &sensors[(n * 2654435761ULL) % SENSORS];
+        s->last_update = tick;
+        tw_schedule(&wheel, &s->liveness, tick + DEADLINE_TICKS);
+    }
+    printf("re-arm on packet:            %9.1f ns\n", (double)(now_ns() - start) / REARMS);
+
+    // Ticks with nothing due
+    start = now_ns();
+    for (int t = 0; t < 100; t++) {
+        tw_advance(&wheel, ++tick, on_silent, NULL);
+    }
+    printf("advance, nothing expiring:   %9.1f us per tick (%lu expired)\n",
+           (double)(now_ns() - start) / 100 / 1000, (unsigned long)expired);
+
+    // SILENT sensors all due on the next tick
+    for (int i = 0; i < SILENT; i++) {
+        tw_schedule(&wheel, &sensors[i].liveness, tick + 1);
+    }
+    expired = 0;
+    start = now_ns();
+    tw_advance(&wheel, ++tick, on_silent, NULL);
+    printf("advance, %d expiring:      %9.1f us (%lu expired)\n", SILENT,
+           (double)(now_ns() - start) / 1000, (unsigned long)expired);
+
+    free(sensors);
+    return 0;
+}
@@ -6,9 +6,41 @@
  * automotive control modules using Controller Area Network (CAN) sockets.
  * 
  * Note: This example requires Linux with SocketCAN support.
- * Compile with: gcc -o can_automotive can_automotive.c
+ * Payload layouts are defined in schemas/can.msg; the build generates
+ * can_codec.h from it with msgc.
+ *
+ * Gateway mode bridges several buses through one epoll loop
+ * (can_gateway.h), with routes indexed by bus and CAN ID, optional ID and
+ * payload rewrites, and one sendmmsg() per destination bus per wakeup:
+ *
+ *     can_automotive --gateway can0 can1 can2 -r "0:0x100>1" -r "0:0x200>2:0x210"
+ *
+ * Without -r rules every bus is bridged to every other bus. Statistics and
+ * the forwarding latency are printed periodically and on exit.
+ *
+ * Bridge mode carries one bus to a remote collector over UDP (can_bridge.h).
+ * Timestamped frames are packed up to 72 per datagram, and a datagram is
+ * sent when it is full or flush_ms after its first frame. Datagrams from the
+ * collector, to the local port, are written back onto the bus:
+ *
+ *     can_automotive --bridge can0 192.168.1.10 9901 [local_port [flush_ms]]
+ *
+ * Diagnostic requests on 0x700 are ISO-TP messages (isotp.h), reassembled
+ * in the main loop and answered on 0x708. The loop handles TesterPresent and
+ * a download session (RequestDownload, TransferData, RequestTransferExit),
+ * so a tester can flash an image into it. Frames on 0x700 that are not
+ * ISO-TP, such as the emergency signal, are still printed raw.
+ *
+ * The main loop also keeps per-ID bus statistics (can_stats.h) from a
+ * second, unfiltered socket: frame counts, bus load, inter-arrival jitter
+ * and frames missed according to the dashboard status counter. The table is
+ * in shared memory, so another process can watch it without touching the
+ * receive loop:
+ *
+ *     can_automotive --stats [shm_name]
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +48,7 @@
 #include <signal.h>
 #include <time.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -24,6 +57,11 @@
 #include "socket_utils.h"
 #include "error_handling.h"
 #include "config.h"
+#include "can_codec.h"
+#include "can_gateway.h"
+#include "can_bridge.h"
+#include "isotp.h"
+#include "can_stats.h"
 
 // CAN interface name
 #define CAN_INTERFACE "can0"
@@ -34,54 +72,43 @@
 #define STEERING_CAN_ID   0x300  // Steering control module
 #define DASHBOARD_CAN_ID  0x400  // Dashboard module
 #define DIAGNOSTIC_CAN_ID 0x700  // Diagnostic messages
+#define DIAGNOSTIC_RESPONSE_ID 0x708  // Diagnostic responses
+
+#define DIAGNOSTIC_BLOCK_LENGTH 4095  // Largest TransferData request we accept
+
+#define GATEWAY_STATS_INTERVAL 10  // Seconds between gateway statistics
+
+#define BRIDGE_LOCAL_PORT 9901     // Port the collector sends frames back to
+#define BRIDGE_FLUSH_MS 10         // Longest a frame waits for its datagram to fill
+
+#define CAN_STATS_SHM "/can_stats"  // Shared memory name of the bus statistics
+#define CAN_BITRATE 500000         // Bus bit rate, for the load
+#define DASHBOARD_COUNTER_BYTE 7   // dashboard_status.counter in schemas/can.msg
+#define STATS_TOP_IDS 20           // IDs shown by --stats, busiest first
 
 // Flag for graceful shutdown
 static volatile int keep_running = 1;
 
+// ISO-TP link for diagnostic requests and the response being sent on it
+static isotp_link_t diag_link;
+static uint8_t diag_request[DIAGNOSTIC_BLOCK_LENGTH];
+static uint8_t diag_response[8];
+static size_t download_bytes;
+
 // Signal handler for graceful shutdown
 void handle_signal(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
     keep_running = 0;
 }
 
-// Structure for engine data
-typedef struct {
-    uint16_t rpm;              // Engine RPM
-    uint8_t temperature;       // Engine temperature in Celsius
-    uint8_t throttle_position; // Throttle position (0-100%)
-    uint16_t fuel_level;       // Fuel level in milliliters
-    uint8_t engine_status;     // Engine status flags
-} engine_data_t;
-
-// Structure for brake data
-typedef struct {
-    uint8_t brake_position;    // Brake pedal position (0-100%)
-    uint8_t brake_pressure;    // Brake system pressure (0-255)
-    uint8_t abs_active;        // ABS status (0=inactive, 1=active)
-    uint8_t brake_status;      // Brake status flags
-} brake_data_t;
-
-// Structure for steering data
-typedef struct {
-    int16_t steering_angle;    // Steering angle in 1/10 degrees (-1800 to +1800)
-    uint8_t steering_speed;    // Steering movement speed
-    uint8_t steering_status;   // Steering system status flags
-} steering_data_t;
-
 // Function to extract engine data from CAN frame
 void process_engine_data(const struct can_frame *frame) {
-    if (frame->can_dlc < 6) {
+    engine_data_t data;
+    if (engine_data_decode(&data, frame->data, frame->can_dlc) < 0) {
         printf("Error: Engine data frame too short\n");
         return;
     }
     
-    engine_data_t data;
-    data.rpm = (frame->data[0] << 8) | frame->data[1];
-    data.temperature = frame->data[2];
-    data.throttle_position = frame->data[3];
-    data.fuel_level = (frame->data[4] << 8) | frame->data[5];
-    data.engine_status = (frame->can_dlc >= 7) ? frame->data[6] : 0;
-    
     printf("Engine: RPM=%u, Temp=%d°C, Throttle=%u%%, Fuel=%u ml, Status=0x%02X\n",
         data.rpm, data.temperature, data.throttle_position, 
         data.fuel_level, data.engine_status);
@@ -91,17 +118,12 @@ void process_engine_data(const struct can_frame *frame) {
 
 // Function to extract brake data from CAN frame
 void process_brake_data(const struct can_frame *frame) {
-    if (frame->can_dlc < 4) {
+    brake_data_t data;
+    if (brake_data_decode(&data, frame->data, frame->can_dlc) < 0) {
         printf("Error: Brake data frame too short\n");
         return;
     }
     
-    brake_data_t data;
-    data.brake_position = frame->data[0];
-    data.brake_pressure = frame->data[1];
-    data.abs_active = frame->data[2];
-    data.brake_status = frame->data[3];
-    
     printf("Brake: Position=%u%%, Pressure=%u, ABS=%s, Status=0x%02X\n",
         data.brake_position, data.brake_pressure,
         data.abs_active ? "Active" : "Inactive", data.brake_status);
@@ -111,18 +133,12 @@ void process_brake_data(const struct can_frame *frame) {
 
 // Function to extract steering data from CAN frame
 void process_steering_data(const struct can_frame *frame) {
-    if (frame->can_dlc < 3) {
+    steering_data_t data;
+    if (steering_data_decode(&data, frame->data, frame->can_dlc) < 0) {
         printf("Error: Steering data frame too short\n");
         return;
     }
     
-    steering_data_t data;
-    // Convert from two's complement for steering angle
-    int16_t raw_angle = (frame->data[0] << 8) | frame->data[1];
-    data.steering_angle = raw_angle;
-    data.steering_speed = frame->data[2];
-    data.steering_status = (frame->can_dlc >= 4) ? frame->data[3] : 0;
-    
     printf("Steering: Angle=%.1f°, Speed=%u, Status=0x%02X\n",
         data.steering_angle / 10.0, data.steering_speed, data.steering_status);
     
@@ -131,14 +147,11 @@ void process_steering_data(const struct can_frame *frame) {
 
 // Check if emergency braking is requested
 int is_emergency_braking(const struct can_frame *frame) {
-    if (frame->can_dlc < 4) {
+    brake_data_t data;
+    if (brake_data_decode(&data, frame->data, frame->can_dlc) < 0) {
         return 0;
     }
     
-    brake_data_t data;
-    data.brake_position = frame->data[0];
-    data.brake_pressure = frame->data[1];
-    
     // Consider it emergency braking if brake position > 80% and pressure is high
     return (data.brake_position > 80 && data.brake_pressure > 200);
 }
@@ -150,9 +163,11 @@ void send_emergency_signal(int sockfd) {
     
     // Set up emergency frame
     frame.can_id = DIAGNOSTIC_CAN_ID;
-    frame.can_dlc = 2;
-    frame.data[0] = 0xFF;  // Emergency code
-    frame.data[1] = 0x01;  // Emergency type: Brake
+    emergency_signal_t emergency = {
+        .code = 0xFF,  // Emergency code
+        .type = 0x01,  // Emergency type: Brake
+    };
+    frame.can_dlc = (uint8_t)emergency_signal_encode(&emergency, frame.data, sizeof(frame.data));
     
     // Send emergency frame
     if (write(sockfd, &frame, sizeof(frame)) < 0) {
@@ -170,17 +185,16 @@ void send_dashboard_update(int sockfd) {
     
     // Set up dashboard update frame
     frame.can_id = DASHBOARD_CAN_ID;
-    frame.can_dlc = 8;
     
     // Dummy data for demonstration - in a real system this would be real sensor data
-    frame.data[0] = 55;         // Current speed (55 km/h)
-    frame.data[1] = 90;         // Engine temperature (90°C)
-    frame.data[2] = 75;         // Fuel level (75%)
-    frame.data[3] = 0;          // Warning flags
-    frame.data[4] = 0;          // Error flags
-    frame.data[5] = 1;          // Gear position (1)
-    frame.data[6] = 0;          // Reserved
-    frame.data[7] = counter++;  // Message counter for detecting missed frames
+    dashboard_status_t status = {
+        .speed = 55,                // Current speed (55 km/h)
+        .engine_temperature = 90,   // Engine temperature (90°C)
+        .fuel_level = 75,           // Fuel level (75%)
+        .gear = 1,                  // Gear position (1)
+        .counter = counter++,       // Message counter for detecting missed frames
+    };
+    frame.can_dlc = (uint8_t)dashboard_status_encode(&status, frame.data, sizeof(frame.data));
     
     // Send dashboard update
     if (write(sockfd, &frame, sizeof(frame)) < 0) {
@@ -188,6 +202,60 @@ void send_dashboard_update(int sockfd) {
     }
 }
 
+// Send one ISO-TP frame of a diagnostic response
+int send_diagnostic_frame(void *ctx, const struct can_frame *frame) {
+    int sockfd = *(int *)ctx;
+    return write(sockfd, frame, sizeof(*frame)) == (ssize_t)sizeof(*frame) ? 0 : -1;
+}
+
+// Answer a complete diagnostic request (UDS service ID in the first byte)
+void handle_diagnostic_request(void *ctx, const uint8_t *data, size_t len) {
+    (void)ctx;
+    size_t response_len = 1;
+    diag_response[0] = data[0] + 0x40;  // Positive response
+    
+    switch (data[0]) {
+        case 0x3E:  // TesterPresent
+            diag_response[1] = 0x00;
+            response_len = 2;
+            break;
+            
+        case 0x34:  // RequestDownload: reply with the largest block we take
+            download_bytes = 0;
+            diag_response[1] = 0x20;
+            diag_response[2] = DIAGNOSTIC_BLOCK_LENGTH >> 8;
+            diag_response[3] = DIAGNOSTIC_BLOCK_LENGTH & 0xFF;
+            response_len = 4;
+            printf("Diagnostic: download requested\n");
+            break;
+            
+        case 0x36:  // TransferData: echo the block sequence counter
+            if (len < 2) {
+                goto not_supported;
+            }
+            download_bytes += len - 2;
+            diag_response[1] = data[1];
+            response_len = 2;
+            break;
+            
+        case 0x37:  // RequestTransferExit
+            printf("Diagnostic: download complete, %zu bytes\n", download_bytes);
+            break;
+            
+        default:
+        not_supported:
+            diag_response[0] = 0x7F;
+            diag_response[1] = data[0];
+            diag_response[2] = 0x11;  // serviceNotSupported
+            response_len = 3;
+            break;
+    }
+    
+    if (isotp_send(&diag_link, diag_response, response_len, isotp_now_us()) < 0) {
+        perror("Error sending diagnostic response");
+    }
+}
+
 // Check if dashboard update should be sent
 int should_update_dashboard() {
     // In this example, we update every ~500ms
@@ -261,11 +329,164 @@ int setup_can_filters(int sockfd) {
     return 0;
 }
 
-int main() {
+// Gateway mode: interfaces, then -r rules; bridges every pair without rules
+int run_gateway(int argc, char *argv[]) {
+    static can_gateway_t gateway;
+    if (cgw_init(&gateway) < 0) {
+        perror("Error creating epoll instance");
+        return 1;
+    }
+    
+    int i = 0;
+    for (; i < argc && strcmp(argv[i], "-r") != 0; i++) {
+        int fd = cgw_open_can(argv[i]);
+        if (fd < 0 || cgw_add_bus(&gateway, fd, argv[i]) < 0) {
+            fprintf(stderr, "Failed to open CAN interface %s: %s\n", argv[i], strerror(errno));
+            cgw_close(&gateway);
+            return 1;
+        }
+    }
+    if (gateway.bus_count < 2) {
+        fprintf(stderr, "Usage: can_automotive --gateway <if0> <if1> [...] [-r src:id>dst[:new_id][,and=HEX][,or=HEX]]...\n");
+        cgw_close(&gateway);
+        return 1;
+    }
+    
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && cgw_parse_rule(&gateway, argv[i + 1]) >= 0) {
+            i++;
+            continue;
+        }
+        fprintf(stderr, "Invalid gateway rule: %s\n",
+            strcmp(argv[i], "-r") == 0 && i + 1 < argc ? argv[i + 1] : argv[i]);
+        cgw_close(&gateway);
+        return 1;
+    }
+    if (gateway.rule_count == 0) {
+        for (int src = 0; src < gateway.bus_count; src++) {
+            for (int dst = 0; dst < gateway.bus_count; dst++) {
+                cgw_rule_t rule = { .id = CGW_ANY_ID, .src = (uint8_t)src, .dst = (uint8_t)dst,
+                                    .and_mask = ~0ULL };
+                if (src != dst) {
+                    cgw_add_rule(&gateway, &rule);
+                }
+            }
+        }
+    }
+    
+    printf("CAN gateway running on %d buses with %d routes\n", gateway.bus_count, gateway.rule_count);
+    printf("Press Ctrl+C to exit\n\n");
+    
+    time_t next_stats = time(NULL) + GATEWAY_STATS_INTERVAL;
+    while (keep_running) {
+        if (cgw_poll(&gateway, 100) < 0) {
+            perror("Error in gateway loop");
+            break;
+        }
+        if (time(NULL) >= next_stats) {
+            cgw_print_stats(&gateway);
+            next_stats = time(NULL) + GATEWAY_STATS_INTERVAL;
+        }
+    }
+    
+    cgw_print_stats(&gateway);
+    cgw_close(&gateway);
+    printf("CAN gateway shut down\n");
+    return 0;
+}
+
+// Bridge mode: interface, collector address and port, then optional local port and flush time
+int run_bridge(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: can_automotive --bridge <if> <collector_ip> <port> [local_port [flush_ms]]\n");
+        return 1;
+    }
+    int port = atoi(argv[2]);
+    int local_port = argc > 3 ? atoi(argv[3]) : BRIDGE_LOCAL_PORT;
+    int flush_ms = argc > 4 ? atoi(argv[4]) : BRIDGE_FLUSH_MS;
+    if (port <= 0 || port > 65535 || local_port < 0 || local_port > 65535 || flush_ms < 0) {
+        fprintf(stderr, "Invalid bridge port or flush time\n");
+        return 1;
+    }
+    
+    int can_fd = cgw_open_can(argv[0]);
+    if (can_fd < 0) {
+        fprintf(stderr, "Failed to open CAN interface %s: %s\n", argv[0], strerror(errno));
+        return 1;
+    }
+    int udp_fd = cbr_open_udp(argv[1], (uint16_t)port, (uint16_t)local_port);
+    if (udp_fd < 0) {
+        fprintf(stderr, "Failed to open UDP socket to %s:%d: %s\n", argv[1], port, strerror(errno));
+        close(can_fd);
+        return 1;
+    }
+    
+    static can_bridge_t bridge;
+    if (cbr_init(&bridge, can_fd, udp_fd, CBR_MAX_RECORDS, (unsigned)flush_ms) < 0) {
+        perror("Error creating epoll instance");
+        cbr_close(&bridge);
+        return 1;
+    }
+    
+    printf("CAN bridge running: %s <-> %s:%d (local port %d, flush %d ms, %d frames per datagram)\n",
+        argv[0], argv[1], port, local_port, flush_ms, (int)CBR_MAX_RECORDS);
+    printf("Press Ctrl+C to exit\n\n");
+    
+    time_t next_stats = time(NULL) + GATEWAY_STATS_INTERVAL;
+    while (keep_running) {
+        if (cbr_poll(&bridge, 100) < 0) {
+            perror("Error in bridge loop");
+            break;
+        }
+        if (time(NULL) >= next_stats) {
+            cbr_print_stats(&bridge);
+            next_stats = time(NULL) + GATEWAY_STATS_INTERVAL;
+        }
+    }
+    
+    cbr_close(&bridge);
+    cbr_print_stats(&bridge);
+    printf("CAN bridge shut down\n");
+    return 0;
+}
+
+// Statistics viewer: attach to the table of a running instance and print it every second
+int run_stats_viewer(int argc, char *argv[]) {
+    const char *name = argc > 0 ? argv[0] : CAN_STATS_SHM;
+    can_stats_t stats;
+    if (cst_attach(&stats, name) < 0) {
+        fprintf(stderr, "No CAN statistics at %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    
+    printf("CAN statistics from %s (writer pid %u)\n", name, (unsigned)stats.hdr->writer_pid);
+    printf("Press Ctrl+C to exit\n\n");
+    
+    while (keep_running) {
+        cst_print(&stats, STATS_TOP_IDS);
+        printf("\n");
+        sleep(1);
+    }
+    
+    cst_close(&stats);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
     // Set up signal handling for graceful shutdown
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
     
+    if (argc > 1 && strcmp(argv[1], "--gateway") == 0) {
+        return run_gateway(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bridge") == 0) {
+        return run_bridge(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+        return run_stats_viewer(argc - 2, argv + 2);
+    }
+    
     printf("Starting automotive CAN communication system\n");
     
     // Initialize CAN interface
@@ -282,16 +503,53 @@ int main() {
         return 1;
     }
     
+    // Unfiltered monitor socket for the bus statistics; it sees our own frames through loopback
+    static can_stats_t stats;
+    int stats_fd = cgw_open_can(CAN_INTERFACE);
+    int one = 1;
+    if (stats_fd < 0 || setsockopt(stats_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0 ||
+        cst_create(&stats, CAN_STATS_SHM, CAN_BITRATE) < 0) {
+        perror("Error setting up CAN statistics");
+        if (stats_fd >= 0) {
+            close(stats_fd);
+        }
+        close(sockfd);
+        return 1;
+    }
+    cst_set_counter(&stats, DASHBOARD_CAN_ID, DASHBOARD_COUNTER_BYTE, 0xFF);
+    
     printf("CAN communication initialized on interface %s\n", CAN_INTERFACE);
+    printf("Bus statistics in shared memory %s (view with --stats)\n", CAN_STATS_SHM);
     printf("Monitoring for engine, brake, and steering messages\n");
     printf("Press Ctrl+C to exit\n\n");
     
+    isotp_init(&diag_link, DIAGNOSTIC_RESPONSE_ID, DIAGNOSTIC_CAN_ID, diag_request, sizeof(diag_request),
+        send_diagnostic_frame, handle_diagnostic_request, &sockfd);
+    
     // Main loop
     struct can_frame frame;
+    struct pollfd pfds[2] = {
+        { .fd = sockfd, .events = POLLIN },
+        { .fd = stats_fd, .events = POLLIN },
+    };
     
     while (keep_running) {
+        // Wait for a frame, or until the diagnostic link has a timer due; wake each second for the bus load
+        uint64_t next = isotp_next_us(&diag_link);
+        uint64_t now = isotp_now_us();
+        int timeout = next <= now ? 0 : next - now >= 1000000 ? 1000 : (int)((next - now + 999) / 1000);
+        int ready = poll(pfds, 2, timeout);
+        isotp_poll(&diag_link, isotp_now_us());
+        if (ready > 0 && (pfds[1].revents & POLLIN) && cst_drain(&stats, stats_fd) < 0) {
+            perror("Error reading CAN statistics socket");
+        }
+        cst_tick(&stats, cgw_realtime_ns());
+        if (ready == 0 || (ready > 0 && !(pfds[0].revents & (POLLIN | POLLERR)))) {
+            continue;
+        }
+        
         // Receive CAN frame
-        ssize_t nbytes = read(sockfd, &frame, sizeof(frame));
+        ssize_t nbytes = ready < 0 ? -1 : read(sockfd, &frame, sizeof(frame));
         
         if (nbytes < 0) {
             // Error reading from socket
@@ -330,6 +588,9 @@ int main() {
                 break;
                 
             case DIAGNOSTIC_CAN_ID:
+                if (isotp_on_frame(&diag_link, &frame, isotp_now_us()) == 0) {
+                    break;
+                }
                 printf("Diagnostic message received: ID=0x%X, Data=[%02X %02X %02X %02X %02X %02X %02X %02X]\n",
                     frame.can_id,
                     frame.data[0], frame.data[1], frame.data[2], frame.data[3],
@@ -349,6 +610,9 @@ int main() {
     }
     
     // Clean up
+    cst_print(&stats, STATS_TOP_IDS);
+    cst_close(&stats);
+    close(stats_fd);
     close(sockfd);
     printf("CAN communication system shut down\n");
     
@@ -4,6 +4,8 @@
  * 
  * This example demonstrates a high-performance web server capable of handling
  * thousands of concurrent connections using the epoll multiplexing method.
+ * Each connection is a stackless coroutine that reads, processes and writes
+ * sequentially, suspending on EAGAIN instead of toggling EPOLLIN/EPOLLOUT.
  */
 
 #include <stdio.h>
@@ -19,15 +21,18 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <time.h>
 #include "socket_utils.h"
 #include "error_handling.h"
 #include "config.h"
 
 #ifdef ENABLE_EPOLL
 #include <sys/epoll.h>
+#include "thread_pool.h"
+#include "coroutine.h"
+#include "mem_pool.h"
 
 #define HTTP_PORT 8080
-#define MAX_EVENTS 1024
 #define MAX_CONNECTIONS 10000
 #define BUFFER_SIZE 8192
 #define WEB_ROOT "./www"
@@ -44,10 +49,21 @@ typedef struct {
     char *response;              // HTTP response data
     size_t response_size;        // Total size of response
     int keep_alive;              // Keep-alive flag
+    ssize_t io_result;           // Result of the last read/write
+    co_task_t co;                // Connection handler coroutine
+    tp_job_t job;                // Offload job for request processing
 } connection_t;
 
-// Connection pool
+// Connection pool, backed by a hugepage arena on the event loop's node
 connection_t *connections;
+static mem_arena_t connection_arena;
+
+// Worker pool for request processing (NULL processes inline)
+static thread_pool_t worker_pool;
+static thread_pool_t *request_pool = NULL;
+static tp_completion_queue_t completions;
+static co_loop_t loop;
+static int connection_count = 0;
 
 // Signal handler for graceful shutdown
 void handle_signal(int sig) {
@@ -57,10 +73,14 @@ void handle_signal(int sig) {
 
 // Initialize connections pool
 void init_connections() {
-    connections = calloc(MAX_CONNECTIONS, sizeof(connection_t));
-    if (!connections) {
+    // The loop thread owns every connection, so bind the table to its node
+    if (mem_arena_init(&connection_arena, MAX_CONNECTIONS * sizeof(connection_t),
+                       MEM_NODE_LOCAL) < 0) {
         FATAL("Failed to allocate connection pool");
     }
+    connections = connection_arena.base;
+    printf("Connection pool: %zu MB, %s, node %d\n", connection_arena.size >> 20,
+           mem_backing_name(connection_arena.backing), connection_arena.node);
     
     // Initialize all connections
     for (int i = 0; i < MAX_CONNECTIONS; i++) {
@@ -76,7 +96,8 @@ void free_connections() {
         }
         free(connections[i].response);
     }
-    free(connections);
+    mem_arena_destroy(&connection_arena);
+    connections = NULL;
 }
 
 // Add new connection to pool
@@ -100,11 +121,9 @@ connection_t *add_connection(int fd) {
 
 // Remove connection from pool
 void remove_connection(connection_t *conn) {
-    if (!conn) return;
+    if (!conn || conn->fd < 0) return;
     
-    if (conn->fd >= 0) {
-        close(conn->fd);
-    }
+    close(conn->fd);
     
     free(conn->response);
     conn->fd = -1;
@@ -113,6 +132,7 @@ void remove_connection(connection_t *conn) {
     conn->response_size = 0;
     conn->response_sent = 0;
     conn->keep_alive = 0;
+    connection_count--;
 }
 
 // Parse HTTP request and generate response
@@ -246,85 +266,186 @@ void process_http_request(connection_t *conn) {
     conn->response_sent = 0;
 }
 
-// Send HTTP response to client
-int send_response(connection_t *conn, int epoll_fd) {
-    if (!conn || !conn->response) return -1;
-    
-    // Calculate remaining data to send
-    size_t remaining = conn->response_size - conn->response_sent;
-    
-    // Send data to client
-    ssize_t bytes_sent = send(conn->fd, conn->response + conn->response_sent, remaining, 0);
-    
-    if (bytes_sent < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // Would block, try again later
-            return 0;
-        }
-        // Error sending data
+// Set socket to non-blocking mode
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        LOG_ERRNO("fcntl F_GETFL error");
         return -1;
     }
     
-    // Update sent counter
-    conn->response_sent += bytes_sent;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        LOG_ERRNO("fcntl F_SETFL O_NONBLOCK error");
+        return -1;
+    }
     
-    // Check if all data has been sent
-    if (conn->response_sent >= conn->response_size) {
-        // Response fully sent
+    return 0;
+}
+
+// Worker side: build the response off the I/O thread
+void request_work(tp_job_t *job) {
+    co_task_t *co = (co_task_t *)job->arg;
+    process_http_request((connection_t *)co->arg);
+}
+
+// Connection coroutine: read a request, build the response, send it,
+// and repeat while the client keeps the connection alive
+int handle_connection(co_task_t *co) {
+    connection_t *conn = (connection_t *)co->arg;
+    
+    CO_BEGIN(co);
+    
+    do {
+        // Read until the request headers are complete or the buffer is full
+        conn->buffer_used = 0;
+        conn->buffer[0] = '\0';
+        while (strstr(conn->buffer, "\r\n\r\n") == NULL &&
+               conn->buffer_used < BUFFER_SIZE - 1) {
+            CO_READ(co, conn->fd, conn->buffer + conn->buffer_used,
+                    BUFFER_SIZE - conn->buffer_used - 1, conn->io_result);
+            if (conn->io_result <= 0) {
+                // Connection closed by client or read error
+                CO_EXIT(co);
+            }
+            conn->buffer_used += conn->io_result;
+            conn->buffer[conn->buffer_used] = '\0';
+        }
+        
+        if (strstr(conn->buffer, "\r\n\r\n") == NULL) {
+            // Buffer full but no complete request, send error
+            const char *response = "HTTP/1.1 413 Request Entity Too Large\r\n"
+                                "Content-Length: 24\r\n"
+                                "Connection: close\r\n"
+                                "\r\n"
+                                "Request is too large";
+            
+            conn->response = strdup(response);
+            conn->response_size = strlen(response);
+            conn->keep_alive = 0;
+        } else if (request_pool) {
+            // Build the response on a worker, resuming here when it is done
+            CO_OFFLOAD(co, request_pool, &conn->job, request_work, &completions);
+        } else {
+            process_http_request(conn);
+        }
+        
+        // Send the complete response
+        conn->response_sent = 0;
+        while (conn->response_sent < conn->response_size) {
+            CO_WRITE(co, conn->fd, conn->response + conn->response_sent,
+                     conn->response_size - conn->response_sent, conn->io_result);
+            if (conn->io_result < 0) {
+                CO_EXIT(co);
+            }
+            conn->response_sent += conn->io_result;
+        }
+        
         free(conn->response);
         conn->response = NULL;
         conn->response_size = 0;
+    } while (conn->keep_alive);
+    
+    CO_END(co);
+}
+
+// Release the connection slot once its coroutine finishes
+void connection_finished(co_task_t *co) {
+    remove_connection((connection_t *)co->arg);
+}
+
+// Accept all pending connections and start a coroutine for each
+void accept_pending(int server_fd) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
         
-        if (conn->keep_alive) {
-            // Reset for next request
-            conn->buffer_used = 0;
-            
-            // Modify epoll event to wait for more data
-            struct epoll_event ev;
-            ev.events = EPOLLIN | EPOLLET;
-            ev.data.ptr = conn;
-            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
-                LOG_ERRNO("epoll_ctl error");
-                return -1;
+        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
+        
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERRNO("accept error");
             }
-            
-            return 0;
-        } else {
-            // Close connection
-            return -1;
+            // No more connections to accept
+            break;
+        }
+        
+        // Set new socket to non-blocking
+        if (set_nonblocking(client_fd) < 0) {
+            close(client_fd);
+            continue;
+        }
+        
+        // Disable Nagle's algorithm for lower latency
+        int flag = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        
+        // Add new connection to pool
+        connection_t *conn = add_connection(client_fd);
+        if (!conn) {
+            // Connection pool full
+            const char *msg = "HTTP/1.1 503 Service Unavailable\r\n"
+                            "Content-Length: 21\r\n"
+                            "Connection: close\r\n"
+                            "\r\n"
+                            "Server is overloaded";
+            send(client_fd, msg, strlen(msg), 0);
+            close(client_fd);
+            continue;
         }
+        connection_count++;
+        
+        // Start the connection handler
+        co_spawn(&loop, &conn->co, handle_connection, connection_finished, conn);
+        
+        // Log connection
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+        printf("New connection from %s:%d\n", client_ip, ntohs(client_addr.sin_port));
     }
-    
-    return 0;
 }
 
-// Set socket to non-blocking mode
-int set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        LOG_ERRNO("fcntl F_GETFL error");
-        return -1;
+// Listener coroutine
+int accept_connections(co_task_t *co) {
+    int server_fd = *(int *)co->arg;
+    
+    CO_BEGIN(co);
+    
+    while (1) {
+        CO_WAIT_FD(co, server_fd, EPOLLIN);
+        accept_pending(server_fd);
     }
     
-    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        LOG_ERRNO("fcntl F_SETFL O_NONBLOCK error");
-        return -1;
+    CO_END(co);
+}
+
+// Completion coroutine: resumes connections whose work finished on the pool
+int drain_completions(co_task_t *co) {
+    CO_BEGIN(co);
+    
+    while (1) {
+        CO_WAIT_FD(co, completions.efd, EPOLLIN);
+        tp_completion_drain(&completions);
     }
     
-    return 0;
+    CO_END(co);
 }
 
 int main(int argc, char *argv[]) {
     int port = HTTP_PORT;
+    int workers = -1;  // -1: one per CPU, 0: process requests inline
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             port = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            workers = atoi(argv[i + 1]);
+            i++;
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [-p port] [--help]\n", argv[0]);
+            printf("Usage: %s [-p port] [-t workers] [--help]\n", argv[0]);
             printf("  -p port   : Port to listen on (default: %d)\n", HTTP_PORT);
+            printf("  -t workers: Request worker threads, 0 = inline (default: CPUs)\n");
             printf("  -h, --help: Show this help message\n");
             return 0;
         }
@@ -337,6 +458,15 @@ int main(int argc, char *argv[]) {
     // Initialize connections pool
     init_connections();
     
+    // Start the request worker pool
+    if (workers != 0) {
+        if (tp_completion_init(&completions) < 0 ||
+            thread_pool_init(&worker_pool, workers) < 0) {
+            FATAL("Failed to start request worker pool");
+        }
+        request_pool = &worker_pool;
+    }
+    
     // Create server socket
     int server_fd = create_tcp_socket(1, 0);  // With SO_REUSEADDR, blocking mode
     if (server_fd < 0) {
@@ -372,186 +502,27 @@ int main(int argc, char *argv[]) {
     printf("Server root directory: %s\n", WEB_ROOT);
     printf("Press Ctrl+C to shut down\n");
     
-    // Create epoll instance
-    int epoll_fd = epoll_create1(0);
-    if (epoll_fd < 0) {
+    // Create the coroutine loop
+    if (co_loop_init(&loop) < 0) {
         close(server_fd);
         FATAL_ERRNO("Failed to create epoll instance");
     }
     
-    // Add server socket to epoll
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET;  // Edge-triggered mode
-    ev.data.ptr = NULL;  // NULL indicates it's the server socket
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
-        close(epoll_fd);
-        close(server_fd);
-        FATAL_ERRNO("Failed to add server socket to epoll");
+    // Listener and worker completions run as coroutines on the same loop
+    co_task_t listener, completion_pump;
+    co_spawn(&loop, &listener, accept_connections, NULL, &server_fd);
+    if (request_pool) {
+        co_spawn(&loop, &completion_pump, drain_completions, NULL, NULL);
+        printf("Processing requests on %d worker threads\n", request_pool->num_workers);
     }
     
     // Event loop
-    struct epoll_event events[MAX_EVENTS];
-    int connection_count = 0;
-    
     while (keep_running) {
-        // Wait for events
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);  // 1 second timeout
-        
-        if (nfds < 0 && errno != EINTR) {
+        if (co_loop_run_once(&loop, 1000) < 0) {  // 1 second timeout
             LOG_ERRNO("epoll_wait error");
             break;
         }
         
-        for (int i = 0; i < nfds; i++) {
-            if (events[i].data.ptr == NULL) {
-                // Event on server socket - accept new connections
-                while (1) {
-                    struct sockaddr_in client_addr;
-                    socklen_t client_len = sizeof(client_addr);
-                    
-                    int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
-                    
-                    if (client_fd < 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                            // No more connections to accept
-                            break;
-                        } else {
-                            LOG_ERRNO("accept error");
-                            break;
-                        }
-                    }
-                    
-                    // Set new socket to non-blocking
-                    if (set_nonblocking(client_fd) < 0) {
-                        close(client_fd);
-                        continue;
-                    }
-                    
-                    // Disable Nagle's algorithm for lower latency
-                    int flag = 1;
-                    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-                    
-                    // Add new connection to pool
-                    connection_t *conn = add_connection(client_fd);
-                    if (!conn) {
-                        // Connection pool full
-                        const char *msg = "HTTP/1.1 503 Service Unavailable\r\n"
-                                        "Content-Length: 21\r\n"
-                                        "Connection: close\r\n"
-                                        "\r\n"
-                                        "Server is overloaded";
-                        send(client_fd, msg, strlen(msg), 0);
-                        close(client_fd);
-                        continue;
-                    }
-                    
-                    // Add socket to epoll instance
-                    struct epoll_event ev;
-                    ev.events = EPOLLIN | EPOLLET;  // Edge-triggered mode
-                    ev.data.ptr = conn;
-                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
-                        LOG_ERRNO("epoll_ctl error");
-                        remove_connection(conn);
-                        continue;
-                    }
-                    
-                    // Log connection
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-                    printf("New connection from %s:%d\n", client_ip, ntohs(client_addr.sin_port));
-                    
-                    connection_count++;
-                }
-            } else {
-                // Event on client socket
-                connection_t *conn = (connection_t *)events[i].data.ptr;
-                
-                if (events[i].events & EPOLLIN) {
-                    // Socket ready for reading
-                    if (conn->response) {
-                        // Already processing a request, ignore additional data
-                        continue;
-                    }
-                    
-                    // Read data from socket
-                    ssize_t bytes_read = recv(conn->fd, conn->buffer + conn->buffer_used, 
-                                            BUFFER_SIZE - conn->buffer_used - 1, 0);
-                    
-                    if (bytes_read < 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                            // No more data to read
-                            continue;
-                        } else {
-                            // Error reading from socket
-                            remove_connection(conn);
-                            connection_count--;
-                            continue;
-                        }
-                    } else if (bytes_read == 0) {
-                        // Connection closed by client
-                        remove_connection(conn);
-                        connection_count--;
-                        continue;
-                    }
-                    
-                    // Update buffer usage
-                    conn->buffer_used += bytes_read;
-                    
-                    // Check if we have a complete HTTP request
-                    if (strstr(conn->buffer, "\r\n\r\n") != NULL) {
-                        // Complete HTTP request received, process it
-                        process_http_request(conn);
-                        
-                        // Change to write mode
-                        struct epoll_event ev;
-                        ev.events = EPOLLOUT | EPOLLET;  // Edge-triggered mode
-                        ev.data.ptr = conn;
-                        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
-                            LOG_ERRNO("epoll_ctl error");
-                            remove_connection(conn);
-                            connection_count--;
-                            continue;
-                        }
-                    } else if (conn->buffer_used >= BUFFER_SIZE - 1) {
-                        // Buffer full but no complete request, send error
-                        const char *response = "HTTP/1.1 413 Request Entity Too Large\r\n"
-                                            "Content-Length: 24\r\n"
-                                            "Connection: close\r\n"
-                                            "\r\n"
-                                            "Request is too large";
-                        
-                        conn->response = strdup(response);
-                        conn->response_size = strlen(response);
-                        conn->response_sent = 0;
-                        conn->keep_alive = 0;
-                        
-                        // Change to write mode
-                        struct epoll_event ev;
-                        ev.events = EPOLLOUT | EPOLLET;  // Edge-triggered mode
-                        ev.data.ptr = conn;
-                        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
-                            LOG_ERRNO("epoll_ctl error");
-                            remove_connection(conn);
-                            connection_count--;
-                            continue;
-                        }
-                    }
-                } else if (events[i].events & EPOLLOUT) {
-                    // Socket ready for writing
-                    if (send_response(conn, epoll_fd) < 0) {
-                        remove_connection(conn);
-                        connection_count--;
-                    }
-                }
-                
-                // Check for errors
-                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                    remove_connection(conn);
-                    connection_count--;
-                }
-            }
-        }
-        
         // Log status periodically
         static time_t last_status = 0;
         time_t now = time(NULL);
@@ -563,7 +534,13 @@ int main(int argc, char *argv[]) {
     
     // Clean up
     printf("Shutting down web server...\n");
-    close(epoll_fd);
+    if (request_pool) {
+        // Workers finish outstanding requests before the pool is torn down
+        thread_pool_destroy(request_pool);
+        tp_completion_drain(&completions);
+        tp_completion_destroy(&completions);
+    }
+    co_loop_destroy(&loop);
     close(server_fd);
     free_connections();
     
@@ -5,8 +5,8 @@
  * This example demonstrates a low-latency financial trading system
  * using raw sockets and kernel bypass techniques to minimize latency.
  * 
- * Note: This example requires root privileges to run as it uses raw sockets.
- * Compile with: gcc -o low_latency_trading low_latency_trading.c -lrt
+ * Note: packet and xdp modes require root privileges.
+ * Compile with: gcc -Iinclude -o low_latency_trading low_latency_trading.c -lpthread -lrt
  */
 
 #include <stdio.h>
@@ -20,6 +20,8 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
@@ -30,6 +32,14 @@
 #include "socket_utils.h"
 #include "error_handling.h"
 #include "config.h"
+#include "xdp_socket.h"
+#include "trading_protocol.h"
+#include "latency_histogram.h"
+#include "risk_engine.h"
+#include "shm_ring.h"
+#include "feed_arbiter.h"
+#include "order_session.h"
+#include "book_snapshot.h"
 
 // Check if running on Linux
 #ifndef __linux__
@@ -40,16 +50,52 @@
 #define INTERFACE_NAME "eth0"   // Network interface to use
 #define MARKET_IP "239.0.0.1"   // Multicast IP for market data
 #define MARKET_PORT 30001       // Market data port
+#define MARKET_IP_B "239.0.0.2" // B line multicast group
+#define MARKET_PORT_B 30003     // B line port
 #define EXCHANGE_IP "10.0.0.10" // Exchange IP address
 #define EXCHANGE_PORT 30002     // Exchange order port
 #define PACKET_BUFFER_SIZE 2048 // Size of packet buffer
 #define MAX_SYMBOLS 100         // Maximum number of symbols to track
 #define RING_SIZE 2048          // Size of ring buffer (must be power of 2)
 #define NSEC_PER_SEC 1000000000L
+#define ORDER_QUANTITY 100      // Shares per order
+#define MD_RING_SLOTS 4096      // Book updates retained for strategy processes
+#define WARMUP_INTERVAL_NS 1000000  // Dry-run the order path after 1 ms without one
+#define SESSION_JOURNAL_SLOTS 65536 // Orders kept for resend (-T)
+#define SESSION_HEARTBEAT_MS 1000   // Order session heartbeat interval
+#define SESSION_RETRY_NS 1000000000ULL  // Reconnect interval
+#define SNAPSHOT_INTERVAL_NS 100000000  // Book snapshot period (-s)
+#define SNAPSHOT_LOG_SLOTS 16384        // Feed messages logged for replay
+#define SNAPSHOT_MAX_MESSAGE 240        // Longest feed message that can be logged
+
+// Default risk limits
+#define RISK_MAX_POSITION 1000          // Shares per symbol, including open orders
+#define RISK_MAX_NOTIONAL_USD 250000    // Per symbol
+#define RISK_MAX_ORDER_QTY 1000         // Shares per order
+#define RISK_PRICE_BAND_BPS 200         // Max distance from last trade
+#define RISK_ORDERS_PER_SEC 5           // Global order rate
+#define RISK_ORDER_BURST 2              // Orders allowed back to back
+
+// Client order IDs carry the symbol slot so replies can be booked to it
+#define ORDER_ID(seq, idx) (((uint64_t)(seq) << 8) | (uint64_t)(idx))
+#define ORDER_SYMBOL(id) ((int)((id) & 0xff))
+
+// Market data ingest modes
+typedef enum {
+    FEED_UDP,       // Kernel UDP socket
+    FEED_PACKET,    // AF_PACKET raw socket
+    FEED_XDP        // AF_XDP socket with XDP redirect
+} feed_mode_t;
 
 // Flag for graceful shutdown
 static volatile int keep_running = 1;
 
+// Redundant feed lines
+enum {
+    FEED_LINE_A = 0,
+    FEED_LINE_B = 1
+};
+
 // Symbol price data
 typedef struct {
     char symbol[16];         // Symbol name (e.g., "AAPL")
@@ -60,15 +106,6 @@ typedef struct {
     uint32_t volume;         // Trading volume
 } market_data_t;
 
-// Trading order
-typedef struct {
-    char symbol[16];         // Symbol to trade
-    char side;               // 'B' for buy, 'S' for sell
-    double price;            // Limit price (0 for market order)
-    uint32_t quantity;       // Number of shares
-    uint32_t order_id;       // Order ID
-} trading_order_t;
-
 // Market data store
 market_data_t market_data[MAX_SYMBOLS];
 int num_symbols = 0;
@@ -82,10 +119,66 @@ typedef struct {
     uint64_t max_latency_ns;
     uint64_t total_latency_ns;
     uint64_t latency_samples;
+    uint64_t acks_received;
+    uint64_t fills_received;
+    uint64_t rejects_received;
+    uint64_t risk_rejects;
+    uint64_t warmups;
+    uint64_t session_down;
 } metrics_t;
 
 metrics_t metrics = {0};
 
+// Wire-to-handler latency for timestamped feed messages
+latency_histogram_t feed_latency;
+
+// Order send to exchange ack, measured on our clock
+latency_histogram_t order_rtt;
+
+// Market data arrival to order handed to the kernel
+latency_histogram_t tick_to_trade;
+
+// Pre-built new-order messages, one cache line per symbol. Only the ID,
+// price, quantity and header stamp are patched when an order goes out.
+typedef struct {
+    _Alignas(64) order_msg_t msg;
+} order_template_t;
+
+order_template_t order_templates[MAX_SYMBOLS];
+
+// Order path used by the market data handlers: UDP socket, or TCP session
+typedef struct {
+    int order_sock;
+    struct sockaddr_in exchange_addr;
+    order_session_t *session;
+} trading_context_t;
+
+// Order-entry session and its journal (-T)
+order_journal_t order_journal;
+order_session_t order_session;
+
+// Periodic dry runs of the order path (-W disables)
+int warmup_enabled = 1;
+uint64_t last_order_path_ns = 0;
+
+// Pre-trade risk state; symbol slots match market_data[]
+risk_engine_t risk;
+
+// A/B line arbitration and per-line wire latency (every copy, winner or not)
+feed_arbiter_t arbiter;
+latency_histogram_t line_latency[FEED_ARB_LINES];
+int line_b_enabled = 0;
+
+// Shared-memory fan-out of normalized book updates (-R)
+shm_ring_t md_ring;
+int md_ring_enabled = 0;
+
+// Book snapshots and feed log for fast restart (-s)
+book_snapshot_t book_snap;
+int snapshot_enabled = 0;
+uint64_t last_snapshot_ns = 0;
+latency_histogram_t snapshot_time;
+
 // Signal handler for graceful shutdown
 void handle_signal(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
@@ -125,8 +218,39 @@ void track_latency(uint64_t start_ns, uint64_t end_ns) {
     }
 }
 
+// Publish market_data[idx] to strategy processes attached to the ring
+void publish_market_update(int idx, uint64_t sent_ns) {
+    if (!md_ring_enabled) {
+        return;
+    }
+    
+    const market_data_t *data = &market_data[idx];
+    md_update_t update;
+    msg_set_symbol(update.symbol, data->symbol);
+    update.last_price = PRICE_TO_TICKS(data->last_price);
+    update.bid = PRICE_TO_TICKS(data->bid);
+    update.ask = PRICE_TO_TICKS(data->ask);
+    update.volume = data->volume;
+    update.symbol_index = (uint32_t)idx;
+    update.exchange_ns = sent_ns;
+    update.feed_ns = get_timestamp_ns();
+    shm_ring_publish(&md_ring, &update, sizeof(update));
+}
+
+// Fill in the fields of symbol idx's order that never change
+void build_order_template(int idx) {
+    order_msg_t *order = &order_templates[idx].msg;
+    
+    memset(order, 0, sizeof(*order));
+    msg_header_init(&order->hdr, MSG_NEW_ORDER, sizeof(*order), 0, 0);
+    msg_set_symbol(order->symbol, market_data[idx].symbol);
+    order->side = SIDE_BUY;
+    order->quantity = ORDER_QUANTITY;
+}
+
 // Update market data
-void update_market_data(const char *symbol, double price, double bid, double ask, uint32_t volume) {
+void update_market_data(const char *symbol, double price, double bid, double ask, uint32_t volume,
+                        uint64_t sent_ns) {
     uint64_t now = get_timestamp_ns();
     
     // Look for existing symbol
@@ -137,6 +261,11 @@ void update_market_data(const char *symbol, double price, double bid, double ask
             market_data[i].ask = ask;
             market_data[i].volume = volume;
             market_data[i].timestamp_ns = now;
+            risk_on_trade_price(&risk, i, PRICE_TO_TICKS(price));
+            if (snapshot_enabled) {
+                book_snapshot_mark(&book_snap, (uint32_t)i);
+            }
+            publish_market_update(i, sent_ns);
             return;
         }
     }
@@ -150,12 +279,19 @@ void update_market_data(const char *symbol, double price, double bid, double ask
         market_data[num_symbols].ask = ask;
         market_data[num_symbols].volume = volume;
         market_data[num_symbols].timestamp_ns = now;
+        risk_register_symbol(&risk, num_symbols, symbol);
+        build_order_template(num_symbols);
+        risk_on_trade_price(&risk, num_symbols, PRICE_TO_TICKS(price));
+        if (snapshot_enabled) {
+            book_snapshot_mark(&book_snap, (uint32_t)num_symbols);
+        }
         num_symbols++;
+        publish_market_update(num_symbols - 1, sent_ns);
     }
 }
 
-// Trading strategy (simple example)
-int should_execute_trade(const market_data_t *data) {
+// Trading strategy (simple example); a dry run leaves the trade clock alone
+int should_execute_trade(const market_data_t *data, int dry_run) {
     static uint64_t last_trade_time = 0;
     uint64_t now = get_timestamp_ns();
     
@@ -167,56 +303,111 @@ int should_execute_trade(const market_data_t *data) {
     // Simple momentum strategy (for demonstration)
     // In a real system, this would be a sophisticated algorithm
     if (data->bid > data->last_price && data->volume > 1000) {
-        last_trade_time = now;
+        if (!dry_run) {
+            last_trade_time = now;
+        }
         return 1; // Buy signal
     }
     
     return 0;
 }
 
-// Parse market data packet
-void parse_market_data(const char *packet, size_t length) {
-    if (length < 32) { // Minimum valid packet size
-        return;
+// One decoded feed message
+typedef struct {
+    char symbol[16];
+    double price;
+    double bid;
+    double ask;
+    uint32_t volume;
+    uint64_t sent_ns;       // Sender timestamp, 0 if absent
+    uint64_t seq;           // Sequence number, 0 if absent
+} feed_msg_t;
+
+// Parse a "symbol price bid ask volume [sent_ns [seq]]" packet, returns 0 on success.
+// sent_ns is the sender's CLOCK_REALTIME stamp, used for wire-to-handler latency.
+int parse_market_data(const char *packet, size_t length, feed_msg_t *msg) {
+    if (length < 32 || length >= PACKET_BUFFER_SIZE) { // Minimum valid packet size
+        return -1;
     }
     
     // In a real system, this would parse the exchange's binary protocol
     // This is a simplified example assuming a text-based format
-    char symbol[16];
-    double price, bid, ask;
-    uint32_t volume;
+    char text[PACKET_BUFFER_SIZE];
+    memcpy(text, packet, length);
+    text[length] = '\0';
+    
+    unsigned long long sent_ns = 0, seq = 0;
     
     // Parse the packet (simplified)
-    if (sscanf(packet, "%15s %lf %lf %lf %u", symbol, &price, &bid, &ask, &volume) == 5) {
-        update_market_data(symbol, price, bid, ask, volume);
+    if (sscanf(text, "%15s %lf %lf %lf %u %llu %llu", msg->symbol, &msg->price, &msg->bid,
+               &msg->ask, &msg->volume, &sent_ns, &seq) < 5) {
+        return -1;
     }
+    msg->sent_ns = sent_ns;
+    msg->seq = seq;
+    return 0;
 }
 
-// Send trading order
-int send_trading_order(int sockfd, const struct sockaddr_in *addr, const market_data_t *data) {
-    // Create order
-    trading_order_t order;
-    strncpy(order.symbol, data->symbol, sizeof(order.symbol));
-    order.side = 'B'; // Buy
-    order.price = data->ask; // Buy at ask price
-    order.quantity = 100; // Fixed quantity for demonstration
+// Record wire-to-handler latency of one feed message
+void track_feed_latency(uint64_t sent_ns, uint64_t received_ns) {
+    if (sent_ns == 0 || received_ns < sent_ns) {
+        return;
+    }
+    
+    latency_histogram_record(&feed_latency, received_ns - sent_ns);
+}
+
+// Send trading order for market_data[idx]; tick_ns is when the triggering data arrived
+int send_trading_order(trading_context_t *ctx, int idx, uint64_t tick_ns, int dry_run) {
+    static uint32_t next_seq = 1;
+    static uint64_t next_order_id = 1;
+    const market_data_t *data = &market_data[idx];
+    order_msg_t *order = &order_templates[idx].msg;
+    
+    // On a session the order is encoded straight into its journal slot. A
+    // dry run patches the template instead and leaves the journal alone.
+    if (ctx->session && !dry_run) {
+        order_msg_t *slot = &order_session_claim(ctx->session)->order;
+        *slot = *order;
+        order = slot;
+    }
     
-    // Generate order ID
-    static uint32_t next_order_id = 1;
-    order.order_id = next_order_id++;
+    // Patch the template; a dry run consumes no ID or sequence number
+    order->client_order_id = ORDER_ID(next_order_id, idx);
+    order->price = PRICE_TO_TICKS(data->ask); // Buy at ask price
+    order->quantity = ORDER_QUANTITY;
     
-    // Track time for latency measurement
+    // Stamp as late as possible; the ack echoes this for the round trip
     uint64_t start_time = get_timestamp_ns();
+    order->hdr.seq = next_seq;
+    order->hdr.send_ns = start_time;
+    last_order_path_ns = start_time;
+    if (dry_run) {
+        return 0;
+    }
+    next_seq++;
+    next_order_id++;
     
-    // Send order
-    ssize_t bytes_sent = sendto(sockfd, &order, sizeof(order), 0,
-                            (const struct sockaddr *)addr, sizeof(*addr));
+    // Send order; a session assigns its own sequence number
+    ssize_t bytes_sent;
+    if (ctx->session) {
+        bytes_sent = order_session_send(ctx->session, MSG_NEW_ORDER, sizeof(*order), start_time);
+    } else {
+        bytes_sent = sendto(ctx->order_sock, order, sizeof(*order), 0,
+                            (const struct sockaddr *)&ctx->exchange_addr, sizeof(ctx->exchange_addr));
+    }
     
     // Calculate latency
     uint64_t end_time = get_timestamp_ns();
     track_latency(start_time, end_time);
+    if (tick_ns && end_time > tick_ns) {
+        latency_histogram_record(&tick_to_trade, end_time - tick_ns);
+    }
     
-    if (bytes_sent < 0) {
+    if (bytes_sent < 0 && ctx->session) {
+        // Journaled; replayed when the session logs on again
+        LOG_ERRNO("Order session failed while sending");
+    } else if (bytes_sent < 0) {
         LOG_ERRNO("Failed to send trading order");
         return -1;
     }
@@ -224,17 +415,80 @@ int send_trading_order(int sockfd, const struct sockaddr_in *addr, const market_
     // Update metrics
     metrics.orders_sent++;
     
-    printf("Sent %s order for %s: %u shares at $%.2f (Order ID: %u, Latency: %.2f µs)\n",
-        order.side == 'B' ? "BUY" : "SELL",
-        order.symbol,
-        order.quantity,
-        order.price,
-        order.order_id,
+    printf("Sent %s order for %s: %u shares at $%.2f (Order ID: %llu, Latency: %.2f µs)\n",
+        order->side == SIDE_BUY ? "BUY" : "SELL",
+        data->symbol,
+        order->quantity,
+        TICKS_TO_PRICE(order->price),
+        (unsigned long long)order->client_order_id,
         (end_time - start_time) / 1000.0);
     
     return 0;
 }
 
+// Book one ack, fill or reject from the exchange (session callback signature)
+void on_exchange_message(void *ctx, const trading_msg_t *msg, int type, uint64_t now) {
+    (void)ctx;
+    
+    switch (type) {
+    case MSG_ACK:
+        metrics.acks_received++;
+        // The ack echoes the order's send time: round trip on this host's clock
+        if (now >= msg->ack.order_send_ns) {
+            latency_histogram_record(&order_rtt, now - msg->ack.order_send_ns);
+        }
+        break;
+    case MSG_FILL:
+        metrics.fills_received++;
+        // The strategy only buys
+        risk_on_fill(&risk, ORDER_SYMBOL(msg->fill.client_order_id), SIDE_BUY, msg->fill.quantity);
+        printf("Fill: order %llu, %u shares at $%.4f (%u open)\n",
+            (unsigned long long)msg->fill.client_order_id, msg->fill.quantity,
+            TICKS_TO_PRICE(msg->fill.price), msg->fill.leaves);
+        break;
+    case MSG_REJECT:
+        metrics.rejects_received++;
+        risk_on_order_done(&risk, ORDER_SYMBOL(msg->reject.client_order_id), SIDE_BUY,
+                           ORDER_QUANTITY);
+        printf("Order %llu rejected (reason %u)\n",
+            (unsigned long long)msg->reject.client_order_id, msg->reject.reason);
+        break;
+    case MSG_CANCELLED:
+        break;
+    default:
+        fprintf(stderr, "Malformed exchange message\n");
+        break;
+    }
+}
+
+// Process acks, fills and rejects from the exchange
+void handle_exchange_messages(trading_context_t *ctx) {
+    trading_msg_t msg;
+    
+    if (ctx->session) {
+        uint64_t logons = ctx->session->stats.logons;
+        order_session_poll(ctx->session, get_timestamp_ns(), NULL, on_exchange_message, NULL);
+        if (ctx->session->stats.logons != logons) {
+            printf("Order session logged on (session %016llx, next out %u, next in %u)\n",
+                (unsigned long long)order_journal.hdr->session_id, order_journal.hdr->out_seq + 1,
+                order_journal.hdr->in_next);
+        }
+        return;
+    }
+    
+    for (;;) {
+        ssize_t len = recv(ctx->order_sock, &msg, sizeof(msg), 0);
+        uint64_t now = get_timestamp_ns();
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO("Failed to receive from exchange");
+            }
+            return;
+        }
+        on_exchange_message(NULL, &msg, msg_validate(&msg, (size_t)len), now);
+    }
+}
+
 // Configure network interface for low latency
 int configure_interface_low_latency(const char *interface_name) {
     // Disable interrupt coalescing
@@ -307,22 +561,6 @@ int setup_market_data_socket(const char *interface_name) {
     int flags = fcntl(sockfd, F_GETFL, 0);
     fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
     
-    // Setup packet ring buffer for zero-copy operation
-    struct tpacket_req req;
-    memset(&req, 0, sizeof(req));
-    req.tp_block_size = getpagesize() * 8;
-    req.tp_block_nr = 64;
-    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
-    req.tp_frame_nr = req.tp_block_size * req.tp_block_nr / req.tp_frame_size;
-    
-    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
-        perror("setsockopt(PACKET_RX_RING)");
-        // Fall back to standard mode if ring buffer not supported
-        printf("Falling back to standard socket mode\n");
-    } else {
-        printf("Using zero-copy packet ring buffer\n");
-    }
-    
     // Set high priority for socket
     int priority = 7;  // Highest non-root priority
     if (setsockopt(sockfd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) < 0) {
@@ -332,6 +570,44 @@ int setup_market_data_socket(const char *interface_name) {
     return sockfd;
 }
 
+// Setup kernel UDP socket for market data
+int setup_market_data_udp_socket(const char *interface_name, const char *group, int port) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    
+    int optval = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sockfd);
+        return -1;
+    }
+    
+    // Join the market data group on the feed interface (unicast feeds work without it)
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    inet_pton(AF_INET, group, &mreq.imr_multiaddr);
+    mreq.imr_ifindex = (int)if_nametoindex(interface_name);
+    if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("setsockopt(IP_ADD_MEMBERSHIP)");
+    }
+    
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    
+    return sockfd;
+}
+
 // Setup UDP socket for sending orders
 int setup_order_socket(const char *exchange_ip, int exchange_port) {
     int sockfd;
@@ -367,12 +643,258 @@ int setup_order_socket(const char *exchange_ip, int exchange_port) {
         return -1;
     }
     
+    // Exchange replies are drained from the main loop
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl");
+        close(sockfd);
+        return -1;
+    }
+    
     return sockfd;
 }
 
+// Risk check and send for symbol i. A dry run goes through the same code
+// and data but books nothing and stops short of sendto().
+int execute_order(trading_context_t *ctx, int i, uint64_t now_ns, int dry_run) {
+    int64_t price = PRICE_TO_TICKS(market_data[i].ask);
+    
+    // No new orders while the session is down; they would go out stale at logon
+    if (ctx->session && ctx->session->state != SESSION_ACTIVE && !dry_run) {
+        metrics.session_down++;
+        return -1;
+    }
+    
+    // Pre-trade risk check, inline on the strategy thread
+    risk_result_t verdict = dry_run
+        ? risk_check_order_dry(&risk, i, SIDE_BUY, price, ORDER_QUANTITY, now_ns)
+        : risk_check_order(&risk, i, SIDE_BUY, price, ORDER_QUANTITY, now_ns);
+    if (verdict != RISK_OK && !dry_run) {
+        metrics.risk_rejects++;
+        printf("Risk rejected BUY %s: %s\n", market_data[i].symbol, risk_result_name(verdict));
+        return -1;
+    }
+    
+    // Execute trade
+    if (send_trading_order(ctx, i, now_ns, dry_run) < 0) {
+        risk_on_order_done(&risk, i, SIDE_BUY, ORDER_QUANTITY);
+        return -1;
+    }
+    return 0;
+}
+
+// Copy changed book records into the snapshot file
+void take_book_snapshot(uint64_t now) {
+    book_snapshot_take(&book_snap, market_data, (uint32_t)num_symbols, now);
+    latency_histogram_record(&snapshot_time, get_timestamp_ns() - now);
+    last_snapshot_ns = now;
+}
+
+// Apply one logged feed message during recovery (no trading on stale data)
+void replay_feed_message(void *ctx, const void *data, uint32_t length) {
+    (void)ctx;
+    feed_msg_t msg;
+    if (parse_market_data(data, length, &msg) == 0) {
+        update_market_data(msg.symbol, msg.price, msg.bid, msg.ask, msg.volume, msg.sent_ns);
+    }
+}
+
+// Rebuild market_data[] from the newest snapshot and the feed log after it
+void recover_book(void) {
+    uint64_t start = get_timestamp_ns();
+    const book_snapshot_image_t *image = book_snapshot_latest(&book_snap);
+    uint32_t loaded = image ? image->count : 0;
+    
+    for (uint32_t i = 0; i < loaded; i++) {
+        const market_data_t *rec = book_snapshot_record(&book_snap, image, i);
+        update_market_data(rec->symbol, rec->last_price, rec->bid, rec->ask, rec->volume, 0);
+    }
+    uint64_t replayed = book_snapshot_replay(&book_snap, replay_feed_message, NULL);
+    
+    printf("Book ready in %.3f ms: %d symbols (%u from snapshot %lu, then %lu logged messages replayed",
+        (get_timestamp_ns() - start) / 1000000.0, num_symbols, loaded, image ? image->generation : 0,
+        replayed);
+    if (book_snap.replay_lost) {
+        printf(", %lu lost", book_snap.replay_lost);
+    }
+    printf(")\n");
+}
+
+// Run the decision and order path for every symbol without sending, so the
+// first real order after a quiet spell does not pay for cold caches
+void warm_order_path(trading_context_t *ctx) {
+    uint64_t now = get_timestamp_ns();
+    
+    for (int i = 0; i < num_symbols; i++) {
+        // The signal is evaluated for its side of the path and then ignored
+        (void)should_execute_trade(&market_data[i], 1);
+        execute_order(ctx, i, now, 1);
+    }
+    last_order_path_ns = now;
+    metrics.warmups++;
+}
+
+// Process one market data payload: update book, run strategy, send orders
+void handle_market_data(trading_context_t *ctx, int line, const char *payload, size_t length,
+                        uint64_t rx_ns) {
+    // Update metrics
+    metrics.packets_received++;
+    
+    feed_msg_t msg;
+    if (parse_market_data(payload, length, &msg) < 0) {
+        return;
+    }
+    if (msg.sent_ns && rx_ns >= msg.sent_ns) {
+        latency_histogram_record(&line_latency[line], rx_ns - msg.sent_ns);
+    }
+    
+    // A/B arbitration: only the first copy of each sequence number is processed
+    if (msg.seq && !feed_arb_accept(&arbiter, line, msg.seq, rx_ns)) {
+        return;
+    }
+    
+    // Log before applying, so a restart can replay it; a message that does
+    // not fit the log is covered by an immediate snapshot instead
+    int unlogged = snapshot_enabled && book_snapshot_log(&book_snap, payload, (uint32_t)length) < 0;
+    
+    // Process market data
+    track_feed_latency(msg.sent_ns, rx_ns);
+    update_market_data(msg.symbol, msg.price, msg.bid, msg.ask, msg.volume, msg.sent_ns);
+    if (unlogged) {
+        take_book_snapshot(rx_ns);
+    }
+    
+    // Check trading signals
+    for (int i = 0; i < num_symbols; i++) {
+        if (should_execute_trade(&market_data[i], 0)) {
+            execute_order(ctx, i, rx_ns, 0);
+        }
+    }
+}
+
+// AF_XDP frame handler: frames are already filtered to the market data port
+void on_xdp_frame(void *arg, const uint8_t *frame, uint32_t len) {
+    uint64_t rx_ns = get_timestamp_ns();
+    size_t payload_len;
+    const char *payload = xsk_udp_payload(frame, len, MARKET_PORT, &payload_len);
+    if (payload) {
+        handle_market_data(arg, FEED_LINE_A, payload, payload_len, rx_ns);
+    }
+}
+
+// Drain pending market data for the active mode, returns messages handled
+int poll_market_data(feed_mode_t mode, int market_sock, xsk_socket_t *xsk, trading_context_t *ctx) {
+    if (mode == FEED_XDP) {
+        return xsk_rx_burst(xsk, on_xdp_frame, ctx);
+    }
+    
+    // Buffer for receiving market data
+    char buffer[PACKET_BUFFER_SIZE];
+    int handled = 0;
+    
+    for (int n = 0; n < XSK_RX_BATCH; n++) {
+        ssize_t bytes_received = recv(market_sock, buffer, sizeof(buffer), 0);
+        if (bytes_received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // Handle error
+                perror("recv");
+                return -1;
+            }
+            break;
+        }
+        uint64_t rx_ns = get_timestamp_ns();
+        
+        if (mode == FEED_UDP) {
+            handle_market_data(ctx, FEED_LINE_A, buffer, (size_t)bytes_received, rx_ns);
+            handled++;
+            continue;
+        }
+        
+        // Raw frames: only the market data port is of interest
+        size_t payload_len;
+        const char *payload = xsk_udp_payload((const uint8_t *)buffer, (size_t)bytes_received,
+                                              MARKET_PORT, &payload_len);
+        if (payload) {
+            handle_market_data(ctx, FEED_LINE_A, payload, payload_len, rx_ns);
+            handled++;
+        }
+    }
+    
+    return handled;
+}
+
+// Drain the B line's UDP socket, returns messages handled
+int poll_line_b(int line_b_sock, trading_context_t *ctx) {
+    char buffer[PACKET_BUFFER_SIZE];
+    int handled = 0;
+    
+    for (int n = 0; n < XSK_RX_BATCH; n++) {
+        ssize_t bytes_received = recv(line_b_sock, buffer, sizeof(buffer), 0);
+        if (bytes_received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("recv (line B)");
+                return -1;
+            }
+            break;
+        }
+        handle_market_data(ctx, FEED_LINE_B, buffer, (size_t)bytes_received, get_timestamp_ns());
+        handled++;
+    }
+    
+    return handled;
+}
+
+// Risk control thread: applies limit changes typed on stdin
+//   halt | resume
+//   rate <orders_per_sec> <burst>
+//   limit <symbol> <max_position> <max_notional_usd> <max_order_qty> <band_bps>
+void *control_thread(void *arg) {
+    (void)arg;
+    char line[256];
+    
+    while (fgets(line, sizeof(line), stdin)) {
+        char symbol[16];
+        unsigned rate, burst;
+        long long position, notional, qty, band;
+        
+        if (strncmp(line, "halt", 4) == 0) {
+            risk_halt(&risk, 1);
+            printf("Risk: trading halted\n");
+        } else if (strncmp(line, "resume", 6) == 0) {
+            risk_halt(&risk, 0);
+            printf("Risk: trading resumed\n");
+        } else if (sscanf(line, "rate %u %u", &rate, &burst) == 2) {
+            risk_set_rate(&risk, rate, burst);
+            printf("Risk: order rate %u/s, burst %u\n", rate, burst);
+        } else if (sscanf(line, "limit %15s %lld %lld %lld %lld",
+                          symbol, &position, &notional, &qty, &band) == 5) {
+            int idx = risk_find_symbol(&risk, symbol);
+            if (idx < 0) {
+                printf("Risk: unknown symbol %s\n", symbol);
+                continue;
+            }
+            risk_limits_t limits = { position, notional * PRICE_SCALE, qty, band };
+            risk_set_limits(&risk, idx, &limits);
+            printf("Risk: %s limits updated\n", symbol);
+        } else {
+            printf("Risk commands: halt | resume | rate <n> <burst> | "
+                   "limit <sym> <pos> <notional> <qty> <band_bps>\n");
+        }
+    }
+    
+    return NULL;
+}
+
 // Display performance metrics
-void display_metrics() {
+void display_metrics(feed_mode_t mode, const xsk_socket_t *xsk) {
+    static const char *mode_names[] = { "udp", "packet", "xdp" };
+    
     printf("\n=== Performance Metrics ===\n");
+    printf("Feed mode: %s", mode_names[mode]);
+    if (mode == FEED_XDP) {
+        printf(" (%s)", xsk_mode_name(xsk));
+    }
+    printf("\n");
     printf("Packets received: %lu\n", metrics.packets_received);
     printf("Orders sent: %lu\n", metrics.orders_sent);
     
@@ -382,13 +904,173 @@ void display_metrics() {
         printf("Average latency: %.3f µs\n", 
             (metrics.total_latency_ns / metrics.latency_samples) / 1000.0);
     }
+    
+    printf("Exchange replies: %lu acks, %lu fills, %lu rejects\n",
+        metrics.acks_received, metrics.fills_received, metrics.rejects_received);
+    printf("Risk rejects: %lu (order rate %lu)\n", metrics.risk_rejects, risk.rate_rejects);
+    for (int i = 0; i < num_symbols; i++) {
+        const risk_symbol_t *rs = &risk.symbols[i];
+        if (rs->position || rs->open_buy || rs->rejects) {
+            printf("  %-8s position %lld, open %lld, risk rejects %lu\n", market_data[i].symbol,
+                (long long)rs->position, (long long)rs->open_buy, rs->rejects);
+        }
+    }
+    
+    char label[64];
+    snprintf(label, sizeof(label), "Feed latency (%s)", mode_names[mode]);
+    latency_histogram_print(&feed_latency, label);
+    latency_histogram_print(&order_rtt, "Order-to-ack round trip");
+    latency_histogram_print(&tick_to_trade, "Tick-to-trade");
+    printf("Order path warm-ups: %lu%s\n", metrics.warmups, warmup_enabled ? "" : " (disabled)");
+    if (snapshot_enabled) {
+        printf("Book snapshots: %lu taken, %lu records copied, %llu messages logged\n",
+            book_snap.snapshots, book_snap.records_copied,
+            (unsigned long long)atomic_load(&book_snap.hdr->log_seq));
+        latency_histogram_print(&snapshot_time, "Snapshot time");
+    }
+    
+    if (order_journal.hdr) {
+        const session_stats_t *ss = &order_session.stats;
+        printf("Order session %016llx: sent up to %u, received up to %u\n",
+            (unsigned long long)order_journal.hdr->session_id, order_journal.hdr->out_seq,
+            order_journal.hdr->in_next - 1);
+        printf("  %lu logons, %lu disconnects, %lu heartbeats in/%lu out, %lu resent, "
+            "%lu resend requests, %lu duplicates, %lu orders skipped while down\n",
+            ss->logons, ss->disconnects, ss->heartbeats_in, ss->heartbeats_out, ss->resent,
+            ss->gaps, ss->duplicates, metrics.session_down);
+    }
+    
+    if (arbiter.delivered) {
+        printf("Feed arbitration: %lu delivered, %lu gaps filled late, %lu missing on both lines, %lu stale\n",
+            arbiter.delivered, arbiter.recovered, arbiter.missing, arbiter.stale);
+        for (int l = 0; l < (line_b_enabled ? FEED_ARB_LINES : 1); l++) {
+            const feed_line_stats_t *ls = &arbiter.line[l];
+            printf("  Line %c: %lu received, %lu won (%.1f%%), %lu duplicates, %lu gaps (%lu messages)",
+                'A' + l, ls->received, ls->won,
+                ls->received ? 100.0 * ls->won / ls->received : 0.0,
+                ls->duplicates, ls->gaps, ls->gap_messages);
+            if (ls->duplicates) {
+                printf(", lag behind winner avg %.3f µs max %.3f µs",
+                    (double)ls->lag_total_ns / ls->duplicates / 1000.0, ls->lag_max_ns / 1000.0);
+            }
+            printf("\n");
+        }
+        if (line_b_enabled) {
+            latency_histogram_print(&line_latency[FEED_LINE_A], "Line A latency");
+            latency_histogram_print(&line_latency[FEED_LINE_B], "Line B latency");
+        }
+    }
+    
+    if (mode == FEED_XDP) {
+        struct xdp_statistics stats;
+        if (xsk_get_stats(xsk, &stats) == 0) {
+            printf("XDP drops: %llu (rx ring full %llu, fill ring empty %llu)\n",
+                (unsigned long long)stats.rx_dropped,
+                (unsigned long long)stats.rx_ring_full,
+                (unsigned long long)stats.rx_fill_ring_empty_descs);
+        }
+    }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    feed_mode_t mode = FEED_PACKET;
+    const char *interface_name = INTERFACE_NAME;
+    uint32_t queue_id = 0;
+    int force_skb = 0;
+    int busy_poll = 0;
+    const char *exchange_ip = EXCHANGE_IP;
+    int exchange_port = EXCHANGE_PORT;
+    const char *ring_name = NULL;
+    const char *line_b_interface = NULL;
+    const char *journal_path = NULL;
+    const char *snapshot_path = NULL;
+    int line_b_port = MARKET_PORT_B;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "udp") == 0) {
+                mode = FEED_UDP;
+            } else if (strcmp(name, "packet") == 0) {
+                mode = FEED_PACKET;
+            } else if (strcmp(name, "xdp") == 0) {
+                mode = FEED_XDP;
+            } else {
+                fprintf(stderr, "Unknown feed mode: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            interface_name = argv[++i];
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            queue_id = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0) {
+            force_skb = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            busy_poll = 1;
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            exchange_ip = argv[++i];
+        } else if (strcmp(argv[i], "-X") == 0 && i + 1 < argc) {
+            exchange_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            ring_name = argv[++i];
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            journal_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (strcmp(argv[i], "-W") == 0) {
+            warmup_enabled = 0;
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            line_b_interface = argv[++i];
+        } else if (strcmp(argv[i], "-Q") == 0 && i + 1 < argc) {
+            line_b_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [-m udp|packet|xdp] [-i interface] [-q queue] [-S] [-b] [-x ip] [-X port] [-R ring] [-B interface] [-Q port] [-W] [-T journal] [-s snapshot]\n", argv[0]);
+            printf("  -m mode     : Market data ingest mode (default: packet)\n");
+            printf("  -i interface: Feed interface (default: %s)\n", INTERFACE_NAME);
+            printf("  -q queue    : RX queue for AF_XDP (default: 0)\n");
+            printf("  -S          : Force generic/SKB XDP mode\n");
+            printf("  -b          : Busy-poll instead of sleeping in poll()\n");
+            printf("  -x ip       : Exchange address (default: %s)\n", EXCHANGE_IP);
+            printf("  -X port     : Exchange order port (default: %d)\n", EXCHANGE_PORT);
+            printf("  -R ring     : Publish book updates to a shm ring (\"/name\", or \"-\" for memfd)\n");
+            printf("  -B interface: Also read the B line (%s) on this interface and arbitrate A/B\n", MARKET_IP_B);
+            printf("  -Q port     : B line port (default: %d)\n", MARKET_PORT_B);
+            printf("  -W          : Disable dry-run warm-up of the order path\n");
+            printf("  -T journal  : Send orders over a TCP session, journaled to this file\n");
+            printf("  -s snapshot : Snapshot the book to this file and recover from it on restart\n");
+            return 0;
+        }
+    }
+    
     // Set up signal handling for graceful shutdown
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
     
+    latency_histogram_init(&feed_latency);
+    latency_histogram_init(&order_rtt);
+    latency_histogram_init(&tick_to_trade);
+    latency_histogram_init(&snapshot_time);
+    latency_histogram_init(&line_latency[FEED_LINE_A]);
+    latency_histogram_init(&line_latency[FEED_LINE_B]);
+    feed_arb_init(&arbiter);
+    
+    // Pre-trade risk limits, adjustable at runtime from the control thread
+    risk_limits_t default_limits = {
+        .max_position = RISK_MAX_POSITION,
+        .max_notional = (int64_t)RISK_MAX_NOTIONAL_USD * PRICE_SCALE,
+        .max_order_qty = RISK_MAX_ORDER_QTY,
+        .price_band_bps = RISK_PRICE_BAND_BPS
+    };
+    if (risk_engine_init(&risk, &default_limits, RISK_ORDERS_PER_SEC, RISK_ORDER_BURST) < 0) {
+        fprintf(stderr, "Failed to initialize risk engine\n");
+        return 1;
+    }
+    pthread_t control;
+    if (pthread_create(&control, NULL, control_thread, NULL) == 0) {
+        pthread_detach(control);
+    }
+    
     // Lock memory to prevent paging
     if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
         perror("mlockall");
@@ -399,84 +1081,217 @@ int main() {
     // This would typically be done with sched_setaffinity()
     
     // Configure interface for low latency
-    if (configure_interface_low_latency(INTERFACE_NAME) < 0) {
+    if (configure_interface_low_latency(interface_name) < 0) {
         fprintf(stderr, "Warning: Could not configure interface for low latency\n");
     }
     
-    // Set up raw socket for market data
-    int market_sock = setup_market_data_socket(INTERFACE_NAME);
-    if (market_sock < 0) {
-        fprintf(stderr, "Failed to set up market data socket\n");
-        return 1;
+    // Set up the market data source for the selected mode
+    int market_sock = -1;
+    xsk_socket_t xsk;
+    memset(&xsk, 0, sizeof(xsk));
+    xsk.fd = xsk.prog_fd = xsk.map_fd = -1;
+    
+    if (mode == FEED_XDP) {
+        if (xsk_socket_open(&xsk, interface_name, queue_id, MARKET_PORT, force_skb, busy_poll) < 0) {
+            fprintf(stderr, "Failed to set up AF_XDP socket\n");
+            return 1;
+        }
+        printf("AF_XDP socket on %s queue %u (%s)\n", interface_name, queue_id, xsk_mode_name(&xsk));
+    } else {
+        market_sock = mode == FEED_UDP ? setup_market_data_udp_socket(interface_name, MARKET_IP, MARKET_PORT)
+                                       : setup_market_data_socket(interface_name);
+        if (market_sock < 0) {
+            fprintf(stderr, "Failed to set up market data socket\n");
+            return 1;
+        }
+        if (busy_poll) {
+            int usecs = XSK_BUSY_POLL_USECS;
+            setsockopt(market_sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+        }
     }
     
-    // Set up UDP socket for sending orders
-    int order_sock = setup_order_socket(EXCHANGE_IP, EXCHANGE_PORT);
-    if (order_sock < 0) {
-        fprintf(stderr, "Failed to set up order socket\n");
-        close(market_sock);
-        return 1;
+    // Redundant B line, always through the kernel UDP stack
+    int line_b_sock = -1;
+    if (line_b_interface) {
+        line_b_sock = setup_market_data_udp_socket(line_b_interface, MARKET_IP_B, line_b_port);
+        if (line_b_sock < 0) {
+            fprintf(stderr, "Failed to set up B line socket\n");
+            if (market_sock >= 0) {
+                close(market_sock);
+            }
+            xsk_socket_close(&xsk);
+            return 1;
+        }
+        if (busy_poll) {
+            int usecs = XSK_BUSY_POLL_USECS;
+            setsockopt(line_b_sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+        }
+        line_b_enabled = 1;
+        printf("Arbitrating A/B lines (B: %s:%d on %s)\n", MARKET_IP_B, line_b_port, line_b_interface);
+    }
+    
+    // Order entry: UDP datagrams, or a journaled TCP session (-T)
+    trading_context_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.order_sock = -1;
+    uint64_t last_connect_ns = get_timestamp_ns();
+    if (journal_path) {
+        // A new journal gets a fresh session ID; a recovered one resumes its session
+        if (order_journal_open(&order_journal, journal_path, SESSION_JOURNAL_SLOTS, last_connect_ns) < 0) {
+            LOG_ERRNO("Failed to open order journal %s", journal_path);
+            if (market_sock >= 0) {
+                close(market_sock);
+            }
+            xsk_socket_close(&xsk);
+            return 1;
+        }
+        order_session_init(&order_session, &order_journal, SESSION_HEARTBEAT_MS);
+        ctx.session = &order_session;
+        printf("%s order journal %s (session %016llx, %u messages sent, next in %u)\n",
+            order_journal.recovered ? "Recovered" : "Created", journal_path,
+            (unsigned long long)order_journal.hdr->session_id, order_journal.hdr->out_seq,
+            order_journal.hdr->in_next);
+        if (order_session_connect(&order_session, exchange_ip, exchange_port, last_connect_ns) < 0) {
+            LOG_ERRNO("Order session connect failed, retrying");
+        }
+    } else {
+        ctx.order_sock = setup_order_socket(exchange_ip, exchange_port);
+        if (ctx.order_sock < 0) {
+            fprintf(stderr, "Failed to set up order socket\n");
+            if (market_sock >= 0) {
+                close(market_sock);
+            }
+            xsk_socket_close(&xsk);
+            return 1;
+        }
     }
     
     // Prepare address for sending orders
-    struct sockaddr_in exchange_addr;
-    memset(&exchange_addr, 0, sizeof(exchange_addr));
-    exchange_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, EXCHANGE_IP, &exchange_addr.sin_addr);
-    exchange_addr.sin_port = htons(EXCHANGE_PORT);
+    ctx.exchange_addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, exchange_ip, &ctx.exchange_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid exchange address: %s\n", exchange_ip);
+        return 1;
+    }
+    ctx.exchange_addr.sin_port = htons(exchange_port);
+    
+    // Shared-memory fan-out for strategy processes
+    if (ring_name) {
+        const char *shm_name = strcmp(ring_name, "-") == 0 ? NULL : ring_name;
+        if (shm_ring_create(&md_ring, shm_name, MD_RING_SLOTS, sizeof(md_update_t)) < 0) {
+            perror("shm_ring_create");
+            return 1;
+        }
+        md_ring_enabled = 1;
+        if (shm_name) {
+            printf("Publishing book updates to shared memory ring %s\n", shm_name);
+        } else {
+            printf("Publishing book updates to memfd ring /proc/%d/fd/%d\n", (int)getpid(), md_ring.fd);
+        }
+    }
+    
+    // Book snapshot file: reload the last book before taking live data
+    if (snapshot_path) {
+        if (book_snapshot_open(&book_snap, snapshot_path, sizeof(market_data_t), MAX_SYMBOLS,
+                               SNAPSHOT_LOG_SLOTS, SNAPSHOT_MAX_MESSAGE) < 0) {
+            LOG_ERRNO("Failed to open book snapshot %s", snapshot_path);
+            return 1;
+        }
+        snapshot_enabled = 1;
+        if (book_snap.recovered) {
+            recover_book();
+        }
+        last_snapshot_ns = get_timestamp_ns();
+    }
     
     printf("Low-latency trading system initialized\n");
-    printf("Monitoring market data on interface %s\n", INTERFACE_NAME);
-    printf("Sending orders to %s:%d\n", EXCHANGE_IP, EXCHANGE_PORT);
+    printf("Monitoring market data on interface %s\n", interface_name);
+    printf("Sending orders to %s:%d (%s)\n", exchange_ip, exchange_port,
+        ctx.session ? "TCP session" : "UDP");
     printf("Press Ctrl+C to exit\n\n");
     
-    // Buffer for receiving market data
-    char buffer[PACKET_BUFFER_SIZE];
+    struct pollfd pfds[3] = {
+        { .fd = mode == FEED_XDP ? xsk.fd : market_sock, .events = POLLIN },
+        { .fd = ctx.order_sock, .events = POLLIN },
+        { .fd = line_b_sock, .events = POLLIN }
+    };
     
     // Main trading loop
     while (keep_running) {
-        // Receive market data packets
-        ssize_t bytes_received = recv(market_sock, buffer, sizeof(buffer), 0);
+        int handled = poll_market_data(mode, market_sock, &xsk, &ctx);
+        if (handled < 0) {
+            break;
+        }
+        if (line_b_sock >= 0) {
+            int handled_b = poll_line_b(line_b_sock, &ctx);
+            if (handled_b < 0) {
+                break;
+            }
+            handled += handled_b;
+        }
+        handle_exchange_messages(&ctx);
         
-        if (bytes_received > 0) {
-            // Skip Ethernet, IP and UDP headers
-            // In a real system, we would parse these headers
-            const size_t header_size = 14 + 20 + 8;  // Ethernet + IP + UDP
-            
-            if (bytes_received > header_size) {
-                // Update metrics
-                metrics.packets_received++;
-                
-                // Process market data
-                parse_market_data(buffer + header_size, bytes_received - header_size);
-                
-                // Check trading signals
-                for (int i = 0; i < num_symbols; i++) {
-                    if (should_execute_trade(&market_data[i])) {
-                        // Execute trade
-                        send_trading_order(order_sock, &exchange_addr, &market_data[i]);
-                    }
-                }
+        // Reconnect a dropped order session
+        if (ctx.session && order_session.state == SESSION_DISCONNECTED) {
+            uint64_t now = get_timestamp_ns();
+            if (now - last_connect_ns >= SESSION_RETRY_NS) {
+                last_connect_ns = now;
+                order_session_connect(&order_session, exchange_ip, exchange_port, now);
+            }
+        }
+        
+        // Snapshot between messages; a long backlog forces one early
+        if (snapshot_enabled && book_snapshot_backlog(&book_snap) > 0) {
+            uint64_t now = get_timestamp_ns();
+            if (now - last_snapshot_ns >= SNAPSHOT_INTERVAL_NS ||
+                book_snapshot_backlog(&book_snap) >= SNAPSHOT_LOG_SLOTS / 2) {
+                take_book_snapshot(now);
             }
-        } else if (bytes_received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-            // Handle error
-            perror("recv");
-            break;
         }
         
-        // Small delay to prevent CPU hogging in this example
-        // In a real HFT system, we would use busy-waiting or event-driven approach
-        usleep(100);
+        // Keep the order path warm while no orders are going out
+        if (handled == 0 && warmup_enabled &&
+            get_timestamp_ns() - last_order_path_ns >= WARMUP_INTERVAL_NS) {
+            warm_order_path(&ctx);
+        }
+        
+        // Busy-polling spins on the rings; otherwise sleep until data arrives
+        if (handled == 0 && !busy_poll) {
+            if (ctx.session) {
+                pfds[1].fd = order_session.fd;
+                pfds[1].events = order_session_events(&order_session);
+            }
+            poll(pfds, 3, warmup_enabled ? WARMUP_INTERVAL_NS / 1000000 : 100);
+        }
     }
     
     // Display performance metrics
-    display_metrics();
+    display_metrics(mode, &xsk);
     
     // Clean up
-    close(market_sock);
-    close(order_sock);
+    if (market_sock >= 0) {
+        close(market_sock);
+    }
+    if (line_b_sock >= 0) {
+        close(line_b_sock);
+    }
+    xsk_socket_close(&xsk);
+    if (ctx.session) {
+        order_session_logout(&order_session, get_timestamp_ns());
+        order_journal_close(&order_journal);
+    } else {
+        close(ctx.order_sock);
+    }
+    risk_engine_destroy(&risk);
+    if (md_ring_enabled) {
+        shm_ring_close(&md_ring);
+    }
+    if (snapshot_enabled) {
+        // A final snapshot leaves nothing to replay on the next start
+        take_book_snapshot(get_timestamp_ns());
+        book_snapshot_close(&book_snap);
+    }
     
     printf("Low-latency trading system shut down\n");
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,230 @@
+/**
+ * @file md_subscriber.c
+ * @brief Strategy-side reader of the shared-memory market data ring
+ *
+ * Attaches read-only to the book update ring published by
+ * `low_latency_trading -R <ring>` and follows it with a private cursor.
+ * Any number of subscribers can run at once; the feed handler's cost does
+ * not change with their count. Reports throughput and laps (messages
+ * overwritten before this reader got to them) every second, and on exit
+ * the handler-to-strategy latency and the latest quote per symbol.
+ *
+ * With -c, a strategy thread that takes the given time per update runs
+ * behind a conflator (conflator.h). The reader still takes every update
+ * off the ring at full speed, so it is never lapped. The strategy gets the
+ * latest quote of each symbol that changed, and intermediate updates are
+ * counted as conflated. Nothing queues up between the two.
+ *
+ * Usage: md_subscriber -R /market_data [-b] [-c usec]
+ *        md_subscriber -R /proc/<pid>/fd/<n>   (memfd ring)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "error_handling.h"
+#include "trading_protocol.h"
+#include "shm_ring.h"
+#include "latency_histogram.h"
+#include "conflator.h"
+
+#define DEFAULT_RING "/market_data"     // shm name used with -R /market_data
+#define MAX_SYMBOLS 256                 // Quotes tracked for the summary
+#define IDLE_SLEEP_NS 50000             // Back-off when the ring is empty
+
+// Flag for graceful shutdown
+static volatile int keep_running = 1;
+
+// Slow strategy behind a conflator (-c)
+static conflator_t strategy_feed;
+static uint64_t strategy_cost_ns = 0;
+static latency_histogram_t strategy_latency;
+
+// Signal handler for graceful shutdown
+void handle_signal(int sig) {
+    printf("\nReceived signal %d, shutting down...\n", sig);
+    keep_running = 0;
+}
+
+// Get current time in nanoseconds (same clock as the feed handler)
+uint64_t get_timestamp_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// Strategy thread: handles the latest quote of each changed symbol, taking
+// strategy_cost_ns per update; feed-handler-to-decision latency includes
+// the time the quote waited for the strategy
+void *strategy_thread(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, IDLE_SLEEP_NS };
+    
+    while (keep_running) {
+        uint32_t key;
+        md_update_t update;
+        if (!conflator_poll(&strategy_feed, &key, &update)) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        uint64_t start = get_timestamp_ns();
+        while (get_timestamp_ns() - start < strategy_cost_ns) {
+            // Simulated decision work
+        }
+        uint64_t now = get_timestamp_ns();
+        if (now >= update.feed_ns) {
+            latency_histogram_record(&strategy_latency, now - update.feed_ns);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *ring_name = DEFAULT_RING;
+    int busy_poll = 0;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            ring_name = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0) {
+            busy_poll = 1;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            strategy_cost_ns = (uint64_t)atol(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [-R ring] [-b] [-c usec]\n", argv[0]);
+            printf("  -R ring : shm name or /proc/<pid>/fd/<n> path (default: %s)\n", DEFAULT_RING);
+            printf("  -b      : Busy-poll instead of sleeping when the ring is empty\n");
+            printf("  -c usec : Run a strategy taking this long per update behind a conflator\n");
+            return 0;
+        }
+    }
+
+    // Set up signal handling for graceful shutdown
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    shm_ring_t ring;
+    if (shm_ring_attach(&ring, ring_name) < 0) {
+        LOG_ERRNO("Failed to attach to ring %s", ring_name);
+        return 1;
+    }
+    pid_t writer = (pid_t)ring.hdr->writer_pid;
+    printf("Attached to %s (%u slots, writer pid %d)\n", ring_name, ring.hdr->slot_count, (int)writer);
+
+    md_update_t latest[MAX_SYMBOLS];
+    memset(latest, 0, sizeof(latest));
+    latency_histogram_t handler_latency, wire_latency;
+    latency_histogram_init(&handler_latency);
+    latency_histogram_init(&wire_latency);
+
+    // Slow consumer, fed the latest quote per symbol
+    pthread_t strategy;
+    int strategy_running = 0;
+    if (strategy_cost_ns) {
+        latency_histogram_init(&strategy_latency);
+        if (conflator_init(&strategy_feed, MAX_SYMBOLS, sizeof(md_update_t)) < 0) {
+            LOG_ERRNO("Failed to create conflator");
+            shm_ring_close(&ring);
+            return 1;
+        }
+        if (pthread_create(&strategy, NULL, strategy_thread, NULL) != 0) {
+            fprintf(stderr, "Failed to start strategy thread\n");
+            conflator_destroy(&strategy_feed);
+            shm_ring_close(&ring);
+            return 1;
+        }
+        strategy_running = 1;
+        printf("Strategy takes %lu µs per update, conflated by symbol\n", strategy_cost_ns / 1000);
+    }
+    
+    uint64_t received = 0, interval_received = 0, interval_lost = 0;
+    uint64_t interval_delivered = 0, interval_conflated = 0;
+    uint64_t next_report = get_timestamp_ns() + 1000000000ULL;
+    struct timespec idle = { 0, IDLE_SLEEP_NS };
+
+    while (keep_running) {
+        md_update_t update;
+        int len = shm_ring_read(&ring, &update, sizeof(update));
+
+        if (len == (int)sizeof(update)) {
+            uint64_t now = get_timestamp_ns();
+            received++;
+            if (now >= update.feed_ns) {
+                latency_histogram_record(&handler_latency, now - update.feed_ns);
+            }
+            if (update.exchange_ns && now >= update.exchange_ns) {
+                latency_histogram_record(&wire_latency, now - update.exchange_ns);
+            }
+            if (update.symbol_index < MAX_SYMBOLS) {
+                latest[update.symbol_index] = update;
+                if (strategy_running) {
+                    conflator_publish(&strategy_feed, update.symbol_index, &update);
+                }
+            }
+            if (received % 1024) {
+                continue;
+            }
+        }
+
+        // Report once a second and check the writer is still there
+        uint64_t now = get_timestamp_ns();
+        if (now >= next_report) {
+            printf("%lu updates/s, %lu lost, %lu total",
+                   received - interval_received, ring.lost - interval_lost, received);
+            if (strategy_running) {
+                uint64_t delivered = atomic_load(&strategy_feed.delivered);
+                uint64_t conflated = atomic_load(&strategy_feed.conflated);
+                printf("; strategy %lu/s, %lu conflated", delivered - interval_delivered,
+                       conflated - interval_conflated);
+                interval_delivered = delivered;
+                interval_conflated = conflated;
+            }
+            printf("\n");
+            interval_received = received;
+            interval_lost = ring.lost;
+            next_report = now + 1000000000ULL;
+
+            if (kill(writer, 0) < 0 && errno == ESRCH) {
+                printf("Feed handler exited\n");
+                break;
+            }
+        }
+        if (len <= 0 && !busy_poll) {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    keep_running = 0;
+    if (strategy_running) {
+        pthread_join(strategy, NULL);
+    }
+    
+    printf("\n=== Subscriber Statistics ===\n");
+    printf("Updates received: %lu, lost to laps: %lu\n", received, ring.lost);
+    latency_histogram_print(&handler_latency, "Feed handler to strategy");
+    latency_histogram_print(&wire_latency, "Exchange to strategy");
+    if (strategy_running) {
+        printf("Slow strategy: %llu of %llu updates handled, %llu conflated, %llu pending\n",
+               (unsigned long long)strategy_feed.delivered, (unsigned long long)strategy_feed.published,
+               (unsigned long long)strategy_feed.conflated,
+               (unsigned long long)conflator_pending(&strategy_feed));
+        latency_histogram_print(&strategy_latency, "Feed handler to slow strategy decision");
+        conflator_destroy(&strategy_feed);
+    }
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        if (latest[i].feed_ns) {
+            printf("  %-8.8s last %.4f  bid %.4f  ask %.4f  volume %u\n", latest[i].symbol,
+                   TICKS_TO_PRICE(latest[i].last_price), TICKS_TO_PRICE(latest[i].bid),
+                   TICKS_TO_PRICE(latest[i].ask), latest[i].volume);
+        }
+    }
+
+    shm_ring_close(&ring);
+    return 0;
+}
@@ -6,14 +6,32 @@
  * for managing industrial equipment using TLS/SSL encryption.
  * 
  * Note: This example requires OpenSSL development libraries.
- * To compile with gcc directly: 
- *   gcc -o secure_command_server secure_command_server.c -lssl -lcrypto
+ * CMake builds it when OpenSSL is found. To compile with gcc directly:
+ *   gcc -DENABLE_TLS -Iinclude -o secure_command_server secure_command_server.c -lssl -lcrypto -lpthread
+ *
+ * Commands are dispatched through a perfect-hash table and may be
+ * pipelined (command_protocol.h): a client can send many commands in one
+ * TLS record without waiting for replies. Every record already received is
+ * processed before the replies go back in one SSL_write(), so a bulk push
+ * of thousands of `set` commands costs a few round trips instead of one
+ * per command.
+ *
+ * `set` and `get` work on a parameter store (param_store.h) shared by all
+ * client threads: gets take no lock, sets lock one stripe of the table.
+ * Each set is journaled to PARAM_JOURNAL, which is replayed at startup.
+ * Before a batch of replies is sent, the journal is synced up to the
+ * client's last set, so an acknowledged set survives a crash. Clients
+ * sending at the same time share one sync. `save` compacts the journal,
+ * `dump` writes every parameter to PARAM_DUMP_FILE as set commands and
+ * `load` applies that file. A dump is written to a temporary file and
+ * renamed into place, so `load` never reads a partial one.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -22,6 +40,8 @@
 #include "socket_utils.h"
 #include "error_handling.h"
 #include "config.h"
+#include "command_protocol.h"
+#include "param_store.h"
 
 // Check if TLS is enabled in configuration
 #ifdef ENABLE_TLS
@@ -32,20 +52,17 @@
 #define COMMAND_PORT 8443
 #define MAX_CLIENTS 10
 #define BUFFER_SIZE 1024
+#define READ_SIZE 16384  // One full TLS record
 #define CERT_FILE "server.crt"
 #define KEY_FILE "server.key"
 #define CA_FILE "ca.crt"  // For client certificate verification
+#define PARAM_JOURNAL "params.journal"
+#define PARAM_DUMP_FILE "params.dump"
+#define PARAM_CAPACITY 65536
 
 // Flag for graceful shutdown
 static volatile int keep_running = 1;
 
-// Command handler structure
-typedef struct {
-    const char *command;
-    const char *description;
-    const char *(*handler)(const char *args);
-} command_handler_t;
-
 // SSL context and client information
 typedef struct {
     SSL *ssl;
@@ -53,12 +70,20 @@ typedef struct {
     pthread_t thread;
     char client_ip[INET_ADDRSTRLEN];
     int client_port;
+    cmd_session_t session;   // Pipelined command state and reply batch
+    uint64_t pending_lsn;    // Journal position of the last set, synced before replying
 } client_info_t;
 
 // Client connections
 client_info_t clients[MAX_CLIENTS];
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Parameters, shared by all clients
+static param_store_t params;
+
+// One dump or save at a time
+static pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 // Signal handler for graceful shutdown
 void handle_signal(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
@@ -139,123 +164,198 @@ void configure_ssl_context(SSL_CTX *ctx) {
 // Example command handlers
 
 // Status command
-const char *handle_status(const char *args) {
-    return "System status: ONLINE\nTemperature: 72.5°F\nPressure: 1013.2 hPa\nHumidity: 45.3%";
+int handle_status(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "System status: ONLINE\nTemperature: 72.5°F\nPressure: 1013.2 hPa\nHumidity: 45.3%%");
+    return CMD_CONTINUE;
 }
 
 // Reboot command
-const char *handle_reboot(const char *args) {
-    return "Initiating system reboot sequence...";
+int handle_reboot(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "Initiating system reboot sequence...");
     // In a real system, this would trigger a reboot
+    return CMD_CONTINUE;
 }
 
 // Shutdown command
-const char *handle_shutdown(const char *args) {
-    return "Initiating system shutdown sequence...";
+int handle_shutdown(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "Initiating system shutdown sequence...");
     // In a real system, this would trigger a shutdown
+    return CMD_CONTINUE;
 }
 
 // Set parameter command
-const char *handle_set(const char *args) {
-    if (!args || !*args) {
-        return "Error: Parameter name and value required";
+int handle_set(void *ctx, const char *args, cmd_out_t *out) {
+    client_info_t *client = (client_info_t *)ctx;
+    size_t name_len = args ? strcspn(args, " \t") : 0;
+    if (!args || !args[name_len]) {
+        cmd_printf(out, "Error: Parameter name and value required");
+        return CMD_CONTINUE;
     }
     
-    static char response[BUFFER_SIZE];
-    snprintf(response, sizeof(response), "Setting parameter: %s", args);
-    return response;
+    const char *value = args + name_len + strspn(args + name_len, " \t");
+    uint64_t lsn;
+    if (ps_put(&params, args, name_len, value, strlen(value), &lsn) < 0) {
+        if (errno == EINVAL) {
+            cmd_printf(out, "Error: Name or value too long (limits %d and %d bytes)", PS_MAX_KEY - 1,
+                PS_MAX_VALUE - 1);
+        } else if (errno == ENOSPC) {
+            cmd_printf(out, "Error: Parameter store full");
+        } else {
+            cmd_printf(out, "Error: Parameter journal failed: %s", strerror(errno));
+        }
+        return CMD_CONTINUE;
+    }
+    
+    // Acknowledged only once the batch's replies are sent, after the journal sync
+    if (lsn > client->pending_lsn) {
+        client->pending_lsn = lsn;
+    }
+    cmd_printf(out, "Setting parameter: %s", args);
+    return CMD_CONTINUE;
 }
 
 // Get parameter command
-const char *handle_get(const char *args) {
-    if (!args || !*args) {
-        return "Error: Parameter name required";
+int handle_get(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    if (!args) {
+        cmd_printf(out, "Error: Parameter name required");
+        return CMD_CONTINUE;
     }
     
-    static char response[BUFFER_SIZE];
-    snprintf(response, sizeof(response), "Parameter %s = 42.0", args);
-    return response;
+    char value[PS_MAX_VALUE];
+    if (ps_get(&params, args, value, sizeof(value)) < 0) {
+        cmd_printf(out, "Error: Parameter %s not set", args);
+        return CMD_CONTINUE;
+    }
+    
+    cmd_printf(out, "Parameter %s = %s", args, value);
+    return CMD_CONTINUE;
+}
+
+// Dump command: every parameter to PARAM_DUMP_FILE, as set commands
+int handle_dump(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    pthread_mutex_lock(&files_mutex);
+    FILE *f = fopen(PARAM_DUMP_FILE ".tmp", "w");
+    long count = f ? ps_dump(&params, f) : -1;
+    if (f && count >= 0 && fdatasync(fileno(f)) < 0) {
+        count = -1;
+    }
+    if (f && fclose(f) != 0) {
+        count = -1;
+    }
+    if (count >= 0 && (rename(PARAM_DUMP_FILE ".tmp", PARAM_DUMP_FILE) < 0 || ps_sync_dir(PARAM_DUMP_FILE) < 0)) {
+        count = -1;
+    }
+    int err = errno;
+    if (f && count < 0) {
+        unlink(PARAM_DUMP_FILE ".tmp");
+    }
+    pthread_mutex_unlock(&files_mutex);
+    
+    if (count < 0) {
+        cmd_printf(out, "Error: Dump to %s failed: %s", PARAM_DUMP_FILE, strerror(err));
+    } else {
+        cmd_printf(out, "Dumped %ld parameters to %s", count, PARAM_DUMP_FILE);
+    }
+    return CMD_CONTINUE;
+}
+
+// Load command: apply the set commands in PARAM_DUMP_FILE
+int handle_load(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    FILE *f = fopen(PARAM_DUMP_FILE, "r");
+    long count = f ? ps_load(&params, f) : -1;
+    int err = errno;
+    if (f) {
+        fclose(f);
+    }
+    
+    // ps_load() commits, so the loaded values are durable before the reply
+    if (count < 0) {
+        cmd_printf(out, "Error: Load from %s failed: %s", PARAM_DUMP_FILE, strerror(err));
+    } else {
+        cmd_printf(out, "Loaded %ld parameters from %s", count, PARAM_DUMP_FILE);
+    }
+    return CMD_CONTINUE;
+}
+
+// Save command: compact the journal to one record per parameter
+int handle_save(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    pthread_mutex_lock(&files_mutex);
+    long count = ps_checkpoint(&params);
+    int err = errno;
+    pthread_mutex_unlock(&files_mutex);
+    if (count < 0) {
+        cmd_printf(out, "Error: Checkpoint failed: %s", strerror(err));
+    } else {
+        cmd_printf(out, "Saved %ld parameters", count);
+    }
+    return CMD_CONTINUE;
 }
 
 // Help command
-const char *handle_help(const char *args) {
-    static const char *help_text =
+int handle_help(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    static const char help_text[] =
         "Available commands:\n"
         "  status           - Show system status\n"
         "  reboot           - Reboot the system\n"
         "  shutdown         - Shutdown the system\n"
         "  set <param> <val>- Set parameter value\n"
         "  get <param>      - Get parameter value\n"
+        "  dump             - Write all parameters to " PARAM_DUMP_FILE "\n"
+        "  load             - Set the parameters in " PARAM_DUMP_FILE "\n"
+        "  save             - Compact the parameter journal\n"
         "  help             - Show this help text\n"
         "  quit             - Close connection";
     
-    return help_text;
+    cmd_write(out, help_text, sizeof(help_text) - 1);
+    return CMD_CONTINUE;
 }
 
-// Command table
-command_handler_t command_handlers[] = {
+// Quit command: replies, then the connection closes
+int handle_quit(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "Closing connection...");
+    return CMD_CLOSE;
+}
+
+// Command table, indexed by a perfect hash built at startup
+const cmd_def_t command_handlers[] = {
     {"status",    "Show system status",       handle_status},
     {"reboot",    "Reboot the system",        handle_reboot},
     {"shutdown",  "Shutdown the system",      handle_shutdown},
     {"set",       "Set parameter value",      handle_set},
     {"get",       "Get parameter value",      handle_get},
+    {"dump",      "Dump all parameters",      handle_dump},
+    {"load",      "Load a parameter dump",    handle_load},
+    {"save",      "Compact the journal",      handle_save},
     {"help",      "Show help text",           handle_help},
-    {NULL,        NULL,                       NULL}  // End marker
+    {"quit",      "Close connection",         handle_quit},
 };
+cmd_table_t command_table;
 
-// Process and execute a command
-const char *process_command(const char *command_line) {
-    static char response[BUFFER_SIZE];
-    
-    // Skip leading whitespace
-    while (*command_line && isspace(*command_line)) {
-        command_line++;
+// Send a batch of replies in one SSL_write(), once the sets they acknowledge are durable
+int send_replies(void *io, const char *data, size_t len) {
+    client_info_t *client = (client_info_t *)io;
+    if (ps_commit(&params, client->pending_lsn) < 0) {
+        LOG_ERRNO("Parameter journal sync failed");
+        return -1;
     }
-    
-    if (!*command_line) {
-        return ""; // Empty command, return empty response
-    }
-    
-    // Extract command and arguments
-    char cmd[BUFFER_SIZE];
-    const char *args = NULL;
-    
-    // Find first space to separate command from args
-    const char *space = strchr(command_line, ' ');
-    if (space) {
-        size_t cmd_len = space - command_line;
-        if (cmd_len >= sizeof(cmd)) {
-            cmd_len = sizeof(cmd) - 1;
-        }
-        
-        strncpy(cmd, command_line, cmd_len);
-        cmd[cmd_len] = '\0';
-        
-        // Skip whitespace after command
-        args = space + 1;
-        while (*args && isspace(*args)) {
-            args++;
-        }
-    } else {
-        strncpy(cmd, command_line, sizeof(cmd) - 1);
-        cmd[sizeof(cmd) - 1] = '\0';
-    }
-    
-    // Handle special 'quit' command
-    if (strcmp(cmd, "quit") == 0) {
-        return "Closing connection...";
-    }
-    
-    // Search for command handler
-    for (int i = 0; command_handlers[i].command != NULL; i++) {
-        if (strcmp(cmd, command_handlers[i].command) == 0) {
-            return command_handlers[i].handler(args);
-        }
-    }
-    
-    // Command not found
-    snprintf(response, sizeof(response), "Unknown command: %s\nType 'help' for available commands", cmd);
-    return response;
+    return SSL_write(client->ssl, data, (int)len) == (int)len ? 0 : -1;
 }
 
 // Handle client connections
@@ -321,36 +421,35 @@ void *handle_client(void *arg) {
                         "> ";
     SSL_write(ssl, welcome, strlen(welcome));
     
-    // Client command processing loop
-    char buffer[BUFFER_SIZE];
+    // Client command processing loop: each batch is everything already received
+    cmd_session_t *session = &client->session;
+    client->pending_lsn = 0;
+    cmd_session_init(session, &command_table, client, send_replies, client);
+    char buffer[READ_SIZE];
     int bytes;
     
-    while ((bytes = SSL_read(ssl, buffer, sizeof(buffer) - 1)) > 0) {
-        // Null-terminate the received data
-        buffer[bytes] = '\0';
+    while ((bytes = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+        int rc = cmd_session_feed(session, buffer, (size_t)bytes);
         
-        // Remove trailing newline
-        if (bytes > 0 && (buffer[bytes-1] == '\n' || buffer[bytes-1] == '\r')) {
-            buffer[--bytes] = '\0';
-        }
-        if (bytes > 0 && (buffer[bytes-1] == '\n' || buffer[bytes-1] == '\r')) {
-            buffer[--bytes] = '\0';
+        // Records the library has buffered belong to the same batch. The
+        // buffer may end in a partial record, so drain without blocking.
+        if (rc == CMD_CONTINUE && SSL_has_pending(ssl)) {
+            int flags = fcntl(client_sock, F_GETFL, 0);
+            fcntl(client_sock, F_SETFL, flags | O_NONBLOCK);
+            while (rc == CMD_CONTINUE && (bytes = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+                rc = cmd_session_feed(session, buffer, (size_t)bytes);
+            }
+            if (bytes <= 0) {
+                int ssl_error = SSL_get_error(ssl, bytes);
+                if (ssl_error == SSL_ERROR_WANT_READ || ssl_error == SSL_ERROR_WANT_WRITE) {
+                    bytes = 1;  // Nothing more received yet; not an error
+                }
+            }
+            fcntl(client_sock, F_SETFL, flags);
         }
         
-        printf("Client %s:%d sent command: %s\n", 
-            client->client_ip, client->client_port, buffer);
-        
-        // Process command
-        const char *response = process_command(buffer);
-        
-        // Send response with prompt
-        char full_response[BUFFER_SIZE + 8];
-        snprintf(full_response, sizeof(full_response), "%s\r\n> ", response);
-        
-        SSL_write(ssl, full_response, strlen(full_response));
-        
-        // Check for quit command
-        if (strncmp(buffer, "quit", 4) == 0) {
+        // Send the replies for the whole batch at once
+        if (cmd_session_flush(session) < 0 || rc != CMD_CONTINUE || bytes <= 0) {
             break;
         }
     }
@@ -365,7 +464,8 @@ void *handle_client(void *arg) {
     }
     
     // Clean up
-    printf("Client %s:%d disconnected\n", client->client_ip, client->client_port);
+    printf("Client %s:%d disconnected after %lu commands in %lu replies\n", client->client_ip,
+        client->client_port, (unsigned long)session->commands, (unsigned long)session->flushes);
     SSL_free(ssl);
     close(client_sock);
     
@@ -394,6 +494,30 @@ int main() {
     SSL_CTX *ctx = create_ssl_context();
     configure_ssl_context(ctx);
     
+    // Read whole socket buffers at once so pipelined records are batched together
+    SSL_CTX_set_read_ahead(ctx, 1);
+    
+    // Build the command dispatch table
+    if (cmd_table_build(&command_table, command_handlers,
+            sizeof(command_handlers) / sizeof(command_handlers[0])) < 0) {
+        SSL_CTX_free(ctx);
+        cleanup_openssl();
+        FATAL("Failed to build command table");
+    }
+    
+    // Recover parameters from the journal
+    if (ps_open(&params, PARAM_JOURNAL, PARAM_CAPACITY, 1) < 0) {
+        SSL_CTX_free(ctx);
+        cleanup_openssl();
+        FATAL_ERRNO("Failed to open parameter journal %s", PARAM_JOURNAL);
+    }
+    printf("Recovered %u parameters from %lu journal records", ps_count(&params),
+        (unsigned long)params.recovered);
+    if (params.truncated) {
+        printf(" (cut off %lu bytes of torn record)", (unsigned long)params.truncated);
+    }
+    printf("\n");
+    
     // Create server socket
     int server_fd = create_tcp_socket(1, 0);  // With SO_REUSEADDR, blocking mode
     if (server_fd < 0) {
@@ -529,6 +653,7 @@ int main() {
     pthread_mutex_unlock(&clients_mutex);
     
     // Clean up server
+    ps_close(&params);
     close(server_fd);
     SSL_CTX_free(ctx);
     cleanup_openssl();
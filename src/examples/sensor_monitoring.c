@@ -3,7 +3,32 @@
  * @brief IoT sensor monitoring system using UDP
  * 
  * This example demonstrates a sensor monitoring system for industrial environments.
- * It uses UDP for efficient data collection from multiple sensors.
+ * It uses UDP for efficient data collection from multiple sensors. File logging
+ * runs on a housekeeping thread fed through a lock-free channel, so the
+ * receive loop never blocks on disk I/O. Each sensor has a liveness timer in
+ * a hierarchical timing wheel (timer_wheel.h), re-armed in O(1) by every
+ * packet. A sensor is reported as silent on the tick its deadline passes,
+ * and nothing ever scans the whole sensor table. The console display
+ * runs on its own thread behind a conflator keyed by sensor (conflator.h).
+ * When the terminal cannot keep up, it shows the latest reading of every
+ * sensor that changed, and the readings in between are counted, not queued.
+ * The packet layout is defined in schemas/sensor.msg and decoded by the
+ * generated sensor_codec.h. Each sensor keeps 1 s / 1 min / 1 h min/max/avg
+ * rollups (rollup.h), updated in O(1) per reading. The statistics view on
+ * the display thread queries them without taking the sensor mutex.
+ *
+ * A query thread serves latest readings, rollups and inactive sensors as
+ * JSON over HTTP (port 8889) and a Unix socket (query_server.h), e.g.
+ * `curl localhost:8889/sensors` or `echo /inactive | nc -U /tmp/sensor_query.sock`.
+ * It reads the same lock-free snapshots, so query load does not slow ingest.
+ *
+ * Every valid packet is also forwarded upstream (forwarder.h). The receive
+ * loop appends it to a batch, which is compressed when it reaches 64 KB or
+ * is a second old and then written to a spill file. A forwarding thread
+ * sends the spilled batches over one TCP connection to the collector on
+ * port 9900 and drops them once they are acknowledged. If the collector is
+ * down, batches wait in the spill file (kept across restarts) until it is
+ * back. Run src/tools/fwd_collector as a local stand-in.
  */
 
 #include <stdio.h>
@@ -16,68 +41,121 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "socket_utils.h"
 #include "error_handling.h"
 #include "config.h"
+#include "channel.h"
+#include "conflator.h"
+#include "sensor_codec.h"
+#include "rollup.h"
+#include "query_server.h"
+#include "timer_wheel.h"
+#include "forwarder.h"
 
 #define SENSOR_PORT 8888
 #define MAX_SENSORS 100
 #define MAX_BUFFER_SIZE 1024
 #define TEMP_THRESHOLD 85.0  // Temperature threshold in Celsius
 #define LOG_FILE "sensor_data.log"
+#define LOG_QUEUE_SIZE 4096           // Log records in flight
+#define DISPLAY_IDLE_NS 1000000       // Display thread back-off when nothing changed
+#define STATS_INTERVAL_MS 5000        // Milliseconds between statistics views
+#define INACTIVE_AFTER 300            // Seconds without data before a sensor is inactive
+#define LIVENESS_TICK_MS 100          // Timing wheel resolution and receive timeout
+#define QUERY_HTTP_PORT 8889
+#define QUERY_UDS_PATH "/tmp/sensor_query.sock"
+#define QUERY_CONNECTIONS 64
+#define QUERY_BUFFERS 8               // Responses being sent at once
+#define QUERY_BUFFER_SIZE (256 * 1024)
+#define FORWARD_HOST "127.0.0.1"
+#define FORWARD_PORT 9900
+#define FORWARD_SPILL "sensor_forward.spill"
+#define FORWARD_SPILL_SIZE (64 * 1024 * 1024)   // Hours of readings if the collector is down
+#define FORWARD_BATCH (3200 * SENSOR_DATA_SIZE) // 64 KB of readings per batch
+#define FORWARD_DELAY_MS 1000                   // Longest a reading waits for its batch
 
 // Flag for graceful shutdown
 static volatile int keep_running = 1;
 
-// Structure for sensor data packet
-typedef struct {
-    uint32_t sensor_id;
-    float temperature;
-    float pressure;
-    float humidity;
-    uint32_t timestamp;
-} sensor_data_packet;
-
 // Structure for sensor information
 typedef struct {
     uint32_t sensor_id;
     char ip_address[INET_ADDRSTRLEN];
+    atomic_uint stamp;          // Odd while last_update/last_reading change
     time_t last_update;
-    sensor_data_packet last_reading;
+    sensor_data_t last_reading;
+    rollup_t rollup;            // Temperature, pressure, humidity; written by the receive loop
+    tw_timer_t liveness;        // Fires INACTIVE_AFTER seconds after the last packet
+    atomic_int inactive;        // Set when the liveness timer fired
 } sensor_info;
 
-// Global sensor database
+// Global sensor database; slots below sensor_count never move, so the
+// statistics view reads them and their rollups without the mutex
 sensor_info sensors[MAX_SENSORS];
-int sensor_count = 0;
+atomic_int sensor_count = 0;
 pthread_mutex_t sensor_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Log record handed from the receive loop to the housekeeping thread
+typedef struct {
+    sensor_data_t data;
+    char ip_address[INET_ADDRSTRLEN];
+    time_t received;
+} log_record_t;
+
+// Preallocated records cycle between the free queue and the log channel
+static log_record_t log_records[LOG_QUEUE_SIZE];
+static mpmc_queue_t free_records;
+static channel_t log_channel;
+static unsigned long log_dropped = 0;
+
+// Latest reading per sensor slot for the display thread
+static conflator_t display_feed;
+
+// JSON query endpoint
+static qs_server_t query_server;
+
+// Liveness deadlines, armed and advanced by the receive loop only
+static timer_wheel_t liveness_wheel;
+
 // Signal handler for graceful shutdown
 void handle_signal(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
     keep_running = 0;
 }
 
-// Function to log sensor data to file
-void log_sensor_data(const sensor_data_packet *data, const char *ip_addr) {
-    FILE *log_file = fopen(LOG_FILE, "a");
-    if (!log_file) {
-        perror("Failed to open log file");
-        return;
-    }
-    
-    time_t t = time(NULL);
-    struct tm *tm_info = localtime(&t);
+// Function to write one sensor record to the log file
+void log_sensor_data(FILE *log_file, const log_record_t *rec) {
+    struct tm *tm_info = localtime(&rec->received);
     char time_str[64];
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
     
     fprintf(log_file, "%s | Sensor ID: %u | IP: %s | Temp: %.1f°C | Pressure: %.1f kPa | Humidity: %.1f%%\n",
-            time_str, data->sensor_id, ip_addr, data->temperature, data->pressure, data->humidity);
+            time_str, rec->data.sensor_id, rec->ip_address, rec->data.temperature,
+            rec->data.pressure, rec->data.humidity);
+}
+
+// Queue a record for the housekeeping thread; drops rather than blocks when full
+void queue_sensor_log(const sensor_data_t *data, const char *ip_addr) {
+    log_record_t *rec = mpmc_queue_pop(&free_records);
+    if (!rec) {
+        log_dropped++;
+        return;
+    }
+    
+    rec->data = *data;
+    strncpy(rec->ip_address, ip_addr, INET_ADDRSTRLEN - 1);
+    rec->ip_address[INET_ADDRSTRLEN - 1] = '\0';
+    rec->received = time(NULL);
     
-    fclose(log_file);
+    if (channel_send(&log_channel, rec) < 0) {
+        mpmc_queue_push(&free_records, rec);
+        log_dropped++;
+    }
 }
 
 // Function to send alert on critical condition
-void send_alert(const char *message, const sensor_data_packet *data) {
+void send_alert(const char *message, const sensor_data_t *data) {
     printf("\033[1;31mALERT: %s\033[0m\n", message);
     printf("Sensor ID: %u | Temperature: %.1f°C | Pressure: %.1f kPa | Humidity: %.1f%%\n",
         data->sensor_id, data->temperature, data->pressure, data->humidity);
@@ -85,86 +163,306 @@ void send_alert(const char *message, const sensor_data_packet *data) {
     // In a real system, this would send alerts via email, SMS, etc.
 }
 
-// Function to update or add sensor to database
-void update_sensor_database(const sensor_data_packet *data, const char *ip_addr) {
+// Function to update or add sensor to database, returns its slot or -1 if full
+int update_sensor_database(const sensor_data_t *data, const char *ip_addr) {
     pthread_mutex_lock(&sensor_mutex);
     
     // Look for existing sensor
-    int found = 0;
+    int slot = -1;
     for (int i = 0; i < sensor_count; i++) {
         if (sensors[i].sensor_id == data->sensor_id) {
-            // Update existing sensor
+            // Update existing sensor; readers retry a copy that overlaps this
+            unsigned stamp = atomic_load_explicit(&sensors[i].stamp, memory_order_relaxed);
+            atomic_store_explicit(&sensors[i].stamp, stamp + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
             sensors[i].last_update = time(NULL);
-            memcpy(&sensors[i].last_reading, data, sizeof(sensor_data_packet));
-            found = 1;
+            memcpy(&sensors[i].last_reading, data, sizeof(sensor_data_t));
+            atomic_store_explicit(&sensors[i].stamp, stamp + 2, memory_order_release);
+            slot = i;
             break;
         }
     }
     
     // Add new sensor if not found
-    if (!found && sensor_count < MAX_SENSORS) {
+    if (slot < 0 && sensor_count < MAX_SENSORS) {
         sensors[sensor_count].sensor_id = data->sensor_id;
         strncpy(sensors[sensor_count].ip_address, ip_addr, INET_ADDRSTRLEN);
         sensors[sensor_count].last_update = time(NULL);
-        memcpy(&sensors[sensor_count].last_reading, data, sizeof(sensor_data_packet));
-        sensor_count++;
+        memcpy(&sensors[sensor_count].last_reading, data, sizeof(sensor_data_t));
+        rollup_init(&sensors[sensor_count].rollup, 3);
+        tw_timer_init(&sensors[sensor_count].liveness);
+        slot = atomic_fetch_add(&sensor_count, 1);
     }
     
     pthread_mutex_unlock(&sensor_mutex);
+    return slot;
 }
 
-// Function to check for inactive sensors
-void *check_inactive_sensors(void *arg) {
+// Consistent copy of a sensor's latest reading, without the mutex
+static void read_sensor(const sensor_info *info, sensor_data_t *reading, time_t *updated) {
+    for (;;) {
+        unsigned before = atomic_load_explicit(&info->stamp, memory_order_acquire);
+        *reading = info->last_reading;
+        *updated = info->last_update;
+        atomic_thread_fence(memory_order_acquire);
+        if ((before & 1) == 0 && atomic_load_explicit(&info->stamp, memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+// Wall-clock milliseconds, so rollup buckets align with minutes and hours
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Print one temperature window as min/avg/max
+static void print_window(const char *label, const rollup_bucket_t *agg) {
+    if (agg->count) {
+        printf("  %s %5.1f/%5.1f/%5.1f", label, agg->min[0], rollup_mean(agg, 0), agg->max[0]);
+    } else {
+        printf("  %s %17s", label, "-");
+    }
+}
+
+// Function to display sensor statistics from the rollups
+void display_sensor_stats() {
+    int count = atomic_load(&sensor_count);
+    uint64_t now = wall_ms();
+    
+    printf("\n--- Sensor Statistics ---\n");
+    printf("Active sensors: %d\n", count);
+    printf("Readings displayed: %llu, conflated: %llu\n",
+        (unsigned long long)atomic_load(&display_feed.delivered),
+        (unsigned long long)atomic_load(&display_feed.conflated));
+    
+    // Per-sensor temperature over 1 s, a sliding minute and a sliding hour
+    printf("Temperature min/avg/max (°C):\n");
+    rollup_bucket_t fleet;
+    rollup_reset(&fleet, 0);
+    for (int i = 0; i < count; i++) {
+        rollup_bucket_t second, minute, hour;
+        rollup_query(&sensors[i].rollup, ROLLUP_SECOND, 1, now, &second);
+        rollup_query(&sensors[i].rollup, ROLLUP_SECOND, 60, now, &minute);
+        rollup_query(&sensors[i].rollup, ROLLUP_MINUTE, 60, now, &hour);
+        rollup_merge(&fleet, &minute, 3);
+        
+        printf("Sensor %-6u", sensors[i].sensor_id);
+        print_window("1s", &second);
+        print_window("1m", &minute);
+        print_window("1h", &hour);
+        printf("\n");
+    }
+    
+    // Averages across all sensors over the last minute
+    if (fleet.count > 0) {
+        printf("Average temperature (1m): %.1f°C\n", rollup_mean(&fleet, 0));
+        printf("Average pressure (1m): %.1f kPa\n", rollup_mean(&fleet, 1));
+        printf("Average humidity (1m): %.1f%%\n", rollup_mean(&fleet, 2));
+    }
+}
+
+// Display thread: prints the latest reading of each sensor that changed,
+// and the statistics view every STATS_INTERVAL_MS
+void *display_thread(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, DISPLAY_IDLE_NS };
+    uint64_t next_stats = wall_ms() + STATS_INTERVAL_MS;
+    
     while (keep_running) {
-        sleep(60);  // Check every minute
+        if (wall_ms() >= next_stats) {
+            display_sensor_stats();
+            next_stats = wall_ms() + STATS_INTERVAL_MS;
+        }
         
-        time_t current_time = time(NULL);
-        pthread_mutex_lock(&sensor_mutex);
+        uint32_t slot;
+        log_record_t rec;
+        if (!conflator_poll(&display_feed, &slot, &rec)) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        printf("Received data from sensor %u at %s - Temp: %.1f°C, Pressure: %.1f kPa, Humidity: %.1f%%\n",
+            rec.data.sensor_id, rec.ip_address, rec.data.temperature, rec.data.pressure,
+            rec.data.humidity);
+    }
+    return NULL;
+}
+
+// Current liveness tick (monotonic, so wall-clock changes cannot expire sensors)
+static uint64_t liveness_tick(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000) / LIVENESS_TICK_MS;
+}
+
+// Liveness timer expiry: the sensor has been silent for INACTIVE_AFTER seconds
+static void on_sensor_silent(void *ctx, tw_timer_t *timer) {
+    (void)ctx;
+    sensor_info *info = (sensor_info *)((char *)timer - offsetof(sensor_info, liveness));
+    atomic_store(&info->inactive, 1);
+    printf("\033[1;33mWARNING: Sensor %u (IP: %s) hasn't reported in %d seconds\033[0m\n",
+        info->sensor_id, info->ip_address, INACTIVE_AFTER);
+}
+
+// Re-arm a sensor's liveness deadline after a packet
+static void sensor_alive(sensor_info *info) {
+    if (atomic_exchange(&info->inactive, 0)) {
+        printf("Sensor %u (IP: %s) is reporting again\n", info->sensor_id, info->ip_address);
+    }
+    tw_schedule(&liveness_wheel, &info->liveness,
+        liveness_tick() + (uint64_t)INACTIVE_AFTER * 1000 / LIVENESS_TICK_MS);
+}
+
+// Housekeeping thread: writes queued log records
+void *housekeeping_thread(void *arg) {
+    (void)arg;
+    FILE *log_file = fopen(LOG_FILE, "a");
+    if (!log_file) {
+        perror("Failed to open log file");
+    }
+    
+    for (;;) {
+        log_record_t *rec = channel_recv_wait(&log_channel, -1);
         
-        for (int i = 0; i < sensor_count; i++) {
-            // If sensor hasn't updated in 5 minutes, log warning
-            if (difftime(current_time, sensors[i].last_update) > 300) {
-                printf("\033[1;33mWARNING: Sensor %u (IP: %s) hasn't reported in %ld seconds\033[0m\n",
-                    sensors[i].sensor_id, sensors[i].ip_address, 
-                    (long)difftime(current_time, sensors[i].last_update));
+        if (rec) {
+            if (log_file) {
+                log_sensor_data(log_file, rec);
+                // Batch writes during bursts, flush once the backlog is gone
+                if (mpmc_queue_size(&log_channel.queue) == 0) {
+                    fflush(log_file);
+                }
             }
+            mpmc_queue_push(&free_records, rec);
+        } else if (errno == EPIPE) {
+            break;  // Closed and drained
         }
-        
-        pthread_mutex_unlock(&sensor_mutex);
     }
     
+    if (log_file) {
+        fclose(log_file);
+    }
     return NULL;
 }
 
-// Function to display sensor statistics
-void display_sensor_stats() {
-    pthread_mutex_lock(&sensor_mutex);
+// JSON for one sensor's identity and latest reading, without the closing brace
+static void json_sensor(qs_response_t *resp, const sensor_info *info, time_t now) {
+    sensor_data_t reading;
+    time_t updated;
+    read_sensor(info, &reading, &updated);
+    qs_printf(resp, "{\"id\":%u,\"ip\":", info->sensor_id);
+    qs_json_string(resp, info->ip_address);
+    qs_printf(resp, ",\"age_s\":%ld,\"temperature\":%.2f,\"pressure\":%.2f,\"humidity\":%.2f",
+        (long)difftime(now, updated), reading.temperature, reading.pressure, reading.humidity);
+}
+
+// JSON for the 1 s, sliding 1 min and sliding 1 h rollups of one sensor
+static void json_rollups(qs_response_t *resp, const sensor_info *info, uint64_t now_ms) {
+    static const char *const windows[] = { "1s", "1m", "1h" };
+    static const char *const metrics[] = { "temperature", "pressure", "humidity" };
+    rollup_bucket_t agg[3];
+    rollup_query(&info->rollup, ROLLUP_SECOND, 1, now_ms, &agg[0]);
+    rollup_query(&info->rollup, ROLLUP_SECOND, 60, now_ms, &agg[1]);
+    rollup_query(&info->rollup, ROLLUP_MINUTE, 60, now_ms, &agg[2]);
     
-    printf("\n--- Sensor Statistics ---\n");
-    printf("Active sensors: %d\n", sensor_count);
+    qs_printf(resp, ",\"rollups\":{");
+    for (int w = 0; w < 3; w++) {
+        qs_printf(resp, "%s\"%s\":{\"count\":%llu", w ? "," : "", windows[w],
+            (unsigned long long)agg[w].count);
+        for (int m = 0; m < 3 && agg[w].count; m++) {
+            qs_printf(resp, ",\"%s\":{\"min\":%.2f,\"avg\":%.2f,\"max\":%.2f}", metrics[m],
+                agg[w].min[m], rollup_mean(&agg[w], m), agg[w].max[m]);
+        }
+        qs_printf(resp, "}");
+    }
+    qs_printf(resp, "}");
+}
+
+// Query handler: /sensors, /sensors/<id>, /rollups, /inactive
+static int handle_query(void *ctx, const char *path, qs_response_t *resp) {
+    (void)ctx;
+    int count = atomic_load(&sensor_count);
+    time_t now = time(NULL);
+    uint64_t now_ms = wall_ms();
+    unsigned id;
     
-    // Calculate average temperature across all sensors
-    float avg_temp = 0.0;
-    float avg_pressure = 0.0;
-    float avg_humidity = 0.0;
+    if (strcmp(path, "/sensors") == 0 || strcmp(path, "/rollups") == 0) {
+        int with_rollups = path[1] == 'r';
+        qs_printf(resp, "{\"sensors\":[");
+        for (int i = 0; i < count; i++) {
+            qs_printf(resp, "%s", i ? "," : "");
+            json_sensor(resp, &sensors[i], now);
+            if (with_rollups) {
+                json_rollups(resp, &sensors[i], now_ms);
+            }
+            qs_printf(resp, "}");
+        }
+        qs_printf(resp, "]}");
+        return 200;
+    }
     
-    for (int i = 0; i < sensor_count; i++) {
-        avg_temp += sensors[i].last_reading.temperature;
-        avg_pressure += sensors[i].last_reading.pressure;
-        avg_humidity += sensors[i].last_reading.humidity;
+    if (sscanf(path, "/sensors/%u", &id) == 1) {
+        for (int i = 0; i < count; i++) {
+            if (sensors[i].sensor_id == id) {
+                json_sensor(resp, &sensors[i], now);
+                json_rollups(resp, &sensors[i], now_ms);
+                qs_printf(resp, "}");
+                return 200;
+            }
+        }
+        qs_printf(resp, "{\"error\":\"unknown sensor\"}");
+        return 404;
     }
     
-    if (sensor_count > 0) {
-        avg_temp /= sensor_count;
-        avg_pressure /= sensor_count;
-        avg_humidity /= sensor_count;
-        
-        printf("Average temperature: %.1f°C\n", avg_temp);
-        printf("Average pressure: %.1f kPa\n", avg_pressure);
-        printf("Average humidity: %.1f%%\n", avg_humidity);
+    if (strcmp(path, "/inactive") == 0) {
+        qs_printf(resp, "{\"inactive_after_s\":%d,\"sensors\":[", INACTIVE_AFTER);
+        int listed = 0;
+        for (int i = 0; i < count; i++) {
+            if (!atomic_load(&sensors[i].inactive)) {
+                continue;
+            }
+            sensor_data_t reading;
+            time_t updated;
+            read_sensor(&sensors[i], &reading, &updated);
+            qs_printf(resp, "%s{\"id\":%u,\"ip\":", listed++ ? "," : "", sensors[i].sensor_id);
+            qs_json_string(resp, sensors[i].ip_address);
+            qs_printf(resp, ",\"age_s\":%ld}", (long)difftime(now, updated));
+        }
+        qs_printf(resp, "]}");
+        return 200;
     }
     
-    pthread_mutex_unlock(&sensor_mutex);
+    qs_printf(resp, "{\"error\":\"not found\",\"paths\":"
+        "[\"/sensors\",\"/sensors/<id>\",\"/rollups\",\"/inactive\"]}");
+    return 404;
+}
+
+// Upstream forwarding: the receive loop fills batches, forward_thread sends them
+static fwd_t forwarder;
+static int forwarding = 0;
+
+void *forward_thread(void *arg) {
+    (void)arg;
+    while (keep_running) {
+        if (fwd_poll(&forwarder, 100) < 0) {
+            LOG_ERRNO("Forwarder poll failed");
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Query thread: serves the HTTP and UDS endpoints until shutdown
+void *query_thread(void *arg) {
+    (void)arg;
+    while (keep_running) {
+        if (qs_server_poll(&query_server, 100) < 0) {
+            LOG_ERRNO("Query server poll failed");
+            break;
+        }
+    }
+    return NULL;
 }
 
 int main() {
@@ -194,12 +492,64 @@ int main() {
     
     printf("Sensor monitoring system started on port %d\n", SENSOR_PORT);
     
-    // Create thread to check for inactive sensors
-    pthread_t inactive_thread;
-    pthread_create(&inactive_thread, NULL, check_inactive_sensors, NULL);
+    // Set up the log channel and its pool of free records
+    if (channel_init(&log_channel, LOG_QUEUE_SIZE) < 0 ||
+        mpmc_queue_init(&free_records, LOG_QUEUE_SIZE) < 0) {
+        FATAL("Failed to create log channel");
+    }
+    for (int i = 0; i < LOG_QUEUE_SIZE; i++) {
+        mpmc_queue_push(&free_records, &log_records[i]);
+    }
     
-    // Counter for statistics display
-    int packet_counter = 0;
+    // Wake at least once per liveness tick, even when no sensor is sending
+    if (set_socket_timeout(sockfd, 0, LIVENESS_TICK_MS * 1000) < 0) {
+        FATAL("Failed to set receive timeout");
+    }
+    tw_init(&liveness_wheel, liveness_tick());
+    
+    // Create housekeeping thread for logging
+    pthread_t housekeeping;
+    if (pthread_create(&housekeeping, NULL, housekeeping_thread, NULL) != 0) {
+        FATAL("Failed to create housekeeping thread");
+    }
+    
+    // Console output runs behind a conflator so a slow terminal never stalls receive
+    pthread_t display;
+    if (conflator_init(&display_feed, MAX_SENSORS, sizeof(log_record_t)) < 0) {
+        FATAL_ERRNO("Failed to create display conflator");
+    }
+    if (pthread_create(&display, NULL, display_thread, NULL) != 0) {
+        FATAL("Failed to create display thread");
+    }
+    
+    // Query endpoint; the monitor runs without it if the port or path is taken
+    pthread_t query;
+    int query_running = 0;
+    if (qs_server_init(&query_server, QUERY_HTTP_PORT, QUERY_UDS_PATH, QUERY_CONNECTIONS,
+                       QUERY_BUFFERS, QUERY_BUFFER_SIZE, handle_query, NULL) < 0) {
+        LOG_ERRNO("Failed to start query server");
+    } else if (pthread_create(&query, NULL, query_thread, NULL) != 0) {
+        qs_server_close(&query_server);
+    } else {
+        query_running = 1;
+        printf("Query endpoint on http://localhost:%d and %s\n", query_server.http_port, QUERY_UDS_PATH);
+    }
+    
+    // Upstream forwarding; readings stay local only if the spill file cannot be opened
+    pthread_t forward;
+    if (fwd_open(&forwarder, FORWARD_SPILL, FORWARD_SPILL_SIZE, FORWARD_BATCH, FORWARD_DELAY_MS,
+                 FORWARD_HOST, FORWARD_PORT) < 0) {
+        LOG_ERRNO("Failed to open forwarder spill file %s", FORWARD_SPILL);
+    } else if (pthread_create(&forward, NULL, forward_thread, NULL) != 0) {
+        fwd_close(&forwarder);
+    } else {
+        forwarding = 1;
+        printf("Forwarding to %s:%d", FORWARD_HOST, FORWARD_PORT);
+        if (forwarder.recovered) {
+            printf(" (%lu batches left from the last run)", (unsigned long)fwd_unacked(&forwarder));
+        }
+        printf("\n");
+    }
     
     // Main loop to receive sensor data
     while (keep_running) {
@@ -212,9 +562,15 @@ int main() {
         ssize_t bytes_received = recvfrom(sockfd, buffer, sizeof(buffer) - 1, 0,
                                         (struct sockaddr *)&client_addr, &addr_len);
         
+        // Fire the liveness timers that are due; costs nothing when none are
+        tw_advance(&liveness_wheel, liveness_tick(), on_sensor_silent, NULL);
+        if (forwarding) {
+            fwd_tick(&forwarder, fwd_now_ms());
+        }
+        
         if (bytes_received < 0) {
-            if (errno == EINTR) {
-                // Interrupted by signal, check if we should keep running
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Interrupted by signal or receive timeout, check if we should keep running
                 continue;
             }
             LOG_ERRNO("Error receiving sensor data");
@@ -225,37 +581,70 @@ int main() {
         char client_ip[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
         
-        // Process the received data
-        if (bytes_received == sizeof(sensor_data_packet)) {
-            // Parse sensor data packet
-            sensor_data_packet *data = (sensor_data_packet *)buffer;
+        // Process the received data: one length check, fields at fixed offsets
+        sensor_data_t reading;
+        if (sensor_data_decode(&reading, buffer, (size_t)bytes_received) == 0) {
+            sensor_data_t *data = &reading;
             
-            printf("Received data from sensor %u at %s - Temp: %.1f°C, Pressure: %.1f kPa, Humidity: %.1f%%\n",
-                data->sensor_id, client_ip, data->temperature, data->pressure, data->humidity);
+            // Forward the packet as received; a memcpy into the open batch
+            if (forwarding) {
+                fwd_append(&forwarder, buffer, SENSOR_DATA_SIZE, fwd_now_ms());
+            }
             
-            // Check for critical conditions
+            // Check for critical conditions; alerts are never conflated
             if (data->temperature > TEMP_THRESHOLD) {
                 send_alert("High temperature detected", data);
             }
             
             // Log data to database and file
-            update_sensor_database(data, client_ip);
-            log_sensor_data(data, client_ip);
+            int slot = update_sensor_database(data, client_ip);
+            queue_sensor_log(data, client_ip);
             
-            // Display stats every 10 packets
-            if (++packet_counter % 10 == 0) {
-                display_sensor_stats();
+            // Roll the reading up, then hand it to the display; only the latest
+            // per sensor is kept
+            if (slot >= 0) {
+                float values[3] = { data->temperature, data->pressure, data->humidity };
+                rollup_record(&sensors[slot].rollup, wall_ms(), values);
+                sensor_alive(&sensors[slot]);
+                
+                log_record_t rec;
+                rec.data = *data;
+                memcpy(rec.ip_address, client_ip, sizeof(rec.ip_address));
+                rec.received = time(NULL);
+                conflator_publish(&display_feed, (uint32_t)slot, &rec);
             }
         } else {
-            printf("Received invalid packet size from %s (expected %zu, got %zd bytes)\n",
-                client_ip, sizeof(sensor_data_packet), bytes_received);
+            printf("Received invalid packet size from %s (expected %d, got %zd bytes)\n",
+                client_ip, SENSOR_DATA_SIZE, bytes_received);
         }
     }
     
     // Clean up
     printf("Shutting down sensor monitoring system...\n");
-    pthread_cancel(inactive_thread);
-    pthread_join(inactive_thread, NULL);
+    pthread_join(display, NULL);
+    conflator_destroy(&display_feed);
+    if (query_running) {
+        pthread_join(query, NULL);
+        printf("Queries served: %lu (rejected %lu)\n", query_server.requests, query_server.rejected);
+        qs_server_close(&query_server);
+    }
+    if (forwarding) {
+        // The open batch goes to the spill file and is sent on the next run if not now
+        fwd_seal(&forwarder);
+        pthread_join(forward, NULL);
+        printf("Forwarded %lu readings in %lu batches (%lu -> %lu bytes), %lu unacknowledged, %lu dropped\n",
+            (unsigned long)forwarder.records, (unsigned long)forwarder.batches,
+            (unsigned long)forwarder.raw_bytes, (unsigned long)forwarder.wire_bytes,
+            (unsigned long)fwd_unacked(&forwarder), (unsigned long)forwarder.dropped);
+        fwd_close(&forwarder);
+    }
+    channel_close(&log_channel);
+    pthread_join(housekeeping, NULL);
+    channel_destroy(&log_channel);
+    mpmc_queue_destroy(&free_records);
+    if (log_dropped > 0) {
+        printf("Dropped %lu log records (log queue full)\n", log_dropped);
+    }
     pthread_mutex_destroy(&sensor_mutex);
     close(sockfd);
     
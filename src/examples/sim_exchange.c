@@ -0,0 +1,775 @@
+/**
+ * @file sim_exchange.c
+ * @brief Local simulated exchange for exercising the trading order path
+ *
+ * Stand-in venue for low_latency_trading. It accepts binary orders
+ * (trading_protocol.h) over UDP, runs them through a price-time priority
+ * matching engine and answers with acks, fills and rejects. A simulated
+ * market maker keeps every book quoted and trades occasionally; each book
+ * change is published as a market data message on the feed group/port in
+ * the text format the feed handler parses, stamped with the send time
+ * and a sequence number. With -B the same messages also go out on a
+ * redundant B line, and -l drops a share of messages on each line
+ * independently, to exercise A/B arbitration in the feed handler.
+ *
+ * Orders are accepted both as UDP datagrams and over the sequenced TCP
+ * order-entry session (order_session.h) on the same port number. Session
+ * clients are identified by the session ID in their logon. Their outbound
+ * messages are journaled in memory, so a client that reconnects gets
+ * whatever it missed.
+ *
+ * UDP orders are timestamped on arrival with the kernel receive time
+ * (SO_TIMESTAMPNS); acks echo the client's send time so the client can
+ * measure true order-to-ack round trips. The exchange's own receive-to-ack
+ * latency is reported on shutdown.
+ *
+ * Typical local run:
+ *   sim_exchange -d 127.0.0.1 &
+ *   low_latency_trading -m udp -i lo -x 127.0.0.1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "socket_utils.h"
+#include "error_handling.h"
+#include "config.h"
+#include "trading_protocol.h"
+#include "matching_engine.h"
+#include "latency_histogram.h"
+#include "order_session.h"
+
+#define ORDER_PORT 30002            // Order entry port
+#define MARKET_GROUP "239.0.0.1"    // Market data destination (group or unicast)
+#define MARKET_PORT 30001           // Market data port
+#define MARKET_PORT_B 30003         // B line market data port
+#define MAX_ORDER_CLIENTS 64        // Distinct order senders tracked
+#define MAX_ORDERS 65536            // Order pool size
+#define MAX_LEVELS 8192             // Price level pool size
+#define DEFAULT_TICK_RATE 1000      // Market maker updates per second
+#define MM_SPREAD_TICKS 100         // Market maker half-spread (0.01)
+#define MM_QUOTE_SIZE 500           // Market maker quote size
+#define MD_BUFFER_SIZE 128          // Market data message buffer
+#define SESSION_JOURNAL_SLOTS 4096  // Messages kept per session client for resend
+#define SESSION_SERVICE_NS 10000000 // Heartbeat/timeout check interval for idle sessions
+
+// Flag for graceful shutdown
+static volatile int keep_running = 1;
+
+struct session_conn;
+
+// Order sender: a UDP source address, or a TCP session ID
+typedef struct {
+    struct sockaddr_in addr;
+    uint32_t out_seq;
+    uint64_t session_id;            // 0 for UDP clients
+    order_journal_t journal;        // Session clients: outbound messages
+    struct session_conn *conn;      // Session clients: live connection, if any
+} client_t;
+
+// TCP connection carrying an order-entry session
+typedef struct session_conn {
+    order_session_t session;
+    client_t *client;               // Bound at logon
+} session_conn_t;
+
+// Simulated market maker state per book
+typedef struct {
+    int64_t mid;
+    uint64_t bid_id;
+    uint64_t ask_id;
+} maker_state_t;
+
+// Exchange statistics
+typedef struct {
+    uint64_t orders;
+    uint64_t cancels;
+    uint64_t acks;
+    uint64_t fills;
+    uint64_t rejects;
+    uint64_t md_published;
+    uint64_t md_dropped[2];         // Simulated line losses
+    uint64_t malformed;
+} exchange_stats_t;
+
+static me_engine_t engine;
+static client_t clients[MAX_ORDER_CLIENTS];
+static int num_clients = 0;
+static maker_state_t makers[ME_MAX_SYMBOLS];
+static exchange_stats_t stats;
+static latency_histogram_t ack_latency;     // Kernel receive -> ack sent
+static int order_sock = -1;
+static int listen_sock = -1;
+static session_conn_t *conns[MAX_ORDER_CLIENTS];
+static int md_sock = -1;
+static struct sockaddr_in md_addr[2];       // A and B line destinations
+static int md_lines = 1;
+static uint32_t md_loss_pct = 0;
+static uint64_t md_seq = 0;
+static uint32_t rng_state = 2463534242u;
+
+// Signal handler for graceful shutdown
+void handle_signal(int sig) {
+    printf("\nReceived signal %d, shutting down...\n", sig);
+    keep_running = 0;
+}
+
+// Get current time in nanoseconds (same clock as the trading client)
+uint64_t get_timestamp_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// xorshift32 for the market maker's random walk
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Find or register the client for a source address
+client_t *lookup_client(const struct sockaddr_in *addr) {
+    for (int i = 0; i < num_clients; i++) {
+        if (clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            clients[i].addr.sin_port == addr->sin_port) {
+            return &clients[i];
+        }
+    }
+    if (num_clients >= MAX_ORDER_CLIENTS) {
+        return NULL;
+    }
+    client_t *c = &clients[num_clients++];
+    memset(c, 0, sizeof(*c));
+    c->addr = *addr;
+    return c;
+}
+
+// Send a message to a client
+void send_to_client(client_t *c, void *msg, uint16_t type, uint16_t length) {
+    if (c->session_id) {
+        // Session client: journal it, and send it if connected
+        memcpy(order_journal_claim(&c->journal), msg, length);
+        if (c->conn) {
+            order_session_send(&c->conn->session, type, length, get_timestamp_ns());
+        } else {
+            order_journal_commit(&c->journal, type, length, get_timestamp_ns());
+        }
+        return;
+    }
+    msg_header_init((msg_header_t *)msg, type, length, ++c->out_seq, get_timestamp_ns());
+    if (sendto(order_sock, msg, length, 0, (struct sockaddr *)&c->addr, sizeof(c->addr)) < 0) {
+        LOG_ERRNO("Failed to send to client");
+    }
+}
+
+// Publish top of book for one symbol in the feed's text format
+void publish_market_data(int book_idx) {
+    const me_book_t *book = &engine.books[book_idx];
+    char msg[MD_BUFFER_SIZE];
+    int64_t last = book->last_price ? book->last_price : makers[book_idx].mid;
+
+    int len = snprintf(msg, sizeof(msg), "%-8s %.4f %.4f %.4f %u %llu %llu",
+                       book->symbol, TICKS_TO_PRICE(last),
+                       TICKS_TO_PRICE(me_best_bid(book)), TICKS_TO_PRICE(me_best_ask(book)),
+                       (uint32_t)book->volume, (unsigned long long)get_timestamp_ns(),
+                       (unsigned long long)++md_seq);
+
+    // Either line may go first, as with independent network paths
+    int first = md_lines > 1 ? (int)(next_random() & 1) : 0;
+    for (int n = 0; n < md_lines; n++) {
+        int line = first ^ n;
+        if (md_loss_pct && next_random() % 100 < md_loss_pct) {
+            stats.md_dropped[line]++;
+            continue;
+        }
+        if (sendto(md_sock, msg, (size_t)len, 0, (struct sockaddr *)&md_addr[line],
+                   sizeof(md_addr[line])) < 0) {
+            LOG_ERRNO("Failed to publish market data");
+        }
+    }
+    stats.md_published++;
+}
+
+// Execution callback: report fills to client-owned orders
+void on_execution(void *ctx, const me_order_t *maker, const me_order_t *taker,
+                  int64_t price, uint32_t qty) {
+    (void)ctx;
+    const me_order_t *sides[2] = { maker, taker };
+    for (int i = 0; i < 2; i++) {
+        client_t *c = sides[i]->owner;
+        if (!c) {
+            continue;  // Market maker order
+        }
+        fill_msg_t fill;
+        memset(&fill, 0, sizeof(fill));
+        fill.client_order_id = sides[i]->client_order_id;
+        fill.exchange_order_id = sides[i]->id;
+        fill.price = price;
+        fill.quantity = qty;
+        fill.leaves = sides[i]->remaining;
+        send_to_client(c, &fill, MSG_FILL, sizeof(fill));
+        stats.fills++;
+    }
+}
+
+// Reject an order back to its sender
+void reject_order(client_t *c, const order_msg_t *order, uint32_t reason) {
+    reject_msg_t rej;
+    memset(&rej, 0, sizeof(rej));
+    rej.client_order_id = order->client_order_id;
+    rej.order_send_ns = order->hdr.send_ns;
+    rej.reason = reason;
+    send_to_client(c, &rej, MSG_REJECT, sizeof(rej));
+    stats.rejects++;
+}
+
+// Handle a new order from a client
+void handle_new_order(client_t *c, const order_msg_t *order, uint64_t rx_ns) {
+    stats.orders++;
+
+    int book = me_find_book(&engine, order->symbol, strnlen(order->symbol, SYMBOL_LEN));
+    if (book < 0) {
+        reject_order(c, order, REJECT_UNKNOWN_SYMBOL);
+        return;
+    }
+    if (order->price <= 0 || (order->side != SIDE_BUY && order->side != SIDE_SELL)) {
+        reject_order(c, order, REJECT_BAD_PRICE);
+        return;
+    }
+    if (order->quantity == 0) {
+        reject_order(c, order, REJECT_BAD_QUANTITY);
+        return;
+    }
+
+    me_order_t *o = me_new_order(&engine, book, order->side, order->price, order->quantity,
+                                 order->client_order_id, c);
+    if (!o) {
+        reject_order(c, order, REJECT_BOOK_FULL);
+        return;
+    }
+
+    // Acknowledge before matching so fills always follow the ack
+    ack_msg_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.client_order_id = order->client_order_id;
+    ack.exchange_order_id = o->id;
+    ack.order_send_ns = order->hdr.send_ns;
+    ack.exchange_recv_ns = rx_ns;
+    send_to_client(c, &ack, MSG_ACK, sizeof(ack));
+    stats.acks++;
+    latency_histogram_record(&ack_latency, get_timestamp_ns() - rx_ns);
+
+    me_match(&engine, o, on_execution, NULL);
+    publish_market_data(book);
+}
+
+// Handle a cancel request from a client
+void handle_cancel(client_t *c, const cancel_msg_t *cancel) {
+    stats.cancels++;
+    me_order_t *o = me_find_order(&engine, cancel->exchange_order_id);
+    if (!o || o->owner != c) {
+        order_msg_t ref;
+        memset(&ref, 0, sizeof(ref));
+        ref.client_order_id = cancel->client_order_id;
+        ref.hdr.send_ns = cancel->hdr.send_ns;
+        reject_order(c, &ref, REJECT_UNKNOWN_ORDER);
+        return;
+    }
+
+    int book = o->book;
+    me_cancel(&engine, cancel->exchange_order_id, NULL);
+
+    ack_msg_t done;
+    memset(&done, 0, sizeof(done));
+    done.client_order_id = cancel->client_order_id;
+    done.exchange_order_id = cancel->exchange_order_id;
+    done.order_send_ns = cancel->hdr.send_ns;
+    done.exchange_recv_ns = get_timestamp_ns();
+    send_to_client(c, &done, MSG_CANCELLED, sizeof(done));
+    publish_market_data(book);
+}
+
+// Receive and dispatch all pending order messages
+void drain_order_socket() {
+    for (;;) {
+        trading_msg_t msg;
+        struct sockaddr_in from;
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct iovec iov = { .iov_base = &msg, .iov_len = sizeof(msg) };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_name = &from;
+        mh.msg_namelen = sizeof(from);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(order_sock, &mh, 0);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO("recvmsg");
+            }
+            return;
+        }
+
+        // Prefer the kernel's arrival time over the time we got around to it
+        uint64_t rx_ns = 0;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+                rx_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            }
+        }
+        if (rx_ns == 0) {
+            rx_ns = get_timestamp_ns();
+        }
+
+        client_t *c = lookup_client(&from);
+        int type = msg_validate(&msg, (size_t)len);
+        if (!c || type == 0) {
+            stats.malformed++;
+            continue;
+        }
+
+        if (type == MSG_NEW_ORDER) {
+            handle_new_order(c, &msg.order, rx_ns);
+        } else if (type == MSG_CANCEL) {
+            handle_cancel(c, &msg.cancel);
+        } else {
+            stats.malformed++;
+        }
+    }
+}
+
+// Session logon: find or create the client for a session ID
+order_journal_t *resolve_session(void *ctx, uint64_t session_id) {
+    session_conn_t *conn = ctx;
+    client_t *c = NULL;
+    for (int i = 0; i < num_clients; i++) {
+        if (clients[i].session_id == session_id) {
+            c = &clients[i];
+            break;
+        }
+    }
+    if (!c) {
+        if (session_id == 0 || num_clients >= MAX_ORDER_CLIENTS) {
+            return NULL;
+        }
+        c = &clients[num_clients];
+        memset(c, 0, sizeof(*c));
+        if (order_journal_open(&c->journal, NULL, SESSION_JOURNAL_SLOTS, session_id) < 0) {
+            LOG_ERRNO("Failed to create session journal");
+            return NULL;
+        }
+        c->session_id = session_id;
+        num_clients++;
+    }
+
+    // A new logon replaces any connection the session still has
+    if (c->conn && c->conn != conn) {
+        order_session_disconnect(&c->conn->session);
+        c->conn->client = NULL;
+    }
+    c->conn = conn;
+    conn->client = c;
+    printf("Session %016llx logged on (next out %u, next in %u)\n",
+           (unsigned long long)session_id, c->journal.hdr->out_seq + 1, c->journal.hdr->in_next);
+    return &c->journal;
+}
+
+// In-sequence application message from a session client
+void on_session_message(void *ctx, const trading_msg_t *msg, int type, uint64_t rx_ns) {
+    session_conn_t *conn = ctx;
+    if (type == MSG_NEW_ORDER) {
+        handle_new_order(conn->client, &msg->order, rx_ns);
+    } else if (type == MSG_CANCEL) {
+        handle_cancel(conn->client, &msg->cancel);
+    } else {
+        stats.malformed++;
+    }
+}
+
+// Accept pending session connections
+void accept_sessions(int epfd) {
+    for (;;) {
+        int fd = accept(listen_sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO("accept");
+            }
+            return;
+        }
+
+        int slot = -1;
+        for (int i = 0; i < MAX_ORDER_CLIENTS && slot < 0; i++) {
+            if (!conns[i]) {
+                slot = i;
+            }
+        }
+        session_conn_t *conn = slot >= 0 ? malloc(sizeof(*conn)) : NULL;
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        order_session_init(&conn->session, NULL, 0);
+        order_session_accept(&conn->session, fd, get_timestamp_ns());
+        conn->client = NULL;
+        conns[slot] = conn;
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// Service one session connection; drop it once it disconnects
+void service_session(int slot, uint64_t now) {
+    session_conn_t *conn = conns[slot];
+    order_session_poll(&conn->session, now, resolve_session, on_session_message, conn);
+    if (conn->session.state != SESSION_DISCONNECTED) {
+        return;
+    }
+    if (conn->client) {
+        printf("Session %016llx disconnected\n", (unsigned long long)conn->client->session_id);
+        conn->client->conn = NULL;
+    }
+    free(conn);
+    conns[slot] = NULL;
+}
+
+// Market maker: requote one random book around a random-walking mid and
+// occasionally cross the spread to print a trade
+void market_maker_tick() {
+    int book = (int)(next_random() % (uint32_t)engine.num_books);
+    maker_state_t *mm = &makers[book];
+
+    // Random walk of up to +/- 2 half-spreads
+    mm->mid += ((int64_t)(next_random() % 5) - 2) * MM_SPREAD_TICKS;
+    if (mm->mid < 10 * MM_SPREAD_TICKS) {
+        mm->mid = 10 * MM_SPREAD_TICKS;
+    }
+
+    // A quote that crosses a resting client order fills it: report the fill
+    uint32_t size = MM_QUOTE_SIZE + next_random() % MM_QUOTE_SIZE;
+    me_cancel(&engine, mm->ask_id, NULL);
+    mm->ask_id = 0;
+    me_requote(&engine, book, &mm->bid_id, SIDE_BUY, mm->mid - MM_SPREAD_TICKS, size, NULL, on_execution, NULL);
+    me_requote(&engine, book, &mm->ask_id, SIDE_SELL, mm->mid + MM_SPREAD_TICKS, size, NULL, on_execution, NULL);
+
+    // One tick in eight prints a trade against the resting quote
+    if ((next_random() & 7) == 0) {
+        uint8_t side = (next_random() & 1) ? SIDE_BUY : SIDE_SELL;
+        int64_t px = side == SIDE_BUY ? me_best_ask(&engine.books[book]) : me_best_bid(&engine.books[book]);
+        if (px > 0) {
+            me_order_t *aggr = me_new_order(&engine, book, side, px, 100 + next_random() % 1000, 0, NULL);
+            if (aggr) {
+                uint64_t id = aggr->id;
+                // Do not leave the aggressor resting: it would cross the next quote
+                if (me_match(&engine, aggr, on_execution, NULL) > 0) {
+                    me_cancel(&engine, id, NULL);
+                }
+            }
+        }
+    }
+
+    publish_market_data(book);
+}
+
+// Create the order entry socket with kernel receive timestamps
+int setup_order_socket(int port) {
+    int sockfd = create_udp_socket(0, 1);
+    if (sockfd < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+        perror("setsockopt(SO_TIMESTAMPNS)");
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Resolve a market data line destination
+int set_market_data_line(int line, const char *dest_ip, int port) {
+    memset(&md_addr[line], 0, sizeof(md_addr[line]));
+    md_addr[line].sin_family = AF_INET;
+    md_addr[line].sin_port = htons(port);
+    if (inet_pton(AF_INET, dest_ip, &md_addr[line].sin_addr) <= 0) {
+        fprintf(stderr, "Invalid market data address: %s\n", dest_ip);
+        return -1;
+    }
+    return 0;
+}
+
+// Create the market data publisher (multicast on the given interface, or unicast)
+int setup_market_data_publisher(const char *if_addr) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // Multicast options are ignored for unicast destinations
+    struct in_addr iface;
+    inet_pton(AF_INET, if_addr, &iface);
+    unsigned char loop = 1, ttl = 1;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0 ||
+        setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+        setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+        perror("setsockopt(IP_MULTICAST_*)");
+    }
+    return sockfd;
+}
+
+// Create the order entry session listener on the same port number
+int setup_session_listener(int port) {
+    int sockfd = create_tcp_socket(1, 1);
+    if (sockfd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sockfd, SOMAXCONN) < 0) {
+        perror("bind/listen (session)");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Seed books and market maker quotes
+void setup_books() {
+    static const struct { const char *symbol; double price; } seeds[] = {
+        { "AAPL", 150.0 }, { "MSFT", 300.0 }, { "GOOG", 130.0 },
+        { "AMZN", 140.0 }, { "TSLA", 250.0 }, { "NVDA", 450.0 }
+    };
+
+    for (size_t i = 0; i < sizeof(seeds) / sizeof(seeds[0]); i++) {
+        int book = me_add_book(&engine, seeds[i].symbol);
+        makers[book].mid = PRICE_TO_TICKS(seeds[i].price);
+    }
+    for (int i = 0; i < engine.num_books; i++) {
+        market_maker_tick();
+    }
+}
+
+// Display exchange statistics
+void display_stats() {
+    printf("\n=== Exchange Statistics ===\n");
+    printf("Clients: %d\n", num_clients);
+    printf("Orders: %lu, cancels: %lu, acks: %lu, fills: %lu, rejects: %lu\n",
+           stats.orders, stats.cancels, stats.acks, stats.fills, stats.rejects);
+    printf("Executions: %lu, market data messages: %lu, malformed: %lu\n",
+           engine.executions, stats.md_published, stats.malformed);
+    for (int i = 0; i < num_clients; i++) {
+        if (clients[i].session_id) {
+            printf("Session %016llx: sent up to %u, received up to %u, %s\n",
+                   (unsigned long long)clients[i].session_id, clients[i].journal.hdr->out_seq,
+                   clients[i].journal.hdr->in_next - 1, clients[i].conn ? "connected" : "disconnected");
+        }
+    }
+    if (md_loss_pct) {
+        printf("Simulated drops: line A %lu, line B %lu\n", stats.md_dropped[0], stats.md_dropped[1]);
+    }
+    latency_histogram_print(&ack_latency, "Receive-to-ack latency");
+}
+
+int main(int argc, char *argv[]) {
+    int order_port = ORDER_PORT;
+    const char *md_dest = MARKET_GROUP;
+    int md_port = MARKET_PORT;
+    const char *md_if = "127.0.0.1";
+    const char *md_dest_b = NULL;
+    int md_port_b = MARKET_PORT_B;
+    int tick_rate = DEFAULT_TICK_RATE;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            order_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            md_dest = argv[++i];
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            md_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            md_if = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            tick_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            md_dest_b = argv[++i];
+        } else if (strcmp(argv[i], "-Q") == 0 && i + 1 < argc) {
+            md_port_b = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            md_loss_pct = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [-p order_port] [-d md_dest] [-P md_port] [-I md_if_addr] [-r rate]\n"
+                   "          [-B md_dest_b] [-Q md_port_b] [-l loss_pct]\n", argv[0]);
+            printf("  -p port   : Order entry port, UDP and TCP session (default: %d)\n", ORDER_PORT);
+            printf("  -d addr   : Market data destination, multicast or unicast (default: %s)\n", MARKET_GROUP);
+            printf("  -P port   : Market data port (default: %d)\n", MARKET_PORT);
+            printf("  -I addr   : Interface address for multicast (default: 127.0.0.1)\n");
+            printf("  -r rate   : Market maker updates per second, 0 = off (default: %d)\n", DEFAULT_TICK_RATE);
+            printf("  -B addr   : Also publish on a redundant B line to this address\n");
+            printf("  -Q port   : B line port (default: %d)\n", MARKET_PORT_B);
+            printf("  -l pct    : Drop this percentage of messages on each line\n");
+            return 0;
+        }
+    }
+
+    // Set up signal handling for graceful shutdown
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (me_engine_init(&engine, MAX_ORDERS, MAX_LEVELS) < 0) {
+        FATAL("Failed to initialize matching engine");
+    }
+    latency_histogram_init(&ack_latency);
+
+    order_sock = setup_order_socket(order_port);
+    listen_sock = setup_session_listener(order_port);
+    md_sock = setup_market_data_publisher(md_if);
+    if (set_market_data_line(0, md_dest, md_port) < 0 ||
+        (md_dest_b && set_market_data_line(1, md_dest_b, md_port_b) < 0)) {
+        return 1;
+    }
+    md_lines = md_dest_b ? 2 : 1;
+    if (order_sock < 0 || listen_sock < 0 || md_sock < 0) {
+        FATAL("Failed to set up exchange sockets");
+    }
+
+    setup_books();
+
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        FATAL_ERRNO("epoll_create1");
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = order_sock };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, order_sock, &ev);
+    ev.data.fd = listen_sock;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sock, &ev);
+
+    // Market maker ticks from a timerfd so orders and quotes share one loop
+    int timer_fd = -1;
+    if (tick_rate > 0) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        long interval_ns = 1000000000L / tick_rate;
+        struct itimerspec its = {
+            .it_interval = { interval_ns / 1000000000L, interval_ns % 1000000000L },
+            .it_value = { interval_ns / 1000000000L, interval_ns % 1000000000L }
+        };
+        timerfd_settime(timer_fd, 0, &its, NULL);
+        ev.data.fd = timer_fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev);
+    }
+
+    printf("Simulated exchange listening for orders on UDP and TCP port %d\n", order_port);
+    printf("Publishing market data to %s:%d (%d books, %d updates/s)\n",
+           md_dest, md_port, engine.num_books, tick_rate);
+    if (md_dest_b) {
+        printf("B line to %s:%d\n", md_dest_b, md_port_b);
+    }
+    if (md_loss_pct) {
+        printf("Simulating %u%% loss per line\n", md_loss_pct);
+    }
+    printf("Press Ctrl+C to exit\n\n");
+
+    struct epoll_event events[8];
+    uint64_t next_service = 0;
+    while (keep_running) {
+        int n = epoll_wait(epfd, events, 8, SESSION_SERVICE_NS / 1000000);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERRNO("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == order_sock) {
+                drain_order_socket();
+            } else if (events[i].data.fd == listen_sock) {
+                accept_sessions(epfd);
+            } else if (events[i].data.fd == timer_fd) {
+                uint64_t expirations = 0;
+                if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    for (uint64_t t = 0; t < expirations; t++) {
+                        market_maker_tick();
+                    }
+                }
+            } else {
+                for (int c = 0; c < MAX_ORDER_CLIENTS; c++) {
+                    if (conns[c] && conns[c]->session.fd == events[i].data.fd) {
+                        service_session(c, get_timestamp_ns());
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Heartbeats and timeouts for idle sessions
+        uint64_t now = get_timestamp_ns();
+        if (now >= next_service) {
+            for (int c = 0; c < MAX_ORDER_CLIENTS; c++) {
+                if (conns[c]) {
+                    service_session(c, now);
+                }
+            }
+            next_service = now + SESSION_SERVICE_NS;
+        }
+    }
+
+    display_stats();
+
+    if (timer_fd >= 0) {
+        close(timer_fd);
+    }
+    close(epfd);
+    for (int c = 0; c < MAX_ORDER_CLIENTS; c++) {
+        if (conns[c]) {
+            order_session_logout(&conns[c]->session, get_timestamp_ns());
+            free(conns[c]);
+        }
+    }
+    for (int i = 0; i < num_clients; i++) {
+        if (clients[i].session_id) {
+            order_journal_close(&clients[i].journal);
+        }
+    }
+    close(listen_sock);
+    close(order_sock);
+    close(md_sock);
+    me_engine_destroy(&engine);
+
+    printf("Simulated exchange shut down\n");
+    return 0;
+}
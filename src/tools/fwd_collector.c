@@ -0,0 +1,103 @@
+/**
+ * @file fwd_collector.c
+ * @brief Stand-in upstream collector for the forwarder (forwarder.h)
+ *
+ * Accepts one forwarder connection at a time, decompresses each batch,
+ * acknowledges it and prints a line per batch. Batches resent after a
+ * reconnect are acknowledged and skipped. Stop it and start it again to
+ * simulate an upstream outage: the forwarder spills to disk meanwhile and
+ * catches up once the collector is back. Because the last sequence number
+ * is only kept in memory, batches resent to a restarted collector are
+ * delivered again.
+ *
+ * Usage: fwd_collector [port] [record_size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "forwarder.h"
+
+#define DEFAULT_PORT 9900
+#define DEFAULT_RECORD_SIZE 20      // sensor_data
+#define MAX_BATCH (1024 * 1024)
+
+static volatile sig_atomic_t keep_running = 1;
+static uint64_t total_records;
+static uint64_t total_bytes;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+static void on_batch(void *ctx, const fwd_frame_t *frame, const uint8_t *records) {
+    size_t record_size = *(size_t *)ctx;
+    (void)records;
+    total_records += frame->records;
+    total_bytes += frame->raw_length;
+    printf("batch %lu: %u records, %u bytes -> %u on the wire%s\n", (unsigned long)frame->seq,
+           frame->records, frame->raw_length, frame->length,
+           frame->raw_length != (uint64_t)frame->records * record_size ? " (unexpected record size)" : "");
+}
+
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? atoi(argv[1]) : DEFAULT_PORT;
+    size_t record_size = argc > 2 ? (size_t)atoi(argv[2]) : DEFAULT_RECORD_SIZE;
+
+    // No SA_RESTART, so Ctrl-C interrupts accept() and read()
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0) {
+        perror("fwd_collector: listen");
+        return 1;
+    }
+
+    fwd_collector_t collector;
+    if (fwd_collector_init(&collector, MAX_BATCH) < 0) {
+        perror("fwd_collector: malloc");
+        return 1;
+    }
+    printf("Collector listening on port %d\n", port);
+
+    while (keep_running) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("fwd_collector: accept");
+            }
+            continue;
+        }
+        printf("Forwarder connected, resuming after batch %lu\n", (unsigned long)collector.last_seq);
+        if (fwd_collector_serve(&collector, fd, on_batch, &record_size) < 0 && keep_running) {
+            perror("fwd_collector: connection");
+        }
+        printf("Forwarder disconnected\n");
+        close(fd);
+    }
+
+    printf("Received %lu batches (%lu resent, %lu forwarder restarts with a fresh spill) with %lu records, %lu bytes (%lu on the wire)\n",
+           (unsigned long)collector.batches, (unsigned long)collector.duplicates, (unsigned long)collector.restarts,
+           (unsigned long)total_records, (unsigned long)total_bytes, (unsigned long)collector.wire_bytes);
+    fwd_collector_destroy(&collector);
+    close(listen_fd);
+    return 0;
+}
@@ -0,0 +1,441 @@
+/**
+ * @file msgc.c
+ * @brief Schema compiler: generates fixed-layout C codecs from a message IDL
+ *
+ * Reads a schema file and writes a header of static inline encoders and
+ * decoders built on wire_codec.h. The build runs it as a custom command
+ * for every schema in schemas/.
+ *
+ * Schema syntax:
+ *
+ *     # comment
+ *     message engine_data big {        # byte order: big (default) or little
+ *         u16 rpm;
+ *         u8 temperature;
+ *         i16 samples[32];             # fixed-length array
+ *         char symbol[8];              # raw bytes, never swapped
+ *         u8 status optional;          # trailing fields may be optional
+ *     }
+ *
+ * Types: u8 u16 u32 u64 i8 i16 i32 i64 f32 f64 char.
+ *
+ * For each message <name> the header defines:
+ *  - <NAME>_SIZE, and <NAME>_MIN_SIZE when trailing fields are optional;
+ *  - a native struct <name>_t;
+ *  - <name>_decode(), which checks the length once and then reads every
+ *    field at its fixed offset (optional fields cost one more check each);
+ *  - <name>_encode(), which checks the capacity once.
+ * Nothing is interpreted at run time.
+ *
+ * Usage: msgc <schema.msg> <output.h>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#define MAX_MESSAGES 64
+#define MAX_FIELDS 64
+#define MAX_NAME 64
+
+// Field types
+typedef struct {
+    const char *name;       // Schema keyword
+    const char *ctype;      // Native C type
+    int width;              // Bytes per element
+    int is_float;
+    int is_bytes;           // char: copied, never swapped
+} field_type_t;
+
+static const field_type_t field_types[] = {
+    { "u8", "uint8_t", 1, 0, 0 },   { "i8", "int8_t", 1, 0, 0 },
+    { "u16", "uint16_t", 2, 0, 0 }, { "i16", "int16_t", 2, 0, 0 },
+    { "u32", "uint32_t", 4, 0, 0 }, { "i32", "int32_t", 4, 0, 0 },
+    { "u64", "uint64_t", 8, 0, 0 }, { "i64", "int64_t", 8, 0, 0 },
+    { "f32", "float", 4, 1, 0 },    { "f64", "double", 8, 1, 0 },
+    { "char", "char", 1, 0, 1 },
+};
+
+typedef struct {
+    char name[MAX_NAME];
+    const field_type_t *type;
+    int count;              // 0 for a scalar, else array length
+    int offset;
+    int optional;
+} field_t;
+
+typedef struct {
+    char name[MAX_NAME];
+    int big_endian;
+    field_t fields[MAX_FIELDS];
+    int num_fields;
+    int size;
+    int min_size;
+} message_t;
+
+// Tokenizer state
+static const char *schema_path;
+static const char *src;
+static int line_no = 1;
+static char token[MAX_NAME];
+
+static void fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s:%d: error: ", schema_path, line_no);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(1);
+}
+
+// Read the next token into token[]; returns 0 at end of input
+static int next_token(void) {
+    for (;;) {
+        while (isspace((unsigned char)*src)) {
+            if (*src == '\n') {
+                line_no++;
+            }
+            src++;
+        }
+        if (*src != '#') {
+            break;
+        }
+        while (*src && *src != '\n') {
+            src++;
+        }
+    }
+    if (!*src) {
+        token[0] = '\0';
+        return 0;
+    }
+    size_t len = 0;
+    if (isalnum((unsigned char)*src) || *src == '_') {
+        while (isalnum((unsigned char)*src) || *src == '_') {
+            if (len + 1 >= sizeof(token)) {
+                fail("identifier too long");
+            }
+            token[len++] = *src++;
+        }
+    } else {
+        token[len++] = *src++;
+    }
+    token[len] = '\0';
+    return 1;
+}
+
+static void expect(const char *what) {
+    if (!next_token() || strcmp(token, what) != 0) {
+        fail("expected '%s', got '%s'", what, token);
+    }
+}
+
+static int is_identifier(const char *s) {
+    if (!isalpha((unsigned char)s[0]) && s[0] != '_') {
+        return 0;
+    }
+    for (; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const field_type_t *find_type(const char *name) {
+    for (size_t i = 0; i < sizeof(field_types) / sizeof(field_types[0]); i++) {
+        if (strcmp(field_types[i].name, name) == 0) {
+            return &field_types[i];
+        }
+    }
+    return NULL;
+}
+
+// Parse "<type> <name>[N] [optional];" after the type token
+static void parse_field(message_t *msg) {
+    if (msg->num_fields == MAX_FIELDS) {
+        fail("too many fields in %s", msg->name);
+    }
+    field_t *f = &msg->fields[msg->num_fields];
+    f->type = find_type(token);
+    if (!f->type) {
+        fail("unknown type '%s'", token);
+    }
+    if (!next_token() || !is_identifier(token)) {
+        fail("expected field name");
+    }
+    for (int i = 0; i < msg->num_fields; i++) {
+        if (strcmp(msg->fields[i].name, token) == 0) {
+            fail("duplicate field '%s'", token);
+        }
+    }
+    snprintf(f->name, sizeof(f->name), "%s", token);
+
+    next_token();
+    if (strcmp(token, "[") == 0) {
+        next_token();
+        char *end;
+        long n = strtol(token, &end, 10);
+        if (*end || n <= 0 || n > 65536) {
+            fail("bad array length '%s'", token);
+        }
+        f->count = (int)n;
+        expect("]");
+        next_token();
+    } else if (f->type->is_bytes) {
+        f->count = 1;
+    }
+    if (strcmp(token, "optional") == 0) {
+        f->optional = 1;
+        next_token();
+    } else if (msg->num_fields && msg->fields[msg->num_fields - 1].optional) {
+        fail("required field '%s' after an optional one", f->name);
+    }
+    if (strcmp(token, ";") != 0) {
+        fail("expected ';' after field '%s'", f->name);
+    }
+
+    f->offset = msg->size;
+    msg->size += f->type->width * (f->count ? f->count : 1);
+    if (!f->optional) {
+        msg->min_size = msg->size;
+    }
+    msg->num_fields++;
+}
+
+static void parse_message(message_t *msg) {
+    if (!next_token() || !is_identifier(token)) {
+        fail("expected message name");
+    }
+    snprintf(msg->name, sizeof(msg->name), "%s", token);
+    msg->big_endian = 1;
+
+    next_token();
+    if (strcmp(token, "big") == 0 || strcmp(token, "little") == 0) {
+        msg->big_endian = token[0] == 'b';
+        next_token();
+    }
+    if (strcmp(token, "{") != 0) {
+        fail("expected '{' after message %s", msg->name);
+    }
+    while (next_token() && strcmp(token, "}") != 0) {
+        parse_field(msg);
+    }
+    if (strcmp(token, "}") != 0) {
+        fail("unterminated message %s", msg->name);
+    }
+    if (msg->num_fields == 0) {
+        fail("message %s has no fields", msg->name);
+    }
+}
+
+static void upper(char *dst, const char *s, size_t size) {
+    size_t i = 0;
+    for (; s[i] && i + 1 < size; i++) {
+        dst[i] = (char)toupper((unsigned char)s[i]);
+    }
+    dst[i] = '\0';
+}
+
+// Emit the statement reading field f from p into m
+static void emit_decode_field(FILE *out, const message_t *msg, const field_t *f, const char *indent) {
+    const char *swap = msg->big_endian ? "WIRE_SWAP_BE" : "WIRE_SWAP_LE";
+    int w = f->type->width;
+
+    if (f->count) {
+        if (w == 1) {
+            fprintf(out, "%smemcpy(m->%s, p + %d, %d);\n", indent, f->name, f->offset, f->count);
+        } else {
+            fprintf(out, "%swire_copy%d(m->%s, p + %d, %d, %s);\n", indent, w * 8, f->name, f->offset,
+                    f->count, swap);
+        }
+    } else if (w == 1) {
+        fprintf(out, "%sm->%s = (%s)p[%d];\n", indent, f->name, f->type->ctype, f->offset);
+    } else if (f->type->is_float) {
+        fprintf(out, "%sm->%s = wire_get_f%d(p + %d, %s);\n", indent, f->name, w * 8, f->offset, swap);
+    } else {
+        fprintf(out, "%sm->%s = (%s)wire_get%d(p + %d, %s);\n", indent, f->name, f->type->ctype, w * 8,
+                f->offset, swap);
+    }
+}
+
+static void emit_encode_field(FILE *out, const message_t *msg, const field_t *f) {
+    const char *swap = msg->big_endian ? "WIRE_SWAP_BE" : "WIRE_SWAP_LE";
+    int w = f->type->width;
+
+    if (f->count) {
+        if (w == 1) {
+            fprintf(out, "    memcpy(p + %d, m->%s, %d);\n", f->offset, f->name, f->count);
+        } else {
+            fprintf(out, "    wire_copy%d(p + %d, m->%s, %d, %s);\n", w * 8, f->offset, f->name, f->count,
+                    swap);
+        }
+    } else if (w == 1) {
+        fprintf(out, "    p[%d] = (uint8_t)m->%s;\n", f->offset, f->name);
+    } else if (f->type->is_float) {
+        fprintf(out, "    wire_put_f%d(p + %d, m->%s, %s);\n", w * 8, f->offset, f->name, swap);
+    } else {
+        fprintf(out, "    wire_put%d(p + %d, (uint%d_t)m->%s, %s);\n", w * 8, f->offset, w * 8, f->name,
+                swap);
+    }
+}
+
+static void emit_message(FILE *out, const message_t *msg) {
+    char up[MAX_NAME];
+    upper(up, msg->name, sizeof(up));
+    int has_optional = msg->min_size < msg->size;
+
+    // Layout table
+    fprintf(out, "/*\n * %s: %d bytes, %s-endian\n *\n", msg->name, msg->size,
+            msg->big_endian ? "big" : "little");
+    for (int i = 0; i < msg->num_fields; i++) {
+        const field_t *f = &msg->fields[i];
+        char decl[MAX_NAME + 16];
+        if (f->count) {
+            snprintf(decl, sizeof(decl), "%s[%d]", f->name, f->count);
+        } else {
+            snprintf(decl, sizeof(decl), "%s", f->name);
+        }
+        fprintf(out, " *   %4d  %-6s %s%s\n", f->offset, f->type->name, decl, f->optional ? " (optional)" : "");
+    }
+    fprintf(out, " */\n");
+    fprintf(out, "#define %s_SIZE %d\n", up, msg->size);
+    if (has_optional) {
+        fprintf(out, "#define %s_MIN_SIZE %d\n", up, msg->min_size);
+    }
+    fprintf(out, "\n");
+
+    // Native struct
+    fprintf(out, "typedef struct {\n");
+    for (int i = 0; i < msg->num_fields; i++) {
+        const field_t *f = &msg->fields[i];
+        if (f->count) {
+            fprintf(out, "    %s %s[%d];\n", f->type->ctype, f->name, f->count);
+        } else {
+            fprintf(out, "    %s %s;\n", f->type->ctype, f->name);
+        }
+    }
+    fprintf(out, "} %s_t;\n\n", msg->name);
+
+    // Decoder
+    fprintf(out, "/**\n * @brief Decode %s from buf\n", msg->name);
+    if (has_optional) {
+        fprintf(out, " *\n * Optional fields missing from a short message are zeroed.\n");
+    }
+    fprintf(out, " *\n * @return 0 on success, -1 if len is too short\n */\n");
+    fprintf(out, "static inline int %s_decode(%s_t *m, const void *buf, size_t len) {\n", msg->name, msg->name);
+    fprintf(out, "    const uint8_t *p = buf;\n");
+    fprintf(out, "    if (len < %s_%sSIZE) {\n        return -1;\n    }\n", up, has_optional ? "MIN_" : "");
+    for (int i = 0; i < msg->num_fields; i++) {
+        const field_t *f = &msg->fields[i];
+        if (!f->optional) {
+            emit_decode_field(out, msg, f, "    ");
+            continue;
+        }
+        int end = f->offset + f->type->width * (f->count ? f->count : 1);
+        fprintf(out, "    if (len >= %d) {\n", end);
+        emit_decode_field(out, msg, f, "        ");
+        fprintf(out, "    } else {\n");
+        if (f->count) {
+            fprintf(out, "        memset(m->%s, 0, sizeof(m->%s));\n", f->name, f->name);
+        } else {
+            fprintf(out, "        m->%s = 0;\n", f->name);
+        }
+        fprintf(out, "    }\n");
+    }
+    fprintf(out, "    return 0;\n}\n\n");
+
+    // Encoder
+    fprintf(out, "/**\n * @brief Encode %s into buf\n *\n", msg->name);
+    fprintf(out, " * @return Bytes written (%s_SIZE), or 0 if cap is too small\n */\n", up);
+    fprintf(out, "static inline size_t %s_encode(const %s_t *m, void *buf, size_t cap) {\n", msg->name,
+            msg->name);
+    fprintf(out, "    uint8_t *p = buf;\n");
+    fprintf(out, "    if (cap < %s_SIZE) {\n        return 0;\n    }\n", up);
+    for (int i = 0; i < msg->num_fields; i++) {
+        emit_encode_field(out, msg, &msg->fields[i]);
+    }
+    fprintf(out, "    return %s_SIZE;\n}\n\n", up);
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)size + 1);
+    if (!buf || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        perror(path);
+        exit(1);
+    }
+    buf[size] = '\0';
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <schema.msg> <output.h>\n", argv[0]);
+        return 1;
+    }
+    schema_path = argv[1];
+    char *text = read_file(schema_path);
+    src = text;
+
+    static message_t messages[MAX_MESSAGES];
+    int num_messages = 0;
+    while (next_token()) {
+        if (strcmp(token, "message") != 0) {
+            fail("expected 'message', got '%s'", token);
+        }
+        if (num_messages == MAX_MESSAGES) {
+            fail("too many messages");
+        }
+        parse_message(&messages[num_messages]);
+        for (int i = 0; i < num_messages; i++) {
+            if (strcmp(messages[i].name, messages[num_messages].name) == 0) {
+                fail("duplicate message '%s'", messages[i].name);
+            }
+        }
+        num_messages++;
+    }
+    free(text);
+
+    // Include guard and @file name from the output file name
+    const char *base = strrchr(argv[2], '/');
+    base = base ? base + 1 : argv[2];
+    const char *schema_base = strrchr(schema_path, '/');
+    schema_base = schema_base ? schema_base + 1 : schema_path;
+    char guard[MAX_NAME];
+    upper(guard, base, sizeof(guard));
+    for (char *c = guard; *c; c++) {
+        if (!isalnum((unsigned char)*c)) {
+            *c = '_';
+        }
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "/**\n * @file %s\n * @brief Message codecs generated by msgc from %s; do not edit\n */\n\n",
+            base, schema_base);
+    fprintf(out, "#ifndef %s\n#define %s\n\n", guard, guard);
+    fprintf(out, "#include <stdint.h>\n#include <stddef.h>\n#include <string.h>\n#include \"wire_codec.h\"\n\n");
+    for (int i = 0; i < num_messages; i++) {
+        emit_message(out, &messages[i]);
+    }
+    fprintf(out, "#endif /* %s */\n", guard);
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    return 0;
+}
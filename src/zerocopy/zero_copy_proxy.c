@@ -0,0 +1,453 @@
+// Zero-Copy TCP Proxy Example
+// Relays bytes between clients and an upstream server using refcounted
+// buffer chains: data is read with readv() straight into pool segments and
+// written out of the same segments with writev(). With -l, every byte is
+// also teed to a log file by sharing segment references, not by copying.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "socket_utils.h"
+#include "buffer_chain.h"
+
+#define LISTEN_PORT 9000
+#define UPSTREAM_IP "127.0.0.1"
+#define UPSTREAM_PORT 8080
+#define MAX_EVENTS 64
+#define POOL_SEGMENTS 4096         // 8 MB of 2 KB segments
+#define HIGH_WATERMARK (256 * 1024) // Stop reading when the peer lags this far
+#define READ_SEGMENTS 8            // Fresh segments offered per readv()
+#define LOG_FLUSH_BYTES (64 * 1024)
+
+// One direction of a proxied connection
+typedef struct endpoint {
+    int fd;                   // Socket for this side
+    bc_chain_t pending;       // Data waiting to be written to this side
+    struct endpoint *peer;    // Other side of the session
+    uint32_t events;          // Currently registered epoll events
+    int eof;                  // This side stopped sending
+    int shut_wr;              // Write side of this socket already shut down
+    int connecting;           // Non-blocking connect still in progress
+    int starved;              // Read hit an empty pool; on the starved list
+    struct endpoint *next_starved;
+} endpoint_t;
+
+typedef struct {
+    endpoint_t client;
+    endpoint_t upstream;
+} session_t;
+
+static volatile int keep_running = 1;
+static bc_pool_t pool;
+static int epoll_fd = -1;
+static int log_fd = -1;
+static bc_chain_t log_chain;
+static unsigned long long bytes_relayed = 0;
+static endpoint_t *starved_list = NULL;  // Endpoints waiting for free segments
+
+static void handle_signal(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl O_NONBLOCK");
+        return -1;
+    }
+    return 0;
+}
+
+// Recompute which events an endpoint needs and update epoll if changed
+static int update_interest(endpoint_t *ep) {
+    uint32_t events = 0;
+    if (ep->connecting) {
+        events = EPOLLOUT;  // Connect completion only
+    } else {
+        if (!ep->eof && !ep->starved && ep->peer->pending.len < HIGH_WATERMARK) {
+            events |= EPOLLIN;
+        }
+        if (ep->pending.len > 0) {
+            events |= EPOLLOUT;
+        }
+    }
+
+    if (events == ep->events) {
+        return 0;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = ep;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ep->fd, &ev) < 0) {
+        perror("epoll_ctl MOD");
+        return -1;
+    }
+    ep->events = events;
+    return 0;
+}
+
+// Flush the shared-reference log chain to disk
+static void flush_log(int force) {
+    if (log_fd < 0 || log_chain.len == 0) {
+        return;
+    }
+    if (!force && log_chain.len < LOG_FLUSH_BYTES) {
+        return;
+    }
+    while (log_chain.len > 0) {
+        if (bc_chain_write(&pool, &log_chain, log_fd) < 0) {
+            perror("log write");
+            bc_chain_free(&pool, &log_chain);
+            break;
+        }
+    }
+}
+
+// Remove an endpoint from the starved list
+static void unlink_starved(endpoint_t *ep) {
+    for (endpoint_t **p = &starved_list; *p; p = &(*p)->next_starved) {
+        if (*p == ep) {
+            *p = ep->next_starved;
+            break;
+        }
+    }
+    ep->starved = 0;
+}
+
+// Re-arm reads that stopped on an empty pool once segments are free again
+static void resume_starved(void) {
+    while (starved_list && pool.free_segs_count >= READ_SEGMENTS) {
+        endpoint_t *ep = starved_list;
+        starved_list = ep->next_starved;
+        ep->starved = 0;
+        update_interest(ep);
+    }
+}
+
+static void close_session(session_t *s) {
+    if (s->client.starved) {
+        unlink_starved(&s->client);
+    }
+    if (s->upstream.starved) {
+        unlink_starved(&s->upstream);
+    }
+    printf("Session closed (client fd %d)\n", s->client.fd);
+    close(s->client.fd);
+    close(s->upstream.fd);
+    bc_chain_free(&pool, &s->client.pending);
+    bc_chain_free(&pool, &s->upstream.pending);
+    free(s);
+}
+
+// Read from ep into the peer's pending chain; returns -1 on fatal error
+static int relay_in(endpoint_t *ep) {
+    bc_chain_t incoming;
+    bc_chain_init(&incoming);
+
+    ssize_t n = bc_chain_read(&pool, &incoming, ep->fd, READ_SEGMENTS);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        if (errno == ENOBUFS) {
+            // Pool exhausted: stop polling this side until writers drain segments,
+            // or level-triggered EPOLLIN would fire again at once
+            if (!ep->starved) {
+                ep->starved = 1;
+                ep->next_starved = starved_list;
+                starved_list = ep;
+            }
+            return 0;
+        }
+        return -1;
+    }
+    if (n == 0) {
+        ep->eof = 1;
+        return 0;
+    }
+
+    bytes_relayed += (unsigned long long)n;
+
+    // Tee to the log by reference
+    if (log_fd >= 0 && bc_chain_clone(&pool, &incoming, &log_chain) < 0) {
+        fprintf(stderr, "Log tee dropped %zd bytes (no descriptors)\n", n);
+    }
+
+    bc_chain_concat(&ep->peer->pending, &incoming);
+    return 0;
+}
+
+// Write pending data to ep; returns -1 on fatal error
+static int relay_out(endpoint_t *ep) {
+    if (ep->connecting) {
+        return 0;  // Pending data goes out once the connect completes
+    }
+    while (ep->pending.len > 0) {
+        ssize_t n = bc_chain_write(&pool, &ep->pending, ep->fd);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            return -1;
+        }
+    }
+
+    // Propagate half-close once everything from the peer was delivered
+    if (ep->peer->eof && !ep->shut_wr) {
+        shutdown(ep->fd, SHUT_WR);
+        ep->shut_wr = 1;
+    }
+    return 0;
+}
+
+static session_t *find_session(endpoint_t *ep) {
+    // Endpoints are embedded in the session; recover it from either side
+    if (ep->peer == ep + 1) {
+        return (session_t *)ep;
+    }
+    return (session_t *)(ep - 1);
+}
+
+// Start a non-blocking connect; *in_progress is set if it completes on EPOLLOUT
+static int connect_upstream(const struct sockaddr_in *addr, int *in_progress) {
+    int fd = create_tcp_socket(0, 1);
+    if (fd < 0) {
+        return -1;
+    }
+    disable_nagle(fd);
+    *in_progress = 0;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            perror("upstream connect");
+            close(fd);
+            return -1;
+        }
+        *in_progress = 1;
+    }
+    return fd;
+}
+
+// Finish a non-blocking connect; returns -1 if it failed
+static int finish_connect(endpoint_t *ep) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(ep->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        fprintf(stderr, "upstream connect: %s\n", strerror(err ? err : errno));
+        return -1;
+    }
+    ep->connecting = 0;
+    return 0;
+}
+
+static void accept_clients(int server_fd, const struct sockaddr_in *upstream_addr) {
+    while (1) {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+
+        int connecting;
+        int upstream_fd = connect_upstream(upstream_addr, &connecting);
+        if (upstream_fd < 0 || set_nonblocking(client_fd) < 0) {
+            if (upstream_fd >= 0) {
+                close(upstream_fd);
+            }
+            close(client_fd);
+            continue;
+        }
+        disable_nagle(client_fd);
+
+        session_t *s = calloc(1, sizeof(session_t));
+        if (!s) {
+            close(client_fd);
+            close(upstream_fd);
+            continue;
+        }
+        s->client.fd = client_fd;
+        s->upstream.fd = upstream_fd;
+        s->upstream.connecting = connecting;
+        s->client.peer = &s->upstream;
+        s->upstream.peer = &s->client;
+        bc_chain_init(&s->client.pending);
+        bc_chain_init(&s->upstream.pending);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &s->client;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+        s->client.events = EPOLLIN;
+        // Client bytes are buffered while the upstream connect completes
+        ev.events = connecting ? EPOLLOUT : EPOLLIN;
+        ev.data.ptr = &s->upstream;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, upstream_fd, &ev);
+        s->upstream.events = ev.events;
+
+        printf("Session opened (client fd %d <-> upstream fd %d)\n", client_fd, upstream_fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int listen_port = LISTEN_PORT;
+    const char *upstream_ip = UPSTREAM_IP;
+    int upstream_port = UPSTREAM_PORT;
+    const char *log_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            listen_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0 && i + 2 < argc) {
+            upstream_ip = argv[++i];
+            upstream_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else {
+            printf("Usage: %s [-p listen_port] [-u upstream_ip upstream_port] [-l log_file]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Step 1: Preallocate the segment pool
+    if (bc_pool_init(&pool, BC_DEFAULT_SEGMENT_SIZE, POOL_SEGMENTS) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    bc_chain_init(&log_chain);
+
+    if (log_path) {
+        log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (log_fd < 0) {
+            perror("open log file");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct sockaddr_in upstream_addr;
+    memset(&upstream_addr, 0, sizeof(upstream_addr));
+    upstream_addr.sin_family = AF_INET;
+    upstream_addr.sin_port = htons(upstream_port);
+    if (inet_pton(AF_INET, upstream_ip, &upstream_addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid upstream address %s\n", upstream_ip);
+        exit(EXIT_FAILURE);
+    }
+
+    // Step 2: Listening socket
+    int server_fd = create_tcp_socket(1, 1);
+    if (server_fd < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(listen_port);
+
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(server_fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        exit(EXIT_FAILURE);
+    }
+
+    // Step 3: Event loop
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  // NULL marks the listening socket
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+
+    printf("Zero-copy proxy listening on port %d, forwarding to %s:%d\n",
+           listen_port, upstream_ip, upstream_port);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (keep_running) {
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+        if (nfds < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            if (events[i].events == 0) {
+                continue;  // Session was closed earlier in this batch
+            }
+            
+            endpoint_t *ep = (endpoint_t *)events[i].data.ptr;
+            if (!ep) {
+                accept_clients(server_fd, &upstream_addr);
+                continue;
+            }
+            
+            session_t *s = find_session(ep);
+            int failed = 0;
+
+            if (ep->connecting) {
+                // Any event ends the connect; SO_ERROR tells how
+                failed = finish_connect(ep) < 0 || relay_out(ep) < 0;
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                failed = relay_in(ep) < 0;
+                // Forward immediately; most writes complete without EPOLLOUT
+                if (!failed) {
+                    failed = relay_out(ep->peer) < 0;
+                }
+            }
+            if (!failed && !ep->connecting && (events[i].events & EPOLLOUT)) {
+                failed = relay_out(ep) < 0;
+            }
+
+            int done = s->client.eof && s->upstream.eof &&
+                       s->client.pending.len == 0 && s->upstream.pending.len == 0;
+            if (failed || done ||
+                update_interest(&s->client) < 0 || update_interest(&s->upstream) < 0) {
+                endpoint_t *client = &s->client, *upstream = &s->upstream;
+                close_session(s);
+                // Later events in this batch may reference the freed session
+                for (int j = i + 1; j < nfds; j++) {
+                    endpoint_t *other = (endpoint_t *)events[j].data.ptr;
+                    if (other == client || other == upstream) {
+                        events[j].events = 0;
+                    }
+                }
+            }
+        }
+
+        // Starved readers: free the log's segment references, then re-arm
+        flush_log(starved_list != NULL);
+        resume_starved();
+    }
+
+    flush_log(1);
+    printf("\nProxy shutting down, relayed %llu bytes, %zu/%zu segments free\n",
+           bytes_relayed, pool.free_segs_count, pool.num_segs);
+
+    close(epoll_fd);
+    close(server_fd);
+    if (log_fd >= 0) {
+        close(log_fd);
+    }
+    bc_chain_free(&pool, &log_chain);
+    bc_pool_destroy(&pool);
+    return 0;
+}
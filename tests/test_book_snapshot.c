@@ -0,0 +1,237 @@
+/**
+ * @file test_book_snapshot.c
+ * @brief Unit tests for double-buffered book snapshots and log replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "book_snapshot.h"
+
+#define MAX_RECORDS 100
+#define LOG_SLOTS 16
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// A miniature book: one price per symbol index
+typedef struct {
+    int64_t price;
+    uint64_t updates;
+} record_t;
+
+typedef struct {
+    record_t records[MAX_RECORDS];
+    uint32_t count;
+} book_t;
+
+// Messages are "<index> <price>"
+static void apply(book_t *book, const char *text) {
+    unsigned idx;
+    long long price;
+    if (sscanf(text, "%u %lld", &idx, &price) != 2 || idx >= MAX_RECORDS) {
+        test_failed("Malformed message");
+    }
+    book->records[idx].price = price;
+    book->records[idx].updates++;
+    if (idx >= book->count) {
+        book->count = idx + 1;
+    }
+}
+
+// Log, apply and mark one update, as a feed handler would
+static void feed(book_snapshot_t *s, book_t *book, unsigned idx, long long price) {
+    char text[32];
+    int len = snprintf(text, sizeof(text), "%u %lld", idx, price);
+    if (book_snapshot_log(s, text, (uint32_t)len + 1) < 0) {
+        test_failed("Failed to log message");
+    }
+    apply(book, text);
+    book_snapshot_mark(s, idx);
+}
+
+static void on_replay(void *ctx, const void *data, uint32_t length) {
+    (void)length;
+    apply(ctx, data);
+}
+
+// Load the newest image into book and replay the log after it
+static uint64_t recover(book_snapshot_t *s, book_t *book) {
+    memset(book, 0, sizeof(*book));
+    const book_snapshot_image_t *image = book_snapshot_latest(s);
+    if (image) {
+        for (uint32_t i = 0; i < image->count; i++) {
+            memcpy(&book->records[i], book_snapshot_record(s, image, i), sizeof(record_t));
+        }
+        book->count = image->count;
+    }
+    return book_snapshot_replay(s, on_replay, book);
+}
+
+static void expect_same(const book_t *a, const book_t *b, const char *what) {
+    if (a->count != b->count || memcmp(a->records, b->records, a->count * sizeof(record_t)) != 0) {
+        fprintf(stderr, "%s\n", what);
+        test_failed("Recovered book differs from the live book");
+    }
+}
+
+/**
+ * Test that snapshots alternate images and copy only changed records
+ */
+void test_incremental_snapshots() {
+    printf("Testing incremental double-buffered snapshots... ");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_book_snapshot_%d", (int)getpid());
+    unlink(path);
+
+    book_snapshot_t s;
+    book_t live = { .count = 0 };
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0 || s.recovered) {
+        test_failed("Failed to create snapshot file");
+    }
+    if (book_snapshot_latest(&s) != NULL) {
+        test_failed("New file has a snapshot");
+    }
+
+    for (unsigned i = 0; i < 70; i++) {
+        feed(&s, &live, i, 1000 + i);
+    }
+    // Both images start out entirely stale
+    if (book_snapshot_take(&s, live.records, live.count, 1) != 70 ||
+        book_snapshot_take(&s, live.records, live.count, 2) != 70) {
+        test_failed("First snapshots not complete");
+    }
+    const book_snapshot_image_t *first = book_snapshot_latest(&s);
+    if (!first || first->generation != 2 || first->log_seq != 70 || first->count != 70) {
+        test_failed("Wrong snapshot header");
+    }
+
+    // Two updates: each image picks them up on its next turn
+    feed(&s, &live, 3, 5);
+    feed(&s, &live, 65, 6);
+    if (book_snapshot_take(&s, live.records, live.count, 3) != 2 ||
+        book_snapshot_latest(&s) == first ||
+        book_snapshot_take(&s, live.records, live.count, 4) != 2 ||
+        book_snapshot_latest(&s) != first ||
+        book_snapshot_take(&s, live.records, live.count, 5) != 0) {
+        test_failed("Snapshot not incremental");
+    }
+    if (book_snapshot_backlog(&s) != 0 || s.snapshots != 5 || s.records_copied != 144) {
+        test_failed("Wrong snapshot counters");
+    }
+
+    book_t restored;
+    if (recover(&s, &restored) != 0) {
+        test_failed("Replayed messages already in the snapshot");
+    }
+    expect_same(&live, &restored, "after snapshots");
+
+    book_snapshot_close(&s);
+    unlink(path);
+    printf("PASSED\n");
+}
+
+/**
+ * Test restart recovery: snapshot plus replay, torn snapshot, lost log
+ */
+void test_restart_recovery() {
+    printf("Testing restart recovery with log replay... ");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_book_snapshot_%d", (int)getpid());
+    unlink(path);
+
+    book_snapshot_t s;
+    book_t live = { .count = 0 };
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0) {
+        test_failed("Failed to create snapshot file");
+    }
+
+    // Killed before any snapshot: everything comes from the log
+    for (unsigned i = 0; i < 5; i++) {
+        feed(&s, &live, i, 100 + i);
+    }
+    book_snapshot_close(&s);
+    book_t restored;
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0 || !s.recovered) {
+        test_failed("Snapshot file not recovered");
+    }
+    if (recover(&s, &restored) != 5) {
+        test_failed("Log not replayed without a snapshot");
+    }
+    expect_same(&live, &restored, "log only");
+
+    // Snapshot, more updates, then a snapshot torn half-way by a kill
+    book_snapshot_take(&s, live.records, live.count, 10);
+    feed(&s, &live, 1, 7);
+    feed(&s, &live, 6, 8);
+    const book_snapshot_image_t *good = book_snapshot_latest(&s);
+    book_snapshot_image_t *other = s.image[good == s.image[0]];
+    memset(book_snapshot_record(&s, other, 0), 0xee, sizeof(record_t) * 3);
+    other->generation = 999;    // Written but never made current
+    book_snapshot_close(&s);
+
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0 || !s.recovered) {
+        test_failed("Snapshot file not recovered");
+    }
+    if (recover(&s, &restored) != 2) {
+        test_failed("Wrong number of messages replayed after the snapshot");
+    }
+    expect_same(&live, &restored, "torn snapshot");
+
+    // The recovered process continues, and the log wraps past the snapshot
+    memcpy(&live, &restored, sizeof(live));
+    book_snapshot_take(&s, live.records, live.count, 20);
+    for (unsigned i = 0; i < LOG_SLOTS + 4; i++) {
+        feed(&s, &live, i % 8, 200 + i);
+    }
+    if (book_snapshot_backlog(&s) != LOG_SLOTS + 4) {
+        test_failed("Wrong backlog");
+    }
+    book_snapshot_close(&s);
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0) {
+        test_failed("Snapshot file not recovered");
+    }
+    if (recover(&s, &restored) != LOG_SLOTS || s.replay_lost != 4) {
+        test_failed("Overwritten log messages not reported");
+    }
+    book_snapshot_close(&s);
+
+    // Messages too long for a slot are refused
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS, LOG_SLOTS, 32) < 0) {
+        test_failed("Snapshot file not recovered");
+    }
+    char big[128];
+    memset(big, 'x', sizeof(big));
+    if (book_snapshot_log(&s, big, sizeof(big)) != -1) {
+        test_failed("Oversized message logged");
+    }
+    book_snapshot_close(&s);
+
+    // A different geometry starts over
+    if (book_snapshot_open(&s, path, sizeof(record_t), MAX_RECORDS / 2, LOG_SLOTS, 32) < 0 ||
+        s.recovered || book_snapshot_latest(&s) != NULL || book_snapshot_backlog(&s) != 0) {
+        test_failed("Mismatched snapshot file reused");
+    }
+    book_snapshot_close(&s);
+    unlink(path);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running book snapshot tests...\n");
+
+    test_incremental_snapshots();
+    test_restart_recovery();
+
+    printf("All book snapshot tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file test_can_bridge.c
+ * @brief Unit tests for the CAN-to-UDP bridge
+ *
+ * The CAN side is an AF_UNIX SOCK_SEQPACKET pair carrying struct can_frame,
+ * so the tests run without SocketCAN; the collector is a UDP socket on
+ * loopback.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "can_bridge.h"
+
+#define FLUSH_MS 20
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static can_bridge_t bridge;
+static int can_peer;            // Test side of the CAN bus
+static int collector;           // UDP socket standing in for the collector
+
+static void open_bridge(size_t max_records) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv) < 0) {
+        test_failed("socketpair failed");
+    }
+    can_peer = sv[1];
+
+    // Collector on an ephemeral loopback port, connected back to the bridge
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    collector = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (collector < 0 || bind(collector, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(collector, (struct sockaddr *)&addr, &len) < 0) {
+        test_failed("Collector socket failed");
+    }
+    int udp = cbr_open_udp("127.0.0.1", ntohs(addr.sin_port), 0);
+    struct sockaddr_in local;
+    len = sizeof(local);
+    if (udp < 0 || getsockname(udp, (struct sockaddr *)&local, &len) < 0) {
+        test_failed("cbr_open_udp failed");
+    }
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(collector, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        test_failed("Collector connect failed");
+    }
+    if (cbr_init(&bridge, sv[0], udp, max_records, FLUSH_MS) < 0) {
+        test_failed("cbr_init failed");
+    }
+}
+
+static void close_bridge(void) {
+    cbr_close(&bridge);
+    close(can_peer);
+    close(collector);
+}
+
+static void send_frame(canid_t id, uint8_t dlc, uint8_t fill) {
+    struct can_frame f;
+    memset(&f, 0, sizeof(f));
+    f.can_id = id;
+    f.can_dlc = dlc;
+    memset(f.data, fill, dlc);
+    if (write(can_peer, &f, sizeof(f)) != (ssize_t)sizeof(f)) {
+        test_failed("Failed to send frame");
+    }
+}
+
+// Next datagram at the collector; its length, 0 if none is waiting
+static size_t recv_datagram(uint8_t *buf) {
+    ssize_t n = recv(collector, buf, CBR_MAX_DATAGRAM + 1, 0);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+/**
+ * Test the record encoding round trip
+ */
+void test_records() {
+    printf("Testing record encoding... ");
+
+    struct can_frame in, out;
+    memset(&in, 0, sizeof(in));
+    in.can_id = 0x18FEF100 | CAN_EFF_FLAG;
+    in.can_dlc = 5;
+    memcpy(in.data, "\x01\x02\x03\x04\x05", 5);
+    uint8_t rec[CBR_RECORD_SIZE];
+    cbr_put_record(rec, &in, 123456789);
+    uint32_t offset;
+    if (cbr_get_record(rec, &out, &offset) < 0 || offset != 123456789 || memcmp(&in, &out, sizeof(in)) != 0) {
+        test_failed("Record changed in transit");
+    }
+    // Little-endian on the wire whatever the host
+    if (rec[0] != 0x15 || rec[4] != 0x00 || rec[7] != 0x98 || rec[8] != 5) {
+        test_failed("Record layout wrong");
+    }
+    rec[8] = 9;
+    if (cbr_get_record(rec, &out, &offset) == 0) {
+        test_failed("DLC above 8 accepted");
+    }
+    if (CBR_MAX_RECORDS != 72) {
+        test_failed("A full datagram no longer holds 72 frames");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test the size and time flush thresholds
+ */
+void test_flush() {
+    printf("Testing size and time flushes... ");
+
+    open_bridge(CBR_MAX_RECORDS);
+    uint8_t buf[CBR_MAX_DATAGRAM + 1];
+
+    // 100 frames: one full datagram at once, the other 28 after the timer
+    for (int i = 0; i < 100; i++) {
+        send_frame(0x100 + (canid_t)i, 8, (uint8_t)i);
+    }
+    uint64_t start = cbr_monotonic_ns();
+    cbr_poll(&bridge, 0);
+    size_t len = recv_datagram(buf);
+    if (len != CBR_HEADER_SIZE + CBR_MAX_RECORDS * CBR_RECORD_SIZE || recv_datagram(buf) != 0) {
+        test_failed("Full datagram not sent at once");
+    }
+    if (wire_get32(buf, WIRE_SWAP_LE) != CBR_MAGIC || wire_get32(buf + 4, WIRE_SWAP_LE) != 0) {
+        test_failed("Header wrong");
+    }
+    for (int i = 0; i < CBR_MAX_RECORDS; i++) {
+        struct can_frame f;
+        uint32_t offset;
+        if (cbr_get_record(buf + CBR_HEADER_SIZE + i * CBR_RECORD_SIZE, &f, &offset) < 0) {
+            test_failed("Record rejected");
+        }
+        if (f.can_id != 0x100 + (canid_t)i || f.can_dlc != 8 || f.data[7] != i || offset > 1000000000u) {
+            test_failed("Frame wrong or out of order");
+        }
+    }
+
+    while (bridge.out_records) {
+        cbr_poll(&bridge, 1000);
+    }
+    uint64_t waited = cbr_monotonic_ns() - start;
+    len = recv_datagram(buf);
+    if (len != CBR_HEADER_SIZE + 28 * CBR_RECORD_SIZE || wire_get32(buf + 4, WIRE_SWAP_LE) != 1) {
+        test_failed("Partial datagram not flushed by the timer");
+    }
+    if (waited < FLUSH_MS * 1000000ULL || waited > (FLUSH_MS + 500) * 1000000ULL) {
+        test_failed("Timer flush at the wrong time");
+    }
+    if (bridge.can_rx != 100 || bridge.datagrams_tx != 2 || bridge.latency.count != 100 ||
+        bridge.latency.max_ns < FLUSH_MS * 1000000ULL) {
+        test_failed("Wrong counters");
+    }
+    close_bridge();
+
+    // A smaller size threshold
+    open_bridge(10);
+    for (int i = 0; i < 25; i++) {
+        send_frame(0x7FF, 2, 0xAA);
+    }
+    cbr_poll(&bridge, 0);
+    if (recv_datagram(buf) != CBR_HEADER_SIZE + 10 * CBR_RECORD_SIZE ||
+        recv_datagram(buf) != CBR_HEADER_SIZE + 10 * CBR_RECORD_SIZE || recv_datagram(buf) != 0 ||
+        bridge.out_records != 5) {
+        test_failed("Size threshold not honoured");
+    }
+    close_bridge();
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test the reverse path: datagrams from the collector become CAN frames
+ */
+void test_reverse() {
+    printf("Testing UDP to CAN... ");
+
+    open_bridge(CBR_MAX_RECORDS);
+    uint8_t buf[CBR_MAX_DATAGRAM];
+    for (uint32_t seq = 0; seq < 4; seq++) {
+        if (seq == 2) {
+            continue;               // Lost on the way
+        }
+        wire_put32(buf, CBR_MAGIC, WIRE_SWAP_LE);
+        wire_put32(buf + 4, seq, WIRE_SWAP_LE);
+        wire_put64(buf + 8, 0, WIRE_SWAP_LE);
+        for (int i = 0; i < 3; i++) {
+            struct can_frame f;
+            memset(&f, 0, sizeof(f));
+            f.can_id = 0x500 + seq * 16 + (uint32_t)i;
+            f.can_dlc = (uint8_t)(i + 1);
+            f.data[0] = (uint8_t)seq;
+            cbr_put_record(buf + CBR_HEADER_SIZE + i * CBR_RECORD_SIZE, &f, 0);
+        }
+        send(collector, buf, CBR_HEADER_SIZE + 3 * CBR_RECORD_SIZE, 0);
+    }
+    send(collector, "junk", 4, 0);
+    buf[CBR_HEADER_SIZE + 8] = 12;  // Last datagram again with a bad DLC
+    send(collector, buf, CBR_HEADER_SIZE + 3 * CBR_RECORD_SIZE, 0);
+    usleep(10000);
+    cbr_poll(&bridge, 100);
+
+    struct can_frame f;
+    for (uint32_t seq = 0; seq < 4; seq++) {
+        for (int i = 0; seq != 2 && i < 3; i++) {
+            if (read(can_peer, &f, sizeof(f)) != (ssize_t)sizeof(f) || f.can_id != 0x500 + seq * 16 + (uint32_t)i ||
+                f.can_dlc != i + 1 || f.data[0] != seq) {
+                test_failed("Frame from collector wrong");
+            }
+        }
+    }
+    if (read(can_peer, &f, sizeof(f)) >= 0) {
+        test_failed("Malformed datagram reached CAN");
+    }
+    if (bridge.datagrams_rx != 3 || bridge.can_tx != 9 || bridge.lost_datagrams != 1 || bridge.bad_datagrams != 2) {
+        test_failed("Wrong counters");
+    }
+    close_bridge();
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running CAN bridge tests...\n");
+
+    test_records();
+    test_flush();
+    test_reverse();
+
+    printf("All CAN bridge tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file test_can_gateway.c
+ * @brief Unit tests for the multi-bus CAN gateway
+ *
+ * Buses are AF_UNIX SOCK_SEQPACKET pairs carrying struct can_frame, so the
+ * tests run without SocketCAN.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "can_gateway.h"
+
+#define BUSES 3
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static can_gateway_t gw;
+static int peer[BUSES];         // Test side of each bus
+
+static void open_gateway(void) {
+    if (cgw_init(&gw) < 0) {
+        test_failed("cgw_init failed");
+    }
+    for (int b = 0; b < BUSES; b++) {
+        int sv[2];
+        char name[8];
+        snprintf(name, sizeof(name), "bus%d", b);
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sv) < 0 || cgw_add_bus(&gw, sv[0], name) != b) {
+            test_failed("Failed to add bus");
+        }
+        peer[b] = sv[1];
+    }
+}
+
+static void close_gateway(void) {
+    cgw_close(&gw);
+    for (int b = 0; b < BUSES; b++) {
+        close(peer[b]);
+    }
+}
+
+static void send_frame(int bus, canid_t id, uint8_t fill) {
+    struct can_frame f;
+    memset(&f, 0, sizeof(f));
+    f.can_id = id;
+    f.can_dlc = 8;
+    memset(f.data, fill, sizeof(f.data));
+    if (write(peer[bus], &f, sizeof(f)) != (ssize_t)sizeof(f)) {
+        test_failed("Failed to send frame");
+    }
+}
+
+// Next frame delivered to a bus; 0 if none is waiting
+static int recv_frame(int bus, struct can_frame *f) {
+    return read(peer[bus], f, sizeof(*f)) == (ssize_t)sizeof(*f);
+}
+
+/**
+ * Test rule parsing and lookup for standard, extended and default routes
+ */
+void test_rules() {
+    printf("Testing route rules... ");
+
+    open_gateway();
+    int engine = cgw_parse_rule(&gw, "0:0x100>1");
+    int fanout = cgw_parse_rule(&gw, "0:0x100>2:0x180,and=ff00000000000000,or=0000000000000001");
+    int ext = cgw_parse_rule(&gw, "0:0x18FEF100>1");
+    int def = cgw_parse_rule(&gw, "1:*>0");
+    if (engine < 0 || fanout < 0 || ext < 0 || def < 0) {
+        test_failed("Valid rule rejected");
+    }
+    const char *bad[] = { "", "0:0x100", "0:0x100>0", "0:0x100>7", "9:1>0", "0:0x100>1:", "0:0x100>1,and=12",
+                          "0:0x100>1,xor=0000000000000000", "0:0x20000000>1", "0:0x100>1 " };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (cgw_parse_rule(&gw, bad[i]) >= 0) {
+            fprintf(stderr, "%s\n", bad[i]);
+            test_failed("Malformed rule accepted");
+        }
+    }
+
+    if (cgw_lookup(&gw, 0, 0x100) != engine || gw.rules[engine].next != fanout ||
+        gw.rules[fanout].next != CGW_NO_RULE) {
+        test_failed("Standard ID chain wrong");
+    }
+    if (cgw_lookup(&gw, 0, 0x18FEF100 | CAN_EFF_FLAG) != ext || cgw_lookup(&gw, 0, 0x18FEF101 | CAN_EFF_FLAG) != CGW_NO_RULE) {
+        test_failed("Extended ID lookup wrong");
+    }
+    // The same number as a standard ID is a different frame
+    if (cgw_lookup(&gw, 0, 0x101) != CGW_NO_RULE || cgw_lookup(&gw, 2, 0x100) != CGW_NO_RULE) {
+        test_failed("Unrouted ID matched");
+    }
+    if (cgw_lookup(&gw, 1, 0x555) != def || cgw_lookup(&gw, 1, 0x555 | CAN_ERR_FLAG) != CGW_NO_RULE) {
+        test_failed("Default route wrong");
+    }
+
+    // Rewrite keeps RTR, replaces the ID, masks the data
+    struct can_frame in, out;
+    memset(&in, 0, sizeof(in));
+    in.can_id = 0x100 | CAN_RTR_FLAG;
+    in.can_dlc = 8;
+    memset(in.data, 0xAB, sizeof(in.data));
+    cgw_apply(&gw.rules[fanout], &in, &out);
+    uint8_t expected[8] = { 0xAB, 0, 0, 0, 0, 0, 0, 1 };
+    if (out.can_id != (0x180 | CAN_RTR_FLAG) || out.can_dlc != 8 || memcmp(out.data, expected, 8) != 0) {
+        test_failed("Rewrite wrong");
+    }
+    close_gateway();
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test forwarding between buses, fan-out and batched transmission
+ */
+void test_forwarding() {
+    printf("Testing forwarding through the epoll loop... ");
+
+    open_gateway();
+    cgw_parse_rule(&gw, "0:0x100>1");
+    cgw_parse_rule(&gw, "0:0x100>2:0x101");
+    cgw_parse_rule(&gw, "1:*>0");
+    cgw_parse_rule(&gw, "2:0x1ABCDEF0>1:0x7FF");
+
+    // A burst on bus 0 goes out as one sendmmsg() per destination
+    for (int i = 0; i < 50; i++) {
+        send_frame(0, 0x100, (uint8_t)i);
+    }
+    send_frame(0, 0x222, 0);                    // No route
+    send_frame(1, 0x333, 7);
+    send_frame(2, 0x1ABCDEF0 | CAN_EFF_FLAG, 9);
+    if (cgw_poll(&gw, 100) != 3) {
+        test_failed("Not every bus readable");
+    }
+
+    struct can_frame f;
+    for (int i = 0; i < 50; i++) {
+        if (!recv_frame(1, &f) || f.can_id != 0x100 || f.data[0] != (uint8_t)i) {
+            test_failed("Bus 1 frame wrong or out of order");
+        }
+        if (!recv_frame(2, &f) || f.can_id != 0x101 || f.data[0] != (uint8_t)i) {
+            test_failed("Bus 2 frame not rewritten");
+        }
+    }
+    if (!recv_frame(1, &f) || f.can_id != 0x7FF || f.data[0] != 9 || recv_frame(1, &f)) {
+        test_failed("Extended frame not routed");
+    }
+    if (!recv_frame(0, &f) || f.can_id != 0x333 || recv_frame(0, &f) || recv_frame(2, &f)) {
+        test_failed("Default route not applied");
+    }
+
+    cgw_bus_t *b0 = &gw.buses[0], *b1 = &gw.buses[1], *b2 = &gw.buses[2];
+    if (b0->rx_frames != 51 || b0->unrouted != 1 || b1->tx_frames != 51 || b2->tx_frames != 50 ||
+        b0->tx_frames != 1) {
+        test_failed("Wrong counters");
+    }
+    if (b1->tx_batches != 1 || b2->tx_batches != 1) {
+        test_failed("Transmission not batched");
+    }
+
+    // More than a batch in one poll: queues flush as they fill
+    for (int i = 0; i < CGW_BATCH * 2 + 5; i++) {
+        send_frame(0, 0x100, (uint8_t)i);
+    }
+    cgw_poll(&gw, 100);
+    int received = 0;
+    while (recv_frame(1, &f)) {
+        if (f.data[0] != (uint8_t)received++) {
+            test_failed("Large burst reordered");
+        }
+    }
+    if (received != CGW_BATCH * 2 + 5 || b1->dropped != 0) {
+        test_failed("Large burst lost frames");
+    }
+    close_gateway();
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a destination that cannot take frames drops them and the rest flow
+ */
+void test_full_destination() {
+    printf("Testing full destination bus... ");
+
+    open_gateway();
+    cgw_parse_rule(&gw, "0:*>1");
+    cgw_parse_rule(&gw, "0:*>2");
+
+    // Nobody reads bus 1; keep sending until its socket buffer is full
+    struct can_frame f;
+    uint64_t sent = 0;
+    for (int round = 0; round < 200 && gw.buses[1].dropped == 0; round++) {
+        for (int i = 0; i < 32; i++) {
+            send_frame(0, 0x10, (uint8_t)i);
+            sent++;
+        }
+        cgw_poll(&gw, 100);
+        while (recv_frame(2, &f)) {
+        }
+    }
+    if (gw.buses[1].dropped == 0 || gw.buses[1].tx_frames + gw.buses[1].dropped != sent ||
+        gw.buses[2].tx_frames != sent) {
+        test_failed("Full bus blocked the gateway or lost accounting");
+    }
+    close_gateway();
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running CAN gateway tests...\n");
+
+    test_rules();
+    test_forwarding();
+    test_full_destination();
+
+    if (gw.latency.count == 0) {
+        printf("Note: no receive timestamps on this socket type\n");
+    }
+    printf("All CAN gateway tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file test_can_stats.c
+ * @brief Unit tests for the per-ID CAN statistics table
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "can_stats.h"
+
+#define MS 1000000ULL
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static struct can_frame make_frame(canid_t id, uint8_t dlc, uint8_t fill) {
+    struct can_frame f;
+    memset(&f, 0, sizeof(f));
+    f.can_id = id;
+    f.can_dlc = dlc;
+    memset(f.data, fill, dlc);
+    return f;
+}
+
+/**
+ * Test frame lengths on the wire
+ */
+void test_frame_bits() {
+    printf("Testing frame bit lengths... ");
+
+    // ID 0, no data: 34 zero bits up to the end of the CRC, stuffed after every 5
+    struct can_frame f = make_frame(0, 0, 0);
+    if (cst_frame_bits(&f) != 34 + 6 + 13) {
+        fprintf(stderr, "%u bits\n", cst_frame_bits(&f));
+        test_failed("Empty frame length wrong");
+    }
+    // Every length lies between the unstuffed size and the worst case
+    for (int id = 0; id <= 0x7FF; id += 0x55) {
+        for (int dlc = 0; dlc <= 8; dlc++) {
+            f = make_frame((canid_t)id, (uint8_t)dlc, (uint8_t)(id * 7 + dlc));
+            unsigned nominal = 47 + 8 * (unsigned)dlc, bits = cst_frame_bits(&f);
+            if (bits < nominal || bits > nominal + (34 + 8 * (unsigned)dlc - 1) / 4) {
+                test_failed("Standard frame length out of range");
+            }
+        }
+    }
+    f = make_frame(0x18FEF100 | CAN_EFF_FLAG, 8, 0x5A);
+    unsigned bits = cst_frame_bits(&f);
+    if (bits < 67 + 64 || bits > 67 + 64 + (54 + 64 - 1) / 4) {
+        test_failed("Extended frame length out of range");
+    }
+    // A remote frame sends no data whatever its DLC
+    f = make_frame(0x123 | CAN_RTR_FLAG, 8, 0);
+    if (cst_frame_bits(&f) > 47 + 34 / 4) {
+        test_failed("Remote frame counted data bits");
+    }
+
+    // The table-driven length matches bit by bit, extended and remote frames included
+    cst_bit_tables_t tables;
+    cst_bit_tables_init(&tables);
+    srand(1);
+    for (int i = 0; i < 100000; i++) {
+        canid_t flags = (i & 1 ? CAN_EFF_FLAG : 0) | (i % 5 == 0 ? CAN_RTR_FLAG : 0);
+        f = make_frame(((canid_t)rand() & CAN_EFF_MASK) | flags, (uint8_t)(rand() % 9), 0);
+        for (int b = 0; b < 8; b++) {
+            f.data[b] = (uint8_t)(rand() % 4 ? rand() : 0);    // Zero bytes make long runs
+        }
+        if (cst_frame_bits_fast(&tables, &f) != cst_frame_bits(&f)) {
+            test_failed("Table-driven frame length differs");
+        }
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test per-ID counters, gaps, jitter and missed counters
+ */
+void test_entries() {
+    printf("Testing per-ID statistics... ");
+
+    can_stats_t s;
+    if (cst_create(&s, NULL, 500000) < 0) {
+        test_failed("cst_create failed");
+    }
+    cst_set_counter(&s, 0x400, 7, 0xFF);
+    cst_set_counter(&s, 0x401, 0, 0x0F);
+
+    // 0x100 every 10 ms with one late frame; 0x400 with counters 250..255, 0..9 minus three
+    uint64_t t = 1700000000ULL * 1000000000ULL;
+    struct can_frame f = make_frame(0x100, 8, 0);
+    for (int i = 0; i < 100; i++) {
+        cst_record(&s, &f, t + (uint64_t)i * 10 * MS + (i == 50 ? 3 * MS : 0));
+    }
+    uint8_t counters[] = { 250, 251, 252, 253, 255, 0, 1, 1, 2, 5, 6, 7, 8, 9 };
+    for (size_t i = 0; i < sizeof(counters); i++) {
+        f = make_frame(0x400, 8, 0);
+        f.data[7] = counters[i];
+        cst_record(&s, &f, t + i * 100 * MS);
+    }
+    // 4-bit counter in the low nibble, upper nibble carries a signal
+    uint8_t nibbles[] = { 0x3E, 0x7F, 0x10, 0x93 };
+    for (size_t i = 0; i < sizeof(nibbles); i++) {
+        f = make_frame(0x401, 1, nibbles[i]);
+        cst_record(&s, &f, t + i * MS);
+    }
+
+    cst_entry_t e;
+    if (!cst_read(&s, 0x100, &e) || e.frames != 100 || e.bytes != 800 || e.gaps != 99) {
+        test_failed("Counts wrong");
+    }
+    if (e.gap_min_ns != 7 * MS || e.gap_max_ns != 13 * MS || e.gap_sum_ns != 990 * MS) {
+        test_failed("Gap min/max/mean wrong");
+    }
+    if (e.period_ns < 9 * MS || e.period_ns > 11 * MS) {
+        test_failed("Smoothed period wrong");
+    }
+    // All but the early gap in the 8-16 ms bucket; the late and early ones deviate by ~3 ms
+    if (e.gap_hist[cst_bucket(10 * MS)] != 98 || e.gap_hist[cst_bucket(7 * MS)] != 1 || e.jitter_hist[0] < 50 ||
+        cst_hist_percentile(e.jitter_hist, 0.5) > 2000 || cst_hist_percentile(e.jitter_hist, 1.0) < 2 * MS) {
+        test_failed("Histograms wrong");
+    }
+    if (e.counter_byte != CST_NO_COUNTER || e.counter_missed != 0) {
+        test_failed("Counter tracked without being configured");
+    }
+
+    if (!cst_read(&s, 0x400, &e) || e.counter_missed != 3) {
+        fprintf(stderr, "%lu missed\n", (unsigned long)e.counter_missed);
+        test_failed("Missed 8-bit counters wrong");
+    }
+    if (!cst_read(&s, 0x401, &e) || e.counter_missed != 2) {
+        fprintf(stderr, "%lu missed\n", (unsigned long)e.counter_missed);
+        test_failed("Missed 4-bit counters wrong");
+    }
+    if (cst_read(&s, 0x555, &e)) {
+        test_failed("Unseen ID reported");
+    }
+
+    // Extended and error frames count in the header only
+    f = make_frame(0x555 | CAN_EFF_FLAG, 8, 0);
+    cst_record(&s, &f, t + 2000 * MS);
+    f = make_frame(CAN_ERR_FLAG | 0x555, 8, 0);
+    cst_record(&s, &f, t + 2000 * MS);
+    if (cst_read(&s, 0x555, &e) || atomic_load(&s.hdr->extended_frames) != 1 ||
+        atomic_load(&s.hdr->error_frames) != 1 || atomic_load(&s.hdr->frames) != 100 + 14 + 4 + 2) {
+        test_failed("Header counters wrong");
+    }
+    cst_close(&s);
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test bus load windows
+ */
+void test_bus_load() {
+    printf("Testing bus load... ");
+
+    can_stats_t s;
+    if (cst_create(&s, NULL, 500000) < 0) {
+        test_failed("cst_create failed");
+    }
+    // 2000 frames in one second on a 500 kbit/s bus, then a quiet second
+    uint64_t t = 1000 * CST_WINDOW_NS;
+    struct can_frame f = make_frame(0x200, 8, 0x55);
+    uint64_t bits = 0;
+    for (int i = 0; i < 2000; i++) {
+        cst_record(&s, &f, t + (uint64_t)i * 500000);
+        bits += cst_frame_bits(&f);
+    }
+    cst_tick(&s, t + CST_WINDOW_NS);
+    unsigned expected = (unsigned)(bits * 1000 / 500000);
+    if (atomic_load(&s.hdr->load_permille) != expected || atomic_load(&s.hdr->peak_permille) != expected ||
+        expected < 400 || expected > 600) {
+        fprintf(stderr, "load %u, expected %u\n", atomic_load(&s.hdr->load_permille), expected);
+        test_failed("Load of a busy window wrong");
+    }
+    cst_tick(&s, t + 2 * CST_WINDOW_NS + 1);
+    if (atomic_load(&s.hdr->load_permille) != 0 || atomic_load(&s.hdr->peak_permille) != expected) {
+        test_failed("Idle window not reported as zero");
+    }
+    cst_tick(&s, t + 10 * CST_WINDOW_NS);
+    cst_record(&s, &f, t + 10 * CST_WINDOW_NS + 1);
+    if (atomic_load(&s.hdr->load_permille) != 0) {
+        test_failed("Load after a long idle period wrong");
+    }
+    cst_close(&s);
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test a reader attached through shared memory while the writer updates
+ */
+void test_shared() {
+    printf("Testing shared memory export... ");
+
+    char name[64];
+    snprintf(name, sizeof(name), "/can_stats_test_%d", (int)getpid());
+    can_stats_t writer, reader;
+    if (cst_create(&writer, name, 1000000) < 0) {
+        test_failed("cst_create failed");
+    }
+    if (cst_attach(&reader, name) < 0) {
+        test_failed("cst_attach failed");
+    }
+    struct can_frame f = make_frame(0x7DF, 8, 1);
+    for (int i = 0; i < 10; i++) {
+        cst_record(&writer, &f, 1000 + (uint64_t)i * MS);
+    }
+    cst_entry_t e;
+    if (!cst_read(&reader, 0x7DF, &e) || e.frames != 10 || (atomic_load(&e.seq) & 1) ||
+        atomic_load(&reader.hdr->frames) != 10 || reader.hdr->bitrate != 1000000) {
+        test_failed("Reader sees wrong values");
+    }
+
+    // Read-only mapping: the reader cannot disturb the writer
+    if (mprotect(reader.hdr, reader.map_size, PROT_READ | PROT_WRITE) == 0) {
+        test_failed("Reader mapping writable");
+    }
+
+    // A reader and writer interleaved at random see consistent entries
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < 200000; i++) {
+            cst_record(&writer, &f, 2000000000ULL + (uint64_t)i * 1000);
+        }
+        _exit(0);
+    }
+    uint64_t frame_bits = cst_frame_bits(&f);
+    int consistent = 1;
+    for (int i = 0; i < 20000; i++) {
+        cst_read(&reader, 0x7DF, &e);
+        // Every update adds the same frame: bytes and bits track frames exactly
+        if (e.bytes != e.frames * 8 || e.bits != e.frames * frame_bits) {
+            consistent = 0;
+        }
+    }
+    waitpid(pid, NULL, 0);
+    if (!consistent) {
+        test_failed("Torn entry read");
+    }
+    cst_close(&reader);
+    cst_close(&writer);
+    if (cst_attach(&reader, name) == 0) {
+        test_failed("Table not removed by the writer");
+    }
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running CAN statistics tests...\n");
+
+    test_frame_bits();
+    test_entries();
+    test_bus_load();
+    test_shared();
+
+    printf("All CAN statistics tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file test_channel.c
+ * @brief Unit tests for the lock-free MPMC queue and eventfd channel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include "channel.h"
+
+#define NUM_PRODUCERS 4
+#define NUM_CONSUMERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Items are encoded as (producer << 32 | sequence) + 1 so they are never NULL
+#define ENCODE(p, i) ((void *)(uintptr_t)((((uint64_t)(p) << 32) | (uint64_t)(i)) + 1))
+#define DECODE_P(v) ((int)((((uint64_t)(uintptr_t)(v)) - 1) >> 32))
+#define DECODE_I(v) ((uint32_t)(((uint64_t)(uintptr_t)(v)) - 1))
+
+static mpmc_queue_t stress_queue;
+static atomic_int consumed_total;
+static atomic_ullong checksum;
+
+/**
+ * Test FIFO order and full/empty behavior on one thread
+ */
+void test_queue_basic() {
+    printf("Testing MPMC queue FIFO and bounds... ");
+
+    mpmc_queue_t q;
+    if (mpmc_queue_init(&q, 5) < 0 || mpmc_queue_capacity(&q) != 8) {
+        test_failed("Queue capacity not rounded to power of 2");
+    }
+
+    if (mpmc_queue_pop(&q) != NULL) {
+        test_failed("Empty queue returned an item");
+    }
+
+    // Several laps around the ring
+    for (int lap = 0; lap < 3; lap++) {
+        for (int i = 0; i < 8; i++) {
+            if (mpmc_queue_push(&q, ENCODE(lap, i)) < 0) {
+                test_failed("Push failed before queue was full");
+            }
+        }
+        if (mpmc_queue_push(&q, ENCODE(9, 9)) == 0) {
+            test_failed("Push succeeded on full queue");
+        }
+        if (mpmc_queue_size(&q) != 8) {
+            test_failed("Size incorrect on full queue");
+        }
+        for (int i = 0; i < 8; i++) {
+            void *v = mpmc_queue_pop(&q);
+            if (!v || DECODE_P(v) != lap || DECODE_I(v) != (uint32_t)i) {
+                test_failed("Items not returned in FIFO order");
+            }
+        }
+    }
+
+    mpmc_queue_destroy(&q);
+    printf("PASSED\n");
+}
+
+static void *stress_producer(void *arg) {
+    int id = (int)(intptr_t)arg;
+    for (uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        while (mpmc_queue_push(&stress_queue, ENCODE(id, i)) < 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *arg) {
+    (void)arg;
+    uint32_t last_seen[NUM_PRODUCERS];
+    memset(last_seen, 0, sizeof(last_seen));
+
+    while (atomic_load(&consumed_total) < NUM_PRODUCERS * ITEMS_PER_PRODUCER) {
+        void *v = mpmc_queue_pop(&stress_queue);
+        if (!v) {
+            sched_yield();
+            continue;
+        }
+        int p = DECODE_P(v);
+        uint32_t i = DECODE_I(v);
+        // Per-producer order must be preserved for each consumer
+        if (p < 0 || p >= NUM_PRODUCERS || (i != 0 && i + 1 <= last_seen[p])) {
+            test_failed("Per-producer order violated");
+        }
+        last_seen[p] = i + 1;
+        atomic_fetch_add(&checksum, (unsigned long long)i);
+        atomic_fetch_add(&consumed_total, 1);
+    }
+    return NULL;
+}
+
+/**
+ * Test concurrent producers and consumers lose and duplicate nothing
+ */
+void test_queue_concurrent() {
+    printf("Testing MPMC queue with %d producers / %d consumers... ",
+           NUM_PRODUCERS, NUM_CONSUMERS);
+
+    if (mpmc_queue_init(&stress_queue, 256) < 0) {
+        test_failed("Failed to create queue");
+    }
+    atomic_store(&consumed_total, 0);
+    atomic_store(&checksum, 0);
+
+    pthread_t producers[NUM_PRODUCERS], consumers[NUM_CONSUMERS];
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        pthread_create(&consumers[i], NULL, stress_consumer, NULL);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_create(&producers[i], NULL, stress_producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+
+    unsigned long long expected = (unsigned long long)NUM_PRODUCERS *
+        ((unsigned long long)ITEMS_PER_PRODUCER * (ITEMS_PER_PRODUCER - 1) / 2);
+    if (atomic_load(&consumed_total) != NUM_PRODUCERS * ITEMS_PER_PRODUCER ||
+        atomic_load(&checksum) != expected) {
+        test_failed("Items lost or duplicated");
+    }
+    if (mpmc_queue_pop(&stress_queue) != NULL) {
+        test_failed("Queue not empty after run");
+    }
+
+    mpmc_queue_destroy(&stress_queue);
+    printf("PASSED\n");
+}
+
+// Check whether a descriptor is readable without consuming it
+static int fd_readable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 1;
+}
+
+/**
+ * Test that the eventfd is signalled only on the empty to non-empty edge
+ */
+void test_channel_signalling() {
+    printf("Testing channel eventfd signalling... ");
+
+    channel_t ch;
+    if (channel_init(&ch, 16) < 0) {
+        test_failed("Failed to create channel");
+    }
+
+    if (fd_readable(channel_fd(&ch))) {
+        test_failed("New channel is readable");
+    }
+
+    for (int i = 0; i < 10; i++) {
+        if (channel_send(&ch, ENCODE(0, i)) < 0) {
+            test_failed("Send failed");
+        }
+    }
+
+    // Ten sends, one eventfd write
+    uint64_t count = 0;
+    if (read(channel_fd(&ch), &count, sizeof(count)) != sizeof(count) || count != 1) {
+        test_failed("Eventfd written more than once for a burst");
+    }
+    atomic_store(&ch.signalled, 0);
+
+    int received = 0;
+    while (channel_recv(&ch)) {
+        received++;
+    }
+    if (received != 10) {
+        test_failed("Not all messages received");
+    }
+
+    // Next send after a drain signals again
+    channel_send(&ch, ENCODE(0, 42));
+    if (!fd_readable(channel_fd(&ch))) {
+        test_failed("Channel not signalled after drain");
+    }
+    channel_ack(&ch);
+    if (fd_readable(channel_fd(&ch))) {
+        test_failed("Ack did not clear the eventfd");
+    }
+    if (DECODE_I(channel_recv(&ch)) != 42) {
+        test_failed("Wrong message after ack");
+    }
+
+    // Full channel reports EAGAIN
+    for (int i = 0; i < 16; i++) {
+        channel_send(&ch, ENCODE(0, i));
+    }
+    if (channel_send(&ch, ENCODE(0, 99)) == 0 || errno != EAGAIN) {
+        test_failed("Send on full channel did not fail with EAGAIN");
+    }
+
+    channel_destroy(&ch);
+    printf("PASSED\n");
+}
+
+static void *blocking_receiver(void *arg) {
+    channel_t *ch = arg;
+    intptr_t count = 0;
+    while (channel_recv_wait(ch, -1)) {
+        count++;
+    }
+    if (errno != EPIPE) {
+        test_failed("Blocking receive ended without EPIPE");
+    }
+    return (void *)count;
+}
+
+/**
+ * Test blocking receive across threads and close semantics
+ */
+void test_channel_blocking() {
+    printf("Testing channel blocking receive and close... ");
+
+    channel_t ch;
+    if (channel_init(&ch, 64) < 0) {
+        test_failed("Failed to create channel");
+    }
+
+    if (channel_recv_wait(&ch, 10) != NULL || errno != ETIMEDOUT) {
+        test_failed("Empty wait did not time out");
+    }
+
+    pthread_t receivers[2];
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&receivers[i], NULL, blocking_receiver, &ch);
+    }
+
+    for (int i = 0; i < 10000; i++) {
+        while (channel_send(&ch, ENCODE(1, i)) < 0) {
+            sched_yield();
+        }
+    }
+    channel_close(&ch);
+
+    if (channel_send(&ch, ENCODE(1, 0)) == 0 || errno != EPIPE) {
+        test_failed("Send after close did not fail with EPIPE");
+    }
+
+    intptr_t total = 0;
+    for (int i = 0; i < 2; i++) {
+        void *res;
+        pthread_join(receivers[i], &res);
+        total += (intptr_t)res;
+    }
+    if (total != 10000) {
+        test_failed("Blocking receivers lost messages");
+    }
+
+    channel_destroy(&ch);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running channel tests...\n");
+
+    test_queue_basic();
+    test_queue_concurrent();
+    test_channel_signalling();
+    test_channel_blocking();
+
+    printf("All channel tests PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file test_codec.c
+ * @brief Unit tests for msgc-generated message codecs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "can_codec.h"
+#include "sensor_codec.h"
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Test field offsets and byte order against hand-built wire images
+ */
+void test_wire_layout() {
+    printf("Testing wire layout and byte order... ");
+
+    // Big-endian CAN payload, as can_automotive receives it
+    const uint8_t engine_wire[7] = { 0x0b, 0xb8, 90, 42, 0x30, 0x39, 0x81 };
+    engine_data_t e;
+    if (engine_data_decode(&e, engine_wire, sizeof(engine_wire)) != 0 || e.rpm != 3000 ||
+        e.temperature != 90 || e.throttle_position != 42 || e.fuel_level != 12345 ||
+        e.engine_status != 0x81) {
+        test_failed("engine_data decoded wrongly");
+    }
+
+    const uint8_t steering_wire[4] = { 0xfc, 0x18, 7, 1 };
+    steering_data_t st;
+    if (steering_data_decode(&st, steering_wire, sizeof(steering_wire)) != 0 ||
+        st.steering_angle != -1000 || st.steering_speed != 7 || st.steering_status != 1) {
+        test_failed("Signed big-endian field decoded wrongly");
+    }
+
+    // Little-endian sensor packet: same bytes as the old packed struct on x86
+    sensor_data_t s = { 0x01020304, 21.5f, 1013.25f, 40.0f, 0xa0b0c0d0 };
+    uint8_t sensor_wire[SENSOR_DATA_SIZE];
+    const uint8_t id_bytes[4] = { 0x04, 0x03, 0x02, 0x01 };
+    const uint8_t ts_bytes[4] = { 0xd0, 0xc0, 0xb0, 0xa0 };
+    float temperature;
+    if (sensor_data_encode(&s, sensor_wire, sizeof(sensor_wire)) != SENSOR_DATA_SIZE ||
+        memcmp(sensor_wire, id_bytes, 4) != 0 || memcmp(sensor_wire + 16, ts_bytes, 4) != 0) {
+        test_failed("sensor_data encoded wrongly");
+    }
+    uint32_t bits = (uint32_t)sensor_wire[4] | (uint32_t)sensor_wire[5] << 8 |
+                    (uint32_t)sensor_wire[6] << 16 | (uint32_t)sensor_wire[7] << 24;
+    memcpy(&temperature, &bits, sizeof(temperature));
+    if (temperature != 21.5f) {
+        test_failed("Float field not at its offset");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test encode/decode round trips, including arrays
+ */
+void test_round_trip() {
+    printf("Testing round trips and arrays... ");
+
+    dashboard_status_t d = { 55, 90, 75, 1, 2, 3, 0, 200 };
+    dashboard_status_t d2;
+    uint8_t frame[8];
+    if (dashboard_status_encode(&d, frame, sizeof(frame)) != DASHBOARD_STATUS_SIZE || frame[0] != 55 ||
+        frame[7] != 200 || dashboard_status_decode(&d2, frame, sizeof(frame)) != 0 ||
+        memcmp(&d, &d2, sizeof(d)) != 0) {
+        test_failed("dashboard_status round trip");
+    }
+
+    // 32 big-endian samples: long enough to take the SIMD path when enabled
+    vibration_block_t v = { 7, 123456789, 1000, 32, { 0 } };
+    for (int i = 0; i < 32; i++) {
+        v.samples[i] = (int16_t)(i * 1021 - 16000);
+    }
+    uint8_t buf[VIBRATION_BLOCK_SIZE];
+    vibration_block_t v2;
+    if (vibration_block_encode(&v, buf, sizeof(buf)) != VIBRATION_BLOCK_SIZE ||
+        vibration_block_decode(&v2, buf, sizeof(buf)) != 0 || memcmp(&v, &v2, sizeof(v)) != 0) {
+        test_failed("vibration_block round trip");
+    }
+    // samples[1] = -14979 = 0xc57d, at offset 12 + 2
+    if (buf[14] != 0xc5 || buf[15] != 0x7d) {
+        test_failed("Array element not big-endian");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test short buffers, optional fields and too-small output buffers
+ */
+void test_lengths() {
+    printf("Testing short messages and optional fields... ");
+
+    const uint8_t wire[7] = { 0x0b, 0xb8, 90, 42, 0x30, 0x39, 0x81 };
+    engine_data_t e;
+    memset(&e, 0xff, sizeof(e));
+    if (engine_data_decode(&e, wire, 6) != 0 || e.engine_status != 0 || e.fuel_level != 12345) {
+        test_failed("Missing optional field not zeroed");
+    }
+    if (engine_data_decode(&e, wire, ENGINE_DATA_MIN_SIZE - 1) != -1) {
+        test_failed("Short engine_data accepted");
+    }
+
+    brake_data_t b;
+    steering_data_t st;
+    if (brake_data_decode(&b, wire, 3) != -1 || steering_data_decode(&st, wire, 3) != 0 ||
+        st.steering_status != 0 || steering_data_decode(&st, wire, 2) != -1) {
+        test_failed("Wrong length handling");
+    }
+
+    sensor_data_t s;
+    uint8_t big[64] = { 0 };
+    if (sensor_data_decode(&s, big, SENSOR_DATA_SIZE - 1) != -1 ||
+        sensor_data_decode(&s, big, sizeof(big)) != 0) {
+        test_failed("Wrong sensor_data length handling");
+    }
+
+    uint8_t small[SENSOR_DATA_SIZE - 1];
+    if (sensor_data_encode(&s, small, sizeof(small)) != 0) {
+        test_failed("Encoded past the end of the buffer");
+    }
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running message codec tests...\n");
+
+    test_wire_layout();
+    test_round_trip();
+    test_lengths();
+
+    printf("All message codec tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,271 @@
+/**
+ * @file test_command_protocol.c
+ * @brief Unit tests for perfect-hash command dispatch and pipelined sessions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_protocol.h"
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static int handle_echo(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    cmd_printf(out, "echo %s", args ? args : "(none)");
+    return CMD_CONTINUE;
+}
+
+static int handle_count(void *ctx, const char *args, cmd_out_t *out) {
+    (void)args;
+    cmd_printf(out, "%d", ++*(int *)ctx);
+    return CMD_CONTINUE;
+}
+
+static int handle_big(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    for (int i = 0; i < 2 * CMD_MAX_REPLY; i++) {
+        cmd_write(out, "x", 1);
+    }
+    return CMD_CONTINUE;
+}
+
+static int handle_quit(void *ctx, const char *args, cmd_out_t *out) {
+    (void)ctx;
+    (void)args;
+    cmd_printf(out, "bye");
+    return CMD_CLOSE;
+}
+
+static const cmd_def_t defs[] = {
+    {"echo", "Echo the arguments", handle_echo},
+    {"count", "Count calls", handle_count},
+    {"big", "Reply larger than allowed", handle_big},
+    {"quit", "Close", handle_quit},
+    {"status", "", handle_echo},
+    {"reboot", "", handle_echo},
+    {"shutdown", "", handle_echo},
+    {"set", "", handle_echo},
+    {"get", "", handle_echo},
+    {"help", "", handle_echo},
+};
+#define NDEFS (sizeof(defs) / sizeof(defs[0]))
+
+// Flush callback collecting everything sent
+static char sent[1 << 20];
+static size_t sent_len;
+static int fail_flush;
+
+static int collect(void *io, const char *data, size_t len) {
+    (void)io;
+    if (fail_flush || sent_len + len > sizeof(sent)) {
+        return -1;
+    }
+    memcpy(sent + sent_len, data, len);
+    sent_len += len;
+    return 0;
+}
+
+static void expect_sent(const char *expected, const char *message) {
+    if (sent_len != strlen(expected) || memcmp(sent, expected, sent_len) != 0) {
+        fprintf(stderr, "sent: %.*s\n", (int)sent_len, sent);
+        test_failed(message);
+    }
+    sent_len = 0;
+}
+
+/**
+ * Test the perfect-hash table
+ */
+void test_table() {
+    printf("Testing perfect-hash dispatch... ");
+
+    cmd_table_t t;
+    if (cmd_table_build(&t, defs, NDEFS) < 0 || t.mask != 31) {
+        test_failed("Table not built");
+    }
+    for (size_t i = 0; i < NDEFS; i++) {
+        if (cmd_lookup(&t, defs[i].name, strlen(defs[i].name)) != &defs[i]) {
+            test_failed("Command not found");
+        }
+    }
+    // Prefixes, extensions, case and empty names are not commands
+    const char *misses[] = { "", "e", "ech", "echoo", "ECHO", "sett", "ge", "quit ", "help\r" };
+    for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+        if (cmd_lookup(&t, misses[i], strlen(misses[i])) != NULL) {
+            test_failed("Non-command found");
+        }
+    }
+    // Length comes from the caller: the name need not be terminated
+    if (cmd_lookup(&t, "setx", 3) != &defs[7]) {
+        test_failed("Lookup by length failed");
+    }
+
+    cmd_def_t dup[] = { {"a", "", handle_echo}, {"b", "", handle_echo}, {"a", "", handle_echo} };
+    if (cmd_table_build(&t, dup, 3) == 0) {
+        test_failed("Duplicate names accepted");
+    }
+    cmd_def_t many[40];
+    char names[40][8];
+    for (int i = 0; i < 40; i++) {
+        snprintf(names[i], sizeof(names[i]), "c%d", i);
+        many[i] = (cmd_def_t){ names[i], "", handle_echo };
+    }
+    if (cmd_table_build(&t, many, 32) < 0 || cmd_table_build(&t, many, 40) == 0) {
+        test_failed("Table size limit wrong");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test pipelined commands, split lines and one flush per batch
+ */
+void test_pipelining() {
+    printf("Testing pipelined sessions... ");
+
+    cmd_table_t t;
+    cmd_table_build(&t, defs, NDEFS);
+    static cmd_session_t s;
+    int calls = 0;
+    cmd_session_init(&s, &t, &calls, collect, NULL);
+
+    // Several commands in one read: one flush with every reply in order
+    const char *batch = "echo a b\r\ncount\n  echo   padded  \nnope 1 2\n\necho\n";
+    if (cmd_session_feed(&s, batch, strlen(batch)) != CMD_CONTINUE || sent_len != 0) {
+        test_failed("Replies sent before the flush");
+    }
+    cmd_session_flush(&s);
+    expect_sent("echo a b\r\n> 1\r\n> echo padded  \r\n> "
+                "Unknown command: nope\nType 'help' for available commands\r\n> \r\n> echo (none)\r\n> ",
+                "Batch replies wrong");
+    if (s.flushes != 1 || s.commands != 5) {
+        test_failed("Wrong counters");
+    }
+
+    // A command split across reads, one byte at a time
+    const char *split = "count\r\necho split\n";
+    for (size_t i = 0; i < strlen(split); i++) {
+        cmd_session_feed(&s, split + i, 1);
+    }
+    cmd_session_flush(&s);
+    expect_sent("2\r\n> echo split\r\n> ", "Split commands wrong");
+    cmd_session_feed(&s, "count", 5);
+    cmd_session_flush(&s);
+    if (sent_len != 0 || calls != 2) {
+        test_failed("Partial line run");
+    }
+    cmd_session_feed(&s, "\n", 1);
+    cmd_session_flush(&s);
+    expect_sent("3\r\n> ", "Completed line not run");
+
+    // Over-long lines are answered with an error and skipped, in pieces or whole
+    char line[3 * CMD_MAX_LINE];
+    memset(line, 'z', sizeof(line));
+    cmd_session_feed(&s, "echo ", 5);
+    cmd_session_feed(&s, line, CMD_MAX_LINE);
+    cmd_session_feed(&s, line, CMD_MAX_LINE);
+    cmd_session_feed(&s, "\necho after\n", 12);
+    cmd_session_flush(&s);
+    expect_sent("Error: Line too long (limit 1023 bytes)\r\n> echo after\r\n> ", "Long line not skipped");
+    memcpy(line, "echo ", 5);
+    line[CMD_MAX_LINE - 2] = '\n';  // Longest accepted line
+    cmd_session_feed(&s, line, CMD_MAX_LINE - 1);
+    cmd_session_flush(&s);
+    if (sent_len != CMD_MAX_LINE - 2 + 4 || memcmp(sent, "echo zzz", 8) != 0) {
+        test_failed("Longest line not accepted");
+    }
+    sent_len = 0;
+
+    // Replies are capped at CMD_MAX_REPLY
+    cmd_session_feed(&s, "big\nbig\n", 8);
+    cmd_session_flush(&s);
+    if (sent_len != 2 * (CMD_MAX_REPLY - 1 + 4)) {
+        test_failed("Reply not truncated");
+    }
+    sent_len = 0;
+
+    // Nothing runs after quit, even in the same read
+    if (cmd_session_feed(&s, "count\nquit\ncount\n", 17) != CMD_CLOSE ||
+        cmd_session_feed(&s, "count\n", 6) != CMD_CLOSE) {
+        test_failed("Quit not reported");
+    }
+    cmd_session_flush(&s);
+    expect_sent("4\r\n> bye\r\n> ", "Commands ran after quit");
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a bulk push flushes only when the batch is full
+ */
+void test_bulk() {
+    printf("Testing bulk batches... ");
+
+    cmd_table_t t;
+    cmd_table_build(&t, defs, NDEFS);
+    static cmd_session_t s;
+    int calls = 0;
+    cmd_session_init(&s, &t, &calls, collect, NULL);
+
+    // 20000 commands in 16 KB reads, like full TLS records
+    static char input[20000 * 16];
+    size_t len = 0;
+    for (int i = 0; i < 20000; i++) {
+        len += (size_t)sprintf(input + len, "set p%05d 1.5\n", i);
+    }
+    for (size_t off = 0; off < len; off += 16384) {
+        size_t n = len - off < 16384 ? len - off : 16384;
+        if (cmd_session_feed(&s, input + off, n) != CMD_CONTINUE) {
+            test_failed("Feed failed");
+        }
+    }
+    cmd_session_flush(&s);
+
+    // "echo p00000 1.5\r\n> " per command, in order
+    size_t reply = strlen("echo p00000 1.5\r\n> ");
+    if (sent_len != 20000 * reply || s.commands != 20000) {
+        test_failed("Bulk replies missing");
+    }
+    for (int i = 0; i < 20000; i += 997) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "echo p%05d 1.5\r\n> ", i);
+        if (memcmp(sent + (size_t)i * reply, expected, reply) != 0) {
+            test_failed("Bulk reply out of order");
+        }
+    }
+    // Flushes happen only when the buffer is nearly full
+    size_t min_flushes = sent_len / CMD_OUT_SIZE + 1;
+    if (s.flushes < min_flushes || s.flushes > min_flushes + 1) {
+        fprintf(stderr, "%lu flushes\n", (unsigned long)s.flushes);
+        test_failed("Too many flushes");
+    }
+    sent_len = 0;
+
+    // A failed early flush is reported
+    fail_flush = 1;
+    if (cmd_session_feed(&s, input, sizeof(input) / 2) != -1) {
+        test_failed("Flush failure not reported");
+    }
+    fail_flush = 0;
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running command protocol tests...\n");
+
+    test_table();
+    test_pipelining();
+    test_bulk();
+
+    printf("All command protocol tests PASSED\n");
+    return 0;
+}
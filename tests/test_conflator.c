@@ -0,0 +1,165 @@
+/**
+ * @file test_conflator.c
+ * @brief Unit tests for latest-value conflation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "conflator.h"
+
+#define KEYS 16
+#define UPDATES_PER_KEY 20000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Every field carries the same count, so a torn copy is detectable
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+    uint64_t c[6];
+} value_t;
+
+static value_t make_value(uint64_t n) {
+    value_t v;
+    v.a = v.b = n;
+    for (int i = 0; i < 6; i++) {
+        v.c[i] = n;
+    }
+    return v;
+}
+
+/**
+ * Test coalescing, delivery order and counters on one thread
+ */
+void test_coalescing() {
+    printf("Testing conflation and delivery order... ");
+
+    conflator_t c;
+    if (conflator_init(&c, KEYS, sizeof(value_t)) < 0) {
+        test_failed("Failed to create conflator");
+    }
+
+    // Key 5 changes three times, then key 2, then key 5 again
+    value_t v = make_value(1);
+    if (conflator_publish(&c, 5, &v) != 1) {
+        test_failed("First update not queued");
+    }
+    v = make_value(2);
+    conflator_publish(&c, 5, &v);
+    v = make_value(10);
+    conflator_publish(&c, 2, &v);
+    v = make_value(3);
+    if (conflator_publish(&c, 5, &v) != 0 || conflator_publish(&c, KEYS, &v) != -1) {
+        test_failed("Pending update not conflated");
+    }
+    if (conflator_pending(&c) != 2 || c.published != 4 || c.conflated != 2) {
+        test_failed("Wrong counters after publishing");
+    }
+
+    // Keys come out in the order they first changed, with their latest value
+    uint32_t key;
+    value_t out;
+    if (conflator_poll(&c, &key, &out) != 1 || key != 5 || out.a != 3 ||
+        conflator_poll(&c, &key, &out) != 1 || key != 2 || out.a != 10 ||
+        conflator_poll(&c, &key, &out) != 0) {
+        test_failed("Wrong delivery");
+    }
+
+    // Once read, a key is queued again by its next update
+    v = make_value(4);
+    if (conflator_publish(&c, 5, &v) != 1 || conflator_poll(&c, &key, &out) != 1 || out.a != 4) {
+        test_failed("Key not requeued after delivery");
+    }
+    if (c.delivered != 3 || c.published != c.delivered + c.conflated) {
+        test_failed("Counters do not balance");
+    }
+
+    conflator_destroy(&c);
+    printf("PASSED\n");
+}
+
+static conflator_t shared;
+static atomic_int producer_done;
+
+// Publish an increasing count for every key, round robin, as fast as possible
+static void *producer(void *arg) {
+    (void)arg;
+    for (uint64_t n = 1; n <= UPDATES_PER_KEY; n++) {
+        for (uint32_t key = 0; key < KEYS; key++) {
+            value_t v = make_value(n);
+            conflator_publish(&shared, key, &v);
+        }
+    }
+    atomic_store(&producer_done, 1);
+    return NULL;
+}
+
+/**
+ * Test a slow consumer against a fast producer
+ */
+void test_slow_consumer() {
+    printf("Testing slow consumer against fast producer... ");
+
+    if (conflator_init(&shared, KEYS, sizeof(value_t)) < 0) {
+        test_failed("Failed to create conflator");
+    }
+    atomic_store(&producer_done, 0);
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, NULL);
+
+    uint64_t last[KEYS] = { 0 };
+    struct timespec pause = { 0, 1000 };
+    for (;;) {
+        int done = atomic_load(&producer_done);
+        uint32_t key;
+        value_t out;
+        while (conflator_poll(&shared, &key, &out)) {
+            if (out.a != out.b || out.a != out.c[5]) {
+                test_failed("Torn value delivered");
+            }
+            if (out.a <= last[key]) {
+                test_failed("Value went backwards or repeated");
+            }
+            last[key] = out.a;
+            nanosleep(&pause, NULL);    // The slow part
+        }
+        if (done) {
+            break;
+        }
+    }
+    pthread_join(thread, NULL);
+
+    for (int key = 0; key < KEYS; key++) {
+        if (last[key] != UPDATES_PER_KEY) {
+            test_failed("Latest value not delivered");
+        }
+    }
+    if (shared.published != (uint64_t)KEYS * UPDATES_PER_KEY ||
+        shared.published != shared.delivered + shared.conflated || shared.conflated == 0) {
+        test_failed("Counters do not balance");
+    }
+
+    conflator_destroy(&shared);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running conflator tests...\n");
+
+    test_coalescing();
+    test_slow_consumer();
+
+    printf("All conflator tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file test_coroutine.c
+ * @brief Unit tests for stackless coroutines and the co_loop scheduler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include "coroutine.h"
+
+#define TEST_MESSAGE "COROUTINE TEST MESSAGE"
+#define NUM_SLEEPERS 5
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+typedef struct {
+    co_task_t co;
+    int fd;
+    char buffer[64];
+    size_t used;
+    ssize_t res;
+    int finished;
+} echo_state_t;
+
+// Reader: waits for the full message then writes it back
+static int echo_reader(co_task_t *co) {
+    echo_state_t *st = (echo_state_t *)co->arg;
+
+    CO_BEGIN(co);
+
+    while (st->used < strlen(TEST_MESSAGE)) {
+        CO_READ(co, st->fd, st->buffer + st->used, sizeof(st->buffer) - st->used - 1, st->res);
+        if (st->res <= 0) {
+            CO_EXIT(co);
+        }
+        st->used += st->res;
+    }
+
+    CO_WRITE(co, st->fd, st->buffer, st->used, st->res);
+
+    CO_END(co);
+}
+
+// Writer: sleeps first so the reader has to suspend on EAGAIN
+static int delayed_writer(co_task_t *co) {
+    echo_state_t *st = (echo_state_t *)co->arg;
+
+    CO_BEGIN(co);
+
+    CO_SLEEP(co, 20);
+    CO_WRITE(co, st->fd, TEST_MESSAGE, strlen(TEST_MESSAGE), st->res);
+    st->used = 0;
+    while (st->used < strlen(TEST_MESSAGE)) {
+        CO_READ(co, st->fd, st->buffer + st->used, sizeof(st->buffer) - st->used - 1, st->res);
+        if (st->res <= 0) {
+            CO_EXIT(co);
+        }
+        st->used += st->res;
+    }
+
+    CO_END(co);
+}
+
+static void mark_finished(co_task_t *co) {
+    ((echo_state_t *)co->arg)->finished = 1;
+}
+
+/**
+ * Test read/write suspension on a non-blocking socket pair
+ */
+void test_coroutine_io() {
+    printf("Testing coroutine read/write suspension... ");
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) {
+        test_failed("Failed to create socket pair");
+    }
+
+    co_loop_t loop;
+    if (co_loop_init(&loop) < 0) {
+        test_failed("Failed to create coroutine loop");
+    }
+
+    echo_state_t reader, writer;
+    memset(&reader, 0, sizeof(reader));
+    memset(&writer, 0, sizeof(writer));
+    reader.fd = sv[0];
+    writer.fd = sv[1];
+
+    co_spawn(&loop, &reader.co, echo_reader, mark_finished, &reader);
+    co_spawn(&loop, &writer.co, delayed_writer, mark_finished, &writer);
+
+    for (int i = 0; i < 100 && loop.active > 0; i++) {
+        co_loop_run_once(&loop, 100);
+    }
+
+    if (!reader.finished || !writer.finished) {
+        test_failed("Coroutines did not finish");
+    }
+
+    writer.buffer[writer.used] = '\0';
+    if (strcmp(writer.buffer, TEST_MESSAGE) != 0) {
+        test_failed("Echoed message mismatch");
+    }
+
+    co_loop_destroy(&loop);
+    close(sv[0]);
+    close(sv[1]);
+    printf("PASSED\n");
+}
+
+typedef struct {
+    co_task_t co;
+    int delay_ms;
+} sleeper_t;
+
+static int wake_order[NUM_SLEEPERS];
+static int wake_count;
+
+static int sleeper(co_task_t *co) {
+    sleeper_t *s = (sleeper_t *)co->arg;
+
+    CO_BEGIN(co);
+    CO_SLEEP(co, s->delay_ms);
+    wake_order[wake_count++] = s->delay_ms;
+    CO_END(co);
+}
+
+/**
+ * Test that sleeping coroutines wake in deadline order
+ */
+void test_coroutine_sleep_order() {
+    printf("Testing coroutine sleep ordering... ");
+
+    co_loop_t loop;
+    if (co_loop_init(&loop) < 0) {
+        test_failed("Failed to create coroutine loop");
+    }
+
+    static const int delays[NUM_SLEEPERS] = {40, 10, 30, 50, 20};
+    sleeper_t sleepers[NUM_SLEEPERS];
+    wake_count = 0;
+
+    for (int i = 0; i < NUM_SLEEPERS; i++) {
+        sleepers[i].delay_ms = delays[i];
+        co_spawn(&loop, &sleepers[i].co, sleeper, NULL, &sleepers[i]);
+    }
+
+    uint64_t start = co_now_ns();
+    while (loop.active > 0 && co_now_ns() - start < 2000000000ULL) {
+        co_loop_run_once(&loop, 100);
+    }
+
+    if (wake_count != NUM_SLEEPERS) {
+        test_failed("Not all sleepers woke up");
+    }
+
+    for (int i = 1; i < NUM_SLEEPERS; i++) {
+        if (wake_order[i - 1] > wake_order[i]) {
+            test_failed("Sleepers woke out of order");
+        }
+    }
+
+    co_loop_destroy(&loop);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running coroutine tests...\n");
+
+    test_coroutine_io();
+    test_coroutine_sleep_order();
+
+    printf("All coroutine tests PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file test_feed_arbiter.c
+ * @brief Unit tests for A/B feed line arbitration
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "feed_arbiter.h"
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Test that the first copy wins and the second is dropped with its lag
+ */
+void test_first_copy_wins() {
+    printf("Testing first copy wins... ");
+
+    feed_arbiter_t arb;
+    feed_arb_init(&arb);
+
+    // A leads on 1..3, B leads on 4
+    for (uint64_t seq = 1; seq <= 3; seq++) {
+        if (!feed_arb_accept(&arb, 0, seq, seq * 1000)) {
+            test_failed("First copy on A rejected");
+        }
+        if (feed_arb_accept(&arb, 1, seq, seq * 1000 + 200)) {
+            test_failed("Duplicate on B delivered");
+        }
+    }
+    if (!feed_arb_accept(&arb, 1, 4, 4000) || feed_arb_accept(&arb, 0, 4, 4500)) {
+        test_failed("B should win sequence 4");
+    }
+
+    if (arb.delivered != 4 || arb.line[0].won != 3 || arb.line[1].won != 1) {
+        test_failed("Wrong win counts");
+    }
+    if (arb.line[1].duplicates != 3 || arb.line[1].lag_total_ns != 600 || arb.line[1].lag_max_ns != 200) {
+        test_failed("Wrong lag on B");
+    }
+    if (arb.line[0].duplicates != 1 || arb.line[0].lag_max_ns != 500) {
+        test_failed("Wrong lag on A");
+    }
+    if (arb.missing || arb.line[0].gaps || arb.line[1].gaps) {
+        test_failed("Unexpected gaps");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a gap on one line is filled by the other
+ */
+void test_gap_filled_by_other_line() {
+    printf("Testing gap filled by other line... ");
+
+    feed_arbiter_t arb;
+    feed_arb_init(&arb);
+
+    // A loses 3 and 4; B is behind but has them
+    feed_arb_accept(&arb, 0, 1, 100);
+    feed_arb_accept(&arb, 0, 2, 200);
+    feed_arb_accept(&arb, 0, 5, 500);
+    if (arb.missing != 2 || arb.line[0].gaps != 1 || arb.line[0].gap_messages != 2) {
+        test_failed("Gap on A not tracked");
+    }
+
+    int delivered = 0;
+    for (uint64_t seq = 1; seq <= 5; seq++) {
+        delivered += feed_arb_accept(&arb, 1, seq, seq * 100 + 50);
+    }
+    if (delivered != 2 || arb.recovered != 2 || arb.missing != 0) {
+        test_failed("B did not fill the gap");
+    }
+    if (arb.delivered != 5 || arb.line[1].gaps != 0 || arb.line[1].duplicates != 3) {
+        test_failed("Wrong totals after recovery");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test loss on both lines and stale copies outside the window
+ */
+void test_loss_and_stale() {
+    printf("Testing loss on both lines and stale copies... ");
+
+    feed_arbiter_t arb;
+    feed_arb_init(&arb);
+
+    // 10..19 lost everywhere
+    for (uint64_t seq = 1; seq <= 30; seq++) {
+        if (seq >= 10 && seq < 20) {
+            continue;
+        }
+        feed_arb_accept(&arb, 0, seq, seq);
+        feed_arb_accept(&arb, 1, seq, seq + 1);
+    }
+    if (arb.missing != 10 || arb.delivered != 20) {
+        test_failed("Loss on both lines not counted as missing");
+    }
+    if (arb.line[0].gaps != 1 || arb.line[1].gap_messages != 10) {
+        test_failed("Per-line gaps wrong");
+    }
+
+    // Advance well past the window, then offer one of the lost messages
+    feed_arb_accept(&arb, 0, 30 + FEED_ARB_WINDOW, 5000);
+    if (feed_arb_accept(&arb, 1, 15, 6000) || arb.stale != 1) {
+        test_failed("Stale copy delivered");
+    }
+
+    // A slot reused by a newer sequence must not be mistaken for a duplicate
+    uint64_t seq = 31 + FEED_ARB_WINDOW;
+    if (!feed_arb_accept(&arb, 1, seq, 7000) || feed_arb_accept(&arb, 0, seq, 7100)) {
+        test_failed("Window reuse broke duplicate detection");
+    }
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running feed arbiter tests...\n");
+
+    test_first_copy_wins();
+    test_gap_filled_by_other_line();
+    test_loss_and_stale();
+
+    printf("All feed arbiter tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,407 @@
+/**
+ * @file test_forwarder.c
+ * @brief Unit tests for the block compressor and the batching forwarder
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "forwarder.h"
+
+#define RECORD_SIZE 20
+#define BATCH_BYTES 2000            // 100 records
+#define MAX_RAW 200000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static uint8_t raw[MAX_RAW];
+static uint8_t packed[MAX_RAW + MAX_RAW / 255 + 16];
+static uint8_t unpacked[MAX_RAW];
+
+// A sensor-like reading: counter, slowly varying values
+static void make_record(uint8_t *p, uint32_t n) {
+    wire_put32(p, n, WIRE_SWAP_LE);
+    wire_put32(p + 4, n % 7, WIRE_SWAP_LE);
+    wire_put_f32(p + 8, 20.0f + (float)(n % 50) / 10, WIRE_SWAP_LE);
+    wire_put_f32(p + 12, 1013.0f, WIRE_SWAP_LE);
+    wire_put32(p + 16, 1700000000u + n / 100, WIRE_SWAP_LE);
+}
+
+static size_t roundtrip(size_t n) {
+    size_t len = lzb_compress(raw, n, packed, lzb_bound(n));
+    if (len == 0 || len > lzb_bound(n)) {
+        test_failed("Compression did not fit the bound");
+    }
+    if (lzb_decompress(packed, len, unpacked, sizeof(unpacked)) != (ssize_t)n || memcmp(raw, unpacked, n) != 0) {
+        test_failed("Round trip changed the data");
+    }
+    return len;
+}
+
+/**
+ * Test compression round trips and rejection of malformed blocks
+ */
+void test_block_compression() {
+    printf("Testing block compression... ");
+
+    roundtrip(0);
+    raw[0] = 'x';
+    roundtrip(1);
+
+    srand(7);
+    for (size_t i = 0; i < MAX_RAW; i++) {
+        raw[i] = (uint8_t)rand();
+    }
+    if (roundtrip(MAX_RAW) > lzb_bound(MAX_RAW)) {
+        test_failed("Random data expanded past the bound");
+    }
+
+    // Long runs need multi-byte lengths
+    memset(raw, 0, MAX_RAW);
+    if (roundtrip(MAX_RAW) > 1000) {
+        test_failed("Zero run not compressed");
+    }
+
+    size_t n = 0;
+    for (uint32_t i = 0; n + RECORD_SIZE <= MAX_RAW; i++, n += RECORD_SIZE) {
+        make_record(raw + n, i);
+    }
+    size_t len = roundtrip(n);
+    if (len * 2 > n) {
+        test_failed("Readings compressed less than 2:1");
+    }
+
+    // Truncated input, too little room, offset before the start
+    ssize_t r = lzb_decompress(packed, len - 3, unpacked, sizeof(unpacked));
+    if (r == (ssize_t)n) {
+        test_failed("Truncated block accepted");
+    }
+    if (lzb_decompress(packed, len, unpacked, n - 1) != -1) {
+        test_failed("Output overrun not detected");
+    }
+    if (lzb_compress(raw, n, packed, len / 2) != 0) {
+        test_failed("Compression overran its output");
+    }
+    uint8_t bad[] = { 0x10, 'a', 0x09, 0x00 };
+    if (lzb_decompress(bad, sizeof(bad), unpacked, sizeof(unpacked)) != -1) {
+        test_failed("Offset before start accepted");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test size and time thresholds and the sealed frame contents
+ */
+void test_batching() {
+    printf("Testing batch thresholds... ");
+
+    fwd_t f;
+    if (fwd_open(&f, NULL, 64 * 1024, BATCH_BYTES, 50, "127.0.0.1", 1) < 0) {
+        test_failed("Failed to open forwarder");
+    }
+    uint8_t rec[RECORD_SIZE];
+    uint64_t now = 1000;
+    for (uint32_t i = 0; i < 100; i++) {
+        make_record(rec, i);
+        fwd_append(&f, rec, sizeof(rec), now);
+    }
+    if (f.spill->last_seq != 1 || f.batch_records != 0 || f.records != 100) {
+        test_failed("Full batch not sealed");
+    }
+
+    make_record(rec, 100);
+    fwd_append(&f, rec, sizeof(rec), now);
+    fwd_tick(&f, now + 49);
+    if (f.spill->last_seq != 1) {
+        test_failed("Batch sealed before its delay");
+    }
+    fwd_tick(&f, now + 50);
+    if (f.spill->last_seq != 2 || f.records != 101) {
+        test_failed("Batch not sealed after its delay");
+    }
+
+    fwd_frame_t h;
+    if (fwd_get_header(f.ring, &h) < 0 || h.seq != 1 || h.records != 100 || h.raw_length != BATCH_BYTES ||
+        h.length >= h.raw_length) {
+        test_failed("Wrong first frame");
+    }
+    if (fwd_unpack(&h, f.ring + FWD_HEADER_SIZE, unpacked, sizeof(unpacked)) != BATCH_BYTES) {
+        test_failed("First frame does not unpack");
+    }
+    for (uint32_t i = 0; i < 100; i++) {
+        if (wire_get32(unpacked + i * RECORD_SIZE, WIRE_SWAP_LE) != i) {
+            test_failed("Records out of order");
+        }
+    }
+    fwd_close(&f);
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a full ring drops new batches and keeps the spilled ones
+ */
+void test_spill_full() {
+    printf("Testing full spill ring... ");
+
+    fwd_t f;
+    size_t ring = fwd_align(FWD_HEADER_SIZE + BATCH_BYTES) * 4;
+    if (fwd_open(&f, NULL, ring, BATCH_BYTES, 1000, "127.0.0.1", 1) < 0) {
+        test_failed("Failed to open forwarder");
+    }
+    srand(3);
+    uint8_t rec[RECORD_SIZE];
+    for (int i = 0; i < 1000; i++) {
+        for (int b = 0; b < RECORD_SIZE; b++) {
+            rec[b] = (uint8_t)rand();    // Incompressible: every frame full size
+        }
+        fwd_append(&f, rec, sizeof(rec), 0);
+    }
+    if (f.spill->last_seq != 4 || f.dropped != 600 || fwd_unacked(&f) != 4) {
+        test_failed("Wrong drop accounting");
+    }
+    fwd_close(&f);
+
+    printf("PASSED\n");
+}
+
+static uint64_t delivered_batches;
+
+static void count_batch(void *ctx, const fwd_frame_t *frame, const uint8_t *records) {
+    (void)ctx;
+    (void)frame;
+    (void)records;
+    delivered_batches++;
+}
+
+/**
+ * Test that resent batches are acknowledged and skipped
+ */
+void test_collector_duplicates() {
+    printf("Testing duplicate batches at the collector... ");
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        test_failed("socketpair failed");
+    }
+    uint8_t frame[FWD_HEADER_SIZE + 4];
+    fwd_frame_t h = { 4, 1, 4, 1, 7 };
+    fwd_put_header(frame, &h);
+    memcpy(frame + FWD_HEADER_SIZE, "abcd", 4);
+    for (int i = 0; i < 2; i++) {
+        if (write(sv[0], frame, sizeof(frame)) != (ssize_t)sizeof(frame)) {
+            test_failed("write failed");
+        }
+    }
+    shutdown(sv[0], SHUT_WR);
+
+    fwd_collector_t c;
+    fwd_collector_init(&c, 1024);
+    if (fwd_collector_serve(&c, sv[1], count_batch, NULL) != 0 || delivered_batches != 1 ||
+        c.duplicates != 1 || c.last_seq != 1) {
+        test_failed("Duplicate not skipped");
+    }
+    uint8_t acks[2 * FWD_ACK_SIZE];
+    if (read(sv[0], acks, sizeof(acks)) != (ssize_t)sizeof(acks) ||
+        wire_get64(acks + FWD_ACK_SIZE + 8, WIRE_SWAP_LE) != 1) {
+        test_failed("Duplicate not acknowledged");
+    }
+    fwd_collector_destroy(&c);
+    close(sv[0]);
+    close(sv[1]);
+
+    printf("PASSED\n");
+}
+
+// Stand-in collector: accepts until stopped, checks records arrive once, in order
+static int collector_fd;
+static atomic_int collector_running;
+static fwd_collector_t collector;
+static uint32_t next_record;
+static int out_of_order;
+
+static void check_batch(void *ctx, const fwd_frame_t *frame, const uint8_t *records) {
+    (void)ctx;
+    for (uint32_t i = 0; i < frame->records; i++) {
+        if (wire_get32(records + i * RECORD_SIZE, WIRE_SWAP_LE) != next_record++) {
+            out_of_order = 1;
+        }
+    }
+}
+
+static void *collector_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&collector_running)) {
+        struct pollfd pfd = { collector_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        int fd = accept(collector_fd, NULL, NULL);
+        if (fd >= 0) {
+            fwd_collector_serve(&collector, fd, check_batch, NULL);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static fwd_t fwd;
+static atomic_int sender_running;
+
+static void *sender_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&sender_running)) {
+        fwd_poll(&fwd, 10);
+    }
+    return NULL;
+}
+
+static void wait_acked(const char *message) {
+    for (int i = 0; i < 500 && fwd_unacked(&fwd) > 0; i++) {
+        usleep(10000);
+    }
+    if (fwd_unacked(&fwd) > 0) {
+        test_failed(message);
+    }
+}
+
+static void append_records(uint32_t *n, int count) {
+    uint8_t rec[RECORD_SIZE];
+    for (int i = 0; i < count; i++) {
+        make_record(rec, (*n)++);
+        fwd_append(&fwd, rec, sizeof(rec), fwd_now_ms());
+    }
+    fwd_seal(&fwd);
+}
+
+/**
+ * Test delivery through an outage, a forwarder restart and a fresh spill
+ */
+void test_outage_and_restart() {
+    printf("Testing delivery through outage and restart... ");
+
+    // Reserve a port, then leave it closed: the collector is down
+    collector_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    int one = 1;
+    setsockopt(collector_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(collector_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(collector_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        test_failed("Failed to reserve a port");
+    }
+    int port = ntohs(addr.sin_port);
+
+    char spill_path[64];
+    snprintf(spill_path, sizeof(spill_path), "/tmp/test_forwarder_%d.spill", (int)getpid());
+    unlink(spill_path);
+    if (fwd_open(&fwd, spill_path, 1024 * 1024, BATCH_BYTES, 20, "127.0.0.1", port) < 0) {
+        test_failed("Failed to open forwarder");
+    }
+    fwd.retry_ms = 20;
+    atomic_store(&sender_running, 1);
+    pthread_t sender;
+    pthread_create(&sender, NULL, sender_thread, NULL);
+
+    // Readings spill while nobody listens
+    uint32_t n = 0;
+    append_records(&n, 5000);
+    usleep(100000);
+    if (fwd.connects != 0 || fwd_unacked(&fwd) != 50) {
+        test_failed("Batches not held during outage");
+    }
+
+    // Collector comes up: everything is delivered
+    fwd_collector_init(&collector, BATCH_BYTES);
+    if (listen(collector_fd, 4) < 0) {
+        test_failed("listen failed");
+    }
+    atomic_store(&collector_running, 1);
+    pthread_t coll;
+    pthread_create(&coll, NULL, collector_thread, NULL);
+    wait_acked("Spilled batches not delivered");
+    if (next_record != 5000 || out_of_order) {
+        test_failed("Spilled records lost or reordered");
+    }
+
+    // Forwarder stops with unsent batches; a new one resumes from the spill file
+    atomic_store(&sender_running, 0);
+    pthread_join(sender, NULL);
+    append_records(&n, 3000);
+    uint64_t last = fwd.spill->last_seq;
+    fwd_close(&fwd);
+    if (fwd_open(&fwd, spill_path, 1024 * 1024, BATCH_BYTES, 20, "127.0.0.1", port) < 0 || !fwd.recovered ||
+        fwd_unacked(&fwd) != 30) {
+        test_failed("Spill not recovered");
+    }
+    fwd.retry_ms = 20;
+    append_records(&n, 2000);
+    if (fwd.spill->last_seq != last + 20) {
+        test_failed("Sequence numbers restarted");
+    }
+    atomic_store(&sender_running, 1);
+    pthread_create(&sender, NULL, sender_thread, NULL);
+    wait_acked("Recovered batches not delivered");
+    if (next_record != 10000 || out_of_order || collector.batches != 100 || collector.restarts != 0) {
+        test_failed("Records lost or duplicated across restart");
+    }
+
+    // A new forwarder with a fresh spill counts from 1 in a new epoch
+    atomic_store(&sender_running, 0);
+    pthread_join(sender, NULL);
+    uint64_t epoch = fwd.spill->epoch;
+    fwd_close(&fwd);
+    unlink(spill_path);
+    if (fwd_open(&fwd, spill_path, 1024 * 1024, BATCH_BYTES, 20, "127.0.0.1", port) < 0 || fwd.recovered ||
+        fwd.spill->epoch == epoch) {
+        test_failed("Fresh spill not initialized");
+    }
+    fwd.retry_ms = 20;
+    append_records(&n, 1000);
+    if (fwd.spill->last_seq != 10) {
+        test_failed("Fresh spill did not count from 1");
+    }
+    atomic_store(&sender_running, 1);
+    pthread_create(&sender, NULL, sender_thread, NULL);
+    wait_acked("Fresh spill not delivered");
+    if (next_record != 11000 || out_of_order || collector.batches != 110 || collector.restarts != 1) {
+        test_failed("Batches from a fresh spill skipped as duplicates");
+    }
+
+    atomic_store(&sender_running, 0);
+    pthread_join(sender, NULL);
+    fwd_close(&fwd);
+    atomic_store(&collector_running, 0);
+    pthread_join(coll, NULL);
+    fwd_collector_destroy(&collector);
+    close(collector_fd);
+    unlink(spill_path);
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running forwarder tests...\n");
+
+    test_block_compression();
+    test_batching();
+    test_spill_full();
+    test_collector_duplicates();
+    test_outage_and_restart();
+
+    printf("All forwarder tests PASSED\n");
+    return 0;
+}
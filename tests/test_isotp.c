@@ -0,0 +1,415 @@
+/**
+ * @file test_isotp.c
+ * @brief Unit tests for the ISO-TP transport
+ *
+ * Two links exchange frames through in-memory queues on a simulated clock,
+ * so flow control and timing are checked exactly. The blocking endpoint is
+ * tested over an AF_UNIX SOCK_SEQPACKET pair carrying struct can_frame, so
+ * the tests run without SocketCAN.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "isotp.h"
+
+#define TESTER_ID 0x7E0
+#define ECU_ID 0x7E8
+#define QUEUE_FRAMES 4096
+#define MAX_MESSAGE (256 * 1024)
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// One direction of the simulated bus
+typedef struct {
+    struct can_frame frames[QUEUE_FRAMES];
+    int head, tail;
+    int refuse;                 // Frames to refuse before accepting again
+    unsigned fc_frames;
+    unsigned cf_frames;
+    int new_block;              // The next CF starts a block: no gap to measure
+    uint64_t last_cf_us;
+    uint64_t min_cf_gap_us;     // Smallest gap between CFs within a block
+} queue_t;
+
+static uint64_t clock_us;
+static queue_t to_ecu, to_tester;
+static isotp_link_t tester, ecu;
+static uint8_t tester_buf[MAX_MESSAGE], ecu_buf[MAX_MESSAGE];
+static size_t ecu_received, tester_received;
+
+static int queue_tx(void *ctx, const struct can_frame *frame) {
+    queue_t *q = ctx == &tester ? &to_ecu : &to_tester;
+    if (q->refuse > 0) {
+        q->refuse--;
+        return -1;
+    }
+    if (q->tail - q->head == QUEUE_FRAMES) {
+        return -1;
+    }
+    uint8_t pci = frame->data[0] >> 4;
+    if (pci == ISOTP_PCI_FC) {
+        q->fc_frames++;
+        (q == &to_ecu ? &to_tester : &to_ecu)->new_block = 1;
+    } else if (pci == ISOTP_PCI_CF) {
+        if (!q->new_block && clock_us - q->last_cf_us < q->min_cf_gap_us) {
+            q->min_cf_gap_us = clock_us - q->last_cf_us;
+        }
+        q->last_cf_us = clock_us;
+        q->new_block = 0;
+        q->cf_frames++;
+    }
+    q->frames[q->tail % QUEUE_FRAMES] = *frame;
+    q->tail++;
+    return 0;
+}
+
+static void on_message(void *ctx, const uint8_t *data, size_t len) {
+    (void)data;
+    if (ctx == &tester) {
+        tester_received = len;
+    } else {
+        ecu_received = len;
+    }
+}
+
+static void reset_links(uint8_t ecu_bs, uint8_t ecu_stmin, size_t ecu_cap) {
+    memset(&to_ecu, 0, sizeof(to_ecu));
+    memset(&to_tester, 0, sizeof(to_tester));
+    to_ecu.min_cf_gap_us = UINT64_MAX;
+    to_tester.min_cf_gap_us = UINT64_MAX;
+    clock_us = 1000;
+    ecu_received = tester_received = 0;
+    // Each link passes itself as ctx, so the callbacks know the direction
+    isotp_init(&tester, TESTER_ID, ECU_ID, tester_buf, sizeof(tester_buf), queue_tx, on_message, &tester);
+    isotp_init(&ecu, ECU_ID, TESTER_ID, ecu_buf, ecu_cap, queue_tx, on_message, &ecu);
+    ecu.block_size = ecu_bs;
+    ecu.stmin = ecu_stmin;
+}
+
+static void deliver(queue_t *q, isotp_link_t *to) {
+    while (q->head < q->tail) {
+        if (isotp_on_frame(to, &q->frames[q->head % QUEUE_FRAMES], clock_us) != 0) {
+            test_failed("ISO-TP frame not accepted");
+        }
+        q->head++;
+    }
+}
+
+// Run the bus until both links are idle, jumping the clock to the next event
+static void run(void) {
+    for (int steps = 0; steps < 10000000; steps++) {
+        deliver(&to_ecu, &ecu);
+        deliver(&to_tester, &tester);
+        isotp_poll(&tester, clock_us);
+        isotp_poll(&ecu, clock_us);
+        if (to_ecu.head < to_ecu.tail || to_tester.head < to_tester.tail) {
+            continue;
+        }
+        uint64_t next = isotp_next_us(&tester);
+        if (isotp_next_us(&ecu) < next) {
+            next = isotp_next_us(&ecu);
+        }
+        if (next == UINT64_MAX) {
+            return;
+        }
+        clock_us = next > clock_us ? next : clock_us + 1;
+    }
+    test_failed("Transfer never finished");
+}
+
+static void fill(uint8_t *p, size_t len, uint32_t seed) {
+    for (size_t i = 0; i < len; i++) {
+        p[i] = (uint8_t)(seed + i * 31 + (i >> 8));
+    }
+}
+
+/**
+ * Test STmin encoding and decoding
+ */
+void test_stmin() {
+    printf("Testing STmin encoding... ");
+
+    if (isotp_stmin_us(0) != 0 || isotp_stmin_us(0x7F) != 127000 || isotp_stmin_us(0xF1) != 100 ||
+        isotp_stmin_us(0xF9) != 900 || isotp_stmin_us(0x80) != 127000 || isotp_stmin_us(0xFA) != 127000) {
+        test_failed("STmin decoded wrong");
+    }
+    if (isotp_stmin_encode(0) != 0 || isotp_stmin_encode(1) != 0xF1 || isotp_stmin_encode(500) != 0xF5 ||
+        isotp_stmin_encode(901) != 1 || isotp_stmin_encode(20000) != 20 || isotp_stmin_encode(500000) != 0x7F) {
+        test_failed("STmin encoded wrong");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test round trips across the SF, FF and escaped FF boundaries
+ */
+void test_sizes() {
+    printf("Testing message sizes... ");
+
+    static uint8_t message[MAX_MESSAGE];
+    size_t sizes[] = { 1, 7, 8, 13, 14, 15, 100, 4095, 4096, 4097, 65536, MAX_MESSAGE };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i];
+        reset_links(0, 0, sizeof(ecu_buf));
+        fill(message, len, (uint32_t)i);
+        if (isotp_send(&tester, message, len, clock_us) < 0) {
+            test_failed("isotp_send failed");
+        }
+        run();
+        if (tester.tx_result != 0 || ecu_received != len || memcmp(ecu_buf, message, len) != 0) {
+            fprintf(stderr, "%zu bytes\n", len);
+            test_failed("Message corrupted");
+        }
+        unsigned cfs = len <= 7 ? 0 : (unsigned)((len - (len <= 4095 ? 6 : 2) + 6) / 7);
+        if (to_ecu.cf_frames != cfs || to_tester.fc_frames != (len <= 7 ? 0u : 1u)) {
+            fprintf(stderr, "%zu bytes: %u CFs, %u FCs\n", len, to_ecu.cf_frames, to_tester.fc_frames);
+            test_failed("Wrong frame count");
+        }
+    }
+
+    // Replies travel the other way on the same pair of links
+    reset_links(0, 0, sizeof(ecu_buf));
+    fill(message, 300, 9);
+    isotp_send(&ecu, message, 300, clock_us);
+    run();
+    if (tester_received != 300 || memcmp(tester_buf, message, 300) != 0 || ecu.tx_messages != 1) {
+        test_failed("Reply corrupted");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that block size and STmin from flow control pace the sender
+ */
+void test_flow_control() {
+    printf("Testing block size and STmin... ");
+
+    static uint8_t message[10000];
+    fill(message, sizeof(message), 3);
+    unsigned cfs = (sizeof(message) - 6 + 6) / 7;
+
+    // BS 8: one FC after the FF and after every 8 CFs except the last block
+    reset_links(8, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, sizeof(message), clock_us);
+    run();
+    if (ecu_received != sizeof(message) || to_tester.fc_frames != 1 + (cfs - 1) / 8) {
+        test_failed("Block size not honoured");
+    }
+    if (clock_us != 1000) {
+        test_failed("STmin 0 delayed the sender");
+    }
+
+    // STmin 500 us: the whole transfer takes at least (CFs - 1) gaps
+    reset_links(0, isotp_stmin_encode(500), sizeof(ecu_buf));
+    isotp_send(&tester, message, sizeof(message), clock_us);
+    run();
+    if (ecu_received != sizeof(message) || to_ecu.min_cf_gap_us < 500 || clock_us - 1000 < (uint64_t)(cfs - 1) * 500) {
+        test_failed("STmin 500 us not honoured");
+    }
+
+    // STmin 2 ms with BS 4: the gap is only enforced inside a block
+    reset_links(4, 2, sizeof(ecu_buf));
+    isotp_send(&tester, message, 200, clock_us);
+    run();
+    if (ecu_received != 200 || memcmp(ecu_buf, message, 200) != 0 || to_ecu.min_cf_gap_us < 2000) {
+        test_failed("STmin 2 ms not honoured");
+    }
+
+    // A busy bus delays a CF without losing it
+    reset_links(0, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, 100, clock_us);
+    to_ecu.refuse = 3;
+    deliver(&to_ecu, &ecu);
+    deliver(&to_tester, &tester);   // FC: the first CFs are refused
+    for (int i = 0; i < 3 && isotp_busy(&tester); i++) {
+        isotp_poll(&tester, clock_us);
+    }
+    run();
+    if (ecu_received != 100 || memcmp(ecu_buf, message, 100) != 0) {
+        test_failed("Refused frame lost");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test overflow, wait frames, timeouts and sequence errors
+ */
+void test_errors() {
+    printf("Testing flow control errors and timeouts... ");
+
+    static uint8_t message[1000];
+    fill(message, sizeof(message), 5);
+
+    // Receiver too small: FC overflow ends the transfer
+    reset_links(0, 0, 100);
+    isotp_send(&tester, message, 200, clock_us);
+    run();
+    if (tester.tx_result != -EOVERFLOW || ecu_received != 0 || isotp_busy(&tester)) {
+        test_failed("Overflow not reported");
+    }
+    if (isotp_send(&tester, message, 50, clock_us) < 0) {
+        test_failed("Link unusable after overflow");
+    }
+    run();
+    if (ecu_received != 50) {
+        test_failed("Message after overflow lost");
+    }
+
+    // Nobody answers the FF: N_Bs timeout
+    reset_links(0, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, 100, clock_us);
+    if (isotp_send(&tester, message, 100, clock_us) == 0 || errno != EBUSY) {
+        test_failed("Second send while busy accepted");
+    }
+    to_ecu.head = to_ecu.tail;
+    run();
+    if (tester.tx_result != -ETIMEDOUT || clock_us != 1000 + ISOTP_TIMEOUT_US || tester.errors != 1) {
+        test_failed("Missing flow control not timed out");
+    }
+
+    // FC WAIT extends the deadline, too many of them give up
+    reset_links(0, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, 100, clock_us);
+    struct can_frame wait;
+    memset(&wait, 0, sizeof(wait));
+    wait.can_id = ECU_ID;
+    wait.can_dlc = 8;
+    wait.data[0] = ISOTP_PCI_FC << 4 | ISOTP_FC_WAIT;
+    for (int i = 0; i < ISOTP_MAX_WAIT_FRAMES; i++) {
+        clock_us += ISOTP_TIMEOUT_US / 2;
+        isotp_on_frame(&tester, &wait, clock_us);
+        isotp_poll(&tester, clock_us);
+    }
+    if (!isotp_busy(&tester)) {
+        test_failed("Wait frame did not extend the deadline");
+    }
+    isotp_on_frame(&tester, &wait, clock_us);
+    if (isotp_busy(&tester) || tester.tx_result != -ETIMEDOUT) {
+        test_failed("Endless wait frames accepted");
+    }
+
+    // A lost CF shows up as a sequence error and aborts reception
+    reset_links(0, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, 100, clock_us);
+    deliver(&to_ecu, &ecu);
+    deliver(&to_tester, &tester);
+    to_ecu.head++;
+    deliver(&to_ecu, &ecu);
+    if (ecu.rx_active || ecu.errors != 1 || ecu_received != 0) {
+        test_failed("Sequence error not detected");
+    }
+
+    // The sender stops after the FF: N_Cr timeout on the receiver
+    reset_links(0, 0, sizeof(ecu_buf));
+    isotp_send(&tester, message, 100, clock_us);
+    deliver(&to_ecu, &ecu);
+    isotp_poll(&ecu, clock_us + ISOTP_TIMEOUT_US - 1);
+    if (!ecu.rx_active) {
+        test_failed("Receiver timed out early");
+    }
+    isotp_poll(&ecu, clock_us + ISOTP_TIMEOUT_US);
+    if (ecu.rx_active || ecu.errors != 1) {
+        test_failed("Receiver never timed out");
+    }
+
+    // Other IDs and non-ISO-TP payloads are left to the caller
+    struct can_frame f;
+    memset(&f, 0, sizeof(f));
+    f.can_id = 0x123;
+    f.can_dlc = 2;
+    if (isotp_on_frame(&ecu, &f, clock_us) != -1) {
+        test_failed("Frame for another ID taken");
+    }
+    f.can_id = TESTER_ID;
+    f.data[0] = 0xFF;
+    f.data[1] = 0x01;
+    if (isotp_on_frame(&ecu, &f, clock_us) != -1) {
+        test_failed("Non-ISO-TP frame taken");
+    }
+    f.data[0] = 0x05;               // SF claiming more bytes than the DLC holds
+    if (isotp_on_frame(&ecu, &f, clock_us) != -1) {
+        test_failed("Short single frame taken");
+    }
+
+    printf("PASSED\n");
+}
+
+static isotp_socket_t ecu_socket;
+
+static void *ecu_thread(void *arg) {
+    (void)arg;
+    // Echo each request back, so the tester checks both directions
+    for (int i = 0; i < 3; i++) {
+        ssize_t len = isotp_socket_recv(&ecu_socket, 5000);
+        if (len < 0 || isotp_socket_send(&ecu_socket, ecu_buf, (size_t)len) < 0) {
+            test_failed("ECU endpoint failed");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Test the blocking endpoint over a socket pair
+ */
+void test_socket() {
+    printf("Testing blocking endpoint... ");
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        test_failed("socketpair failed");
+    }
+    isotp_socket_t s;
+    isotp_socket_attach(&s, sv[0], TESTER_ID, ECU_ID, 0, 0, tester_buf, sizeof(tester_buf));
+    isotp_socket_attach(&ecu_socket, sv[1], ECU_ID, TESTER_ID, 16, isotp_stmin_encode(100), ecu_buf, sizeof(ecu_buf));
+    pthread_t ecu_tid;
+    pthread_create(&ecu_tid, NULL, ecu_thread, NULL);
+
+    static uint8_t message[65536];
+    size_t sizes[] = { 3, 2000, sizeof(message) };
+    for (int i = 0; i < 3; i++) {
+        fill(message, sizes[i], (uint32_t)i + 40);
+        if (isotp_socket_send(&s, message, sizes[i]) < 0) {
+            test_failed("isotp_socket_send failed");
+        }
+        ssize_t len = isotp_socket_recv(&s, 5000);
+        if (len != (ssize_t)sizes[i] || memcmp(tester_buf, message, sizes[i]) != 0) {
+            test_failed("Echo corrupted");
+        }
+    }
+    pthread_join(ecu_tid, NULL);
+
+    // Nobody left to answer: the receive times out
+    if (isotp_socket_recv(&s, 50) != -1 || errno != ETIMEDOUT) {
+        test_failed("Receive did not time out");
+    }
+    isotp_socket_close(&s);
+    isotp_socket_close(&ecu_socket);
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running ISO-TP tests...\n");
+
+    test_stmin();
+    test_sizes();
+    test_flow_control();
+    test_errors();
+    test_socket();
+
+    printf("All ISO-TP tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,322 @@
+/**
+ * @file test_matching_engine.c
+ * @brief Unit tests for the price-time priority matching engine and latency histogram
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "matching_engine.h"
+#include "latency_histogram.h"
+#include "trading_protocol.h"
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Executions captured by the callback
+typedef struct {
+    uint64_t maker_client_id;
+    uint64_t taker_client_id;
+    const void *maker_owner;
+    uint32_t maker_leaves;
+    int64_t price;
+    uint32_t qty;
+} exec_record_t;
+
+static exec_record_t execs[64];
+static int num_execs;
+
+static void record_exec(void *ctx, const me_order_t *maker, const me_order_t *taker,
+                        int64_t price, uint32_t qty) {
+    (void)ctx;
+    if (num_execs < 64) {
+        execs[num_execs].maker_client_id = maker->client_order_id;
+        execs[num_execs].taker_client_id = taker->client_order_id;
+        execs[num_execs].maker_owner = maker->owner;
+        execs[num_execs].maker_leaves = maker->remaining;
+        execs[num_execs].price = price;
+        execs[num_execs].qty = qty;
+    }
+    num_execs++;
+}
+
+// Submit an order and return its exchange ID (0 if it did not rest)
+static uint64_t submit(me_engine_t *me, int book, uint8_t side, int64_t price, uint32_t qty,
+                       uint64_t client_id) {
+    me_order_t *o = me_new_order(me, book, side, price, qty, client_id, NULL);
+    if (!o) {
+        test_failed("Order pool exhausted");
+    }
+    uint64_t id = o->id;
+    return me_match(me, o, record_exec, NULL) > 0 ? id : 0;
+}
+
+/**
+ * Test that better prices match first and equal prices match oldest first
+ */
+void test_price_time_priority() {
+    printf("Testing price-time priority... ");
+
+    me_engine_t me;
+    if (me_engine_init(&me, 64, 16) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    int book = me_add_book(&me, "AAPL");
+
+    submit(&me, book, SIDE_SELL, 1010, 100, 1);
+    submit(&me, book, SIDE_SELL, 1000, 100, 2);
+    submit(&me, book, SIDE_SELL, 1000, 100, 3);
+    submit(&me, book, SIDE_SELL, 1020, 100, 4);
+
+    if (me_best_ask(&me.books[book]) != 1000 || me_best_bid(&me.books[book]) != 0) {
+        test_failed("Wrong top of book");
+    }
+
+    // Buy 250 up to 1010: orders 2, 3 at 1000, then 50 of order 1 at 1010
+    num_execs = 0;
+    if (submit(&me, book, SIDE_BUY, 1010, 250, 10) != 0) {
+        test_failed("Marketable order should not rest");
+    }
+    if (num_execs != 3 ||
+        execs[0].maker_client_id != 2 || execs[0].price != 1000 || execs[0].qty != 100 ||
+        execs[1].maker_client_id != 3 || execs[1].price != 1000 || execs[1].qty != 100 ||
+        execs[2].maker_client_id != 1 || execs[2].price != 1010 || execs[2].qty != 50) {
+        test_failed("Executions out of price-time order");
+    }
+    if (me_best_ask(&me.books[book]) != 1010 || me.books[book].asks->total_qty != 50) {
+        test_failed("Partially filled maker should stay at the front");
+    }
+    if (me.books[book].last_price != 1010 || me.books[book].volume != 250) {
+        test_failed("Last price or volume not tracked");
+    }
+
+    me_engine_destroy(&me);
+    printf("PASSED\n");
+}
+
+/**
+ * Test partial fills that leave the remainder resting
+ */
+void test_partial_fill_rests() {
+    printf("Testing partial fill remainder rests... ");
+
+    me_engine_t me;
+    if (me_engine_init(&me, 64, 16) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    int book = me_add_book(&me, "MSFT");
+
+    submit(&me, book, SIDE_BUY, 500, 100, 1);
+    submit(&me, book, SIDE_BUY, 490, 100, 2);
+
+    // Sell 300 at 495: takes the 500 bid, rests 200 at 495
+    num_execs = 0;
+    uint64_t id = submit(&me, book, SIDE_SELL, 495, 300, 3);
+    if (id == 0 || num_execs != 1 || execs[0].price != 500) {
+        test_failed("Sell should fill once and rest");
+    }
+    if (me_best_ask(&me.books[book]) != 495 || me_best_bid(&me.books[book]) != 490) {
+        test_failed("Book not uncrossed after partial fill");
+    }
+    me_order_t *o = me_find_order(&me, id);
+    if (!o || o->remaining != 200 || o->quantity != 300) {
+        test_failed("Resting remainder has wrong quantity");
+    }
+
+    me_engine_destroy(&me);
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a requote crossing a resting client order reports the client's fill
+ */
+void test_requote_fills_client() {
+    printf("Testing requote against a resting client order... ");
+
+    me_engine_t me;
+    if (me_engine_init(&me, 64, 16) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    int book = me_add_book(&me, "AAPL");
+    int client = 0;                 // Owner tag of the client's orders
+
+    // Client rests a sell at 1000; the exchange's bid rests below it
+    me_order_t *o = me_new_order(&me, book, SIDE_SELL, 1000, 100, 7, &client);
+    if (!o || me_match(&me, o, record_exec, NULL) != 100) {
+        test_failed("Client order did not rest");
+    }
+    uint64_t quote = 0;
+    num_execs = 0;
+    if (me_requote(&me, book, &quote, SIDE_BUY, 995, 300, NULL, record_exec, NULL) != 300 || quote == 0 ||
+        num_execs != 0) {
+        test_failed("First quote should rest without trading");
+    }
+
+    // The mid moves up: the new bid crosses the client's sell
+    uint64_t old_quote = quote;
+    if (me_requote(&me, book, &quote, SIDE_BUY, 1005, 300, NULL, record_exec, NULL) != 200) {
+        test_failed("Requote should fill 100 and rest 200");
+    }
+    if (num_execs != 1 || execs[0].maker_owner != &client || execs[0].maker_client_id != 7 ||
+        execs[0].price != 1000 || execs[0].qty != 100 || execs[0].maker_leaves != 0) {
+        test_failed("Client fill not reported");
+    }
+    if (quote == 0 || quote == old_quote || me_find_order(&me, old_quote) != NULL) {
+        test_failed("Old quote not replaced");
+    }
+    if (me_best_bid(&me.books[book]) != 1005 || me_best_ask(&me.books[book]) != 0 ||
+        me.books[book].bids->next != NULL) {
+        test_failed("Book wrong after requote");
+    }
+
+    me_engine_destroy(&me);
+    printf("PASSED\n");
+}
+
+/**
+ * Test cancels, stale IDs and that pools are returned intact
+ */
+void test_cancel_and_pool_reuse() {
+    printf("Testing cancel and pool reuse... ");
+
+    me_engine_t me;
+    if (me_engine_init(&me, 8, 4) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    int book = me_add_book(&me, "GOOG");
+    if (me_add_book(&me, "GOOG") != book || me_find_book(&me, "GOO", 3) != -1) {
+        test_failed("Book lookup is not exact");
+    }
+
+    uint64_t a = submit(&me, book, SIDE_BUY, 100, 10, 1);
+    uint64_t b = submit(&me, book, SIDE_BUY, 100, 10, 2);
+    if (me_cancel(&me, a, NULL) != 0) {
+        test_failed("Cancel of resting order failed");
+    }
+    if (me_cancel(&me, a, NULL) != -1 || me_find_order(&me, a) != NULL) {
+        test_failed("Stale ID should not be found");
+    }
+
+    // The freed slot is reused with a new ID, so the old ID stays dead
+    uint64_t c = submit(&me, book, SIDE_BUY, 99, 10, 3);
+    if (c == a || me_find_order(&me, a) != NULL || me_find_order(&me, c) == NULL) {
+        test_failed("Reused slot kept the old ID");
+    }
+
+    me_order_t copy;
+    if (me_cancel(&me, b, &copy) != 0 || copy.client_order_id != 2 || copy.remaining != 10) {
+        test_failed("Cancel copy is wrong");
+    }
+    me_cancel(&me, c, NULL);
+
+    if (me.books[book].bids != NULL) {
+        test_failed("Empty side still has levels");
+    }
+    if (me.orders.free_count != me.orders.capacity || me.levels.free_count != me.levels.capacity) {
+        test_failed("Pool objects leaked");
+    }
+
+    // Churn far beyond capacity to prove nothing leaks
+    for (int i = 0; i < 1000; i++) {
+        submit(&me, book, SIDE_SELL, 100 + i % 3, 5, (uint64_t)i);
+        submit(&me, book, SIDE_BUY, 102, 5, (uint64_t)i);
+    }
+    if (me.orders.free_count != me.orders.capacity || me.levels.free_count != me.levels.capacity) {
+        test_failed("Pool objects leaked during churn");
+    }
+
+    me_engine_destroy(&me);
+    printf("PASSED\n");
+}
+
+/**
+ * Test histogram bucketing and percentiles
+ */
+void test_latency_histogram() {
+    printf("Testing latency histogram... ");
+
+    latency_histogram_t h;
+    latency_histogram_init(&h);
+    if (latency_histogram_percentile(&h, 0.5) != 0) {
+        test_failed("Empty histogram should report 0");
+    }
+
+    for (uint64_t v = 1; v <= 1000; v++) {
+        latency_histogram_record(&h, v * 1000);
+    }
+    if (h.count != 1000 || h.min_ns != 1000 || h.max_ns != 1000000) {
+        test_failed("Summary statistics wrong");
+    }
+
+    // Log-linear buckets are accurate to 1/16
+    uint64_t p50 = latency_histogram_percentile(&h, 0.50);
+    uint64_t p99 = latency_histogram_percentile(&h, 0.99);
+    if (p50 < 500000 || p50 > 500000 + 500000 / 16 || p99 < 990000 || p99 > 1000000) {
+        test_failed("Percentiles outside bucket precision");
+    }
+    if (latency_histogram_percentile(&h, 1.0) != 1000000) {
+        test_failed("p100 should be the maximum");
+    }
+
+    latency_histogram_t other;
+    latency_histogram_init(&other);
+    latency_histogram_record(&other, 5);
+    latency_histogram_merge(&h, &other);
+    if (h.count != 1001 || h.min_ns != 5 || latency_histogram_percentile(&h, 0.0) != 5) {
+        test_failed("Merge lost samples");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test protocol message validation
+ */
+void test_message_validation() {
+    printf("Testing order message validation... ");
+
+    order_msg_t order;
+    memset(&order, 0, sizeof(order));
+    msg_header_init(&order.hdr, MSG_NEW_ORDER, sizeof(order), 1, 0);
+    msg_set_symbol(order.symbol, "VERYLONGSYMBOL");
+
+    if (msg_validate(&order, sizeof(order)) != MSG_NEW_ORDER) {
+        test_failed("Valid order rejected");
+    }
+    if (msg_validate(&order, sizeof(order) - 1) != 0) {
+        test_failed("Truncated order accepted");
+    }
+    order.hdr.type = MSG_CANCEL;
+    if (msg_validate(&order, sizeof(order)) != 0) {
+        test_failed("Length/type mismatch accepted");
+    }
+    order.hdr.type = 99;
+    if (msg_validate(&order, sizeof(order)) != 0) {
+        test_failed("Unknown type accepted");
+    }
+    if (memcmp(order.symbol, "VERYLONG", SYMBOL_LEN) != 0 || PRICE_TO_TICKS(150.01) != 1500100) {
+        test_failed("Symbol or price conversion wrong");
+    }
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running matching engine tests...\n");
+
+    test_price_time_priority();
+    test_partial_fill_rests();
+    test_requote_fills_client();
+    test_cancel_and_pool_reuse();
+    test_latency_histogram();
+    test_message_validation();
+
+    printf("All matching engine tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file test_mem_pool.c
+ * @brief Unit tests for hugepage/NUMA arenas and object pools
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "mem_pool.h"
+
+#define NUM_OBJECTS 1000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Test arena sizing, alignment and zeroing
+ */
+void test_arena() {
+    printf("Testing arena mapping... ");
+
+    mem_arena_t small, large;
+    if (mem_arena_init(&small, 100, MEM_NODE_ANY) < 0) {
+        test_failed("Failed to map small arena");
+    }
+    if (small.size < 100 || small.backing != MEM_BACKING_PAGES || small.node != MEM_NODE_ANY) {
+        test_failed("Small arena should use regular pages");
+    }
+
+    if (mem_arena_init(&large, MEM_HUGE_PAGE_SIZE + 1, MEM_NODE_LOCAL) < 0) {
+        test_failed("Failed to map large arena");
+    }
+    if (large.size != 2 * MEM_HUGE_PAGE_SIZE) {
+        test_failed("Large arena not rounded to hugepages");
+    }
+    if (((uintptr_t)large.base & (MEM_HUGE_PAGE_SIZE - 1)) != 0) {
+        test_failed("Large arena not hugepage aligned");
+    }
+
+    const char *bytes = large.base;
+    for (size_t i = 0; i < large.size; i += 4096) {
+        if (bytes[i] != 0) {
+            test_failed("Arena memory not zeroed");
+        }
+    }
+    memset(large.base, 0xab, large.size);
+
+    mem_arena_destroy(&small);
+    mem_arena_destroy(&large);
+    printf("PASSED\n");
+}
+
+/**
+ * Test object pool allocation, alignment and reuse
+ */
+void test_object_pool() {
+    printf("Testing object pool... ");
+
+    mem_pool_t pool;
+    if (mem_pool_init(&pool, 100, NUM_OBJECTS, MEM_NODE_LOCAL) < 0) {
+        test_failed("Failed to create pool");
+    }
+    if (pool.obj_size != 128) {
+        test_failed("Object size not rounded to cache lines");
+    }
+
+    static void *objs[NUM_OBJECTS];
+    for (int i = 0; i < NUM_OBJECTS; i++) {
+        objs[i] = mem_pool_alloc(&pool);
+        if (!objs[i]) {
+            test_failed("Pool exhausted early");
+        }
+        if (((uintptr_t)objs[i] & (MEM_CACHE_LINE - 1)) != 0) {
+            test_failed("Object not cache-line aligned");
+        }
+        memset(objs[i], i & 0xff, 100);
+    }
+    if (mem_pool_alloc(&pool) != NULL || pool.free_count != 0) {
+        test_failed("Exhausted pool returned an object");
+    }
+
+    // Allocations are handed out in address order
+    for (int i = 1; i < NUM_OBJECTS; i++) {
+        if ((char *)objs[i] - (char *)objs[i - 1] != (ptrdiff_t)pool.obj_size) {
+            test_failed("Objects not contiguous");
+        }
+    }
+
+    mem_pool_free(&pool, objs[10]);
+    unsigned char *again = mem_pool_alloc(&pool);
+    if (again != objs[10] || again[0] != 0) {
+        test_failed("Freed object not reused or not zeroed");
+    }
+
+    mem_pool_destroy(&pool);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running memory pool tests...\n");
+
+    test_arena();
+    test_object_pool();
+
+    printf("All memory pool tests PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,470 @@
+/**
+ * @file test_order_session.c
+ * @brief Unit tests for the order journal and the TCP order-entry session
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "order_session.h"
+
+#define SESSION_ID 42
+#define HEARTBEAT_MS 100
+#define MS 1000000ULL
+#define LARGE_GAP 4000                  /**< Messages replayed in test_large_resend */
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Acceptor side: one known session
+static order_journal_t server_journal;
+static uint64_t fake_now = 1000 * MS;
+
+// Messages delivered to each side, in order
+typedef struct {
+    uint32_t seqs[64];
+    int count;
+} received_t;
+
+static order_journal_t *resolve(void *ctx, uint64_t session_id) {
+    (void)ctx;
+    return session_id == SESSION_ID ? &server_journal : NULL;
+}
+
+static void on_message(void *ctx, const trading_msg_t *msg, int type, uint64_t rx_ns) {
+    (void)type;
+    (void)rx_ns;
+    received_t *r = ctx;
+    if (r->count < 64) {
+        r->seqs[r->count++] = msg->hdr.seq;
+    }
+}
+
+static int listen_loopback(int *port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        test_failed("Failed to set up listener");
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Poll both ends for a while, accepting the client when it connects
+static void pump(order_session_t *client, order_session_t *server, int listener,
+                 received_t *client_rx, received_t *server_rx) {
+    for (int i = 0; i < 50; i++) {
+        if (server->state == SESSION_DISCONNECTED && listener >= 0) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                order_session_accept(server, fd, fake_now);
+            }
+        }
+        order_session_poll(client, fake_now, NULL, on_message, client_rx);
+        order_session_poll(server, fake_now, resolve, on_message, server_rx);
+        usleep(200);
+    }
+}
+
+static void send_order(order_session_t *s, uint64_t id) {
+    trading_msg_t *msg = order_session_claim(s);
+    memset(msg, 0, sizeof(order_msg_t));
+    msg->order.client_order_id = id;
+    msg->order.side = SIDE_BUY;
+    msg->order.quantity = 100;
+    msg->order.price = 1000000;
+    msg_set_symbol(msg->order.symbol, "TEST");
+    order_session_send(s, MSG_NEW_ORDER, sizeof(order_msg_t), fake_now);
+}
+
+static void send_ack(order_session_t *s, uint64_t id) {
+    trading_msg_t *msg = order_session_claim(s);
+    memset(msg, 0, sizeof(ack_msg_t));
+    msg->ack.client_order_id = id;
+    order_session_send(s, MSG_ACK, sizeof(ack_msg_t), fake_now);
+}
+
+static void expect_sequence(const received_t *r, int count, const char *what) {
+    if (r->count != count) {
+        fprintf(stderr, "%s: got %d messages, expected %d\n", what, r->count, count);
+        test_failed("Wrong number of messages delivered");
+    }
+    for (int i = 0; i < count; i++) {
+        if (r->seqs[i] != (uint32_t)(i + 1)) {
+            test_failed("Messages delivered out of sequence");
+        }
+    }
+}
+
+/**
+ * Test journal slots, wrap-around and reopening a file-backed journal
+ */
+void test_journal() {
+    printf("Testing order journal... ");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_order_journal_%d", (int)getpid());
+    unlink(path);
+
+    order_journal_t j;
+    order_session_t s;
+    if (order_journal_open(&j, path, 4, 7) < 0 || j.recovered) {
+        test_failed("Failed to create journal");
+    }
+    order_session_init(&s, &j, HEARTBEAT_MS);
+    for (uint64_t id = 1; id <= 10; id++) {
+        send_order(&s, id);     // Not connected: journaled only
+    }
+    // Four slots hold the last three messages; the fourth is the claim slot
+    if (j.hdr->out_seq != 10 || order_journal_oldest(&j) != 8 ||
+        order_journal_get(&j, 7) != NULL || order_journal_get(&j, 11) != NULL) {
+        test_failed("Wrong journal window");
+    }
+    const trading_msg_t *m = order_journal_get(&j, 9);
+    if (!m || m->hdr.seq != 9 || m->order.client_order_id != 9 || m->hdr.type != MSG_NEW_ORDER) {
+        test_failed("Journaled message corrupted");
+    }
+
+    // A claim that is never sent leaves every retained message intact
+    trading_msg_t *claimed = order_session_claim(&s);
+    memset(claimed, 0xa5, sizeof(order_msg_t));
+    for (uint32_t seq = 8; seq <= 10; seq++) {
+        m = order_journal_get(&j, seq);
+        if (!m || m->hdr.seq != seq || m->order.client_order_id != seq) {
+            test_failed("Claim overwrote a retained message");
+        }
+    }
+    j.hdr->in_next = 5;
+    order_journal_close(&j);
+
+    if (order_journal_open(&j, path, 4, 99) < 0 || !j.recovered) {
+        test_failed("Journal not recovered");
+    }
+    if (j.hdr->session_id != 7 || j.hdr->out_seq != 10 || j.hdr->in_next != 5 ||
+        order_journal_get(&j, 10)->order.client_order_id != 10) {
+        test_failed("Recovered journal lost state");
+    }
+    order_journal_close(&j);
+
+    // A different geometry starts over
+    if (order_journal_open(&j, path, 16, 8) < 0 || j.recovered || j.hdr->out_seq != 0 ||
+        j.hdr->session_id != 8) {
+        test_failed("Mismatched journal reused");
+    }
+    order_journal_close(&j);
+    unlink(path);
+    printf("PASSED\n");
+}
+
+/**
+ * Test logon, two-way traffic, reconnect with replay, gap fill and duplicates
+ */
+void test_session_recovery() {
+    printf("Testing logon, reconnect and resend... ");
+
+    int port;
+    int listener = listen_loopback(&port);
+    order_journal_t client_journal;
+    if (order_journal_open(&client_journal, NULL, 64, SESSION_ID) < 0 ||
+        order_journal_open(&server_journal, NULL, 64, 0) < 0) {
+        test_failed("Failed to create journals");
+    }
+
+    order_session_t client, server;
+    order_session_init(&client, &client_journal, HEARTBEAT_MS);
+    order_session_init(&server, NULL, 0);
+    received_t client_rx = { .count = 0 }, server_rx = { .count = 0 };
+
+    if (order_session_connect(&client, "127.0.0.1", port, fake_now) < 0) {
+        test_failed("Connect failed");
+    }
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    if (client.state != SESSION_ACTIVE || server.state != SESSION_ACTIVE ||
+        server.heartbeat_ms != HEARTBEAT_MS) {
+        test_failed("Logon did not complete");
+    }
+
+    // Live traffic both ways
+    send_order(&client, 1);
+    send_order(&client, 2);
+    send_order(&client, 3);
+    send_ack(&server, 1);
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    expect_sequence(&server_rx, 3, "server");
+    expect_sequence(&client_rx, 1, "client");
+
+    // Connection lost; both sides keep sending into their journals
+    order_session_disconnect(&client);
+    pump(&client, &server, -1, &client_rx, &server_rx);
+    if (server.state != SESSION_DISCONNECTED) {
+        test_failed("Server did not notice the disconnect");
+    }
+    send_order(&client, 4);
+    send_order(&client, 5);
+    send_ack(&server, 2);
+    send_ack(&server, 3);
+
+    // Reconnect: the logons replay what each side missed
+    if (order_session_connect(&client, "127.0.0.1", port, fake_now) < 0) {
+        test_failed("Reconnect failed");
+    }
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    expect_sequence(&server_rx, 5, "server after reconnect");
+    expect_sequence(&client_rx, 3, "client after reconnect");
+    if (client.stats.resent != 2 || server.stats.resent != 2) {
+        test_failed("Wrong number of messages replayed");
+    }
+
+    // A message lost on the wire is noticed at the next one and resent
+    server.state = SESSION_LOGON_WAIT;
+    send_ack(&server, 4);   // Journaled, not sent
+    server.state = SESSION_ACTIVE;
+    send_ack(&server, 5);
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    expect_sequence(&client_rx, 5, "client after gap");
+    if (client.stats.gaps != 1 || client.resend_target != 0) {
+        test_failed("Gap not recovered through a resend request");
+    }
+
+    // Replaying everything again only produces duplicates
+    order_session_resend(&server, 1, 0, fake_now);
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    if (client_rx.count != 5 || client.stats.duplicates < 5) {
+        test_failed("Duplicates were delivered");
+    }
+
+    // Idle sessions heartbeat; a heartbeat also reveals a trailing gap
+    server.state = SESSION_LOGON_WAIT;
+    send_ack(&server, 6);
+    server.state = SESSION_ACTIVE;
+    fake_now += HEARTBEAT_MS * MS;
+    pump(&client, &server, listener, &client_rx, &server_rx);
+    if (client.stats.heartbeats_in == 0 || server.stats.heartbeats_in == 0) {
+        test_failed("No heartbeats exchanged");
+    }
+    expect_sequence(&client_rx, 6, "client after heartbeat gap");
+
+    // A silent peer is dropped after the timeout
+    fake_now += (SESSION_TIMEOUT_HEARTBEATS + 1) * HEARTBEAT_MS * MS;
+    if (order_session_poll(&client, fake_now, NULL, on_message, &client_rx) != -1 ||
+        client.state != SESSION_DISCONNECTED) {
+        test_failed("Silent peer not dropped");
+    }
+
+    order_session_disconnect(&server);
+    order_journal_close(&client_journal);
+    order_journal_close(&server_journal);
+    close(listener);
+    printf("PASSED\n");
+}
+
+// Order IDs delivered, for checking replayed contents
+static void on_order_id(void *ctx, const trading_msg_t *msg, int type, uint64_t rx_ns) {
+    (void)rx_ns;
+    received_t *r = ctx;
+    if (type == MSG_NEW_ORDER && r->count < 64) {
+        r->seqs[r->count++] = (uint32_t)msg->order.client_order_id;
+    }
+}
+
+/**
+ * Test that a claim after the journal wraps does not corrupt the resend
+ */
+void test_wrap_resend() {
+    printf("Testing resend after journal wrap... ");
+
+    int port;
+    int listener = listen_loopback(&port);
+    order_journal_t client_journal;
+    if (order_journal_open(&client_journal, NULL, 4, SESSION_ID) < 0 ||
+        order_journal_open(&server_journal, NULL, 16, 0) < 0) {
+        test_failed("Failed to create journals");
+    }
+    order_session_t client, server;
+    order_session_init(&client, &client_journal, HEARTBEAT_MS);
+    order_session_init(&server, NULL, 0);
+
+    // Journaled while disconnected, then a claim that is never sent
+    for (uint64_t id = 1; id <= 10; id++) {
+        send_order(&client, id);
+    }
+    trading_msg_t *claimed = order_session_claim(&client);
+    memset(claimed, 0, sizeof(order_msg_t));
+    claimed->order.client_order_id = 999;
+
+    // The server asks for everything: a reset to the oldest, then 8, 9, 10 intact
+    received_t client_rx = { .count = 0 }, server_rx = { .count = 0 };
+    if (order_session_connect(&client, "127.0.0.1", port, fake_now) < 0) {
+        test_failed("Connect failed");
+    }
+    for (int i = 0; i < 50; i++) {
+        if (server.state == SESSION_DISCONNECTED) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                order_session_accept(&server, fd, fake_now);
+            }
+        }
+        order_session_poll(&client, fake_now, NULL, on_message, &client_rx);
+        order_session_poll(&server, fake_now, resolve, on_order_id, &server_rx);
+        usleep(200);
+    }
+    if (server_rx.count != 3 || server_rx.seqs[0] != 8 || server_rx.seqs[1] != 9 || server_rx.seqs[2] != 10) {
+        test_failed("Oldest retained message corrupted by a claim");
+    }
+
+    order_session_disconnect(&client);
+    order_session_disconnect(&server);
+    order_journal_close(&client_journal);
+    order_journal_close(&server_journal);
+    close(listener);
+    printf("PASSED\n");
+}
+
+// Large replay: count deliveries and check they arrive in sequence
+typedef struct {
+    uint32_t next;
+    int out_of_order;
+} replay_rx_t;
+
+static void on_replay(void *ctx, const trading_msg_t *msg, int type, uint64_t rx_ns) {
+    (void)type;
+    (void)rx_ns;
+    replay_rx_t *r = ctx;
+    if (msg->hdr.seq != r->next) {
+        r->out_of_order++;
+    }
+    r->next = msg->hdr.seq + 1;
+}
+
+/**
+ * Test replaying a gap far larger than the tx buffer through a small socket buffer
+ */
+void test_large_resend() {
+    printf("Testing resend larger than the tx buffer... ");
+
+    int port;
+    int listener = listen_loopback(&port);
+    order_journal_t client_journal;
+    if (order_journal_open(&client_journal, NULL, LARGE_GAP * 2, SESSION_ID) < 0 ||
+        order_journal_open(&server_journal, NULL, 16, 0) < 0) {
+        test_failed("Failed to create journals");
+    }
+    order_session_t client, server;
+    order_session_init(&client, &client_journal, HEARTBEAT_MS);
+    order_session_init(&server, NULL, 0);
+
+    // Journaled while disconnected; far more than SESSION_TX_BUFFER holds
+    for (int i = 1; i <= LARGE_GAP; i++) {
+        send_order(&client, (uint64_t)i);
+    }
+    if ((size_t)LARGE_GAP * sizeof(order_msg_t) < 8 * SESSION_TX_BUFFER) {
+        test_failed("Gap too small to overflow the tx buffer");
+    }
+
+    if (order_session_connect(&client, "127.0.0.1", port, fake_now) < 0) {
+        test_failed("Connect failed");
+    }
+    int sndbuf = 4096;
+    setsockopt(client.fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    replay_rx_t rx = { 1, 0 };
+    received_t client_rx = { .count = 0 };
+    int live = 0;
+    for (int i = 0; i < 5000 && rx.next <= LARGE_GAP + 10; i++) {
+        if (server.state == SESSION_DISCONNECTED) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                order_session_accept(&server, fd, fake_now);
+            }
+        }
+        if (order_session_poll(&client, fake_now, NULL, on_message, &client_rx) < 0 ||
+            order_session_poll(&server, fake_now, resolve, on_replay, &rx) < 0) {
+            test_failed("Session dropped during the replay");
+        }
+        // Live orders sent mid-replay must follow it in sequence
+        if (client.resend_next && live < 10) {
+            send_order(&client, (uint64_t)(LARGE_GAP + ++live));
+        }
+        usleep(100);
+    }
+    if (live != 10) {
+        test_failed("Replay finished before live orders were sent");
+    }
+    if (rx.next != LARGE_GAP + 11 || rx.out_of_order != 0) {
+        fprintf(stderr, "delivered up to %u, %d out of order\n", rx.next - 1, rx.out_of_order);
+        test_failed("Replay incomplete or out of sequence");
+    }
+    if (client.resend_next != 0 || client.stats.resent != LARGE_GAP + 10 || client.stats.disconnects != 0) {
+        test_failed("Replay state or counters wrong");
+    }
+
+    order_session_disconnect(&client);
+    order_session_disconnect(&server);
+    order_journal_close(&client_journal);
+    order_journal_close(&server_journal);
+    close(listener);
+    printf("PASSED\n");
+}
+
+/**
+ * Test that an unknown session ID is logged out
+ */
+void test_unknown_session() {
+    printf("Testing unknown session refused... ");
+
+    int port;
+    int listener = listen_loopback(&port);
+    order_journal_t journal;
+    if (order_journal_open(&journal, NULL, 16, SESSION_ID + 1) < 0 ||
+        order_journal_open(&server_journal, NULL, 16, 0) < 0) {
+        test_failed("Failed to create journals");
+    }
+
+    order_session_t client, server;
+    order_session_init(&client, &journal, HEARTBEAT_MS);
+    order_session_init(&server, NULL, 0);
+    received_t rx = { .count = 0 };
+
+    if (order_session_connect(&client, "127.0.0.1", port, fake_now) < 0) {
+        test_failed("Connect failed");
+    }
+    pump(&client, &server, listener, &rx, &rx);
+    if (client.state != SESSION_DISCONNECTED || server.state != SESSION_DISCONNECTED ||
+        client.stats.logons != 0) {
+        test_failed("Unknown session was accepted");
+    }
+
+    order_journal_close(&journal);
+    order_journal_close(&server_journal);
+    close(listener);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running order session tests...\n");
+
+    test_journal();
+    test_session_recovery();
+    test_wrap_resend();
+    test_large_resend();
+    test_unknown_session();
+
+    printf("All order session tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,466 @@
+/**
+ * @file test_param_store.c
+ * @brief Unit tests for the concurrent parameter store and its journal
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "param_store.h"
+
+#define THREADS 4
+#define KEYS 256
+#define ROUNDS 20000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static char journal[64];
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static void expect_value(param_store_t *ps, const char *key, const char *expected, const char *message) {
+    char value[PS_MAX_VALUE];
+    if (ps_get(ps, key, value, sizeof(value)) != (int)strlen(expected) || strcmp(value, expected) != 0) {
+        test_failed(message);
+    }
+}
+
+/**
+ * Test set, get, overwrite and the limits
+ */
+void test_basic() {
+    printf("Testing set and get... ");
+
+    param_store_t ps;
+    if (ps_open(&ps, NULL, 4, 0) < 0) {
+        test_failed("Open failed");
+    }
+    uint64_t lsn;
+    char value[PS_MAX_VALUE];
+    if (ps_get(&ps, "rate", value, sizeof(value)) != -1 || errno != ENOENT) {
+        test_failed("Missing parameter found");
+    }
+    if (ps_set(&ps, "rate", "100", &lsn) < 0 || lsn != 0 || ps_commit(&ps, lsn) < 0) {
+        test_failed("Set failed");
+    }
+    expect_value(&ps, "rate", "100", "Value not stored");
+    ps_set(&ps, "rate", "a much longer value than before", &lsn);
+    expect_value(&ps, "rate", "a much longer value than before", "Overwrite lost");
+    ps_set(&ps, "rate", "", &lsn);
+    expect_value(&ps, "rate", "", "Empty value lost");
+    if (ps_get(&ps, "rat", value, sizeof(value)) != -1 || ps_get(&ps, "rates", value, sizeof(value)) != -1) {
+        test_failed("Prefix matched");
+    }
+    // A short buffer gets a terminated prefix and the full length
+    ps_set(&ps, "mode", "automatic", &lsn);
+    if (ps_get(&ps, "mode", value, 5) != 9 || strcmp(value, "auto") != 0) {
+        test_failed("Truncated read wrong");
+    }
+
+    char key[PS_MAX_KEY + 1], big[PS_MAX_VALUE + 1];
+    memset(key, 'k', sizeof(key) - 1);
+    key[PS_MAX_KEY] = '\0';
+    memset(big, 'v', sizeof(big) - 1);
+    big[PS_MAX_VALUE] = '\0';
+    if (ps_set(&ps, key, "1", &lsn) != -1 || errno != EINVAL || ps_set(&ps, "", "1", &lsn) != -1 ||
+        ps_set(&ps, "big", big, &lsn) != -1 || errno != EINVAL) {
+        test_failed("Oversized name or value accepted");
+    }
+    key[PS_MAX_KEY - 1] = '\0';
+    big[PS_MAX_VALUE - 1] = '\0';
+    if (ps_set(&ps, key, big, &lsn) < 0) {
+        test_failed("Longest name and value rejected");
+    }
+    expect_value(&ps, key, big, "Longest value wrong");
+
+    // Full: new names fail, existing ones can still change
+    ps_set(&ps, "fourth", "4", &lsn);
+    if (ps_set(&ps, "fifth", "5", &lsn) != -1 || errno != ENOSPC || ps_count(&ps) != 4) {
+        test_failed("Capacity not enforced");
+    }
+    if (ps_set(&ps, "mode", "manual", &lsn) < 0) {
+        test_failed("Update refused when full");
+    }
+    expect_value(&ps, "mode", "manual", "Update when full lost");
+    ps_close(&ps);
+
+    printf("PASSED\n");
+}
+
+typedef struct {
+    param_store_t *ps;
+    int id;
+    long sets;
+} worker_t;
+
+// Writers set "key<k>" to "<k>:<round>:" padded with the key number, so a torn read shows
+static void make_value(char *value, size_t cap, int k, int round) {
+    int n = snprintf(value, cap, "%d:%d:", k, round);
+    memset(value + n, 'a' + k % 26, (size_t)(k % 90));
+    value[n + k % 90] = '\0';
+}
+
+static void *writer_thread(void *arg) {
+    worker_t *w = arg;
+    char key[16], value[PS_MAX_VALUE];
+    uint64_t lsn = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        int k = (r * 7 + w->id) % KEYS;
+        snprintf(key, sizeof(key), "key%d", k);
+        make_value(value, sizeof(value), k, r);
+        if (ps_set(w->ps, key, value, &lsn) < 0) {
+            test_failed("Concurrent set failed");
+        }
+        w->sets++;
+        if (r % 64 == 63 && ps_commit(w->ps, lsn) < 0) {
+            test_failed("Commit failed");
+        }
+    }
+    return NULL;
+}
+
+static void *reader_thread(void *arg) {
+    worker_t *w = arg;
+    char key[16], value[PS_MAX_VALUE], expected[PS_MAX_VALUE];
+    for (int r = 0; r < 4 * ROUNDS; r++) {
+        int k = (r * 13 + w->id) % KEYS;
+        snprintf(key, sizeof(key), "key%d", k);
+        int len = ps_get(w->ps, key, value, sizeof(value));
+        if (len < 0) {
+            continue;               // Not set yet
+        }
+        // Whatever round it came from, the value must be whole and for this key
+        int key_part, round;
+        if (sscanf(value, "%d:%d:", &key_part, &round) != 2 || key_part != k) {
+            test_failed("Value for another key");
+        }
+        make_value(expected, sizeof(expected), k, round);
+        if (strcmp(value, expected) != 0 || len != (int)strlen(expected)) {
+            test_failed("Torn value read");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Test readers against concurrent writers, then recovery of the result
+ */
+void test_concurrency() {
+    printf("Testing concurrent readers and writers... ");
+
+    unlink(journal);
+    param_store_t ps;
+    if (ps_open(&ps, journal, 1024, 0) < 0) {
+        test_failed("Open failed");
+    }
+    pthread_t threads[2 * THREADS];
+    worker_t workers[2 * THREADS];
+    for (int i = 0; i < 2 * THREADS; i++) {
+        workers[i] = (worker_t){ &ps, i % THREADS, 0 };
+        pthread_create(&threads[i], NULL, i < THREADS ? writer_thread : reader_thread, &workers[i]);
+    }
+    for (int i = 0; i < 2 * THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (ps_count(&ps) != KEYS || ps.journal.records != (uint64_t)THREADS * ROUNDS) {
+        test_failed("Wrong counts after concurrent sets");
+    }
+
+    // Every key holds some writer's last value for it; a reopen replays the same state
+    char key[16], value[PS_MAX_VALUE], saved[KEYS][PS_MAX_VALUE];
+    for (int k = 0; k < KEYS; k++) {
+        snprintf(key, sizeof(key), "key%d", k);
+        if (ps_get(&ps, key, saved[k], sizeof(saved[k])) < 0) {
+            test_failed("Key missing");
+        }
+    }
+    ps_close(&ps);
+    if (ps_open(&ps, journal, 1024, 0) < 0 || ps.recovered != (uint64_t)THREADS * ROUNDS || ps.truncated != 0) {
+        test_failed("Replay count wrong");
+    }
+    for (int k = 0; k < KEYS; k++) {
+        snprintf(key, sizeof(key), "key%d", k);
+        if (ps_get(&ps, key, value, sizeof(value)) < 0 || strcmp(value, saved[k]) != 0) {
+            test_failed("Replayed value differs");
+        }
+    }
+    ps_close(&ps);
+
+    printf("PASSED\n");
+}
+
+static void *commit_thread(void *arg) {
+    worker_t *w = arg;
+    char key[16], value[16];
+    uint64_t lsn;
+    for (int r = 0; r < 200; r++) {
+        snprintf(key, sizeof(key), "t%d.p%d", w->id, r % 8);
+        snprintf(value, sizeof(value), "%d", r);
+        if (ps_set(w->ps, key, value, &lsn) < 0 || ps_commit(w->ps, lsn) < 0) {
+            test_failed("Set and commit failed");
+        }
+        // Committed means the journal covers it
+        if (w->ps->journal.durable < lsn) {
+            test_failed("Commit returned early");
+        }
+        w->sets++;
+    }
+    return NULL;
+}
+
+/**
+ * Test group commit with fdatasync(): waiters share flushes
+ */
+void test_group_commit() {
+    printf("Testing group commit... ");
+
+    unlink(journal);
+    param_store_t ps;
+    if (ps_open(&ps, journal, 64, 1) < 0) {
+        test_failed("Open failed");
+    }
+    pthread_t threads[THREADS];
+    worker_t workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i] = (worker_t){ &ps, i, 0 };
+        pthread_create(&threads[i], NULL, commit_thread, &workers[i]);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // Never more flushes than commits; the journal holds every record
+    uint64_t records = ps.journal.records, flushes = ps.journal.flushes;
+    if (records != THREADS * 200 || flushes == 0 || flushes > records) {
+        test_failed("Flush count wrong");
+    }
+    if (ps.journal.durable != ps.journal.appended || file_size(journal) != (off_t)ps.journal.appended) {
+        test_failed("Journal size wrong");
+    }
+    ps_close(&ps);
+    printf("PASSED (%lu records in %lu flushes)\n", (unsigned long)records, (unsigned long)flushes);
+}
+
+static void *blocked_set_thread(void *arg) {
+    uint64_t lsn;
+    if (ps_set(arg, "full.key", "last", &lsn) < 0) {
+        test_failed("Set after the buffer drained failed");
+    }
+    return NULL;
+}
+
+/**
+ * Test that a set waiting for a full journal buffer does not hold its stripe lock
+ */
+void test_full_buffer() {
+    printf("Testing set with a full journal buffer... ");
+
+    unlink(journal);
+    param_store_t ps;
+    if (ps_open(&ps, journal, 64, 1) < 0) {
+        test_failed("Open failed");
+    }
+    // Pretend a leader is flushing, then fill the active buffer to the brim
+    ps_journal_t *j = &ps.journal;
+    pthread_mutex_lock(&j->lock);
+    j->flushing = 1;
+    pthread_mutex_unlock(&j->lock);
+    uint64_t lsn;
+    size_t rec_len = PS_RECORD_HEADER + strlen("full.key") + strlen("fill");
+    while (j->len + rec_len <= PS_JOURNAL_BUFFER) {
+        if (ps_set(&ps, "full.key", "fill", &lsn) < 0) {
+            test_failed("Fill failed");
+        }
+    }
+
+    // The next set must wait for the flush, but not with the stripe locked
+    pthread_t thread;
+    pthread_create(&thread, NULL, blocked_set_thread, &ps);
+    usleep(50000);
+    uint32_t bucket = (uint32_t)ps_hash("full.key", strlen("full.key")) & ps.bucket_mask;
+    pthread_mutex_t *stripe = &ps.stripes[bucket % PS_STRIPES].lock;
+    if (pthread_mutex_trylock(stripe) != 0) {
+        test_failed("Stripe locked while waiting for the journal");
+    }
+    pthread_mutex_unlock(stripe);
+    expect_value(&ps, "full.key", "fill", "Set applied before it was journaled");
+
+    // Flush finished: the waiter flushes the full buffer itself and goes on
+    pthread_mutex_lock(&j->lock);
+    j->flushing = 0;
+    pthread_cond_broadcast(&j->done);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(thread, NULL);
+    expect_value(&ps, "full.key", "last", "Waiting set lost");
+    uint64_t records = j->records;
+    ps_close(&ps);
+
+    // The journal replays every record, the last one last
+    if (ps_open(&ps, journal, 64, 1) < 0 || ps.recovered != records) {
+        test_failed("Journal not replayed");
+    }
+    expect_value(&ps, "full.key", "last", "Replayed value wrong");
+    ps_close(&ps);
+    printf("PASSED\n");
+}
+
+/**
+ * Test that a torn record at the end of the journal is cut off
+ */
+void test_torn_tail() {
+    printf("Testing torn journal tail... ");
+
+    unlink(journal);
+    param_store_t ps;
+    uint64_t lsn = 0;
+    ps_open(&ps, journal, 16, 1);
+    ps_set(&ps, "a", "1", &lsn);
+    ps_set(&ps, "b", "2", &lsn);
+    ps_set(&ps, "a", "3", &lsn);
+    ps_close(&ps);
+    off_t good = file_size(journal);
+
+    // Half of a record, as a crash during the write would leave
+    uint8_t rec[PS_MAX_RECORD];
+    size_t len = ps_record_encode(rec, "c", 1, "4", 1);
+    FILE *f = fopen(journal, "ab");
+    fwrite(rec, 1, len / 2, f);
+    fclose(f);
+    if (ps_open(&ps, journal, 16, 1) < 0 || ps.recovered != 3 || ps.truncated != len / 2 ||
+        file_size(journal) != good) {
+        test_failed("Partial record not cut off");
+    }
+    expect_value(&ps, "a", "3", "Last value before the tail lost");
+    char value[PS_MAX_VALUE];
+    if (ps_get(&ps, "c", value, sizeof(value)) != -1) {
+        test_failed("Partial record applied");
+    }
+    // New records follow the cut, and replay after them too
+    ps_set(&ps, "c", "5", &lsn);
+    ps_close(&ps);
+
+    // A whole record with a bad checksum ends the journal as well
+    len = ps_record_encode(rec, "d", 1, "6", 1);
+    rec[len - 1] ^= 0x01;
+    f = fopen(journal, "ab");
+    fwrite(rec, 1, len, f);
+    fclose(f);
+    if (ps_open(&ps, journal, 16, 1) < 0 || ps.recovered != 4 || ps.truncated != len) {
+        test_failed("Corrupt record not cut off");
+    }
+    expect_value(&ps, "c", "5", "Record after a cut lost");
+    if (ps_get(&ps, "d", value, sizeof(value)) != -1) {
+        test_failed("Corrupt record applied");
+    }
+    ps_close(&ps);
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test checkpoint compaction and the dump/load text path
+ */
+void test_checkpoint_dump() {
+    printf("Testing checkpoint and dump/load... ");
+
+    unlink(journal);
+    param_store_t ps;
+    uint64_t lsn = 0;
+    char key[16], value[32];
+    ps_open(&ps, journal, 256, 0);
+    for (int r = 0; r < 50; r++) {
+        for (int k = 0; k < 100; k++) {
+            snprintf(key, sizeof(key), "p%d", k);
+            snprintf(value, sizeof(value), "%d.%d", k, r);
+            ps_set(&ps, key, value, &lsn);
+        }
+    }
+    ps_commit(&ps, lsn);
+    off_t before = file_size(journal);
+    if (ps_checkpoint(&ps) != 100) {
+        test_failed("Checkpoint count wrong");
+    }
+    off_t after = file_size(journal);
+    if (after <= 0 || after * 40 > before) {
+        test_failed("Checkpoint did not compact");
+    }
+    // Changes after the checkpoint go to the new file
+    ps_set(&ps, "p0", "new", &lsn);
+    ps_commit(&ps, lsn);
+    ps_close(&ps);
+    if (ps_open(&ps, journal, 256, 0) < 0 || ps.recovered != 101 || ps_count(&ps) != 100) {
+        test_failed("Checkpointed journal not replayed");
+    }
+    expect_value(&ps, "p0", "new", "Change after checkpoint lost");
+    expect_value(&ps, "p99", "99.49", "Checkpointed value wrong");
+
+    // Dump to text, load into an empty store, compare
+    FILE *tmp = tmpfile();
+    if (ps_dump(&ps, tmp) != 100) {
+        test_failed("Dump count wrong");
+    }
+    rewind(tmp);
+    char line[64];
+    if (!fgets(line, sizeof(line), tmp) || strncmp(line, "set p", 5) != 0) {
+        test_failed("Dump format wrong");
+    }
+    rewind(tmp);
+    param_store_t copy;
+    ps_open(&copy, NULL, 256, 0);
+    if (ps_load(&copy, tmp) != 100 || ps_count(&copy) != 100) {
+        test_failed("Load count wrong");
+    }
+    for (int k = 0; k < 100; k++) {
+        char a[PS_MAX_VALUE], b[PS_MAX_VALUE];
+        snprintf(key, sizeof(key), "p%d", k);
+        ps_get(&ps, key, a, sizeof(a));
+        if (ps_get(&copy, key, b, sizeof(b)) < 0 || strcmp(a, b) != 0) {
+            test_failed("Loaded value differs");
+        }
+    }
+    fclose(tmp);
+    ps_close(&copy);
+    ps_close(&ps);
+
+    // Comments, blank lines and values with spaces; a bad line stops the load
+    tmp = tmpfile();
+    fputs("# saved\n\nset  name   two words \r\nset x 1\nget x\nset y 2\n", tmp);
+    rewind(tmp);
+    ps_open(&copy, NULL, 16, 0);
+    if (ps_load(&copy, tmp) != -1 || errno != EINVAL || ps_count(&copy) != 2) {
+        test_failed("Bad line not reported");
+    }
+    expect_value(&copy, "name", "two words ", "Value with spaces wrong");
+    fclose(tmp);
+    ps_close(&copy);
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running parameter store tests...\n");
+    snprintf(journal, sizeof(journal), "/tmp/test_param_store_%d.journal", (int)getpid());
+
+    test_basic();
+    test_concurrency();
+    test_group_commit();
+    test_full_buffer();
+    test_torn_tail();
+    test_checkpoint_dump();
+
+    unlink(journal);
+    printf("All parameter store tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file test_query_server.c
+ * @brief Unit tests for the HTTP/UDS query server
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include "query_server.h"
+
+#define MAX_CONNS 4
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static qs_server_t server;
+static atomic_int server_running;
+static char uds_path[64];
+
+static int handler(void *ctx, const char *path, qs_response_t *resp) {
+    (void)ctx;
+    if (strcmp(path, "/hello") == 0) {
+        qs_printf(resp, "{\"msg\":");
+        qs_json_string(resp, "hi \"there\"\n");
+        qs_printf(resp, ",\"n\":%d}", 42);
+        return 200;
+    }
+    if (strcmp(path, "/big") == 0) {
+        for (int i = 0; i < 10000 && !resp->overflow; i++) {
+            qs_printf(resp, "%d,", i);
+        }
+        return 200;
+    }
+    qs_printf(resp, "{\"error\":\"not found\"}");
+    return 404;
+}
+
+static void *server_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&server_running)) {
+        qs_server_poll(&server, 10);
+    }
+    return NULL;
+}
+
+static int connect_http(void) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)server.http_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        test_failed("HTTP connect failed");
+    }
+    return fd;
+}
+
+static int connect_uds(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, uds_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        test_failed("UDS connect failed");
+    }
+    return fd;
+}
+
+// Read until EOF or until n newlines have arrived (n = 0: until EOF)
+static size_t read_reply(int fd, char *buf, size_t size, int lines) {
+    size_t len = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf + len, size - 1 - len);
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+        buf[len] = '\0';
+        int seen = 0;
+        for (size_t i = 0; i < len; i++) {
+            seen += buf[i] == '\n';
+        }
+        if (lines && seen >= lines) {
+            break;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void http_request(const char *request, char *reply, size_t size) {
+    int fd = connect_http();
+    if (write(fd, request, strlen(request)) != (ssize_t)strlen(request)) {
+        test_failed("HTTP write failed");
+    }
+    read_reply(fd, reply, size, 0);
+    close(fd);
+}
+
+/**
+ * Test HTTP responses, status codes and Content-Length
+ */
+void test_http() {
+    printf("Testing HTTP queries... ");
+
+    char reply[4096];
+    http_request("GET /hello HTTP/1.1\r\nHost: x\r\n\r\n", reply, sizeof(reply));
+    const char *body = strstr(reply, "\r\n\r\n");
+    const char *expected = "{\"msg\":\"hi \\\"there\\\"\\u000a\",\"n\":42}";
+    int length = -1;
+    const char *cl = strstr(reply, "Content-Length: ");
+    if (cl) {
+        length = atoi(cl + 16);
+    }
+    if (strncmp(reply, "HTTP/1.0 200 OK\r\n", 17) != 0 || !body || strcmp(body + 4, expected) != 0 ||
+        length != (int)strlen(expected)) {
+        fprintf(stderr, "%s\n", reply);
+        test_failed("Wrong HTTP response");
+    }
+
+    http_request("GET /nothing HTTP/1.0\r\n\r\n", reply, sizeof(reply));
+    if (strncmp(reply, "HTTP/1.0 404 Not Found", 22) != 0) {
+        test_failed("Unknown path not 404");
+    }
+    http_request("POST /hello HTTP/1.0\r\n\r\n", reply, sizeof(reply));
+    if (strncmp(reply, "HTTP/1.0 400 Bad Request", 24) != 0 || !strstr(reply, "Content-Length: 23")) {
+        fprintf(stderr, "%s\n", reply);
+        test_failed("Bad request not rejected");
+    }
+
+    // A response that does not fit the pooled buffer becomes a 500
+    http_request("GET /big HTTP/1.0\r\n\r\n", reply, sizeof(reply));
+    if (strncmp(reply, "HTTP/1.0 500", 12) != 0 || !strstr(reply, "response too large") ||
+        server.overflows != 1) {
+        test_failed("Overflow not reported");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test pipelined UDS requests and the connection limit
+ */
+void test_uds() {
+    printf("Testing pipelined UDS queries... ");
+
+    int fd = connect_uds();
+    const char *requests = "/hello\n/nothing\r\n/hel";
+    if (write(fd, requests, strlen(requests)) < 0) {
+        test_failed("UDS write failed");
+    }
+    char reply[4096];
+    read_reply(fd, reply, sizeof(reply), 2);
+    if (strcmp(reply, "{\"msg\":\"hi \\\"there\\\"\\u000a\",\"n\":42}\n{\"error\":\"not found\"}\n") != 0) {
+        fprintf(stderr, "%s", reply);
+        test_failed("Wrong pipelined replies");
+    }
+
+    // The rest of a split request arrives later
+    if (write(fd, "lo\n", 3) != 3) {
+        test_failed("UDS write failed");
+    }
+    read_reply(fd, reply, sizeof(reply), 1);
+    if (strncmp(reply, "{\"msg\"", 6) != 0) {
+        test_failed("Split request not served");
+    }
+
+    // With every connection in use, the next one is closed at once
+    int extra[MAX_CONNS];
+    for (int i = 0; i < MAX_CONNS; i++) {
+        extra[i] = connect_uds();
+    }
+    usleep(50000);
+    if (read(extra[MAX_CONNS - 1], reply, sizeof(reply)) != 0 || server.rejected != 1) {
+        test_failed("Connection over the limit not rejected");
+    }
+    for (int i = 0; i < MAX_CONNS; i++) {
+        close(extra[i]);
+    }
+    close(fd);
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running query server tests...\n");
+
+    snprintf(uds_path, sizeof(uds_path), "/tmp/test_query_server_%d.sock", (int)getpid());
+    if (qs_server_init(&server, 0, uds_path, MAX_CONNS, 2, 4096, handler, NULL) < 0) {
+        perror("qs_server_init");
+        test_failed("Failed to start query server");
+    }
+    atomic_store(&server_running, 1);
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, NULL);
+
+    test_http();
+    test_uds();
+
+    atomic_store(&server_running, 0);
+    pthread_join(thread, NULL);
+    if (server.requests != 6) {
+        test_failed("Wrong request count");
+    }
+    qs_server_close(&server);
+    if (access(uds_path, F_OK) == 0) {
+        test_failed("Socket path left behind");
+    }
+
+    printf("All query server tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file test_risk_engine.c
+ * @brief Unit tests for the pre-trade risk engine
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "risk_engine.h"
+
+#define SEC 1000000000ULL
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static const risk_limits_t test_limits = {
+    .max_position = 1000,
+    .max_notional = 1000LL * PRICE_SCALE * 100,     // $100,000
+    .max_order_qty = 500,
+    .price_band_bps = 100                           // 1%
+};
+
+/**
+ * Test each per-symbol limit
+ */
+void test_symbol_limits() {
+    printf("Testing per-symbol limits... ");
+
+    risk_engine_t re;
+    if (risk_engine_init(&re, &test_limits, 0, 0) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    int64_t px = PRICE_TO_TICKS(50.0);
+    risk_on_trade_price(&re, 0, px);
+
+    if (risk_check_order(&re, 0, SIDE_BUY, px, 501, 0) != RISK_ORDER_QTY ||
+        risk_check_order(&re, 0, SIDE_BUY, px, 0, 0) != RISK_ORDER_QTY) {
+        test_failed("Order size limit not enforced");
+    }
+    if (risk_check_order(&re, 0, SIDE_BUY, PRICE_TO_TICKS(50.6), 100, 0) != RISK_PRICE_BAND ||
+        risk_check_order(&re, 0, SIDE_SELL, PRICE_TO_TICKS(49.4), 100, 0) != RISK_PRICE_BAND) {
+        test_failed("Price band not enforced");
+    }
+    if (risk_check_order(&re, 0, SIDE_BUY, PRICE_TO_TICKS(50.5), 100, 0) != RISK_OK) {
+        test_failed("Order at the band edge refused");
+    }
+
+    // Open orders count: 100 + 500 + 400 = 1000 is the limit
+    if (risk_check_order(&re, 0, SIDE_BUY, px, 500, 0) != RISK_OK ||
+        risk_check_order(&re, 0, SIDE_BUY, px, 400, 0) != RISK_OK ||
+        risk_check_order(&re, 0, SIDE_BUY, px, 1, 0) != RISK_POSITION) {
+        test_failed("Position limit ignores open orders");
+    }
+
+    // Fills move open quantity into position; releases free headroom
+    risk_on_fill(&re, 0, SIDE_BUY, 500);
+    risk_on_order_done(&re, 0, SIDE_BUY, 400);
+    if (re.symbols[0].position != 500 || re.symbols[0].open_buy != 100) {
+        test_failed("Fill/release accounting wrong");
+    }
+    if (risk_check_order(&re, 0, SIDE_SELL, px, 500, 0) != RISK_OK) {
+        test_failed("Reducing order refused");
+    }
+
+    // Notional: $100,000 at $200 is 500 shares; another symbol, no band
+    risk_limits_t wide = test_limits;
+    wide.price_band_bps = 0;
+    risk_set_limits(&re, 1, &wide);
+    if (risk_check_order(&re, 1, SIDE_BUY, PRICE_TO_TICKS(200.0), 500, 0) != RISK_OK ||
+        risk_check_order(&re, 1, SIDE_BUY, PRICE_TO_TICKS(200.0), 1, 0) != RISK_NOTIONAL) {
+        test_failed("Notional limit not enforced");
+    }
+
+    if (risk_check_order(&re, RISK_MAX_SYMBOLS, SIDE_BUY, px, 1, 0) != RISK_UNKNOWN_SYMBOL) {
+        test_failed("Out-of-range symbol accepted");
+    }
+
+    risk_engine_destroy(&re);
+    printf("PASSED\n");
+}
+
+/**
+ * Test the order-rate token bucket and the kill switch
+ */
+void test_rate_and_halt() {
+    printf("Testing order rate limit and kill switch... ");
+
+    risk_engine_t re;
+    if (risk_engine_init(&re, &test_limits, 10, 3) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+
+    // Burst of 3, then one token every 100 ms
+    uint64_t t = 5 * SEC;
+    for (int i = 0; i < 3; i++) {
+        if (risk_check_order(&re, 0, SIDE_BUY, 100, 1, t) != RISK_OK) {
+            test_failed("Burst refused");
+        }
+    }
+    if (risk_check_order(&re, 0, SIDE_BUY, 100, 1, t) != RISK_RATE) {
+        test_failed("Order beyond burst accepted");
+    }
+    if (risk_check_order(&re, 0, SIDE_BUY, 100, 1, t + SEC / 10) != RISK_OK ||
+        risk_check_order(&re, 0, SIDE_BUY, 100, 1, t + SEC / 10) != RISK_RATE) {
+        test_failed("Refill rate wrong");
+    }
+
+    // Dry runs give the real verdict but book nothing
+    int64_t open = re.symbols[0].open_buy;
+    uint64_t checks = re.symbols[0].checks;
+    if (risk_check_order_dry(&re, 0, SIDE_BUY, 100, 1, t + SEC / 10) != RISK_RATE ||
+        risk_check_order_dry(&re, 0, SIDE_BUY, 100, 1, t + SEC) != RISK_OK ||
+        risk_check_order_dry(&re, 0, SIDE_BUY, 100, 1, t + SEC) != RISK_OK ||
+        re.symbols[0].open_buy != open || re.symbols[0].checks != checks || re.rate_rejects != 2) {
+        test_failed("Dry run changed risk state");
+    }
+
+    // Refused orders must not consume tokens or open quantity
+    if (risk_check_order(&re, 0, SIDE_BUY, 100, 10000, t + SEC) != RISK_ORDER_QTY ||
+        re.symbols[0].open_buy != open ||
+        risk_check_order(&re, 0, SIDE_BUY, 100, 1, t + SEC) != RISK_OK) {
+        test_failed("Refused order consumed capacity");
+    }
+
+    risk_set_rate(&re, 0, 0);
+    for (int i = 0; i < 100; i++) {
+        if (risk_check_order(&re, 1, SIDE_BUY, 100, 1, t + SEC) != RISK_OK) {
+            test_failed("Unlimited rate refused an order");
+        }
+    }
+
+    risk_halt(&re, 1);
+    if (risk_check_order(&re, 1, SIDE_BUY, 100, 1, t + SEC) != RISK_HALTED) {
+        test_failed("Kill switch ignored");
+    }
+    risk_halt(&re, 0);
+    if (risk_check_order(&re, 1, SIDE_BUY, 100, 1, t + SEC) != RISK_OK) {
+        test_failed("Kill switch not released");
+    }
+
+    risk_engine_destroy(&re);
+    printf("PASSED\n");
+}
+
+static risk_engine_t shared;
+static atomic_int writer_done;
+
+// Publish limit sets whose fields are all equal
+static void *limit_writer(void *arg) {
+    (void)arg;
+    for (int64_t v = 1; v <= 200000; v++) {
+        risk_limits_t lim = { v, v, v, v };
+        risk_set_limits(&shared, 0, &lim);
+    }
+    atomic_store(&writer_done, 1);
+    return NULL;
+}
+
+/**
+ * Test that concurrent limit updates are never seen half-applied
+ */
+void test_consistent_publish() {
+    printf("Testing lock-free limit publication... ");
+
+    risk_limits_t zero = { 0, 0, 0, 0 };
+    if (risk_engine_init(&shared, &zero, 0, 0) < 0) {
+        test_failed("Failed to initialize engine");
+    }
+    risk_register_symbol(&shared, 7, "AAPL");
+    if (risk_find_symbol(&shared, "AAPL") != 7 || risk_find_symbol(&shared, "MSFT") != -1) {
+        test_failed("Symbol registry lookup wrong");
+    }
+
+    pthread_t writer;
+    atomic_store(&writer_done, 0);
+    pthread_create(&writer, NULL, limit_writer, NULL);
+
+    int64_t last = 0;
+    while (!atomic_load(&writer_done)) {
+        risk_limits_t lim;
+        risk_get_limits(&shared, 0, &lim);
+        if (lim.max_position != lim.max_notional || lim.max_position != lim.max_order_qty ||
+            lim.max_position != lim.price_band_bps) {
+            test_failed("Torn limit update observed");
+        }
+        if (lim.max_position < last) {
+            test_failed("Limits went backwards");
+        }
+        last = lim.max_position;
+    }
+    pthread_join(writer, NULL);
+
+    risk_limits_t final;
+    risk_get_limits(&shared, 0, &final);
+    if (final.max_position != 200000) {
+        test_failed("Final limits not visible");
+    }
+
+    risk_engine_destroy(&shared);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running risk engine tests...\n");
+
+    test_symbol_limits();
+    test_rate_and_halt();
+    test_consistent_publish();
+
+    printf("All risk engine tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+/**
+ * @file test_rollup.c
+ * @brief Unit tests for multi-resolution sensor rollups
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "rollup.h"
+
+#define HOUR_MS 3600000ULL
+#define T0 (1700000000000ULL / HOUR_MS * HOUR_MS)  // On an hour boundary
+#define WRITER_READINGS 1000000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void record(rollup_t *r, uint64_t t, float a, float b) {
+    float v[2] = { a, b };
+    rollup_record(r, t, v);
+}
+
+static void expect(const rollup_t *r, int level, uint32_t n, uint64_t now, uint64_t count, float min,
+                   float max, double mean, const char *what) {
+    rollup_bucket_t agg;
+    if (rollup_query(r, level, n, now, &agg) != count ||
+        (count && (agg.min[0] != min || agg.max[0] != max || fabs(rollup_mean(&agg, 0) - mean) > 1e-9))) {
+        fprintf(stderr, "%s: count %llu min %g max %g mean %g\n", what, (unsigned long long)agg.count,
+                agg.min[0], agg.max[0], rollup_mean(&agg, 0));
+        test_failed("Wrong rollup");
+    }
+}
+
+/**
+ * Test windows at each resolution, including open and cascaded buckets
+ */
+void test_windows() {
+    printf("Testing windows at each resolution... ");
+
+    static rollup_t r;
+    if (rollup_init(&r, ROLLUP_MAX_METRICS + 1) != -1 || rollup_init(&r, 2) < 0) {
+        test_failed("Wrong init result");
+    }
+    expect(&r, ROLLUP_SECOND, 60, T0, 0, 0, 0, 0, "empty");
+
+    // Three readings in second 0, two in second 1
+    record(&r, T0, 10, 100);
+    record(&r, T0 + 100, 20, 200);
+    record(&r, T0 + 999, 30, 300);
+    record(&r, T0 + 1000, 5, 50);
+    record(&r, T0 + 1500, 7, 70);
+    expect(&r, ROLLUP_SECOND, 1, T0 + 1500, 2, 5, 7, 6, "current second");
+    expect(&r, ROLLUP_SECOND, 2, T0 + 1500, 5, 5, 30, 14.4, "two seconds");
+    expect(&r, ROLLUP_MINUTE, 1, T0 + 1500, 5, 5, 30, 14.4, "open minute");
+    expect(&r, ROLLUP_HOUR, 1, T0 + 1500, 5, 5, 30, 14.4, "open hour");
+
+    rollup_bucket_t agg;
+    rollup_query(&r, ROLLUP_SECOND, 2, T0 + 1500, &agg);
+    if (agg.min[1] != 50 || agg.max[1] != 300 || rollup_mean(&agg, 1) != 144) {
+        test_failed("Second metric wrong");
+    }
+
+    // One reading per second for two minutes: values 10..129
+    for (int s = 2; s < 122; s++) {
+        record(&r, T0 + (uint64_t)s * 1000, (float)(s + 8), 0);
+    }
+    uint64_t now = T0 + 121 * 1000;
+    expect(&r, ROLLUP_SECOND, 60, now, 60, 70, 129, 99.5, "sliding minute");
+    expect(&r, ROLLUP_MINUTE, 1, now, 2, 128, 129, 128.5, "third minute");
+    expect(&r, ROLLUP_MINUTE, 2, now, 62, 68, 129, 98.5, "two minutes");
+    expect(&r, ROLLUP_MINUTE, 60, now, 125, 5, 129, 8412.0 / 125, "sliding hour");
+    expect(&r, ROLLUP_HOUR, 1, now, 125, 5, 129, 8412.0 / 125, "open hour");
+
+    // A late reading counts towards the open second
+    record(&r, now - 5000, 1000, 0);
+    expect(&r, ROLLUP_SECOND, 1, now, 2, 129, 1000, 564.5, "late reading");
+
+    // Nothing for a while: the query window moves on
+    expect(&r, ROLLUP_SECOND, 60, now + 59000, 2, 129, 1000, 564.5, "one minute later");
+    expect(&r, ROLLUP_SECOND, 60, now + 60000, 0, 0, 0, 0, "window passed");
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test cascading across hours, gaps and ring wrap-around
+ */
+void test_cascade_and_gaps() {
+    printf("Testing cascading, gaps and ring wrap-around... ");
+
+    static rollup_t r;
+    rollup_init(&r, 1);
+
+    // One reading every 10 s for three hours; value = hour index
+    uint64_t t = T0;
+    for (int h = 0; h < 3; h++) {
+        for (int i = 0; i < 360; i++, t += 10000) {
+            float v = (float)h;
+            rollup_record(&r, t, &v);
+        }
+    }
+    uint64_t now = t - 10000;
+    expect(&r, ROLLUP_HOUR, 24, now, 1080, 0, 2, 1.0, "three hours");
+    expect(&r, ROLLUP_HOUR, 1, now, 360, 2, 2, 2.0, "last hour");
+    expect(&r, ROLLUP_MINUTE, 60, now, 360, 2, 2, 2.0, "sliding hour");
+    expect(&r, ROLLUP_MINUTE, 90, now, 360, 2, 2, 2.0, "oversized window capped");
+
+    // The first hour is complete and has aged out of the minute ring
+    rollup_bucket_t first;
+    rollup_query(&r, ROLLUP_HOUR, 1, T0 + HOUR_MS - 1, &first);
+    if (first.count != 360 || first.max[0] != 0) {
+        test_failed("Closed hour wrong");
+    }
+
+    // A two-day gap: only the new reading is in any window
+    now += 48 * HOUR_MS;
+    float v = 42;
+    rollup_record(&r, now, &v);
+    expect(&r, ROLLUP_SECOND, 60, now, 1, 42, 42, 42, "after gap, seconds");
+    expect(&r, ROLLUP_MINUTE, 60, now, 1, 42, 42, 42, "after gap, minutes");
+    expect(&r, ROLLUP_HOUR, 24, now, 1, 42, 42, 42, "after gap, hours");
+
+    printf("PASSED\n");
+}
+
+static rollup_t shared;
+static atomic_int writer_done;
+
+// Record 1.0 every 10 ms of simulated time, as fast as possible
+static void *writer(void *arg) {
+    (void)arg;
+    float one = 1.0f;
+    for (uint64_t i = 0; i < WRITER_READINGS; i++) {
+        rollup_record(&shared, T0 + i * 10, &one);
+    }
+    atomic_store(&writer_done, 1);
+    return NULL;
+}
+
+/**
+ * Test lock-free queries against a concurrent writer
+ */
+void test_concurrent_queries() {
+    printf("Testing queries during concurrent updates... ");
+
+    rollup_init(&shared, 1);
+    atomic_store(&writer_done, 0);
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+
+    // Every reading is 1.0, so any torn aggregate shows up as sum != count
+    uint64_t now = T0 + 23 * HOUR_MS;
+    uint64_t last = 0;
+    unsigned long queries = 0;
+    for (;;) {
+        int done = atomic_load(&writer_done);
+        rollup_bucket_t agg;
+        uint64_t count = rollup_query(&shared, ROLLUP_HOUR, 24, now, &agg);
+        if (count < last) {
+            test_failed("Count went backwards");
+        }
+        if (count && (agg.sum[0] != (double)count || agg.min[0] != 1.0f || agg.max[0] != 1.0f)) {
+            test_failed("Torn aggregate");
+        }
+        last = count;
+        queries++;
+        if (done) {
+            break;
+        }
+    }
+    pthread_join(thread, NULL);
+
+    if (last != WRITER_READINGS) {
+        test_failed("Final count wrong");
+    }
+    printf("PASSED (%lu queries)\n", queries);
+}
+
+int main() {
+    printf("Running rollup tests...\n");
+
+    test_windows();
+    test_cascade_and_gaps();
+    test_concurrent_queries();
+
+    printf("All rollup tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file test_thread_pool.c
+ * @brief Unit tests for the work-stealing thread pool
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include "thread_pool.h"
+
+#define NUM_JOBS 10000
+#define FANOUT_DEPTH 10
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static atomic_int jobs_run;
+static atomic_int jobs_done;
+
+static void count_work(tp_job_t *job) {
+    (void)job;
+    atomic_fetch_add(&jobs_run, 1);
+}
+
+static void count_done(tp_job_t *job) {
+    (void)job;
+    atomic_fetch_add(&jobs_done, 1);
+}
+
+/**
+ * Test that every submitted job runs exactly once
+ */
+void test_submit_all_jobs_run() {
+    printf("Testing job submission... ");
+
+    thread_pool_t pool;
+    if (thread_pool_init(&pool, 4) < 0) {
+        test_failed("Failed to create thread pool");
+    }
+
+    tp_job_t *jobs = calloc(NUM_JOBS, sizeof(tp_job_t));
+    atomic_store(&jobs_run, 0);
+    atomic_store(&jobs_done, 0);
+
+    for (int i = 0; i < NUM_JOBS; i++) {
+        jobs[i].work = count_work;
+        jobs[i].done = count_done;
+        thread_pool_submit(&pool, &jobs[i]);
+    }
+
+    // Destroy drains outstanding work before joining
+    thread_pool_destroy(&pool);
+
+    if (atomic_load(&jobs_run) != NUM_JOBS || atomic_load(&jobs_done) != NUM_JOBS) {
+        test_failed("Not all jobs were executed");
+    }
+
+    free(jobs);
+    printf("PASSED\n");
+}
+
+/**
+ * Binary fan-out: each job spawns two children onto its worker's deque,
+ * which forces idle workers to steal.
+ */
+typedef struct {
+    tp_job_t job;
+    thread_pool_t *pool;
+    int depth;
+} fanout_job_t;
+
+static atomic_int leaves;
+
+static void fanout_free(tp_job_t *job) {
+    free(job);
+}
+
+static void fanout_work(tp_job_t *job) {
+    fanout_job_t *fj = (fanout_job_t *)job;
+
+    if (fj->depth == 0) {
+        atomic_fetch_add(&leaves, 1);
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        fanout_job_t *child = calloc(1, sizeof(*child));
+        child->job.work = fanout_work;
+        child->job.done = fanout_free;
+        child->pool = fj->pool;
+        child->depth = fj->depth - 1;
+        thread_pool_submit(fj->pool, &child->job);
+    }
+}
+
+/**
+ * Test nested spawning and stealing between workers
+ */
+void test_nested_spawn() {
+    printf("Testing nested spawn and stealing... ");
+
+    thread_pool_t pool;
+    if (thread_pool_init(&pool, 4) < 0) {
+        test_failed("Failed to create thread pool");
+    }
+
+    atomic_store(&leaves, 0);
+
+    fanout_job_t *root = calloc(1, sizeof(*root));
+    root->job.work = fanout_work;
+    root->job.done = fanout_free;
+    root->pool = &pool;
+    root->depth = FANOUT_DEPTH;
+    thread_pool_submit(&pool, &root->job);
+
+    // Wait for all leaves to finish
+    for (int i = 0; i < 500 && atomic_load(&leaves) != (1 << FANOUT_DEPTH); i++) {
+        usleep(10000);
+    }
+
+    thread_pool_destroy(&pool);
+
+    if (atomic_load(&leaves) != (1 << FANOUT_DEPTH)) {
+        test_failed("Nested jobs did not all complete");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test offloading with completion on the home loop via eventfd
+ */
+void test_offload_completion() {
+    printf("Testing offload with home-loop completion... ");
+
+    thread_pool_t pool;
+    tp_completion_queue_t cq;
+    if (tp_completion_init(&cq) < 0 || thread_pool_init(&pool, 2) < 0) {
+        test_failed("Failed to create pool or completion queue");
+    }
+
+    atomic_store(&jobs_run, 0);
+    atomic_store(&jobs_done, 0);
+
+    tp_job_t jobs[64];
+    memset(jobs, 0, sizeof(jobs));
+    for (int i = 0; i < 64; i++) {
+        thread_pool_offload(&pool, &jobs[i], count_work, count_done, NULL, &cq);
+    }
+
+    // Completion callbacks must only run when the loop drains the queue
+    struct pollfd pfd = { .fd = cq.efd, .events = POLLIN };
+    int completed = 0;
+    while (completed < 64) {
+        int ret = poll(&pfd, 1, 2000);
+        if (ret <= 0) {
+            test_failed("Timed out waiting for completion eventfd");
+        }
+        completed += tp_completion_drain(&cq);
+    }
+
+    if (atomic_load(&jobs_done) != 64 || atomic_load(&jobs_run) != 64) {
+        test_failed("Completion count mismatch");
+    }
+
+    thread_pool_destroy(&pool);
+    tp_completion_destroy(&cq);
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running thread pool tests...\n");
+
+    test_submit_all_jobs_run();
+    test_nested_spawn();
+    test_offload_completion();
+
+    printf("All thread pool tests PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file test_timer_wheel.c
+ * @brief Unit tests for the hierarchical timing wheel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "timer_wheel.h"
+
+#define NUM_TIMERS 20000
+
+/**
+ * Function to handle test failures
+ */
+void test_failed(const char *message) {
+    fprintf(stderr, "\033[31mTEST FAILED: %s\033[0m\n", message);
+    exit(EXIT_FAILURE);
+}
+
+typedef struct {
+    tw_timer_t timer;
+    uint64_t due;           // Tick it should fire on
+    uint64_t fired_at;      // Tick it fired on, 0 if not yet
+    int fired;
+} entry_t;
+
+static timer_wheel_t wheel;
+static entry_t entries[NUM_TIMERS];
+
+static void on_expire(void *ctx, tw_timer_t *timer) {
+    (void)ctx;
+    entry_t *e = (entry_t *)((char *)timer - offsetof(entry_t, timer));
+    e->fired_at = wheel.now;
+    e->fired++;
+}
+
+static uint64_t rand_ticks(uint64_t limit) {
+    return (((uint64_t)rand() << 31) ^ (uint64_t)rand()) % limit;
+}
+
+/**
+ * Test that every timer fires exactly on its tick, across all levels
+ */
+void test_exact_expiry() {
+    printf("Testing exact expiry across levels... ");
+
+    srand(1);
+    uint64_t start = 123456789;
+    tw_init(&wheel, start);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        tw_timer_init(&entries[i].timer);
+        entries[i].fired = 0;
+        // Mostly near, some in every level
+        uint64_t range = i % 4 == 0 ? 300000 : i % 4 == 1 ? 5000 : 64;
+        entries[i].due = start + 1 + rand_ticks(range);
+        tw_schedule(&wheel, &entries[i].timer, entries[i].due);
+    }
+    if (wheel.pending != NUM_TIMERS) {
+        test_failed("Wrong pending count");
+    }
+
+    // Advance in uneven steps
+    uint64_t now = start;
+    while (wheel.pending) {
+        now += 1 + rand_ticks(700);
+        tw_advance(&wheel, now, on_expire, NULL);
+        for (int i = 0; i < NUM_TIMERS; i++) {
+            if (!entries[i].fired && entries[i].due <= now) {
+                test_failed("Timer did not fire on time");
+            }
+        }
+    }
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        if (entries[i].fired != 1 || entries[i].fired_at != entries[i].due || tw_armed(&entries[i].timer)) {
+            test_failed("Timer fired on the wrong tick");
+        }
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test re-arming, cancelling and past deadlines
+ */
+void test_rearm_and_cancel() {
+    printf("Testing re-arm, cancel and past deadlines... ");
+
+    tw_init(&wheel, 1000);
+    entry_t *a = &entries[0], *b = &entries[1], *c = &entries[2];
+    memset(entries, 0, 3 * sizeof(entry_t));
+
+    // A heartbeat that keeps arriving never expires
+    for (uint64_t t = 1000; t < 5000; t += 10) {
+        tw_advance(&wheel, t, on_expire, NULL);
+        tw_schedule(&wheel, &a->timer, t + 300);
+    }
+    tw_schedule(&wheel, &b->timer, 4500);
+    tw_schedule(&wheel, &c->timer, 100);        // Already past: fires on the next tick
+    tw_cancel(&wheel, &b->timer);
+    tw_cancel(&wheel, &b->timer);               // Harmless when not armed
+    if (a->fired || wheel.pending != 2) {
+        test_failed("Re-armed timer expired");
+    }
+
+    tw_advance(&wheel, 4991, on_expire, NULL);
+    if (c->fired != 1 || c->fired_at != 4991 || a->fired) {
+        test_failed("Past deadline not fired next tick");
+    }
+    // Last re-armed at 4990 for 300 ticks
+    if (tw_advance(&wheel, 5289, on_expire, NULL) != 0 || tw_advance(&wheel, 5290, on_expire, NULL) != 1 ||
+        a->fired_at != 5290 || b->fired) {
+        test_failed("Silent timer not fired exactly");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test deadlines beyond the wheel and jumps over idle time
+ */
+void test_far_and_idle() {
+    printf("Testing far deadlines and idle jumps... ");
+
+    tw_init(&wheel, 0);
+    memset(entries, 0, 2 * sizeof(entry_t));
+    uint64_t far = (1ULL << (TW_BITS * TW_LEVELS)) * 3 + 12345;
+    tw_schedule(&wheel, &entries[0].timer, far);
+    tw_advance(&wheel, far - 1, on_expire, NULL);
+    if (entries[0].fired) {
+        test_failed("Far timer fired early");
+    }
+    tw_advance(&wheel, far, on_expire, NULL);
+    if (entries[0].fired_at != far) {
+        test_failed("Far timer fired late");
+    }
+
+    // Nothing pending: a long jump is free
+    tw_advance(&wheel, far + 1000000000ULL, on_expire, NULL);
+    if (wheel.now != far + 1000000000ULL) {
+        test_failed("Idle wheel did not jump");
+    }
+    tw_schedule(&wheel, &entries[1].timer, wheel.now + 5);
+    tw_advance(&wheel, wheel.now + 5, on_expire, NULL);
+    if (entries[1].fired != 1) {
+        test_failed("Timer after jump not fired");
+    }
+
+    printf("PASSED\n");
+}
+
+/**
+ * Test that ticks with nothing due touch no timers
+ */
+void test_cost_independent_of_pending() {
+    printf("Testing advance cost with many pending timers... ");
+
+    tw_init(&wheel, 0);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        tw_timer_init(&entries[i].timer);
+        entries[i].fired = 0;
+        tw_schedule(&wheel, &entries[i].timer, 1000000 + (uint64_t)i);
+    }
+    // 50 ticks inside one level-0 block: no cascade, nothing due
+    if (tw_advance(&wheel, 50, on_expire, NULL) != 0 || wheel.pending != NUM_TIMERS) {
+        test_failed("Timers fired early");
+    }
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        if (entries[i].timer.next == NULL) {
+            test_failed("Timer disarmed");
+        }
+    }
+    if (tw_advance(&wheel, 1000000 + 99, on_expire, NULL) != 100) {
+        test_failed("Wrong number fired");
+    }
+
+    printf("PASSED\n");
+}
+
+int main() {
+    printf("Running timer wheel tests...\n");
+
+    test_exact_expiry();
+    test_rearm_and_cancel();
+    test_far_and_idle();
+    test_cost_independent_of_pending();
+
+    printf("All timer wheel tests PASSED\n");
+    return 0;
+}